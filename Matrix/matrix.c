@@ -5,6 +5,18 @@
 #include <assert.h>
 #include "../Vector/vector.h"
 #include "matrix.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_lu.h"
+#include "matrix_corr.h"
+#include "matrix_binary.h"
+#include "matrix_csv.h"
+#include "matrix_transpose.h"
+#include "matrix_column_index.h"
+#include "matrix_missing.h"
+#include "matrix_stats.h"
+#include "matrix_prefix.h"
+#include "matrix_strassen.h"
 #include "../Math_Extended/math_extended.h"
 #include "../Files/files.h"
 #include "../Utilities/utils.h"
@@ -18,8 +30,10 @@
  *            number of columns in the matrix
  *
  * Returns: a pointer to the matrix
+ *           Entries are stored contiguously in row-major order; m->matrix[i]
+ *           is a lightweight vector view of row i.
  *
- * Dependency: vector.h
+ * Dependency: matrix_from_storage
  */
 static void print_matrix(matrix_t* m);
 static void matrix_print_head(matrix_t*m, int rows);
@@ -40,52 +54,106 @@ static int gaussian_elimination(matrix_t* m);
 static void matrix_impute_missing_values(matrix_t* m, int mode);
 static double matrix_column_mean(matrix_t* m, int col_num);
 static void matrix_to_csv(matrix_t* m, char* fname);
+static void matrix_build_row_views(matrix_t* m);
+static size_t* matrix_copy_offsets(const size_t* src, int n);
 
 
 matrix_t* create_matrix(int rows, int columns)
 {
     assert(rows >= 0 && columns >= 0);
+    int stride = matrix_stride(columns);
+    double* data = matrix_aligned_alloc((size_t)rows*stride*sizeof(*data));
+    return matrix_from_storage(data, rows, columns, stride, rows);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_from_storage
+ *
+ * Arguments: row-major storage from matrix_aligned_alloc, alloc_rows*stride
+ *             doubles, which the matrix takes ownership of
+ *            number of rows and columns in use
+ *            doubles between the start of consecutive rows (a multiple of
+ *             matrix_stride's rounding, at least columns)
+ *            number of rows the storage has room for (at least rows)
+ *
+ * Returns: a pointer to a matrix around the storage, with empty labels
+ *
+ * Dependency: matrix_build_row_views
+ */
+matrix_t* matrix_from_storage(double* data, int rows, int columns, int stride,
+                              int alloc_rows)
+{
+    assert(data != NULL && rows >= 0 && columns >= 0);
+    assert(stride >= columns && alloc_rows >= rows);
     matrix_t* m = malloc(sizeof(*m));
-    m->index_int = malloc(rows*sizeof(*m->index_int));
-    m->index_str = malloc(rows*sizeof(*m->index_str));
-    m->column_names = malloc(columns*sizeof(*m->column_names));
-    
     assert(unwanted_null(m));
-    assert(unwanted_null(m->index_str));
+    m->index_int = malloc((rows ? rows : 1)*sizeof(*m->index_int));
     assert(unwanted_null(m->index_int));
-    assert(unwanted_null(m->column_names));
-
     int i;
     for(i=0; i<rows; i++){
         m->index_int[i] = i;
-        m->index_str[i] = malloc(sizeof(*m->index_str[i]));
-        assert(unwanted_null(m->index_str[i]));
-
-        m->index_str[i][0] = '\0';
-        
     }
-
-    for(i=0; i<columns; i++){
-        m->column_names[i] = malloc(sizeof(*m->column_names[i]));
-        assert(unwanted_null(m->column_names[i]));
-        m->column_names[i][0] = '\0';
-    }
-
+    m->row_labels = NULL;
+    m->column_labels = NULL;
+    m->labels = NULL;
+    m->column_hash = NULL;
+    m->column_hash_slots = 0;
+    m->valid = NULL;
+    m->valid_stride = 0;
+    m->valid_offset = 0;
+    m->stats = NULL;
+    m->prefix = NULL;
     m->str_index_used = 0;
     m->column_index_used = 0;
     m->num_rows = rows;
     m->num_columns = columns;
-    m->alloc_columns = columns;
-    m->alloc_rows = rows;
-    m->matrix = malloc(m->alloc_rows*sizeof(*m->matrix));
-    for(i=0; i<m->alloc_rows; i++){
-        m->matrix[i] = create_zero_vector(m->alloc_columns);
-    }
+    m->alloc_rows = alloc_rows;
+    m->is_view = 0;
+    m->parent = NULL;
+    m->num_views = 0;
+    m->read_only = 0;
+    m->mapping = NULL;
+    m->mapping_bytes = 0;
+    m->stride = stride;
+    m->alloc_columns = m->stride;
+    m->data = data;
+    matrix_build_row_views(m);
     matrix_add_function_pointers(m);
     return m;
 }
 //-----------------------------------------------------------------------------
 
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_from_mapping
+ *
+ * Arguments: start and length of a memory mapped file, unmapped when the
+ *             matrix is freed
+ *            row-major storage inside the mapping, MATRIX_ALIGNMENT aligned
+ *            number of rows and columns
+ *            doubles between the start of consecutive rows
+ *            1 if the mapping cannot be written to
+ *
+ * Returns: a pointer to a matrix around the mapped storage, with empty
+ *          labels
+ *
+ * Dependency: matrix_from_storage
+ */
+matrix_t* matrix_from_mapping(void* mapping, size_t mapping_bytes,
+                              double* data, int rows, int columns, int stride,
+                              int read_only)
+{
+    assert(mapping != NULL);
+    matrix_t* m = matrix_from_storage(data, rows, columns, stride, rows);
+    m->read_only = read_only;
+    m->mapping = mapping;
+    m->mapping_bytes = mapping_bytes;
+    return m;
+}
+//-----------------------------------------------------------------------------
+
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
  * Function: clone_matrix
@@ -94,48 +162,424 @@ matrix_t* create_matrix(int rows, int columns)
  *
  * Returns: pointer to a matrix with components equal to the source matrix
  *
- * Dependency: vector.h
+ * Dependency: matrix_aligned_alloc
+ *             matrix_copy_offsets
+ *             matrix_copy_missing
+ *             matrix_copy_stats
+ *             matrix_build_row_views
  */
 matrix_t* clone_matrix(matrix_t* m)
 {
     matrix_t* dest = malloc(sizeof(*m));
-    dest->index_int = malloc(m->num_rows*sizeof(*dest->index_int));
-    dest->index_str = malloc(m->num_rows*sizeof(*dest->index_str));
-    dest->column_names = malloc(m->num_rows*sizeof(*dest->column_names));
-
     assert(unwanted_null(dest));
-    assert(unwanted_null(dest->index_str));
+    dest->index_int = malloc((m->num_rows ? m->num_rows : 1)
+                             *sizeof(*dest->index_int));
     assert(unwanted_null(dest->index_int));
-    assert(unwanted_null(dest->column_names));
-    int i;
-    for(i=0; i<m->num_rows; i++){
-        dest->index_str[i] = malloc((strlen(m->index_str[i])+1)*sizeof(*m->index_str[i]));
-        dest->column_names[i] = malloc((strlen(m->column_names[i])+1)*sizeof(*m->column_names[i]));
-        
-        assert(unwanted_null(dest->index_str[i]));
-        assert(unwanted_null(dest->column_names[i]));
-        strcpy(dest->index_str[i], m->index_str[i]);
-        strcpy(dest->column_names[i], m->column_names[i]);
-    }
     memcpy(dest->index_int, m->index_int, m->num_rows*sizeof(*m->index_int));
+    /* The labels are one arena and two offset arrays, copied whole */
+    dest->row_labels = matrix_copy_offsets(m->row_labels, m->num_rows);
+    dest->column_labels = matrix_copy_offsets(m->column_labels,
+                                              m->num_columns);
+    dest->labels = NULL;
+    if (m->labels != NULL){
+        dest->labels = malloc(sizeof(*dest->labels));
+        assert(unwanted_null(dest->labels));
+        dest->labels->used = dest->labels->alloc = m->labels->used;
+        dest->labels->arena = malloc(m->labels->used);
+        assert(unwanted_null(dest->labels->arena));
+        memcpy(dest->labels->arena, m->labels->arena, m->labels->used);
+    }
+    dest->column_hash = NULL;
+    dest->column_hash_slots = m->column_hash_slots;
+    if (m->column_hash != NULL){
+        dest->column_hash = malloc(m->column_hash_slots
+                                   *sizeof(*dest->column_hash));
+        assert(unwanted_null(dest->column_hash));
+        memcpy(dest->column_hash, m->column_hash,
+               m->column_hash_slots*sizeof(*m->column_hash));
+    }
+    dest->valid = NULL;
+    dest->valid_stride = 0;
+    dest->valid_offset = 0;
+    dest->stats = NULL;
+    dest->prefix = NULL;
     dest->str_index_used = m->str_index_used;
-    dest->str_index_used = m->column_index_used;
+    dest->column_index_used = m->column_index_used;
     dest->num_rows = m->num_rows;
     dest->num_columns = m->num_columns;
-    dest->alloc_columns = m->num_columns;
     dest->alloc_rows = m->num_rows;
-    dest->matrix = malloc(m->alloc_rows*sizeof(*dest->matrix));
-    assert(unwanted_null(dest->matrix));
-
-    for(i=0; i<dest->alloc_rows; i++){
-        dest->matrix[i] = create_vector_from_array(m->matrix[i]->vector,
-                                                   m->matrix[i]->dimension);
+    dest->is_view = 0;
+    dest->parent = NULL;
+    dest->num_views = 0;
+    dest->read_only = 0;
+    dest->mapping = NULL;
+    dest->mapping_bytes = 0;
+    dest->stride = matrix_stride(m->num_columns);
+    dest->alloc_columns = dest->stride;
+    dest->data = matrix_aligned_alloc((size_t)dest->alloc_rows*dest->stride
+                                      *sizeof(*dest->data));
+    int i;
+    for(i=0; i<m->num_rows; i++){
+        memcpy(MATRIX_ROW(dest, i), MATRIX_ROW(m, i),
+               m->num_columns*sizeof(*m->data));
     }
+    matrix_copy_missing(dest, m);
+    matrix_copy_stats(dest, m);
+    matrix_copy_prefix_sums(dest, m);
+    matrix_build_row_views(dest);
     matrix_add_function_pointers(dest);
     return dest;
 }
 //-----------------------------------------------------------------------------
 
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_matrix_view_strided
+ *
+ * Arguments: parent matrix (may itself be a view)
+ *            first row and number of rows
+ *            step between the parent rows taken (1 for a contiguous range)
+ *            first column and number of columns
+ *
+ * Returns: pointer to a matrix whose entries alias the block of the parent,
+ *          without copying. Entry (i, j) of the view is entry
+ *          (row + i*row_step, col + j) of the parent, so writes through the
+ *          view change the parent. Row labels and column names are shared
+ *          and cannot be set through the view. The view can be passed
+ *          anywhere a matrix is read. It must be freed before the parent
+ *          and cannot be resized. While it exists, the parent cannot be
+ *          given a validity bitmap, so flag an entry missing first if any
+ *          will be.
+ *
+ * Dependency: matrix_build_row_views
+ */
+matrix_t* create_matrix_view_strided(matrix_t* m, int row, int num_rows,
+                                     int row_step, int col, int num_columns)
+{
+    assert(m != NULL);
+    assert(row_step >= 1 && num_rows >= 0 && num_columns >= 0);
+    assert(row >= 0 && col >= 0 && col + num_columns <= m->num_columns);
+    assert((num_rows == 0 || row + (num_rows-1)*row_step < m->num_rows)
+           && "View out of range");
+    matrix_t* v = malloc(sizeof(*v));
+    assert(unwanted_null(v));
+    v->index_int = malloc((num_rows ? num_rows : 1)*sizeof(*v->index_int));
+    assert(unwanted_null(v->index_int));
+
+    /* Only the offsets are copied, the label arena belongs to the parent */
+    v->labels = m->labels;
+    v->row_labels = NULL;
+    v->column_labels = NULL;
+    v->column_hash = NULL;      // columns differ, built on the first lookup
+    v->column_hash_slots = 0;
+    /* The bitmap is also the parent's, read from the view's first entry.
+     * The parent cannot add one while it has views, see
+     * missing_alloc_bitmap, so the pointer stays current. */
+    v->valid = NULL;
+    v->valid_stride = 0;
+    v->valid_offset = 0;
+    v->stats = NULL;
+    v->prefix = NULL;
+    if (m->valid != NULL){
+        v->valid = m->valid + (size_t)row*m->valid_stride;
+        v->valid_stride = m->valid_stride*row_step;
+        v->valid_offset = m->valid_offset + col;
+    }
+    if (m->row_labels != NULL){
+        v->row_labels = malloc((num_rows ? num_rows : 1)
+                               *sizeof(*v->row_labels));
+        assert(unwanted_null(v->row_labels));
+    }
+    if (m->column_labels != NULL){
+        v->column_labels = malloc((num_columns ? num_columns : 1)
+                                  *sizeof(*v->column_labels));
+        assert(unwanted_null(v->column_labels));
+        memcpy(v->column_labels, m->column_labels + col,
+               num_columns*sizeof(*v->column_labels));
+    }
+    int i;
+    for(i=0; i<num_rows; i++){
+        v->index_int[i] = m->index_int[row + i*row_step];
+        if (v->row_labels != NULL){
+            v->row_labels[i] = m->row_labels[row + i*row_step];
+        }
+    }
+    v->str_index_used = m->str_index_used;
+    v->column_index_used = m->column_index_used;
+    v->num_rows = num_rows;
+    v->num_columns = num_columns;
+    v->alloc_rows = num_rows;
+    v->alloc_columns = num_columns;
+    v->is_view = 1;
+    v->parent = m->is_view ? m->parent : m;
+    v->num_views = 0;
+    v->parent->num_views++;
+    v->read_only = m->read_only;
+    v->mapping = NULL;
+    v->mapping_bytes = 0;
+    v->stride = m->stride*row_step;
+    v->data = (num_rows > 0) ? MATRIX_ROW(m, row) + col : m->data;
+    matrix_build_row_views(v);
+    matrix_add_function_pointers(v);
+    return v;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_matrix_view
+ *
+ * Arguments: parent matrix
+ *            first row and number of rows
+ *            first column and number of columns
+ *
+ * Returns: pointer to a view of the block, see create_matrix_view_strided
+ */
+matrix_t* create_matrix_view(matrix_t* m, int row, int num_rows, int col,
+                             int num_columns)
+{
+    return create_matrix_view_strided(m, row, num_rows, 1, col, num_columns);
+}
+//-----------------------------------------------------------------------------
+
+/* 1 x num_columns view of a row of m */
+matrix_t* matrix_row_view(matrix_t* m, int row)
+{
+    return create_matrix_view_strided(m, row, 1, 1, 0, m->num_columns);
+}
+
+/* num_rows x 1 view of a column of m */
+matrix_t* matrix_column_view(matrix_t* m, int col)
+{
+    return create_matrix_view_strided(m, 0, m->num_rows, 1, col, 1);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_labels_push
+ *
+ * Arguments: address of a label arena, created if it is NULL
+ *            NUL terminated string to store (may point into the arena)
+ *
+ * Returns: offset of the stored copy. The empty string is always offset 0
+ *          and takes no space.
+ */
+size_t matrix_labels_push(matrix_labels_t** labels, const char* s)
+{
+    assert(labels != NULL && s != NULL);
+    matrix_labels_t* l = *labels;
+    if (l == NULL){
+        l = malloc(sizeof(*l));
+        assert(unwanted_null(l));
+        l->alloc = 64;
+        l->arena = malloc(l->alloc);
+        assert(unwanted_null(l->arena));
+        l->arena[0] = '\0';
+        l->used = 1;
+        *labels = l;
+    }
+    size_t n = strlen(s) + 1;
+    if (n == 1){
+        return 0;
+    }
+    if (l->used + n > l->alloc){
+        /* s may be a label already in the arena, which realloc moves */
+        int inside = (s >= l->arena && s < l->arena + l->used);
+        size_t s_offset = inside ? (size_t)(s - l->arena) : 0;
+        l->alloc = (2*l->alloc > l->used + n) ? 2*l->alloc : l->used + n;
+        l->arena = realloc(l->arena, l->alloc);
+        assert(unwanted_null(l->arena));
+        if (inside){
+            s = l->arena + s_offset;
+        }
+    }
+    memcpy(l->arena + l->used, s, n);
+    l->used += n;
+    return l->used - n;
+}
+//-----------------------------------------------------------------------------
+
+/* Copy of an offset array, or NULL if there is none */
+static size_t* matrix_copy_offsets(const size_t* src, int n)
+{
+    if (src == NULL){
+        return NULL;
+    }
+    size_t* dst = malloc((n ? n : 1)*sizeof(*dst));
+    assert(unwanted_null(dst));
+    memcpy(dst, src, n*sizeof(*dst));
+    return dst;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_row_label
+ *
+ * Arguments: matrix
+ *            row number
+ *
+ * Returns: the label of the row, "" if it has none
+ */
+const char* matrix_row_label(matrix_t* m, int row)
+{
+    assert(m != NULL && row >= 0 && row < m->num_rows);
+    return (m->row_labels == NULL) ? ""
+                                   : m->labels->arena + m->row_labels[row];
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_column_name
+ *
+ * Arguments: matrix
+ *            column number
+ *
+ * Returns: the name of the column, "" if it has none
+ */
+const char* matrix_column_name(matrix_t* m, int col)
+{
+    assert(m != NULL && col >= 0 && col < m->num_columns);
+    return (m->column_labels == NULL) ? ""
+                                      : m->labels->arena + m->column_labels[col];
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_set_row_label
+ *
+ * Arguments: matrix (not a view)
+ *            row number
+ *            label, copied into the matrix's label arena
+ *
+ * Returns: void
+ *           the offset array for the row labels is allocated on first use
+ *           and the matrix is marked as having row labels
+ *
+ * Dependency: matrix_labels_push
+ */
+void matrix_set_row_label(matrix_t* m, int row, const char* label)
+{
+    assert(m != NULL && row >= 0 && row < m->num_rows);
+    assert(!m->is_view && "Cannot set labels through a view");
+    size_t offset = matrix_labels_push(&m->labels, label);
+    if (m->row_labels == NULL){
+        m->row_labels = calloc(m->num_rows, sizeof(*m->row_labels));
+        assert(unwanted_null(m->row_labels));
+    }
+    m->row_labels[row] = offset;
+    m->str_index_used = 1;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_set_column_name
+ *
+ * Arguments: matrix (not a view)
+ *            column number
+ *            name, copied into the matrix's label arena
+ *
+ * Returns: void
+ *           as matrix_set_row_label, for the column names, and keeps the
+ *           column name index in step
+ *
+ * Dependency: matrix_labels_push
+ *             matrix_column_index_renamed
+ */
+void matrix_set_column_name(matrix_t* m, int col, const char* name)
+{
+    assert(m != NULL && col >= 0 && col < m->num_columns);
+    assert(!m->is_view && "Cannot set labels through a view");
+    int was_unnamed = (m->column_labels == NULL || m->column_labels[col] == 0);
+    size_t offset = matrix_labels_push(&m->labels, name);
+    if (m->column_labels == NULL){
+        m->column_labels = calloc(m->num_columns, sizeof(*m->column_labels));
+        assert(unwanted_null(m->column_labels));
+    }
+    m->column_labels[col] = offset;
+    m->column_index_used = 1;
+    matrix_column_index_renamed(m, col, was_unnamed);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_stride
+ *
+ * Arguments: number of columns in the matrix
+ *
+ * Returns: number of doubles allocated per row, rounded up so that every row
+ *          starts on a MATRIX_ALIGNMENT boundary
+ */
+int matrix_stride(int columns)
+{
+    int per_line = MATRIX_ALIGNMENT/sizeof(double);
+    return ((columns + per_line - 1)/per_line)*per_line;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_aligned_alloc
+ *
+ * Arguments: number of bytes to allocate
+ *
+ * Returns: pointer to zeroed storage aligned to MATRIX_ALIGNMENT bytes.
+ *           Note: release with matrix_aligned_free
+ */
+void* matrix_aligned_alloc(size_t bytes)
+{
+    void* p = NULL;
+    bytes = (bytes ? bytes : 1);
+#ifdef _WIN32
+    p = _aligned_malloc(bytes, MATRIX_ALIGNMENT);
+#else
+    if (posix_memalign(&p, MATRIX_ALIGNMENT, bytes) != 0){
+        p = NULL;
+    }
+#endif
+    assert(unwanted_null(p));
+    memset(p, 0, bytes);
+    return p;
+}
+//-----------------------------------------------------------------------------
+
+void matrix_aligned_free(void* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_build_row_views
+ *
+ * Arguments: matrix whose data and dimensions have been set
+ *
+ * Returns: void
+ *           (re)creates m->matrix so that m->matrix[i] is a vector view of
+ *           row i of the contiguous storage. All views live in one block.
+ */
+static void matrix_build_row_views(matrix_t* m)
+{
+    int rows = (m->alloc_rows ? m->alloc_rows : 1);
+    m->matrix = malloc(rows*sizeof(*m->matrix));
+    m->row_views = malloc(rows*sizeof(*m->row_views));
+    assert(unwanted_null(m->matrix));
+    assert(unwanted_null(m->row_views));
+    int i;
+    for(i=0; i<m->alloc_rows; i++){
+        vector_init_view(&m->row_views[i], MATRIX_ROW(m, i), m->num_columns);
+        m->matrix[i] = &m->row_views[i];
+    }
+}
+//-----------------------------------------------------------------------------
+
 static void matrix_add_function_pointers(matrix_t* m)
 {
     assert(m != NULL);
@@ -167,9 +611,11 @@ static void matrix_add_function_pointers(matrix_t* m)
  * Arguments: matrix 1
  *            matrix 2
  *
- * Returns: 1 if matrices are equal, and 0 otherwise
+ * Returns: 1 if matrices are equal, and 0 otherwise. Entries missing in
+ *          both count as equal, whatever they hold.
  *
  * Dependency: matrix_get_entry
+ *             matrix_is_missing
  */
 int matrix_equality(matrix_t* m1, matrix_t* m2)
 {
@@ -178,12 +624,19 @@ int matrix_equality(matrix_t* m1, matrix_t* m2)
         || m1->num_columns != m2->num_columns){
         return 0;
     }
+    int bitmaps = (m1->valid != NULL || m2->valid != NULL);
     int i, j;
     for(i=0; i<m1->num_rows; i++){
         for (j=0; j<m1->num_columns; j++){
             /* Test matrix entries for equality */
-            if (m1->get_entry(m1, i, j) != m2->get_entry(m2, i, j)){
-                return 0;
+            double a = m1->get_entry(m1, i, j);
+            double b = m2->get_entry(m2, i, j);
+            if (bitmaps || a != b){
+                int missing = matrix_is_missing(m1, i, j)
+                              + matrix_is_missing(m2, i, j);
+                if (missing == 1 || (missing == 0 && a != b)){
+                    return 0;
+                }
             }
         }
     }
@@ -191,6 +644,91 @@ int matrix_equality(matrix_t* m1, matrix_t* m2)
 }
 //-----------------------------------------------------------------------------
 
+/* Element-wise operations that can be split across threads by rows */
+#define ELEMENTWISE_ADD 0
+#define ELEMENTWISE_SCALE 1
+#define ELEMENTWISE_HADAMARD 2
+#define ELEMENTWISE_AXPY 3          // dst = scalar*m1 + m2
+
+typedef struct elementwise_args{
+    matrix_t* dst;
+    matrix_t* m1;
+    matrix_t* m2;
+    double scalar;
+    int op;
+} elementwise_args_t;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: elementwise_task
+ *
+ * Arguments: elementwise_args_t
+ *            first row
+ *            one past the last row
+ *
+ * Returns: void
+ *           applies the operation to rows [begin, end) of the destination
+ */
+static void elementwise_task(void* arg, int begin, int end)
+{
+    elementwise_args_t* e = arg;
+    int i, j;
+    for(i=begin; i<end; i++){
+        double* dst = MATRIX_ROW(e->dst, i);
+        double* a = MATRIX_ROW(e->m1, i);
+        double* b = (e->m2 != NULL) ? MATRIX_ROW(e->m2, i) : NULL;
+        switch(e->op){
+            case ELEMENTWISE_ADD:
+                for(j=0; j<e->dst->num_columns; j++){
+                    dst[j] = a[j] + b[j];
+                }
+                break;
+            case ELEMENTWISE_SCALE:
+                for(j=0; j<e->dst->num_columns; j++){
+                    dst[j] = a[j] * e->scalar;
+                }
+                break;
+            case ELEMENTWISE_HADAMARD:
+                for(j=0; j<e->dst->num_columns; j++){
+                    dst[j] = a[j] * b[j];
+                }
+                break;
+            case ELEMENTWISE_AXPY:
+                for(j=0; j<e->dst->num_columns; j++){
+                    dst[j] = e->scalar*a[j] + b[j];
+                }
+                break;
+            default: assert(0 && "Operation not recognised");
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+static void elementwise_run(elementwise_args_t* e, int num_threads)
+{
+    double work = (double)e->dst->num_rows*e->dst->num_columns;
+    matrix_parallel_for(e->dst->num_rows,
+                        matrix_threads_for_work(num_threads, work),
+                        &elementwise_task, e);
+}
+
+/* Checks shapes, then runs op into dst. Each entry of dst depends only on
+ * the same entry of the operands, so dst may be m1 or m2. */
+static void elementwise_into(matrix_t* dst, matrix_t* m1, matrix_t* m2,
+                             double scalar, int op, int num_threads)
+{
+    assert(dst != NULL && m1 != NULL);
+    assert(!dst->read_only && "Matrix is read only");
+    assert(dst->num_rows == m1->num_rows
+           && dst->num_columns == m1->num_columns);
+    assert(m2 == NULL || (m2->num_rows == m1->num_rows
+                          && m2->num_columns == m1->num_columns));
+    elementwise_args_t e = {dst, m1, m2, scalar, op};
+    elementwise_run(&e, num_threads);
+    matrix_invalidate_stats(dst);
+    matrix_prefix_mark_dirty(dst, 0);
+}
+
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
  * Function: matrix_addition
@@ -202,24 +740,87 @@ int matrix_equality(matrix_t* m1, matrix_t* m2)
  * Returns: A third matrix whose components are the sum of the components
  *          of the first two matrices
  *
- * Dependency: clone_matrix
- *             vector.h
+ * Dependency: matrix_addition_mt
  */
 matrix_t* matrix_addition(matrix_t* m1, matrix_t* m2)
+{
+    return matrix_addition_mt(m1, m2, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_addition_mt
+ *
+ * Arguments: matrix 1
+ *            matrix 2
+ *             (must be same size)
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: as matrix_addition, with rows split across threads for large
+ *          matrices
+ *
+ * Dependency: clone_matrix
+ *             matrix_parallel.h
+ */
+matrix_t* matrix_addition_mt(matrix_t* m1, matrix_t* m2, int num_threads)
 {
     assert(m1 != NULL && m2 != NULL);
     assert(m1->num_columns == m2->num_columns && m1->num_rows == m2->num_rows);
     matrix_t* m3 = clone_matrix(m1);
-    int i;
-    for(i=0; i<m3->num_rows; i++){
-        vector_t* temp = m3->matrix[i];
-        m3->matrix[i] = vector_addition(m3->matrix[i], m2->matrix[i]);
-        temp->free(temp);
-    }
+    elementwise_into(m3, m1, m2, 0.0, ELEMENTWISE_ADD, num_threads);
     return m3;
 }
 //-----------------------------------------------------------------------------
 
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_addition_into
+ *
+ * Arguments: result matrix (same size as the operands, may be one of them)
+ *            matrix 1
+ *            matrix 2
+ *
+ * Returns: void
+ *           dst = m1 + m2 without allocating
+ *
+ * Dependency: elementwise_into
+ */
+void matrix_addition_into(matrix_t* dst, matrix_t* m1, matrix_t* m2)
+{
+    assert(m2 != NULL);
+    elementwise_into(dst, m1, m2, 0.0, ELEMENTWISE_ADD,
+                     MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+/* m += other */
+void matrix_add_in_place(matrix_t* m, matrix_t* other)
+{
+    matrix_addition_into(m, m, other);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_axpy
+ *
+ * Arguments: matrix y, updated in place
+ *            scalar alpha
+ *            matrix x (same size as y)
+ *
+ * Returns: void
+ *           y += alpha*x in one pass, without a temporary for alpha*x
+ *
+ * Dependency: elementwise_into
+ */
+void matrix_axpy(matrix_t* y, double alpha, matrix_t* x)
+{
+    assert(x != NULL);
+    elementwise_into(y, x, y, alpha, ELEMENTWISE_AXPY,
+                     MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
  * Function: matrix_scalar_multiplication
@@ -230,21 +831,63 @@ matrix_t* matrix_addition(matrix_t* m1, matrix_t* m2)
  * Returns: A matrix whose components are a scalar multiple of the components
  *          of the first matrix
  *
- * Dependency: clone_matrix
- *             vector.h
+ * Dependency: matrix_scalar_multiplication_mt
  */
 matrix_t* matrix_scalar_multiplication(matrix_t* m1, double scalar)
+{
+    return matrix_scalar_multiplication_mt(m1, scalar, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_scalar_multiplication_mt
+ *
+ * Arguments: matrix 1
+ *            scalar
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: as matrix_scalar_multiplication
+ *
+ * Dependency: clone_matrix
+ *             matrix_parallel.h
+ */
+matrix_t* matrix_scalar_multiplication_mt(matrix_t* m1, double scalar,
+                                          int num_threads)
 {
     assert(m1 != NULL);
     matrix_t* ret = clone_matrix(m1);
-    int i, j;
-    for(i=0; i<ret->num_rows; i++){
-        for(j=0; j<ret->num_columns; j++){
-            ret->matrix[i]->vector[j] *= scalar;
-        }
-    }
+    elementwise_into(ret, m1, NULL, scalar, ELEMENTWISE_SCALE, num_threads);
     return ret;
 }
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_scalar_multiplication_into
+ *
+ * Arguments: result matrix (same size as m1, may be m1)
+ *            matrix 1
+ *            scalar
+ *
+ * Returns: void
+ *           dst = scalar*m1 without allocating
+ *
+ * Dependency: elementwise_into
+ */
+void matrix_scalar_multiplication_into(matrix_t* dst, matrix_t* m1,
+                                       double scalar)
+{
+    elementwise_into(dst, m1, NULL, scalar, ELEMENTWISE_SCALE,
+                     MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+/* m *= scalar */
+void matrix_scale_in_place(matrix_t* m, double scalar)
+{
+    matrix_scalar_multiplication_into(m, m, scalar);
+}
 
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
@@ -262,7 +905,7 @@ static double get_matrix_entry(matrix_t* m, int i, int j)
     assert(m != NULL);
     assert(m->num_rows > i && m->num_columns > j);
     assert(i >= 0 && j >= 0);
-    return (m->matrix[i]->vector[j]);
+    return MATRIX_ENTRY(m, i, j);
 }
 //-----------------------------------------------------------------------------
 
@@ -276,14 +919,26 @@ static double get_matrix_entry(matrix_t* m, int i, int j)
  *            entry to be set into ij slot
  *
  * Returns: void
+ *           the entry is no longer missing, unless entry is MATRIX_NA,
+ *           cached statistics are updated in O(1) and prefix sums are marked
+ *           dirty from row i
  */
 static void set_matrix_entry(matrix_t* m, int i, int j, double entry)
 {
     assert(m != NULL);
+    assert(!m->read_only && "Matrix is read only");
     assert(m->num_rows > i);
     assert(m->num_columns > j);
     assert(i >= 0 && j >= 0);
-    m->matrix[i]->set(m->matrix[i], j, entry);
+    if (m->stats != NULL){
+        matrix_stats_remove_entry(m, i, j);
+    }
+    MATRIX_ENTRY(m, i, j) = entry;
+    matrix_mark_present(m, i, j);
+    matrix_prefix_mark_dirty(m, i);
+    if (m->stats != NULL){
+        matrix_stats_add_entry(m, i, j);
+    }
 }
 //-----------------------------------------------------------------------------
 
@@ -297,17 +952,34 @@ static void set_matrix_entry(matrix_t* m, int i, int j, double entry)
  *            row number of matrix to be set (starting from 0)
  *
  * Returns: void
- *           sets row number in matrix to be the array of doubles
+ *           sets row number in matrix to be the array of doubles; prefix
+ *           sums are rebuilt from that row on their next query
  */
 static void set_matrix_row(matrix_t* m, double* src, int n, int row_num)
 {
     assert(m != NULL);
+    assert(!m->read_only && "Matrix is read only");
     assert(m->num_rows > row_num);
     assert(row_num >= 0);
     assert(m->num_columns == n);
-    vector_t* temp = m->matrix[row_num];
-    m->matrix[row_num] = create_vector_from_array(src, n);
-    temp->free(temp);
+    int j;
+    if (m->stats != NULL){
+        for(j=0; j<n; j++){
+            matrix_stats_remove_entry(m, row_num, j);
+        }
+    }
+    memcpy(MATRIX_ROW(m, row_num), src, n*sizeof(*src));
+    matrix_prefix_mark_dirty(m, row_num);
+    if (m->valid != NULL){
+        for(j=0; j<n; j++){
+            matrix_mark_present(m, row_num, j);
+        }
+    }
+    if (m->stats != NULL){
+        for(j=0; j<n; j++){
+            matrix_stats_add_entry(m, row_num, j);
+        }
+    }
 }
 //-----------------------------------------------------------------------------
 
@@ -322,15 +994,23 @@ void matrix_set_column(matrix_t* m, double* src, int n, int column_num)
  *
  * Arguments: matrix
  *
- * Returns: the trace of a matrix if it is square, otherwise asserts(0)
+ * Returns: the trace of a matrix if it is square, otherwise asserts(0),
+ *          skipping missing entries (from the statistics cache if enabled)
  */
 static double matrix_trace(matrix_t* m)
 {
     assert(m != NULL && m->num_columns == m->num_rows);
+    if (m->stats != NULL){
+        return matrix_stats_trace(m);
+    }
     double sum = 0.0;
     int i;
     for(i=0; i<m->num_rows; i++){
-        sum += m->matrix[i]->vector[i];
+        double x = MATRIX_ENTRY(m, i, i);
+        if ((m->valid != NULL || x != x) && matrix_is_missing(m, i, i)){
+            continue;
+        }
+        sum += x;
     }
     return sum;
 }
@@ -345,17 +1025,30 @@ static double matrix_trace(matrix_t* m)
  *            row_b to swap
  *
  * Returns: void
- *           swaps the two vectors in the matrix
+ *           swaps the contents of the two rows in the matrix, and their
+ *           validity bits
  */
 static void matrix_row_swap(matrix_t* m, int row_a, int row_b)
 {
     assert(m != NULL);
+    assert(!m->read_only && "Matrix is read only");
     assert(m->num_rows > row_a && "Row out of range");
     assert(m->num_rows > row_b && "Row out of range");
     assert(row_a >= 0 && row_b >= 0);
-    vector_t* temp = m->matrix[row_a];
-    m->matrix[row_a] = m->matrix[row_b];
-    m->matrix[row_b] = temp;
+    if (row_a == row_b){
+        return;
+    }
+    matrix_invalidate_stats(m);     // moves entries on and off the diagonal
+    matrix_prefix_mark_dirty(m, (row_a < row_b) ? row_a : row_b);
+    double* a = MATRIX_ROW(m, row_a);
+    double* b = MATRIX_ROW(m, row_b);
+    int j;
+    for(j=0; j<m->num_columns; j++){
+        double temp = a[j];
+        a[j] = b[j];
+        b[j] = temp;
+    }
+    matrix_swap_missing(m, row_a, row_b);
 }
 //-----------------------------------------------------------------------------
 
@@ -366,16 +1059,36 @@ static void matrix_row_swap(matrix_t* m, int row_a, int row_b)
  * Arguments: matrix
  *
  * Returns: a pointer to a matrix that is the transpose of the original
+ *
+ * Dependency: matrix_transpose_mt
  */
 static matrix_t* matrix_transpose(matrix_t* m)
 {
+    return matrix_transpose_mt(m, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_transpose_mt
+ *
+ * Arguments: matrix
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: a pointer to a matrix that is the transpose of the original,
+ *          missing entries included
+ *
+ * Dependency: create_matrix
+ *             matrix_transpose_blocked
+ *             matrix_transpose_missing
+ */
+matrix_t* matrix_transpose_mt(matrix_t* m, int num_threads)
+{
+    assert(m != NULL);
     matrix_t* ret = create_matrix(m->num_columns, m->num_rows);
-    int i, j;
-    for(i=0; i<m->num_rows; i++){
-        for(j=0; j<m->num_columns; j++){
-            ret->matrix[j]->vector[i] = m->matrix[i]->vector[j];
-        }
-    }
+    matrix_transpose_blocked(m->num_rows, m->num_columns, m->data, m->stride,
+                             ret->data, ret->stride, num_threads);
+    matrix_transpose_missing(ret, m);
     return ret;
 }
 //-----------------------------------------------------------------------------
@@ -392,29 +1105,72 @@ static matrix_t* matrix_transpose(matrix_t* m)
  * Let m1 = A be an n x m matrix, and let m2 = B be an m x p matrix.
  * Then let m1 x m2 = C be an n x p matrix, where C_ij = the sum of
  * A_ik dotproduct with B_kj.
+ *
+ * Dependency: matrix_multiply_mt
  */
 matrix_t* matrix_multiply(matrix_t* m1, matrix_t* m2)
+{
+    return matrix_multiply_mt(m1, m2, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_multiply_mt
+ *
+ * Arguments: matrix 1
+ *            matrix 2
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: as matrix_multiply
+ *
+ * Dependency: create_matrix
+ *             matrix_multiply_dispatch
+ */
+matrix_t* matrix_multiply_mt(matrix_t* m1, matrix_t* m2, int num_threads)
 {
     assert(m1 != NULL && m2 != NULL);
     if (m1->num_columns != m2->num_rows){
         return NULL;
     }
     matrix_t* ret = create_matrix(m1->num_rows, m2->num_columns);
-    int i, j, k;
-    for(i=0; i<ret->num_rows; i++){
-        for(j=0; j<ret->num_columns; j++){
-            double tmp = 0.0;   // Stores dotproduct
-            for(k=0; k<ret->num_rows; k++){
-                /* A_ik x B_kj = C_ij */
-                tmp += get_matrix_entry(m1, i, k) * get_matrix_entry(m2, k, j);
-            }
-            ret->matrix[i]->vector[j] = tmp;
-        }
-    }
+    matrix_multiply_dispatch(m1->num_rows, m2->num_columns, m1->num_columns,
+                             m1->data, m1->stride, m2->data, m2->stride,
+                             ret->data, ret->stride, num_threads);
     return ret;
 }
 //-----------------------------------------------------------------------------
 
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_multiply_into
+ *
+ * Arguments: result matrix, m1->num_rows x m2->num_columns (must not share
+ *             storage with m1 or m2)
+ *            matrix 1
+ *            matrix 2
+ *
+ * Returns: void
+ *           dst = m1 x m2 without allocating a result
+ *
+ * Dependency: matrix_multiply_dispatch
+ */
+void matrix_multiply_into(matrix_t* dst, matrix_t* m1, matrix_t* m2)
+{
+    assert(dst != NULL && m1 != NULL && m2 != NULL);
+    assert(!dst->read_only && "Matrix is read only");
+    assert(m1->num_columns == m2->num_rows && "Matrices do not commute");
+    assert(dst->num_rows == m1->num_rows
+           && dst->num_columns == m2->num_columns);
+    assert(dst != m1 && dst != m2 && "Result may not alias an operand");
+    matrix_multiply_dispatch(m1->num_rows, m2->num_columns, m1->num_columns,
+                             m1->data, m1->stride, m2->data, m2->stride,
+                             dst->data, dst->stride, MATRIX_THREADS_DEFAULT);
+    matrix_invalidate_stats(dst);
+    matrix_prefix_mark_dirty(dst, 0);
+}
+//-----------------------------------------------------------------------------
+
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
  * Function: matrix_hadamard_product
@@ -424,10 +1180,29 @@ matrix_t* matrix_multiply(matrix_t* m1, matrix_t* m2)
  *
  * Returns: pointer to resultant matrix if same size, otherwise NULL
  *
- * Dependency: create_matrix
- *             vector.h
+ * Dependency: matrix_hadamard_product_mt
  */
 matrix_t* matrix_hadamard_product(matrix_t* m1, matrix_t* m2)
+{
+    return matrix_hadamard_product_mt(m1, m2, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_hadamard_product_mt
+ *
+ * Arguments: matrix 1
+ *            matrix 2
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: as matrix_hadamard_product
+ *
+ * Dependency: create_matrix
+ *             matrix_parallel.h
+ */
+matrix_t* matrix_hadamard_product_mt(matrix_t* m1, matrix_t* m2,
+                                     int num_threads)
 {
     assert(m1 != NULL && m2 != NULL);
     if (m1->num_columns != m1->num_rows
@@ -437,16 +1212,32 @@ matrix_t* matrix_hadamard_product(matrix_t* m1, matrix_t* m2)
         }
 
     matrix_t* ret = create_matrix(m1->num_rows, m1->num_columns);
-    int i;
-    for(i=0; i<ret->num_rows; i++){
-        vector_t* temp = ret->matrix[i];
-        ret->matrix[i] = vector_hadamard_product(m1->matrix[i], m2->matrix[i]);
-        temp->free(temp);
-    }
+    elementwise_into(ret, m1, m2, 0.0, ELEMENTWISE_HADAMARD, num_threads);
     return ret;
 }
 //-----------------------------------------------------------------------------
 
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_hadamard_product_into
+ *
+ * Arguments: result matrix (same size as the operands, may be one of them)
+ *            matrix 1
+ *            matrix 2
+ *
+ * Returns: void
+ *           dst = m1 o m2 (entry-wise product) without allocating
+ *
+ * Dependency: elementwise_into
+ */
+void matrix_hadamard_product_into(matrix_t* dst, matrix_t* m1, matrix_t* m2)
+{
+    assert(m2 != NULL);
+    elementwise_into(dst, m1, m2, 0.0, ELEMENTWISE_HADAMARD,
+                     MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
 
 static void print_matrix(matrix_t* m)
 {
@@ -454,7 +1245,7 @@ static void print_matrix(matrix_t* m)
     printf("%d x %d Matrix\n", m->num_rows, m->num_columns);
     for(i=0; i<m->num_rows; i++){
         if (m->str_index_used){
-            printf("%40s: ", m->index_str[i]);
+            printf("%40s: ", matrix_row_label(m, i));
         }
         m->matrix[i]->print(m->matrix[i]);
     }
@@ -467,7 +1258,7 @@ static void matrix_print_head(matrix_t*m, int rows)
     printf("%d x %d Matrix\n", m->num_rows, m->num_columns);
     for (i=0; i<rows; i++){
         if (m->str_index_used){
-            printf("%40s: ", m->index_str[i]);
+            printf("%40s: ", matrix_row_label(m, i));
         }
         m->matrix[i]->print(m->matrix[i]);
     }
@@ -488,21 +1279,39 @@ void print_index(matrix_t* m){
  * Arguments: matrix
  *
  * Returns: void
+ *           a view frees only itself, not the storage it aliases, and a
+ *           mapped matrix unmaps its file
  *
- * Dependency: "vector.h"
+ * Dependency: matrix_aligned_free
+ *             matrix_binary_unmap
  */
 static void destroy_matrix(matrix_t* m)
 {
     assert(m != NULL);
-    int i;
-    for(i=0; i<m->num_rows; i++){
-        m->matrix[i]->free(m->matrix[i]);
-
-    }
-    free(m->index_int);
-    free_string_array(m->index_str, m->num_rows);
-    free_string_array(m->column_names, m->num_columns);
+    free(m->row_views);
     free(m->matrix);
+    free(m->index_int);
+    free(m->row_labels);
+    free(m->column_labels);
+    free(m->column_hash);
+    matrix_disable_stats(m);
+    matrix_disable_prefix_sums(m);
+    if (m->is_view){
+        m->parent->num_views--;
+        free(m);
+        return;
+    }
+    if (m->labels != NULL){
+        free(m->labels->arena);
+        free(m->labels);
+    }
+    free(m->valid);
+    if (m->mapping != NULL){
+        matrix_binary_unmap(m->mapping, m->mapping_bytes);
+    }
+    else{
+        matrix_aligned_free(m->data);
+    }
     free(m);
     m = NULL;
 }
@@ -529,17 +1338,37 @@ static int matrix_is_square(matrix_t* m)
  *
  * Arguments: matrix
  *
- * Returns: the sum of all the entries in the matrix (aka grand sum)
+ * Returns: the sum of all the entries in the matrix that are not missing
+ *          (aka grand sum), from the statistics cache if enabled
  *
  * Dependency: "vector.h"
+ *             matrix_stats_grand_sum
  */
 static double matrix_grand_sum(matrix_t* m)
 {
     assert(m != NULL);
+    if (m->stats != NULL){
+        return matrix_stats_grand_sum(m);
+    }
     double grand_sum = 0.0;
-    int i;
+    int i, j;
     for(i=0; i<m->num_rows; i++){
-        grand_sum += m->matrix[i]->sum(m->matrix[i]);
+        double row_sum = m->matrix[i]->sum(m->matrix[i]);
+        /* Bitmap gaps hold 0.0 and add nothing, so only a row with a NaN
+         * can have a missing entry to skip */
+        if (row_sum != row_sum){
+            const double* row = MATRIX_ROW(m, i);
+            row_sum = 0.0;
+            for(j=0; j<m->num_columns; j++){
+                double x = row[j];
+                if ((m->valid != NULL || x != x)
+                    && matrix_is_missing(m, i, j)){
+                    continue;
+                }
+                row_sum += x;
+            }
+        }
+        grand_sum += row_sum;
     }
     return grand_sum;
 }
@@ -554,119 +1383,131 @@ static double matrix_grand_sum(matrix_t* m)
  *             (must be a square matrix)
  *
  * Returns: a pointer to a matrix that is the nth power of the inputted matrix
-
  *
  * Dependency: matrix_is_square
  *             clone_matrix
- *             matrix_multiply
- *             matrix_destroy
+ *             matrix_pow_into
  */
 static matrix_t* matrix_pow(matrix_t* m, int exponent)
 {
     assert(m != NULL);
-    assert(exponent > 0 && "Exponent must be greater than 0");
+    assert(exponent >= 0 && "Exponent must be non-negative");
     assert(m->is_square(m) && "Can only take powers of square matrices");
     matrix_t* ret = m->copy(m);
-    int i;
-    for(i=1; i<exponent; i++){
-        matrix_t* temp = ret;
-        ret = matrix_multiply(ret, m);
-        temp->free(temp);
-    }
+    matrix_pow_into(ret, m, exponent);
     return ret;
 }
 //-----------------------------------------------------------------------------
 
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
- * Function: matrix_col_vec_is_zero
+ * Function: matrix_pow_into
  *
- * Arguments: matrix
- *            column number
- *
- * Returns: 1 if column vector is the zero vector, 0 otherwise
- */
-int matrix_col_vec_is_zero(matrix_t* m, int col_num)
-{
-    assert(m != NULL);
-    assert(m->num_columns > col_num && "Column Number too large");
-    int i;
-    for(i=0; i<m->num_rows; i++){
-        if (m->matrix[i]->vector[col_num] != 0)
-            return 0;
-    }
-    return 1;
-}
-//-----------------------------------------------------------------------------
-
-/*****************************************************************************/
-/**----------------------------------------------------------------------------
- * Function: matrix_eliminate_column
- *
- * Arguments: matrix
- *            row pivot is located on
- *            column to eliminate
- *            pointer to number of rows (swapped in gaussian elimination)
- *            pointer to product of scalars used to multiply rows
+ * Arguments: result matrix (same size as m, may be m itself)
+ *            square matrix
+ *            exponent (0 gives the identity)
  *
  * Returns: void
- *           updates pointers to be used in calculating determinant
+ *           writes m^exponent into dst by repeated squaring, so only
+ *           O(log exponent) multiplications are done. The products
+ *           ping-pong between dst and two scratch buffers allocated once,
+ *           rather than allocating a matrix per step.
  *
- * Dependency: matrix_row_swap
+ * Dependency: matrix_multiply_dispatch
  */
-void matrix_eliminate_column(matrix_t* m, int row_pivot, int col_num,
-                             int* num_row_swaps,
-                             double* scalar_multiple_det)
+void matrix_pow_into(matrix_t* dst, matrix_t* m, int exponent)
 {
-    assert(m->num_columns > col_num);
-    int index_highest_pivot, i, j;
-    double largest = 0.0;   // The pivot element in divisor stored here
+    assert(dst != NULL && m != NULL);
+    assert(!dst->read_only && "Matrix is read only");
+    assert(exponent >= 0 && "Exponent must be non-negative");
+    assert(m->is_square(m) && "Can only take powers of square matrices");
+    assert(dst->num_rows == m->num_rows && dst->num_columns == m->num_columns);
+    int n = m->num_rows;
+    int i;
+    matrix_invalidate_stats(dst);
+    matrix_prefix_mark_dirty(dst, 0);
 
-    /* Partial Pivot Method: Swap largest prospective pivot to pivot row */
-    for(i=row_pivot; i<m->num_rows; i++){
-        double pivot = m->matrix[i]->vector[col_num];
-        if (fabs(pivot) > fabs(largest)){
-            largest = pivot;
-            index_highest_pivot = i;
+    if (exponent == 0){
+        for(i=0; i<n; i++){
+            memset(MATRIX_ROW(dst, i), 0, n*sizeof(*dst->data));
+            MATRIX_ENTRY(dst, i, i) = 1.0;
         }
-    }
-    if (row_pivot == index_highest_pivot){
-        ; // No need to swap with self
-    }
-    else if (largest != 0.0){
-        m->row_swap(m, row_pivot, index_highest_pivot);
-        scalar_swap(&m->index_int[row_pivot],
-                    &m->index_int[index_highest_pivot],
-                    sizeof(int));
-        scalar_swap(m->index_str[row_pivot],
-                    m->index_str[index_highest_pivot],
-                    sizeof(char*));
-        *num_row_swaps += 1;
-    }
-    /* Column vector is zero, so no need to eliminate */
-    else if (largest == 0.0){
         return;
     }
 
-    /* For each row below the pivot row */
-    for(i=row_pivot+1; i<m->num_rows; i++){
-        double lambda = m->matrix[i]->vector[col_num]/m->matrix[row_pivot]->vector[row_pivot];
-        if (fabs(lambda) < GAUSS_ELIM_ACCURACY){
-            continue;
-        }
+    /* A view's rows are interleaved with its parent's, so it gets its own
+     * accumulator and the result is copied in at the end */
+    int stride = dst->is_view ? matrix_stride(n) : dst->stride;
+    size_t bytes = (size_t)n*stride*sizeof(*dst->data);
+    double* scratch_a = matrix_aligned_alloc(bytes);
+    double* scratch_b = matrix_aligned_alloc(bytes);
+    double* scratch_c = dst->is_view ? matrix_aligned_alloc(bytes) : NULL;
+    double* result = dst->is_view ? scratch_c : dst->data;
+    double* base = scratch_a;
+    double* spare = scratch_b;
+    double* acc = NULL;     // set by the lowest bit of the exponent
+    for(i=0; i<n; i++){
+        memcpy(base + (size_t)i*stride, MATRIX_ROW(m, i), n*sizeof(*base));
+    }
 
-        /* Eliminate */
-        for(j=col_num; j<m->num_columns; j++){
-            double v = m->matrix[row_pivot]->vector[j];
-            if (j==col_num){
-                m->matrix[i]->vector[j] = 0.0;
+    while (1){
+        if (exponent & 1){
+            if (acc == NULL){
+                /* Accumulator lives in dst's storage until swapped out */
+                acc = result;
+                memcpy(acc, base, bytes);
             }
             else{
-                m->matrix[i]->vector[j] -= (lambda*v);
+                matrix_multiply_dispatch(n, n, n, acc, stride, base, stride,
+                                         spare, stride,
+                                         MATRIX_THREADS_DEFAULT);
+                double* temp = acc;
+                acc = spare;
+                spare = temp;
             }
+        }
+        exponent >>= 1;
+        if (exponent == 0){
+            break;
+        }
+        matrix_multiply_dispatch(n, n, n, base, stride, base, stride,
+                                 spare, stride, MATRIX_THREADS_DEFAULT);
+        double* temp = base;
+        base = spare;
+        spare = temp;
+    }
 
+    if (acc != dst->data){
+        for(i=0; i<n; i++){
+            memcpy(MATRIX_ROW(dst, i), acc + (size_t)i*stride,
+                   n*sizeof(*acc));
         }
     }
+    matrix_aligned_free(scratch_a);
+    matrix_aligned_free(scratch_b);
+    matrix_aligned_free(scratch_c);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_col_vec_is_zero
+ *
+ * Arguments: matrix
+ *            column number
+ *
+ * Returns: 1 if column vector is the zero vector, 0 otherwise
+ */
+int matrix_col_vec_is_zero(matrix_t* m, int col_num)
+{
+    assert(m != NULL);
+    assert(m->num_columns > col_num && "Column Number too large");
+    int i;
+    for(i=0; i<m->num_rows; i++){
+        if (MATRIX_ENTRY(m, i, col_num) != 0)
+            return 0;
+    }
+    return 1;
 }
 //-----------------------------------------------------------------------------
 
@@ -676,34 +1517,50 @@ void matrix_eliminate_column(matrix_t* m, int row_pivot, int col_num,
  *
  * Arguments: matrix
  *
- * Returns: the determinant of the original matrix
+ * Returns: the determinant of the original matrix (0 if not square)
+ *           by side effect, reduces the matrix to row echelon form, with
+ *           the row index labels and validity bits permuted to follow the
+ *           row swaps
  *
- * Dependency: matrix_row_swap
- *             matrix_eliminate_column
+ * Dependency: matrix_lu.h
+ *             matrix_permute_missing
  */
 static int gaussian_elimination(matrix_t* m)
 {
-    int i;
-    int row_swaps = 0;
-    double scalar_multiple_det = 1.0;
-
-    for(i=0; i<m->num_columns; i++){
-        matrix_eliminate_column(m, i, i, &row_swaps, &scalar_multiple_det);
-    }
-    /* Determinant not defined for non-square matrix */
-    if (!m->is_square(m)){
-        return 0.0;
-    }
-    double diagonal = 1.0;
+    assert(!m->read_only && "Matrix is read only");
+    matrix_invalidate_stats(m);
+    matrix_prefix_mark_dirty(m, 0);
+    lu_t* f = create_lu(m);
+    int* index_int = malloc((m->num_rows ? m->num_rows : 1)*sizeof(*index_int));
+    size_t* row_labels = matrix_copy_offsets(m->row_labels, m->num_rows);
+    assert(unwanted_null(index_int));
+    int i, j;
     for(i=0; i<m->num_rows; i++){
-        diagonal *= m->matrix[i]->vector[i];
+        double* row = MATRIX_ROW(m, i);
+        memcpy(row, f->lu + (size_t)i*f->stride, m->num_columns*sizeof(*row));
+        /* Multipliers (left of the row's pivot, or all of a row past the
+         * rank) and values lost in the tolerance are zero in U */
+        int pivot_column = (i < f->rank) ? f->pivot_columns[i]
+                                         : m->num_columns;
+        for(j=0; j<m->num_columns; j++){
+            if (j < pivot_column || fabs(row[j]) <= f->tolerance){
+                row[j] = 0.0;
+            }
+        }
+        index_int[i] = m->index_int[f->pivot[i]];
+        if (row_labels != NULL){
+            row_labels[i] = m->row_labels[f->pivot[i]];
+        }
     }
-    double det = diagonal;
+    free(m->index_int);
+    free(m->row_labels);
+    m->index_int = index_int;
+    m->row_labels = row_labels;
+    matrix_permute_missing(m, f->pivot);
 
-    /* Swapping rows changes the sign of the determinant */
-    if ((row_swaps+1) %2 == 0){
-        return -det;
-    }
+    /* Determinant not defined for non-square matrix */
+    double det = (m->is_square(m)) ? f->determinant(f) : 0.0;
+    f->free(f);
     return det;
 }
 //-----------------------------------------------------------------------------
@@ -715,18 +1572,19 @@ static int gaussian_elimination(matrix_t* m)
  * Arguments: matrix
  *
  * Returns: the determinant of the matrix
+ *           Note: factorises the matrix on every call; to take the
+ *                 determinant and solve against the same matrix, keep an
+ *                 lu_t from create_lu instead
  *
  * Dependency: matrix_is_square
- *             clone_matrix
- *             gaussian_elimination
- *             destroy_matrix
+ *             matrix_lu.h
  */
 static double matrix_determinant(matrix_t* m)
 {
     assert(m->is_square(m) && "Determinant only defined for square matrices");
-    matrix_t* temp = m->copy(m);
-    double det = temp->gaussian_elimination(temp);
-    temp->free(temp);
+    lu_t* f = create_lu(m);
+    double det = f->determinant(f);
+    f->free(f);
     return det;
 }
 //-----------------------------------------------------------------------------
@@ -739,70 +1597,53 @@ static double matrix_determinant(matrix_t* m)
  *
  * Returns: the rank of the matrix
  *
- * Dependency: clone_matrix
- *             gaussian_elimination
- *             "vector.h"
+ * Dependency: matrix_lu.h
  */
 static int matrix_rank(matrix_t* m)
 {
-    matrix_t* clone = m->copy(m);
-    clone->gaussian_elimination(clone);
-    int i;
-    int rank = 0;
-    for(i=0; i<clone->num_rows; i++){
-        rank += (!clone->matrix[i]->is_zero_vector(clone->matrix[i]));
-        if (rank == clone->num_rows || rank == clone->num_columns){
-            return rank;
-        }
-    }
+    lu_t* f = create_lu(m);
+    int rank = f->get_rank(f);
+    f->free(f);
     return rank;
 }
 //-----------------------------------------------------------------------------
 
+/* Mean of the entries of the column that are not missing */
 static double matrix_column_mean(matrix_t* m, int col_num)
 {
+    assert(m != NULL && col_num >= 0 && col_num < m->num_columns);
+    if (m->stats != NULL){
+        const matrix_column_stats_t* c = matrix_column_stats(m, col_num);
+        return c->sum/c->count;
+    }
     double sum = 0.0;
-    int i;
-    for(i=0; i<m->num_columns; i++){
-        sum += m->get_entry(m, i, col_num);
+    int i, count = 0;
+    for(i=0; i<m->num_rows; i++){
+        double x = MATRIX_ENTRY(m, i, col_num);
+        if ((m->valid != NULL || x != x) && matrix_is_missing(m, i, col_num)){
+            continue;
+        }
+        sum += x;
+        count++;
     }
-    return sum/m->num_columns;
+    return sum/count;
 }
 
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
- * Function: csv_to_matrix
+ * Function: matrix_to_csv
  *
- * Arguments: csv file name
+ * Arguments: matrix
+ *            file name to write to
  *
- * Returns: the rank of the matrix
+ * Returns: void
+ *           writes the entries as csv with shortest round trip formatting
  *
- * Dependency: clone_matrix
- *             gaussian_elimination
- *             "vector.h"
+ * Dependency: matrix_to_csv_mt
  */
 static void matrix_to_csv(matrix_t* m, char* fname)
 {
-    FILE *fp = fopen(fname, "w");
-    int i, j;
-    char empty[] = {"Nan"};
-    for(i=0; i<m->num_rows; i++){
-        for(j=0; j<m->num_columns; j++){
-            double entry = m->get_entry(m, i, j);
-            if (entry == DBL_EPSILON){
-                fprintf(fp, "%s,", empty);
-            }
-            else{
-                fprintf(fp, "%lf", entry);
-                if (j != m->num_columns -1){
-                    fprintf(fp, ",");
-                }
-            }
-            
-        }
-        fprintf(fp, "\n");
-    }
-    fclose(fp);
+    matrix_to_csv_mt(m, fname, MATRIX_THREADS_DEFAULT);
 }
 //-----------------------------------------------------------------------------
 
@@ -814,14 +1655,14 @@ static void matrix_to_csv(matrix_t* m, char* fname)
  *
  * Returns: void
  *
- * Dependency: None
+ * Dependency: matrix_column_name
  */
 void print_column_names(matrix_t* m)
 {
     assert(m->column_index_used);
     int i;
     for(i=0; i<m->num_columns; i++){
-        printf("%s\n", m->column_names[i]);
+        printf("%s\n", matrix_column_name(m, i));
     }
 }
 //-----------------------------------------------------------------------------
@@ -838,7 +1679,8 @@ void print_column_names(matrix_t* m)
  *          the matrix has column names, and if the column name exists,
  *          otherwise assertion failure
  *
- * Dependency: get_matrix_entry
+ * Dependency: matrix_column_index
+ *             get_matrix_entry
  */
 double get_matrix_entry_by_colname(matrix_t* m, int row, char* col_name)
 {
@@ -847,7 +1689,7 @@ double get_matrix_entry_by_colname(matrix_t* m, int row, char* col_name)
                 "matrix\n");
         assert(0 && "No column names");
     }
-    int index = lsearch(m->column_names, m->num_columns, col_name);
+    int index = matrix_column_index(m, col_name);
     if (index == -1){
         fprintf(stderr, "No column name exists\n");
         assert(0);
@@ -857,114 +1699,24 @@ double get_matrix_entry_by_colname(matrix_t* m, int row, char* col_name)
 }
 //-----------------------------------------------------------------------------
 
+/* Each missing entry becomes the mean of its column */
+static void matrix_impute_missing_values(matrix_t* m, int mode){
+    matrix_impute_missing_values_mt(m, mode, MATRIX_THREADS_DEFAULT);
+}
+
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
- * Function: csv_to_matrix
+ * Function: matrix_to_corrcoef
  *
- * Arguments: file name of csv file
- *            characters delimiting the csv (eg ",")
- *            number of rows in csv file
- *            missing value sequence for the csv file, (eg "NA"); NULL if none
- *            whether columns are labelled (LABELLED, NOT_LABELLED) in first row
- *            whether rows are labelled (LABELLED, NOT_LABELLED) in first column
+ * Arguments: matrix whose rows are variables and columns observations
+ *            mode of calculation: SAMPLE or POPULATION
  *
- * Returns: a matrix with entries and indexes corresponding to csv file
+ * Returns: pointer to the matrix of correlation coefficients between rows
  *
- * Dependency: create_matrix
- *             matrix_set_entry
- * 
- */
-matrix_t* csv_to_matrix(char* fname, char* delim, int num_rows, char* miss_val,
-                        int columns_labelled, int rows_labelled)
-{
-    int i = columns_labelled;
-    int initial_i = i;
-    char** buff = malloc((num_rows-i)*sizeof(*buff));
-    assert(unwanted_null(buff));
-    int lines = read_file(fname, buff, num_rows);
-    matrix_t* m = create_matrix(lines-i, columns_in_file(fname, delim));
-    int num_columns = 0;
-
-    /* For each line in the csv file */
-    for(i=0; i<lines; i++){
-        int j = i-initial_i;
-        int entry = 0;
-        char* token;
-        token = strtok(buff[i], delim);
-        
-        /* If the columns are labelled and we are processing the first line */
-        if (columns_labelled && i==0){
-            int k = 0;
-            if (rows_labelled){
-                token = strtok(NULL, delim);
-            }
-            /* Add column names to matrix */
-            while (token != NULL){
-                free(m->column_names[k]);
-                m->column_names[k] = malloc((strlen(token)+1)*sizeof(*m->column_names[k]));
-                assert(unwanted_null(m->column_names[k]));
-                strcpy(m->column_names[k++], token);
-                token = strtok(NULL, delim);
-            }
-            m->column_index_used = 1;
-            num_columns = k-1;
-            continue;
-        }
-        else if (rows_labelled){
-            free(m->index_str[j]);
-            m->index_str[j] = malloc((strlen(token)+1)*sizeof(*m->index_str[j]));
-            assert(unwanted_null(m->index_str[j]));
-            strcpy(m->index_str[j], token);
-            token = strtok(NULL, delim);
-        }
-
-        while (token != NULL){
-            if (miss_val != NULL && !strcmp(miss_val, token)){
-                m->matrix[j]->set(m->matrix[j], entry++, DBL_EPSILON);
-            }
-            else{
-                m->matrix[j]->set(m->matrix[j], entry++, strtod(token, NULL));
-            }
-            token = strtok(NULL, delim);
-        }
-        if (i==initial_i){
-            num_columns = entry;
-        }
-        else{
-            assert(num_columns == entry);
-        }
-        m->matrix[j]->dimension = num_columns;
-    }
-    m->num_columns = num_columns;
-    if (rows_labelled){
-        m->str_index_used = 1;
-    }
-    return m;
-}
-//-----------------------------------------------------------------------------
-
-
-static void matrix_impute_missing_values(matrix_t* m, int mode){
-    int i;
-    for(i=0; i<m->num_rows; i++){
-        m->matrix[i]->impute_missing_value(m->matrix[i], DBL_EPSILON, mode);
-    }
-}
-
+ * Dependency: matrix_correlation
+ */
 matrix_t* matrix_to_corrcoef(matrix_t* m, int mode)
 {
-    assert(m->is_square(m));
-    matrix_t* ret = m->copy(m);
-    int i, j;
-    for(i=0; i<m->num_rows; i++){
-        for(j=i+1; j<m->num_rows; j++){
-            double entry = vector_correlation(m->matrix[i], m->matrix[j], mode);
-            ret->set_entry(ret, i, j, entry);
-            ret->set_entry(ret, j, i, entry);
-        }
-    }
-    for(i=0; i<m->num_rows; i++){
-        ret->set_entry(ret, i, i, 1.0);
-    }
-    return ret;
-} 
+    return matrix_correlation(m, mode);
+}
+//-----------------------------------------------------------------------------
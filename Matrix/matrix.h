@@ -4,20 +4,62 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
-#include "..\Vector\vector.h"
+#include "../Vector/vector.h"
+#include "matrix_parallel.h"
 
 #define GAUSS_ELIM_ACCURACY 1e-26
 #define LABELLED 1
 #define NOT_LABELLED 0
 
+/* Rows start on 64 byte boundaries (one cache line, 8 doubles) */
+#define MATRIX_ALIGNMENT 64
+
+/* Raw access to the contiguous storage, no bounds checking */
+#define MATRIX_ROW(m, i) ((m)->data + (size_t)(i)*(m)->stride)
+#define MATRIX_ENTRY(m, i, j) (MATRIX_ROW(m, i)[j])
+
 typedef struct matrix matrix_t;
 
+/* Row labels and column names, packed NUL terminated into one growing
+ * arena and addressed by offset. Offset 0 is the empty string, so a label
+ * that was never set costs nothing, and a matrix that is never labelled
+ * allocates neither the arena nor the offset arrays. */
+typedef struct matrix_labels{
+    char* arena;
+    size_t used;
+    size_t alloc;
+} matrix_labels_t;
+
 struct matrix{
-    vector_t** matrix;
+    double* data;           // row-major, one aligned block
+    int stride;             // doubles between the start of consecutive rows
+    int is_view;            // 1 if data aliases another matrix's storage
+    matrix_t* parent;       // the matrix a view's storage belongs to, or NULL
+    int num_views;          // views of this matrix's storage not yet freed
+    int read_only;
+    void* mapping;          // mapped file holding data and labels, or NULL
+    size_t mapping_bytes;
+    vector_t** matrix;      // row views aliasing data
+    vector_t* row_views;
     int* index_int;
-    char** index_str;
-    char** column_names;
+    size_t* row_labels;     // offsets into labels, NULL if no row is labelled
+    size_t* column_labels;  // offsets into labels, NULL if no column is named
+    matrix_labels_t* labels;    // NULL until a label is set; a view borrows
+                                // its parent's
+    int* column_hash;       // column name -> column, NULL until built
+    int column_hash_slots;  // size of column_hash, a power of two
+    uint64_t* valid;        // validity bitmap, bit set if the entry is
+                            // present; NULL if no entry is flagged missing.
+                            // A view points into its parent's, so none can
+                            // be added while the parent has views.
+    int valid_stride;       // bitmap words from one row to the next
+    int valid_offset;       // bit of column 0 within a row's words
+    struct matrix_stats* stats; // cached column statistics, NULL unless
+                                // matrix_enable_stats
+    struct matrix_prefix* prefix;   // summed-area table, NULL unless
+                                    // matrix_enable_prefix_sums
     int column_index_used;
     int str_index_used;
     int num_rows;
@@ -48,6 +90,20 @@ struct matrix{
 };
 
 matrix_t* create_matrix(int rows, int columns);
+matrix_t* create_matrix_view(matrix_t* m, int row, int num_rows, int col,
+                             int num_columns);
+matrix_t* create_matrix_view_strided(matrix_t* m, int row, int num_rows,
+                                     int row_step, int col, int num_columns);
+matrix_t* matrix_row_view(matrix_t* m, int row);
+matrix_t* matrix_column_view(matrix_t* m, int col);
+int matrix_stride(int columns);
+matrix_t* matrix_from_storage(double* data, int rows, int columns, int stride,
+                              int alloc_rows);
+matrix_t* matrix_from_mapping(void* mapping, size_t mapping_bytes,
+                              double* data, int rows, int columns, int stride,
+                              int read_only);
+void* matrix_aligned_alloc(size_t bytes);
+void matrix_aligned_free(void* p);
 matrix_t* csv_to_matrix(char* fname, char* delim, int num_rows, char* miss_val,
                         int columns_labelled, int rows_labelled);
 void print_index(matrix_t* m);
@@ -57,6 +113,36 @@ int matrix_equality(matrix_t* m1, matrix_t* m2);
 matrix_t* matrix_addition(matrix_t* m1, matrix_t* m2);
 matrix_t* matrix_multiply(matrix_t* m1, matrix_t* m2);
 matrix_t* matrix_hadamard_product(matrix_t* m1, matrix_t* m2);
+matrix_t* matrix_scalar_multiplication(matrix_t* m1, double scalar);
+
+/* As above, but with an explicit thread count for this call only */
+matrix_t* matrix_addition_mt(matrix_t* m1, matrix_t* m2, int num_threads);
+matrix_t* matrix_multiply_mt(matrix_t* m1, matrix_t* m2, int num_threads);
+matrix_t* matrix_hadamard_product_mt(matrix_t* m1, matrix_t* m2,
+                                     int num_threads);
+matrix_t* matrix_scalar_multiplication_mt(matrix_t* m1, double scalar,
+                                          int num_threads);
+matrix_t* matrix_transpose_mt(matrix_t* m, int num_threads);
+
+/* Write the result into a caller supplied matrix of the right size */
+void matrix_addition_into(matrix_t* dst, matrix_t* m1, matrix_t* m2);
+void matrix_multiply_into(matrix_t* dst, matrix_t* m1, matrix_t* m2);
+void matrix_hadamard_product_into(matrix_t* dst, matrix_t* m1, matrix_t* m2);
+void matrix_scalar_multiplication_into(matrix_t* dst, matrix_t* m1,
+                                       double scalar);
+void matrix_pow_into(matrix_t* dst, matrix_t* m, int exponent);
+
+/* In place: m += other, m *= scalar, y += alpha*x */
+void matrix_add_in_place(matrix_t* m, matrix_t* other);
+void matrix_scale_in_place(matrix_t* m, double scalar);
+void matrix_axpy(matrix_t* y, double alpha, matrix_t* x);
+
+/* The returned strings stay valid until the next label is set on m */
+const char* matrix_row_label(matrix_t* m, int row);
+const char* matrix_column_name(matrix_t* m, int col);
+void matrix_set_row_label(matrix_t* m, int row, const char* label);
+void matrix_set_column_name(matrix_t* m, int col, const char* name);
+size_t matrix_labels_push(matrix_labels_t** labels, const char* s);
 
 void print_column_names(matrix_t* m);
 double get_matrix_entry_by_colname(matrix_t* m, int row, char* col_name);
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_batch.h"
+#include "matrix_gemm.h"
+#include "matrix_simd.h"
+#include "matrix_parallel.h"
+#include "../Utilities/utils.h"
+
+#define BATCH_DETERMINANT 0
+#define BATCH_INVERSE 1
+#define BATCH_MULTIPLY 2
+#define BATCH_SOLVE 3
+
+typedef struct batch_args{
+    int op;
+    const matrix_batch_t* a;
+    const matrix_batch_t* b;    // multiply and solve
+    matrix_batch_t* out;        // NULL for the determinant
+    double* det;                // may be NULL for inverse and solve
+    int count;
+} batch_args_t;
+
+#define BATCH_T double
+#define BATCH_FN(name) name##_scalar
+#include "matrix_batch_template.h"
+#undef BATCH_T
+#undef BATCH_FN
+
+#ifdef __GNUC__
+/* Four matrices per vector: one ymm register with AVX2 */
+typedef double batch_lanes_t __attribute__((vector_size(32)));
+#define BATCH_LANES 4
+
+#define BATCH_T batch_lanes_t
+#define BATCH_FN(name) name##_lanes
+#include "matrix_batch_template.h"
+#undef BATCH_T
+#undef BATCH_FN
+#endif
+
+static void matrix_batch_add_function_pointers(matrix_batch_t* batch);
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_matrix_batch
+ *
+ * Arguments: number of matrices
+ *            rows of each, 1 to MATRIX_BATCH_MAX_DIM
+ *            columns of each, 1 to MATRIX_BATCH_MAX_DIM
+ *
+ * Returns: a pointer to a batch of zero matrices
+ *
+ * Dependency: matrix_aligned_alloc
+ */
+matrix_batch_t* create_matrix_batch(int count, int rows, int columns)
+{
+    assert(count >= 0);
+    assert(rows >= 1 && rows <= MATRIX_BATCH_MAX_DIM
+           && columns >= 1 && columns <= MATRIX_BATCH_MAX_DIM);
+    matrix_batch_t* batch = malloc(sizeof(*batch));
+    assert(unwanted_null(batch));
+    int per_line = MATRIX_ALIGNMENT/sizeof(double);
+    batch->stride = matrix_stride(count);
+    /* An odd number of cache lines apart, so the arrays read together do
+     * not all land in the same cache set when count is a power of two */
+    if ((batch->stride/per_line) % 2 == 0){
+        batch->stride += per_line;
+    }
+    batch->count = count;
+    batch->num_rows = rows;
+    batch->num_columns = columns;
+    size_t bytes = (size_t)rows*columns*batch->stride*sizeof(*batch->data);
+    batch->data = matrix_aligned_alloc(bytes);
+    memset(batch->data, 0, bytes);
+    matrix_batch_add_function_pointers(batch);
+    return batch;
+}
+//-----------------------------------------------------------------------------
+
+/* The shapes the batched operations are most used for, square matrices
+ * with one or as many right hand sides, get code with their sizes as
+ * constants; the rest share one general loop */
+#define BATCH_SHAPE(n, q)                                                     \
+    case (n)*(MATRIX_BATCH_MAX_DIM + 1) + (q):                                \
+        BATCH_RANGES(g, k, last, n, n, q);                                    \
+        break;
+
+#ifdef __GNUC__
+#define BATCH_RANGES(g, k, last, rows, inner, columns) do{                    \
+    k = batch_range_lanes(g, k, last, rows, inner, columns);                  \
+    k = batch_range_scalar(g, k, last, rows, inner, columns);                 \
+} while(0)
+#else
+#define BATCH_RANGES(g, k, last, rows, inner, columns)                        \
+    k = batch_range_scalar(g, k, last, rows, inner, columns)
+#endif
+
+/* Whole vectors first, then the remaining matrices one at a time */
+MATRIX_SIMD_INLINE void batch_chunks(batch_args_t* g, int begin, int end)
+{
+    int rows = g->a->num_rows, inner = g->a->num_columns;
+    int columns = g->b ? g->b->num_columns : inner;
+    int shape = (inner == rows) ? rows*(MATRIX_BATCH_MAX_DIM + 1) + columns
+                                : -1;
+    int c;
+    for(c=begin; c<end; c++){
+        int k = c*MATRIX_BATCH_CHUNK;
+        int last = (k + MATRIX_BATCH_CHUNK < g->count)
+                   ? k + MATRIX_BATCH_CHUNK : g->count;
+        switch (shape){
+        BATCH_SHAPE(1, 1)
+        BATCH_SHAPE(2, 1)
+        BATCH_SHAPE(2, 2)
+        BATCH_SHAPE(3, 1)
+        BATCH_SHAPE(3, 3)
+        BATCH_SHAPE(4, 1)
+        BATCH_SHAPE(4, 4)
+        default:
+            BATCH_RANGES(g, k, last, rows, inner, columns);
+            break;
+        }
+    }
+}
+
+/* Compiled for the baseline and for AVX2/FMA, the latter used whenever the
+ * gemm SIMD kernels are (matrix_gemm_simd_enabled) */
+#define BATCH_KERNELS(suffix, attribute)                                      \
+    attribute static void batch_chunks_##suffix(void* arg, int begin,         \
+                                                int end)                      \
+    {                                                                         \
+        batch_chunks(arg, begin, end);                                        \
+    }
+
+BATCH_KERNELS(baseline, )
+#ifdef MATRIX_HAVE_X86
+BATCH_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+#endif
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: batch_run
+ *
+ * Arguments: batch_args_t
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           runs the operation over the whole batch, threads taking chunks
+ *           of MATRIX_BATCH_CHUNK matrices
+ */
+static void batch_run(batch_args_t* g, int num_threads)
+{
+    int dim = g->a->num_rows;
+    int chunks = (g->count + MATRIX_BATCH_CHUNK - 1)/MATRIX_BATCH_CHUNK;
+    parallel_task_t task = &batch_chunks_baseline;
+#ifdef MATRIX_HAVE_X86
+    if (matrix_gemm_simd_enabled()){
+        task = &batch_chunks_avx2;
+    }
+#endif
+    matrix_parallel_for(chunks, matrix_threads_for_work(num_threads,
+                                                        (double)g->count
+                                                        *dim*dim*dim),
+                        task, g);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_batch_determinant_mt
+ *
+ * Arguments: batch of square matrices
+ *            det, count doubles
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           det[k] = the determinant of matrix k, by cofactor expansion
+ *           rather than elimination
+ */
+void matrix_batch_determinant_mt(matrix_batch_t* a, double* det,
+                                 int num_threads)
+{
+    assert(a != NULL && (det != NULL || a->count == 0));
+    assert(a->num_rows == a->num_columns
+           && "Determinant needs square matrices");
+    batch_args_t g = {BATCH_DETERMINANT, a, NULL, NULL, det, a->count};
+    batch_run(&g, num_threads);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_batch_determinant(matrix_batch_t* a, double* det)
+{
+    matrix_batch_determinant_mt(a, det, MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_batch_inverse_mt
+ *
+ * Arguments: batch of square matrices
+ *            batch of the same shape and count for the inverses (may be a)
+ *            det, count doubles for the determinants, or NULL
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           inv_k = adj(A_k)/det(A_k). There is no pivoting, so this is for
+ *           well conditioned matrices; a matrix with determinant 0 gets
+ *           infinite or NaN entries rather than stopping the batch, and
+ *           det lets the caller screen out near singular ones.
+ */
+void matrix_batch_inverse_mt(matrix_batch_t* a, matrix_batch_t* inv,
+                             double* det, int num_threads)
+{
+    assert(a != NULL && inv != NULL);
+    assert(a->num_rows == a->num_columns && "Inverse needs square matrices");
+    assert(inv->num_rows == a->num_rows && inv->num_columns == a->num_columns
+           && inv->count == a->count);
+    batch_args_t g = {BATCH_INVERSE, a, NULL, inv, det, a->count};
+    batch_run(&g, num_threads);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_batch_inverse(matrix_batch_t* a, matrix_batch_t* inv,
+                          double* det)
+{
+    matrix_batch_inverse_mt(a, inv, det, MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_batch_multiply_mt
+ *
+ * Arguments: batch of n x p matrices
+ *            batch of p x q matrices, the same count
+ *            batch of n x q matrices for the products (may be a or b)
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           C_k = A_k B_k
+ */
+void matrix_batch_multiply_mt(matrix_batch_t* a, matrix_batch_t* b,
+                              matrix_batch_t* c, int num_threads)
+{
+    assert(a != NULL && b != NULL && c != NULL);
+    assert(a->num_columns == b->num_rows && "Matrices do not commute");
+    assert(c->num_rows == a->num_rows && c->num_columns == b->num_columns);
+    assert(a->count == b->count && c->count == a->count);
+    batch_args_t g = {BATCH_MULTIPLY, a, b, c, NULL, a->count};
+    batch_run(&g, num_threads);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_batch_multiply(matrix_batch_t* a, matrix_batch_t* b,
+                           matrix_batch_t* c)
+{
+    matrix_batch_multiply_mt(a, b, c, MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_batch_solve_mt
+ *
+ * Arguments: batch of n x n matrices
+ *            batch of n x q right hand sides, the same count
+ *            batch of n x q matrices for the solutions (may be a or b)
+ *            det, count doubles for the determinants, or NULL
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           X_k = adj(A_k) B_k / det(A_k), with the caveats of
+ *           matrix_batch_inverse_mt
+ */
+void matrix_batch_solve_mt(matrix_batch_t* a, matrix_batch_t* b,
+                           matrix_batch_t* x, double* det, int num_threads)
+{
+    assert(a != NULL && b != NULL && x != NULL);
+    assert(a->num_rows == a->num_columns && "Solve needs square matrices");
+    assert(b->num_rows == a->num_rows && x->num_rows == b->num_rows
+           && x->num_columns == b->num_columns);
+    assert(a->count == b->count && x->count == a->count);
+    batch_args_t g = {BATCH_SOLVE, a, b, x, det, a->count};
+    batch_run(&g, num_threads);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_batch_solve(matrix_batch_t* a, matrix_batch_t* b,
+                        matrix_batch_t* x, double* det)
+{
+    matrix_batch_solve_mt(a, b, x, det, MATRIX_THREADS_DEFAULT);
+}
+
+static double get_batch_entry(matrix_batch_t* batch, int k, int i, int j)
+{
+    assert(batch != NULL && k >= 0 && k < batch->count);
+    assert(i >= 0 && i < batch->num_rows && j >= 0 && j < batch->num_columns);
+    return MATRIX_BATCH_ENTRY(batch, k, i, j);
+}
+
+static void set_batch_entry(matrix_batch_t* batch, int k, int i, int j,
+                            double entry)
+{
+    assert(batch != NULL && k >= 0 && k < batch->count);
+    assert(i >= 0 && i < batch->num_rows && j >= 0 && j < batch->num_columns);
+    MATRIX_BATCH_ENTRY(batch, k, i, j) = entry;
+}
+
+/* A new matrix_t holding matrix k of the batch */
+static matrix_t* get_batch_matrix(matrix_batch_t* batch, int k)
+{
+    assert(batch != NULL && k >= 0 && k < batch->count);
+    matrix_t* m = create_matrix(batch->num_rows, batch->num_columns);
+    int i, j;
+    for(i=0; i<batch->num_rows; i++){
+        for(j=0; j<batch->num_columns; j++){
+            MATRIX_ENTRY(m, i, j) = MATRIX_BATCH_ENTRY(batch, k, i, j);
+        }
+    }
+    return m;
+}
+
+static void set_batch_matrix(matrix_batch_t* batch, int k, matrix_t* m)
+{
+    assert(batch != NULL && m != NULL && k >= 0 && k < batch->count);
+    assert(m->num_rows == batch->num_rows
+           && m->num_columns == batch->num_columns);
+    int i, j;
+    for(i=0; i<batch->num_rows; i++){
+        for(j=0; j<batch->num_columns; j++){
+            MATRIX_BATCH_ENTRY(batch, k, i, j) = MATRIX_ENTRY(m, i, j);
+        }
+    }
+}
+
+static void destroy_matrix_batch(matrix_batch_t* batch)
+{
+    assert(batch != NULL);
+    matrix_aligned_free(batch->data);
+    free(batch);
+}
+
+static void matrix_batch_add_function_pointers(matrix_batch_t* batch)
+{
+    batch->get_entry = &get_batch_entry;
+    batch->set_entry = &set_batch_entry;
+    batch->get_matrix = &get_batch_matrix;
+    batch->set_matrix = &set_batch_matrix;
+    batch->free = &destroy_matrix_batch;
+}
@@ -0,0 +1,57 @@
+#ifndef MATRIX_BATCH_H
+#define MATRIX_BATCH_H
+
+#include "matrix.h"
+
+/* Largest rows or columns of a batched matrix */
+#define MATRIX_BATCH_MAX_DIM 4
+#define MATRIX_BATCH_ENTRIES (MATRIX_BATCH_MAX_DIM*MATRIX_BATCH_MAX_DIM)
+
+/* Matrices per task of the batched operations */
+#define MATRIX_BATCH_CHUNK 4096
+
+#define MATRIX_BATCH_ENTRY(batch, k, i, j)                                    \
+    ((batch)->data[((size_t)(i)*(batch)->num_columns + (j))*(batch)->stride  \
+                   + (k)])
+
+/* count small matrices of the same shape in structure of arrays layout:
+ * entry (i, j) of every matrix is one contiguous array, so SIMD kernels
+ * work on several matrices per instruction with no shuffles. The arrays
+ * are padded to whole cache lines. */
+typedef struct matrix_batch matrix_batch_t;
+
+struct matrix_batch{
+    double* data;           // one aligned block of num_rows*num_columns arrays
+    int stride;             // doubles from one entry's array to the next
+    int count;
+    int num_rows;
+    int num_columns;
+
+    double (*get_entry)(matrix_batch_t* batch, int k, int row, int col);
+    void (*set_entry)(matrix_batch_t* batch, int k, int row, int col,
+                      double entry);
+    matrix_t* (*get_matrix)(matrix_batch_t* batch, int k);
+    void (*set_matrix)(matrix_batch_t* batch, int k, matrix_t* m);
+    void (*free)(matrix_batch_t* batch);
+};
+
+matrix_batch_t* create_matrix_batch(int count, int rows, int columns);
+
+/* det[k] = det(A_k); inv_k = A_k^-1; C_k = A_k B_k; X_k = A_k^-1 B_k */
+void matrix_batch_determinant(matrix_batch_t* a, double* det);
+void matrix_batch_determinant_mt(matrix_batch_t* a, double* det,
+                                 int num_threads);
+void matrix_batch_inverse(matrix_batch_t* a, matrix_batch_t* inv,
+                          double* det);
+void matrix_batch_inverse_mt(matrix_batch_t* a, matrix_batch_t* inv,
+                             double* det, int num_threads);
+void matrix_batch_multiply(matrix_batch_t* a, matrix_batch_t* b,
+                           matrix_batch_t* c);
+void matrix_batch_multiply_mt(matrix_batch_t* a, matrix_batch_t* b,
+                              matrix_batch_t* c, int num_threads);
+void matrix_batch_solve(matrix_batch_t* a, matrix_batch_t* b,
+                        matrix_batch_t* x, double* det);
+void matrix_batch_solve_mt(matrix_batch_t* a, matrix_batch_t* b,
+                           matrix_batch_t* x, double* det, int num_threads);
+
+#endif // MATRIX_BATCH_H
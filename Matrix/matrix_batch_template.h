@@ -0,0 +1,215 @@
+/* Fixed size kernels for one position of a batch (matrix_batch.c), written
+ * once for any type with the arithmetic operators. The including file
+ * defines
+ *   BATCH_T       the type holding one entry of each matrix at a position:
+ *                 double for one matrix, a GCC vector for several
+ *   BATCH_FN(x)   the name of x for that type
+ * and includes this file once per type. Loads and stores go through
+ * MATRIX_SIMD_LOAD and MATRIX_SIMD_STORE, so a vector covers consecutive
+ * matrices of the structure of arrays layout. Every function is always
+ * inlined and vectors only cross them by pointer, so the arithmetic is
+ * compiled for the instruction set of the task calling it. No include
+ * guard, on purpose. */
+
+/* a[e] = entry e (row-major) of the matrices at position k */
+MATRIX_SIMD_INLINE void BATCH_FN(batch_gather)(const matrix_batch_t* batch,
+                                               int k, int entries, BATCH_T* a)
+{
+    int e;
+    for(e=0; e<entries; e++){
+        a[e] = MATRIX_SIMD_LOAD(BATCH_T, batch->data
+                                         + (size_t)e*batch->stride + k);
+    }
+}
+
+MATRIX_SIMD_INLINE void BATCH_FN(batch_scatter)(matrix_batch_t* batch, int k,
+                                                int entries, const BATCH_T* a)
+{
+    int e;
+    for(e=0; e<entries; e++){
+        MATRIX_SIMD_STORE(batch->data + (size_t)e*batch->stride + k, a[e]);
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: batch_adjugate
+ *
+ * Arguments: dimension, 1 to MATRIX_BATCH_MAX_DIM
+ *            entries of the matrices, row-major
+ *            where to write the adjugates, row-major (may be NULL)
+ *            where to write the determinants
+ *
+ * Returns: void
+ *           adj(A) = det(A) inverse(A), built from
+ *           cofactors; the 4 x 4 case shares the 2 x 2 minors of the top
+ *           and bottom row pairs between the determinant and all sixteen
+ *           cofactors.
+ */
+MATRIX_SIMD_INLINE void BATCH_FN(batch_adjugate)(int dim, const BATCH_T* a,
+                                                 BATCH_T* adj, BATCH_T* det)
+{
+    switch (dim){
+    case 1:
+        if (adj != NULL){
+            adj[0] = (BATCH_T){0} + 1.0;
+        }
+        *det = a[0];
+        return;
+    case 2:
+        if (adj != NULL){
+            adj[0] = a[3];
+            adj[1] = -a[1];
+            adj[2] = -a[2];
+            adj[3] = a[0];
+        }
+        *det = a[0]*a[3] - a[1]*a[2];
+        return;
+    case 3:{
+        BATCH_T c00 = a[4]*a[8] - a[5]*a[7];
+        BATCH_T c10 = a[5]*a[6] - a[3]*a[8];
+        BATCH_T c20 = a[3]*a[7] - a[4]*a[6];
+        if (adj != NULL){
+            adj[0] = c00;
+            adj[1] = a[2]*a[7] - a[1]*a[8];
+            adj[2] = a[1]*a[5] - a[2]*a[4];
+            adj[3] = c10;
+            adj[4] = a[0]*a[8] - a[2]*a[6];
+            adj[5] = a[2]*a[3] - a[0]*a[5];
+            adj[6] = c20;
+            adj[7] = a[1]*a[6] - a[0]*a[7];
+            adj[8] = a[0]*a[4] - a[1]*a[3];
+        }
+        *det = a[0]*c00 + a[1]*c10 + a[2]*c20;
+        return;
+    }
+    default:{
+        /* 2 x 2 minors of rows 0-1 (s) and rows 2-3 (c) */
+        BATCH_T s0 = a[0]*a[5] - a[1]*a[4];
+        BATCH_T s1 = a[0]*a[6] - a[2]*a[4];
+        BATCH_T s2 = a[0]*a[7] - a[3]*a[4];
+        BATCH_T s3 = a[1]*a[6] - a[2]*a[5];
+        BATCH_T s4 = a[1]*a[7] - a[3]*a[5];
+        BATCH_T s5 = a[2]*a[7] - a[3]*a[6];
+        BATCH_T c0 = a[8]*a[13] - a[9]*a[12];
+        BATCH_T c1 = a[8]*a[14] - a[10]*a[12];
+        BATCH_T c2 = a[8]*a[15] - a[11]*a[12];
+        BATCH_T c3 = a[9]*a[14] - a[10]*a[13];
+        BATCH_T c4 = a[9]*a[15] - a[11]*a[13];
+        BATCH_T c5 = a[10]*a[15] - a[11]*a[14];
+        if (adj != NULL){
+            adj[0] = a[5]*c5 - a[6]*c4 + a[7]*c3;
+            adj[1] = -a[1]*c5 + a[2]*c4 - a[3]*c3;
+            adj[2] = a[13]*s5 - a[14]*s4 + a[15]*s3;
+            adj[3] = -a[9]*s5 + a[10]*s4 - a[11]*s3;
+            adj[4] = -a[4]*c5 + a[6]*c2 - a[7]*c1;
+            adj[5] = a[0]*c5 - a[2]*c2 + a[3]*c1;
+            adj[6] = -a[12]*s5 + a[14]*s2 - a[15]*s1;
+            adj[7] = a[8]*s5 - a[10]*s2 + a[11]*s1;
+            adj[8] = a[4]*c4 - a[5]*c2 + a[7]*c0;
+            adj[9] = -a[0]*c4 + a[1]*c2 - a[3]*c0;
+            adj[10] = a[12]*s4 - a[13]*s2 + a[15]*s0;
+            adj[11] = -a[8]*s4 + a[9]*s2 - a[11]*s0;
+            adj[12] = -a[4]*c3 + a[5]*c1 - a[6]*c0;
+            adj[13] = a[0]*c3 - a[1]*c1 + a[2]*c0;
+            adj[14] = -a[12]*s3 + a[13]*s1 - a[14]*s0;
+            adj[15] = a[8]*s3 - a[9]*s1 + a[10]*s0;
+        }
+        *det = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+        return;
+    }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/* c = a b for rows x inner and inner x columns matrices, row-major */
+MATRIX_SIMD_INLINE void BATCH_FN(batch_product)(int rows, int inner,
+                                                int columns, const BATCH_T* a,
+                                                const BATCH_T* b, BATCH_T* c)
+{
+    int i, j, p;
+    for(i=0; i<rows; i++){
+        for(j=0; j<columns; j++){
+            BATCH_T sum = a[i*inner]*b[j];
+            for(p=1; p<inner; p++){
+                sum += a[i*inner + p]*b[p*columns + j];
+            }
+            c[i*columns + j] = sum;
+        }
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: batch_position
+ *
+ * Arguments: batch_args_t
+ *            position of the first matrix
+ *            rows and columns of A, columns of B and of the output (for the
+ *             determinant and inverse, the columns of A)
+ *
+ * Returns: void
+ *           runs the operation on the matrices at positions k onwards, as
+ *           many as BATCH_T holds. The shape is passed in so that callers
+ *           with constants get every loop unrolled and every entry kept in
+ *           a register. Everything is read before anything is written, so
+ *           the output may be an input.
+ */
+MATRIX_SIMD_INLINE void BATCH_FN(batch_position)(const batch_args_t* g, int k,
+                                                 int rows, int inner,
+                                                 int columns)
+{
+    BATCH_T a[MATRIX_BATCH_ENTRIES], b[MATRIX_BATCH_ENTRIES];
+    BATCH_T out[MATRIX_BATCH_ENTRIES], det, scale;
+    int e, entries = rows*columns;
+    BATCH_FN(batch_gather)(g->a, k, rows*inner, a);
+    switch (g->op){
+    case BATCH_DETERMINANT:
+        BATCH_FN(batch_adjugate)(rows, a, NULL, &det);
+        MATRIX_SIMD_STORE(g->det + k, det);
+        return;
+    case BATCH_INVERSE:
+        BATCH_FN(batch_adjugate)(rows, a, out, &det);
+        scale = 1.0/det;
+        for(e=0; e<entries; e++){
+            out[e] *= scale;
+        }
+        if (g->det != NULL){
+            MATRIX_SIMD_STORE(g->det + k, det);
+        }
+        break;
+    case BATCH_MULTIPLY:
+        BATCH_FN(batch_gather)(g->b, k, inner*columns, b);
+        BATCH_FN(batch_product)(rows, inner, columns, a, b, out);
+        break;
+    default:{
+        /* x = adj(A) b / det(A) */
+        BATCH_T adj[MATRIX_BATCH_ENTRIES];
+        BATCH_FN(batch_adjugate)(rows, a, adj, &det);
+        scale = 1.0/det;
+        BATCH_FN(batch_gather)(g->b, k, rows*columns, b);
+        BATCH_FN(batch_product)(rows, rows, columns, adj, b, out);
+        for(e=0; e<entries; e++){
+            out[e] *= scale;
+        }
+        if (g->det != NULL){
+            MATRIX_SIMD_STORE(g->det + k, det);
+        }
+        break;
+    }
+    }
+    BATCH_FN(batch_scatter)(g->out, k, entries, out);
+}
+//-----------------------------------------------------------------------------
+
+/* Positions [k, last): whole vectors of BATCH_T while they fit */
+MATRIX_SIMD_INLINE int BATCH_FN(batch_range)(const batch_args_t* g, int k,
+                                             int last, int rows, int inner,
+                                             int columns)
+{
+    int lanes = sizeof(BATCH_T)/sizeof(double);
+    for(; k + lanes <= last; k += lanes){
+        BATCH_FN(batch_position)(g, k, rows, inner, columns);
+    }
+    return k;
+}
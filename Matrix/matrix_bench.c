@@ -0,0 +1,879 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "matrix.h"
+#include "matrix_gemm.h"
+#include "matrix_lu.h"
+#include "matrix_corr.h"
+#include "matrix_csv.h"
+#include "matrix_transpose.h"
+#include "matrix_float.h"
+#include "matrix_missing.h"
+#include "matrix_gemv.h"
+#include "matrix_strassen.h"
+#include "matrix_bool.h"
+#include "matrix_batch.h"
+#include "matrix_prefix.h"
+#include "matrix_ooc.h"
+#include "matrix_binary.h"
+
+/* The naive multiply and the old elimination are only timed up to this many
+ * flops unless "all" is passed on the command line, since they take minutes
+ * on the large shapes */
+#define NAIVE_FLOP_LIMIT (2.0*1024*1024*1024)
+
+/* Pairwise correlation makes several passes per pair, so it gets a lower
+ * limit on variables*variables*observations */
+#define PAIRWISE_LIMIT (1024.0*1024*1024/4)
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static matrix_t* random_matrix(int rows, int columns)
+{
+    matrix_t* m = create_matrix(rows, columns);
+    int i, j;
+    for(i=0; i<rows; i++){
+        for(j=0; j<columns; j++){
+            MATRIX_ENTRY(m, i, j) = (double)rand()/RAND_MAX - 0.5;
+        }
+    }
+    return m;
+}
+
+/* The i-j-k loop matrix_multiply used before the packed GEMM kernel */
+static matrix_t* naive_multiply(matrix_t* m1, matrix_t* m2)
+{
+    matrix_t* ret = create_matrix(m1->num_rows, m2->num_columns);
+    int i, j, k;
+    for(i=0; i<ret->num_rows; i++){
+        for(j=0; j<ret->num_columns; j++){
+            double tmp = 0.0;
+            for(k=0; k<m1->num_columns; k++){
+                tmp += m1->get_entry(m1, i, k) * m2->get_entry(m2, k, j);
+            }
+            ret->set_entry(ret, i, j, tmp);
+        }
+    }
+    return ret;
+}
+
+static double time_multiply(matrix_t* a, matrix_t* b,
+                            matrix_t* (*multiply)(matrix_t*, matrix_t*))
+{
+    double start = now_seconds();
+    matrix_t* c = multiply(a, b);
+    double elapsed = now_seconds() - start;
+    c->free(c);
+    return elapsed;
+}
+
+/* Converts outside the timed region, so only the float GEMM is measured */
+static double time_float_multiply(matrix_t* a, matrix_t* b)
+{
+    matrixf_t* fa = matrix_to_matrixf(a);
+    matrixf_t* fb = matrix_to_matrixf(b);
+    double start = now_seconds();
+    matrixf_t* c = matrixf_multiply(fa, fb);
+    double elapsed = now_seconds() - start;
+    c->free(c);
+    fa->free(fa);
+    fb->free(fb);
+    return elapsed;
+}
+
+/* The column-at-a-time elimination gaussian_elimination used before the
+ * blocked LU, kept here as the baseline */
+static void old_eliminate_column(matrix_t* m, int row_pivot, int col_num,
+                                 int* num_row_swaps)
+{
+    int index_highest_pivot = row_pivot;
+    int i, j;
+    double largest = 0.0;
+    for(i=row_pivot; i<m->num_rows; i++){
+        double pivot = m->matrix[i]->vector[col_num];
+        if (fabs(pivot) > fabs(largest)){
+            largest = pivot;
+            index_highest_pivot = i;
+        }
+    }
+    if (largest == 0.0){
+        return;
+    }
+    else if (row_pivot != index_highest_pivot){
+        m->row_swap(m, row_pivot, index_highest_pivot);
+        *num_row_swaps += 1;
+    }
+    for(i=row_pivot+1; i<m->num_rows; i++){
+        double lambda = m->matrix[i]->vector[col_num]
+                        / m->matrix[row_pivot]->vector[row_pivot];
+        if (fabs(lambda) < GAUSS_ELIM_ACCURACY){
+            continue;
+        }
+        for(j=col_num; j<m->num_columns; j++){
+            double v = m->matrix[row_pivot]->vector[j];
+            if (j==col_num){
+                m->matrix[i]->vector[j] = 0.0;
+            }
+            else{
+                m->matrix[i]->vector[j] -= (lambda*v);
+            }
+        }
+    }
+}
+
+static double time_old_elimination(matrix_t* a)
+{
+    matrix_t* copy = a->copy(a);
+    int swaps = 0, i;
+    double start = now_seconds();
+    for(i=0; i<copy->num_columns; i++){
+        old_eliminate_column(copy, i, i, &swaps);
+    }
+    double elapsed = now_seconds() - start;
+    copy->free(copy);
+    return elapsed;
+}
+
+static double time_lu(matrix_t* a, int num_threads)
+{
+    double start = now_seconds();
+    lu_t* f = create_lu_mt(a, num_threads);
+    double elapsed = now_seconds() - start;
+    f->free(f);
+    return elapsed;
+}
+
+static void bench_gemm(int run_all)
+{
+    int shapes[][3] = {
+        {256, 256, 256}, {512, 512, 512}, {1024, 1024, 1024},
+        {2048, 2048, 2048}, {4096, 4096, 4096},
+        {256, 1024, 512}, {1024, 256, 4096}, {4096, 256, 256},
+        {512, 4096, 512}, {2048, 512, 1024}
+    };
+    int num_shapes = sizeof(shapes)/sizeof(shapes[0]);
+    int simd = matrix_gemm_simd_available();
+    int s;
+
+    printf("GFLOP/s for C(m x n) = A(m x k) * B(k x n)%s\n",
+           simd ? "" : " (no AVX2/FMA on this CPU)");
+    printf("%6s %6s %6s %10s %10s %10s %10s\n",
+           "m", "k", "n", "naive", "scalar", "avx2", "float");
+
+    for(s=0; s<num_shapes; s++){
+        int m = shapes[s][0], k = shapes[s][1], n = shapes[s][2];
+        double flops = 2.0*m*n*k;
+        matrix_t* a = random_matrix(m, k);
+        matrix_t* b = random_matrix(k, n);
+
+        printf("%6d %6d %6d ", m, k, n);
+        if (run_all || flops <= NAIVE_FLOP_LIMIT){
+            printf("%10.2f ", flops/time_multiply(a, b, naive_multiply)*1e-9);
+        }
+        else{
+            printf("%10s ", "skipped");
+        }
+        matrix_gemm_set_simd(0);
+        printf("%10.2f ", flops/time_multiply(a, b, matrix_multiply)*1e-9);
+        matrix_gemm_set_simd(1);
+        if (simd){
+            printf("%10.2f ", flops/time_multiply(a, b, matrix_multiply)*1e-9);
+        }
+        else{
+            printf("%10s ", "-");
+        }
+        printf("%10.2f\n", flops/time_float_multiply(a, b)*1e-9);
+        fflush(stdout);
+        a->free(a);
+        b->free(b);
+    }
+}
+
+static void bench_lu(int run_all)
+{
+    int sizes[] = {500, 1000, 2000, 3000, 4000};
+    int num_sizes = sizeof(sizes)/sizeof(sizes[0]);
+    int threads = matrix_get_num_threads();
+    int s;
+
+    printf("\nGFLOP/s (2n^3/3) for LU of a random n x n matrix\n");
+    printf("%6s %10s %10s %10s\n", "n", "old", "blocked", "threaded");
+    for(s=0; s<num_sizes; s++){
+        int n = sizes[s];
+        double flops = 2.0*n*n*n/3;
+        matrix_t* a = random_matrix(n, n);
+        printf("%6d ", n);
+        if (run_all || flops <= NAIVE_FLOP_LIMIT){
+            printf("%10.2f ", flops/time_old_elimination(a)*1e-9);
+        }
+        else{
+            printf("%10s ", "skipped");
+        }
+        printf("%10.2f ", flops/time_lu(a, 1)*1e-9);
+        printf("%10.2f\n", flops/time_lu(a, threads)*1e-9);
+        fflush(stdout);
+        a->free(a);
+    }
+}
+
+/* The pairwise loop matrix_to_corrcoef used before the GEMM based engine */
+static double time_pairwise_correlation(matrix_t* m)
+{
+    matrix_t* ret = create_matrix(m->num_rows, m->num_rows);
+    int i, j;
+    double start = now_seconds();
+    for(i=0; i<m->num_rows; i++){
+        for(j=i+1; j<m->num_rows; j++){
+            double entry = vector_correlation(m->matrix[i], m->matrix[j],
+                                              SAMPLE);
+            ret->set_entry(ret, i, j, entry);
+            ret->set_entry(ret, j, i, entry);
+        }
+        ret->set_entry(ret, i, i, 1.0);
+    }
+    double elapsed = now_seconds() - start;
+    ret->free(ret);
+    return elapsed;
+}
+
+static double time_correlation(matrix_t* m)
+{
+    double start = now_seconds();
+    matrix_t* ret = matrix_correlation(m, SAMPLE);
+    double elapsed = now_seconds() - start;
+    ret->free(ret);
+    return elapsed;
+}
+
+static void bench_corr(int run_all)
+{
+    int shapes[][2] = {{500, 1000}, {1000, 1000}, {2000, 1000}, {4000, 500}};
+    int num_shapes = sizeof(shapes)/sizeof(shapes[0]);
+    int s;
+
+    printf("\nSeconds for the correlation matrix of n variables with d "
+           "observations\n");
+    printf("%6s %6s %10s %10s\n", "n", "d", "pairwise", "gemm");
+    for(s=0; s<num_shapes; s++){
+        int n = shapes[s][0], d = shapes[s][1];
+        matrix_t* m = random_matrix(n, d);
+        printf("%6d %6d ", n, d);
+        if (run_all || (double)n*n*d <= PAIRWISE_LIMIT){
+            printf("%10.3f ", time_pairwise_correlation(m));
+        }
+        else{
+            printf("%10s ", "skipped");
+        }
+        printf("%10.3f\n", time_correlation(m));
+        fflush(stdout);
+        m->free(m);
+    }
+}
+
+/* The old writer: fprintf of every entry with six decimals */
+static double time_fprintf_csv(matrix_t* m, char* fname)
+{
+    double start = now_seconds();
+    FILE* fp = fopen(fname, "w");
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        for(j=0; j<m->num_columns; j++){
+            fprintf(fp, (j < m->num_columns-1) ? "%lf," : "%lf\n",
+                    MATRIX_ENTRY(m, i, j));
+        }
+    }
+    fclose(fp);
+    return now_seconds() - start;
+}
+
+static double time_csv_writer(matrix_t* m, char* fname)
+{
+    double start = now_seconds();
+    matrix_to_csv_mt(m, fname, MATRIX_THREADS_DEFAULT);
+    return now_seconds() - start;
+}
+
+static void bench_csv(void)
+{
+    int shapes[][2] = {{100000, 10}, {20000, 100}, {1000000, 10}};
+    int num_shapes = sizeof(shapes)/sizeof(shapes[0]);
+    char fname[] = "bench_csv.csv";
+    int s;
+
+    printf("\nSeconds to write an n x d matrix as csv\n");
+    printf("%8s %6s %10s %10s\n", "n", "d", "fprintf", "shortest");
+    for(s=0; s<num_shapes; s++){
+        int n = shapes[s][0], d = shapes[s][1];
+        matrix_t* m = random_matrix(n, d);
+        printf("%8d %6d ", n, d);
+        printf("%10.3f ", time_fprintf_csv(m, fname));
+        printf("%10.3f\n", time_csv_writer(m, fname));
+        fflush(stdout);
+        m->free(m);
+    }
+    remove(fname);
+}
+
+/* The old transpose: one column of the source per row of the result */
+static double time_scatter_transpose(matrix_t* m)
+{
+    double start = now_seconds();
+    matrix_t* ret = create_matrix(m->num_columns, m->num_rows);
+    int i, j;
+    for(j=0; j<m->num_columns; j++){
+        double* dst = MATRIX_ROW(ret, j);
+        for(i=0; i<m->num_rows; i++){
+            dst[i] = MATRIX_ENTRY(m, i, j);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    ret->free(ret);
+    return elapsed;
+}
+
+static double time_blocked_transpose(matrix_t* m)
+{
+    double start = now_seconds();
+    matrix_t* ret = m->transpose(m);
+    double elapsed = now_seconds() - start;
+    ret->free(ret);
+    return elapsed;
+}
+
+static double time_in_place_transpose(matrix_t* m)
+{
+    double start = now_seconds();
+    matrix_transpose_in_place(m);
+    return now_seconds() - start;
+}
+
+static void bench_transpose(void)
+{
+    int sizes[] = {1000, 2048, 4000, 8192};
+    int num_sizes = sizeof(sizes)/sizeof(sizes[0]);
+    int s;
+
+    printf("\nSeconds to transpose an n x n matrix\n");
+    printf("%6s %10s %10s %10s\n", "n", "scatter", "blocked", "in place");
+    for(s=0; s<num_sizes; s++){
+        int n = sizes[s];
+        matrix_t* m = random_matrix(n, n);
+        printf("%6d ", n);
+        printf("%10.3f ", time_scatter_transpose(m));
+        printf("%10.3f ", time_blocked_transpose(m));
+        printf("%10.3f\n", time_in_place_transpose(m));
+        fflush(stdout);
+        m->free(m);
+    }
+}
+
+/* Every 10th entry missing, recorded as the old DBL_EPSILON sentinel in one
+ * matrix and in the bitmap of the other */
+static void bench_missing(void)
+{
+    int rows[] = {1000000, 100000};
+    int columns[] = {16, 200};
+    int num_sizes = sizeof(rows)/sizeof(rows[0]);
+    int s, i, j;
+
+    printf("\nSeconds for missing values in an n x d matrix, 10%% missing\n");
+    printf("%8s %4s %10s %10s %10s %10s\n", "n", "d", "sentinel", "count",
+           "means", "impute");
+    for(s=0; s<num_sizes; s++){
+        int n = rows[s], d = columns[s];
+        matrix_t* sentinel = random_matrix(n, d);
+        matrix_t* gappy = sentinel->copy(sentinel);
+        for(i=0; i<n; i++){
+            for(j=(i % 10); j<d; j+=10){
+                MATRIX_ENTRY(sentinel, i, j) = DBL_EPSILON;
+                matrix_set_missing(gappy, i, j);
+            }
+        }
+        double* means = malloc(d*sizeof(*means));
+        double start = now_seconds();
+        for(i=0; i<n; i++){
+            sentinel->matrix[i]->impute_missing_value(sentinel->matrix[i],
+                                                      DBL_EPSILON, MEAN);
+        }
+        printf("%8d %4d %10.3f ", n, d, now_seconds() - start);
+        start = now_seconds();
+        long missing = matrix_count_missing(gappy);
+        printf("%10.3f ", now_seconds() - start);
+        start = now_seconds();
+        matrix_masked_column_means_mt(gappy, means, MATRIX_THREADS_DEFAULT);
+        printf("%10.3f ", now_seconds() - start);
+        start = now_seconds();
+        gappy->impute_missing_values(gappy, MEAN);
+        printf("%10.3f\n", now_seconds() - start);
+        fflush(stdout);
+        (void)missing;
+        free(means);
+        sentinel->free(sentinel);
+        gappy->free(gappy);
+    }
+}
+
+/* The old route: x as an n x 1 matrix through matrix_multiply, and for the
+ * transposed product an explicit transpose first */
+static void bench_gemv(void)
+{
+    int rows[] = {2000, 1000000, 200};
+    int columns[] = {2000, 16, 50000};
+    int num_sizes = sizeof(rows)/sizeof(rows[0]);
+    int s, i;
+
+    printf("\nSeconds for y = Ax and y = A'x with an m x n matrix\n");
+    printf("%8s %6s %10s %10s %10s %10s\n", "m", "n", "as matrix", "gemv",
+           "as matrix'", "gemv'");
+    for(s=0; s<num_sizes; s++){
+        int m = rows[s], n = columns[s];
+        matrix_t* a = random_matrix(m, n);
+        matrix_t* x = random_matrix(n, 1);
+        matrix_t* xt = random_matrix(m, 1);
+        vector_t* v = create_zero_vector(n);
+        vector_t* vt = create_zero_vector(m);
+        vector_t* y = create_zero_vector(m);
+        vector_t* yt = create_zero_vector(n);
+        for(i=0; i<n; i++){
+            v->vector[i] = MATRIX_ENTRY(x, i, 0);
+        }
+        for(i=0; i<m; i++){
+            vt->vector[i] = MATRIX_ENTRY(xt, i, 0);
+        }
+        double start = now_seconds();
+        matrix_t* product = matrix_multiply(a, x);
+        printf("%8d %6d %10.4f ", m, n, now_seconds() - start);
+        start = now_seconds();
+        matrix_vector_multiply(a, v, y);
+        printf("%10.4f ", now_seconds() - start);
+        start = now_seconds();
+        matrix_t* at = a->transpose(a);
+        matrix_t* product_t = matrix_multiply(at, xt);
+        printf("%10.4f ", now_seconds() - start);
+        start = now_seconds();
+        matrix_transpose_vector_multiply(a, vt, yt);
+        printf("%10.4f\n", now_seconds() - start);
+        fflush(stdout);
+        product->free(product); product_t->free(product_t); at->free(at);
+        a->free(a); x->free(x); xt->free(xt);
+        v->free(v); vt->free(vt); y->free(y); yt->free(yt);
+    }
+}
+
+/* Classical GEMM against Strassen-Winograd at a few cutoffs, with the
+ * largest difference from the classical product scaled by max|A|*max|B| */
+static void bench_strassen(int run_all)
+{
+    int sizes[] = {1024, 2048, 4096};
+    int cutoffs[] = {256, 512, 1024};
+    int num_sizes = run_all ? 3 : 2;
+    int num_cutoffs = sizeof(cutoffs)/sizeof(cutoffs[0]);
+    int s, c, i, j;
+
+    printf("\nSeconds for an n x n multiply, classical and by Strassen with "
+           "each cutoff\n");
+    printf("%6s %10s", "n", "classical");
+    for(c=0; c<num_cutoffs; c++){
+        printf("   cut %4d  error", cutoffs[c]);
+    }
+    printf("\n");
+    for(s=0; s<num_sizes; s++){
+        int n = sizes[s];
+        matrix_t* a = random_matrix(n, n);
+        matrix_t* b = random_matrix(n, n);
+        double start = now_seconds();
+        matrix_t* classical = matrix_multiply(a, b);
+        printf("%6d %10.3f", n, now_seconds() - start);
+        fflush(stdout);
+        matrix_set_multiply_mode(MATRIX_MULTIPLY_STRASSEN);
+        for(c=0; c<num_cutoffs; c++){
+            matrix_set_strassen_cutoff(cutoffs[c]);
+            start = now_seconds();
+            matrix_t* fast = matrix_multiply(a, b);
+            double elapsed = now_seconds() - start;
+            double error = 0.0;
+            for(i=0; i<n; i++){
+                for(j=0; j<n; j++){
+                    double d = fabs(MATRIX_ENTRY(fast, i, j)
+                                    - MATRIX_ENTRY(classical, i, j));
+                    error = (d > error) ? d : error;
+                }
+            }
+            /* Entries are in [-0.5, 0.5] */
+            printf(" %10.3f %7.1e", elapsed, error/0.25);
+            fflush(stdout);
+            fast->free(fast);
+        }
+        printf("\n");
+        matrix_set_multiply_mode(MATRIX_MULTIPLY_CLASSICAL);
+        matrix_set_strassen_cutoff(STRASSEN_DEFAULT_CUTOFF);
+        classical->free(classical);
+        a->free(a);
+        b->free(b);
+    }
+}
+
+/* Random directed graph on n nodes with about degree edges per node */
+static matrixb_t* random_graph(int n, int degree)
+{
+    matrixb_t* g = create_matrixb(n, n);
+    long e;
+    for(e=0; e<(long)n*degree; e++){
+        g->set_entry(g, rand() % n, rand() % n, 1);
+    }
+    return g;
+}
+
+/* Walks of 3 edges through matrix_pow_into on doubles (only while the
+ * doubles fit comfortably) against matrixb_pow, then the boolean closure */
+static void bench_bool(int run_all)
+{
+    int sizes[] = {2048, 8192, 16384};
+    int degrees[] = {4, 256};
+    int num_sizes = run_all ? 3 : 2;
+    int s, d;
+
+    printf("\nSeconds for walks of 3 edges and the transitive closure of a "
+           "random graph\n");
+    printf("%6s %6s %10s %10s %10s %10s %10s\n", "n", "degree", "double MB",
+           "bool MB", "double A^3", "bool A^3", "closure");
+    for(s=0; s<num_sizes; s++){
+        for(d=0; d<2; d++){
+            int n = sizes[s];
+            matrixb_t* g = random_graph(n, degrees[d]);
+            printf("%6d %6d %10.1f %10.1f ", n, degrees[d],
+                   (double)n*n*sizeof(double)/(1 << 20),
+                   (double)n*g->stride*sizeof(*g->words)/(1 << 20));
+            if (n <= 2048){
+                matrix_t* a = matrixb_to_matrix(g);
+                matrix_t* cube = create_matrix(n, n);
+                double start = now_seconds();
+                matrix_pow_into(cube, a, 3);
+                printf("%10.3f ", now_seconds() - start);
+                cube->free(cube);
+                a->free(a);
+            }
+            else{
+                printf("%10s ", "-");
+            }
+            double start = now_seconds();
+            matrixb_t* cube = matrixb_pow(g, 3);
+            printf("%10.3f ", now_seconds() - start);
+            start = now_seconds();
+            matrixb_t* closure = matrixb_transitive_closure(g);
+            printf("%10.3f\n", now_seconds() - start);
+            fflush(stdout);
+            cube->free(cube);
+            closure->free(closure);
+            g->free(g);
+        }
+    }
+}
+
+/* The existing API one matrix at a time (a matrix_t per operand, an LU for
+ * determinant, inverse and solve) against the batched kernels. The loop
+ * gets a tenth of the matrices; both are reported per million. */
+static void bench_batch(void)
+{
+    int count = 1000000, looped = count/10;
+    int dims[] = {3, 4};
+    int d, k, i, j;
+
+    printf("\nSeconds per million small matrices, looped matrix_t calls vs "
+           "batched\n");
+    printf("%4s %9s %9s %9s %9s %9s %9s %9s %9s\n", "dim", "det", "batch",
+           "inverse", "batch", "multiply", "batch", "solve", "batch");
+    for(d=0; d<2; d++){
+        int n = dims[d];
+        matrix_batch_t* a = create_matrix_batch(count, n, n);
+        matrix_batch_t* b = create_matrix_batch(count, n, 1);
+        matrix_batch_t* out = create_matrix_batch(count, n, n);
+        matrix_batch_t* x = create_matrix_batch(count, n, 1);
+        double* det = malloc(count*sizeof(*det));
+        for(k=0; k<count; k++){
+            for(i=0; i<n; i++){
+                for(j=0; j<n; j++){
+                    MATRIX_BATCH_ENTRY(a, k, i, j) = (double)rand()/RAND_MAX
+                                                     + (i == j)*n;
+                }
+                MATRIX_BATCH_ENTRY(b, k, i, 0) = (double)rand()/RAND_MAX;
+            }
+        }
+        double scale = (double)count/looped, start, sink = 0.0;
+        printf("%4d ", n);
+
+        start = now_seconds();
+        for(k=0; k<looped; k++){
+            matrix_t* m = a->get_matrix(a, k);
+            sink += m->determinant(m);
+            m->free(m);
+        }
+        printf("%9.3f ", (now_seconds() - start)*scale);
+        start = now_seconds();
+        matrix_batch_determinant(a, det);
+        printf("%9.4f ", now_seconds() - start);
+
+        start = now_seconds();
+        for(k=0; k<looped; k++){
+            matrix_t* m = a->get_matrix(a, k);
+            lu_t* f = create_lu(m);
+            matrix_t* inv = f->inverse(f);
+            sink += MATRIX_ENTRY(inv, 0, 0);
+            inv->free(inv); f->free(f); m->free(m);
+        }
+        printf("%9.3f ", (now_seconds() - start)*scale);
+        start = now_seconds();
+        matrix_batch_inverse(a, out, NULL);
+        printf("%9.4f ", now_seconds() - start);
+
+        start = now_seconds();
+        for(k=0; k<looped; k++){
+            matrix_t* m = a->get_matrix(a, k);
+            matrix_t* p = matrix_multiply(m, m);
+            sink += MATRIX_ENTRY(p, 0, 0);
+            p->free(p); m->free(m);
+        }
+        printf("%9.3f ", (now_seconds() - start)*scale);
+        start = now_seconds();
+        matrix_batch_multiply(a, a, out);
+        printf("%9.4f ", now_seconds() - start);
+
+        start = now_seconds();
+        for(k=0; k<looped; k++){
+            matrix_t* m = a->get_matrix(a, k);
+            vector_t* rhs = create_zero_vector(n);
+            for(i=0; i<n; i++){
+                rhs->vector[i] = MATRIX_BATCH_ENTRY(b, k, i, 0);
+            }
+            lu_t* f = create_lu(m);
+            vector_t* solution = f->solve(f, rhs);
+            sink += solution->vector[0];
+            solution->free(solution); rhs->free(rhs); f->free(f);
+            m->free(m);
+        }
+        printf("%9.3f ", (now_seconds() - start)*scale);
+        start = now_seconds();
+        matrix_batch_solve(a, b, x, NULL);
+        printf("%9.4f\n", now_seconds() - start);
+        fflush(stdout);
+
+        (void)sink;
+        free(det);
+        a->free(a); b->free(b); out->free(out); x->free(x);
+    }
+}
+
+/* Rectangle sums for a windowed heatmap: rescanning each window against a
+ * summed-area table, counting its build, and the incremental rebuild after
+ * set_matrix_row on the last rows */
+static void bench_prefix(void)
+{
+    int rows = 4096, columns = 4096, queries = 100000, window = 256;
+    int q, i, j;
+    matrix_t* m = random_matrix(rows, columns);
+    int* rect = malloc(4*queries*sizeof(*rect));
+    for(q=0; q<queries; q++){
+        rect[4*q] = rand() % (rows - window);
+        rect[4*q + 1] = rand() % (columns - window);
+        rect[4*q + 2] = rect[4*q] + 1 + rand() % window;
+        rect[4*q + 3] = rect[4*q + 1] + 1 + rand() % window;
+    }
+    double start, rescan, build, lookup;
+    volatile double sink = 0.0;     // keeps the rescans from being dropped
+
+    start = now_seconds();
+    for(q=0; q<queries; q++){
+        double sum = 0.0;
+        for(i=rect[4*q]; i<rect[4*q + 2]; i++){
+            const double* row = MATRIX_ROW(m, i);
+            for(j=rect[4*q + 1]; j<rect[4*q + 3]; j++){
+                sum += row[j];
+            }
+        }
+        sink += sum;
+    }
+    rescan = now_seconds() - start;
+
+    start = now_seconds();
+    matrix_enable_prefix_sums(m);
+    matrix_refresh_prefix_sums(m);
+    build = now_seconds() - start;
+    start = now_seconds();
+    for(q=0; q<queries; q++){
+        sink += matrix_range_sum(m, rect[4*q], rect[4*q + 1], rect[4*q + 2],
+                                 rect[4*q + 3]);
+    }
+    lookup = now_seconds() - start;
+
+    printf("\nSeconds for %d rectangle sums (sides up to %d) of a %d x %d "
+           "matrix\n", queries, window, rows, columns);
+    printf("%12s %12s %12s %12s\n", "rescan", "build", "lookups",
+           "dirty 16");
+    printf("%12.4f %12.4f %12.5f ", rescan, build, lookup);
+    double* new_row = malloc(columns*sizeof(*new_row));
+    for(j=0; j<columns; j++){
+        new_row[j] = (double)rand()/RAND_MAX;
+    }
+    start = now_seconds();
+    for(i=rows-16; i<rows; i++){
+        m->set_matrix_row(m, new_row, columns, i);
+    }
+    sink += matrix_range_sum(m, 0, 0, rows, columns);
+    printf("%12.5f\n", now_seconds() - start);
+    fflush(stdout);
+
+    (void)sink;
+    free(new_row);
+    free(rect);
+    m->free(m);
+}
+
+/* The in-memory multiply against the out-of-core one over binary files, at
+ * budgets holding a few tiles up to every tile. The files are fresh, so
+ * the first run also pays for reading them from the page cache. */
+static void bench_ooc(void)
+{
+    int n = 2048;
+    size_t budgets[] = {(size_t)16 << 20, (size_t)64 << 20,
+                        (size_t)256 << 20};
+    int b, i;
+    matrix_t* m1 = random_matrix(n, n);
+    matrix_t* m2 = random_matrix(n, n);
+    matrix_to_binary(m1, "bench_ooc_a.mtx");
+    matrix_to_binary(m2, "bench_ooc_b.mtx");
+    double start = now_seconds();
+    matrix_t* prod = matrix_multiply(m1, m2);
+    double in_memory = now_seconds() - start;
+
+    printf("\nSeconds for a %d x %d product, in memory %.3f\n", n, n,
+           in_memory);
+    printf("%10s %6s %6s %8s %8s %10s %10s\n", "budget MB", "tile", "slots",
+           "loads", "hits", "seconds", "identical");
+    for(b=0; b<3; b++){
+        matrix_ooc_stats_t stats;
+        start = now_seconds();
+        matrix_multiply_binary_mt("bench_ooc_a.mtx", "bench_ooc_b.mtx",
+                                  "bench_ooc_c.mtx", budgets[b], &stats,
+                                  MATRIX_THREADS_DEFAULT);
+        double seconds = now_seconds() - start;
+        matrix_t* result = matrix_map_binary("bench_ooc_c.mtx",
+                                             MATRIX_MAP_READ_ONLY);
+        int identical = 1;
+        for(i=0; i<n && identical; i++){
+            identical = !memcmp(MATRIX_ROW(result, i), MATRIX_ROW(prod, i),
+                                n*sizeof(double));
+        }
+        printf("%10zu %6d %6d %8ld %8ld %10.3f %10s\n", budgets[b] >> 20,
+               stats.tile, stats.cache_tiles, stats.loads, stats.hits,
+               seconds, identical ? "yes" : "NO");
+        fflush(stdout);
+        result->free(result);
+    }
+    remove("bench_ooc_a.mtx");
+    remove("bench_ooc_b.mtx");
+    remove("bench_ooc_c.mtx");
+    m1->free(m1); m2->free(m2); prod->free(prod);
+}
+
+/* Usage: bench [gemm | lu | corr | csv | transpose | missing | gemv |
+ *               strassen | bool | batch | prefix | ooc] [all] */
+int main(int argc, char* argv[])
+{
+    int run_all = 0, run_gemm = 0, run_lu = 0, run_corr = 0, run_csv = 0;
+    int run_transpose = 0, run_missing = 0, run_gemv = 0, run_strassen = 0;
+    int run_bool = 0, run_batch = 0, run_prefix = 0, run_ooc = 0;
+    int i;
+    for(i=1; i<argc; i++){
+        if (!strcmp(argv[i], "all")){
+            run_all = 1;
+        }
+        else if (!strcmp(argv[i], "gemm")){
+            run_gemm = 1;
+        }
+        else if (!strcmp(argv[i], "lu")){
+            run_lu = 1;
+        }
+        else if (!strcmp(argv[i], "corr")){
+            run_corr = 1;
+        }
+        else if (!strcmp(argv[i], "csv")){
+            run_csv = 1;
+        }
+        else if (!strcmp(argv[i], "transpose")){
+            run_transpose = 1;
+        }
+        else if (!strcmp(argv[i], "missing")){
+            run_missing = 1;
+        }
+        else if (!strcmp(argv[i], "gemv")){
+            run_gemv = 1;
+        }
+        else if (!strcmp(argv[i], "strassen")){
+            run_strassen = 1;
+        }
+        else if (!strcmp(argv[i], "bool")){
+            run_bool = 1;
+        }
+        else if (!strcmp(argv[i], "batch")){
+            run_batch = 1;
+        }
+        else if (!strcmp(argv[i], "prefix")){
+            run_prefix = 1;
+        }
+        else if (!strcmp(argv[i], "ooc")){
+            run_ooc = 1;
+        }
+    }
+    if (!run_gemm && !run_lu && !run_corr && !run_csv && !run_transpose
+        && !run_missing && !run_gemv && !run_strassen && !run_bool
+        && !run_batch && !run_prefix && !run_ooc){
+        run_gemm = run_lu = run_corr = run_csv = run_transpose = 1;
+        run_missing = run_gemv = run_strassen = run_bool = run_batch = 1;
+        run_prefix = run_ooc = 1;
+    }
+    srand(1);
+    if (run_gemm){
+        bench_gemm(run_all);
+    }
+    if (run_lu){
+        bench_lu(run_all);
+    }
+    if (run_corr){
+        bench_corr(run_all);
+    }
+    if (run_csv){
+        bench_csv();
+    }
+    if (run_transpose){
+        bench_transpose();
+    }
+    if (run_missing){
+        bench_missing();
+    }
+    if (run_gemv){
+        bench_gemv();
+    }
+    if (run_strassen){
+        bench_strassen(run_all);
+    }
+    if (run_bool){
+        bench_bool(run_all);
+    }
+    if (run_batch){
+        bench_batch();
+    }
+    if (run_prefix){
+        bench_prefix();
+    }
+    if (run_ooc){
+        bench_ooc();
+    }
+    return 0;
+}
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "matrix.h"
+#include "matrix_binary.h"
+#include "matrix_column_index.h"
+#include "matrix_missing.h"
+#include "../Utilities/utils.h"
+
+/* Fills in a header for rows x columns entries after labels_bytes of labels */
+static void binary_init_header(matrix_binary_header_t* h, int rows,
+                               int columns, uint64_t labels_bytes,
+                               uint32_t flags)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, MATRIX_BINARY_MAGIC, sizeof(MATRIX_BINARY_MAGIC));
+    h->version = MATRIX_BINARY_VERSION;
+    h->byte_order = MATRIX_BINARY_BYTE_ORDER;
+    h->num_rows = rows;
+    h->num_columns = columns;
+    h->stride = matrix_stride(columns);
+    h->labels_offset = sizeof(*h);
+    h->labels_bytes = labels_bytes;
+    h->payload_offset = (h->labels_offset + labels_bytes
+                         + MATRIX_BINARY_PAGE-1)
+                        / MATRIX_BINARY_PAGE * MATRIX_BINARY_PAGE;
+    h->flags = flags;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_to_binary
+ *
+ * Arguments: matrix (or view) to be saved
+ *            file name to write to
+ *
+ * Returns: void
+ *           writes a matrix_binary_header_t, the labels and the entries. Rows
+ *           are padded to matrix_stride(num_columns) doubles and the payload
+ *           starts on a MATRIX_BINARY_PAGE boundary, so matrix_map_binary can
+ *           use the file as the matrix storage as is. A validity bitmap is
+ *           written after the labels with its rows starting on a word.
+ */
+void matrix_to_binary(matrix_t* m, char* fname)
+{
+    assert(m != NULL && fname != NULL);
+    FILE* fp = fopen(fname, "wb");
+    assert(unwanted_null(fp));
+    int rows = m->num_rows, columns = m->num_columns;
+    int stride = matrix_stride(columns);
+    int words = (columns + 63)/64;
+    int i, j;
+
+    uint64_t labels_bytes = (uint64_t)rows*sizeof(int32_t);
+    for(i=0; i<columns; i++){
+        labels_bytes += strlen(matrix_column_name(m, i)) + 1;
+    }
+    for(i=0; i<rows; i++){
+        labels_bytes += strlen(matrix_row_label(m, i)) + 1;
+    }
+    if (m->valid != NULL){
+        labels_bytes += (uint64_t)rows*words*sizeof(uint64_t);
+    }
+    matrix_binary_header_t h;
+    binary_init_header(&h, rows, columns, labels_bytes,
+                       (m->column_index_used ? MATRIX_BINARY_COLUMNS_LABELLED
+                                             : 0)
+                       | (m->str_index_used ? MATRIX_BINARY_ROWS_LABELLED : 0)
+                       | (m->valid != NULL ? MATRIX_BINARY_HAS_MISSING : 0));
+    fwrite(&h, sizeof(h), 1, fp);
+
+    for(i=0; i<rows; i++){
+        int32_t index = m->index_int[i];
+        fwrite(&index, sizeof(index), 1, fp);
+    }
+    for(i=0; i<columns; i++){
+        const char* name = matrix_column_name(m, i);
+        fwrite(name, 1, strlen(name) + 1, fp);
+    }
+    for(i=0; i<rows; i++){
+        const char* label = matrix_row_label(m, i);
+        fwrite(label, 1, strlen(label) + 1, fp);
+    }
+    if (m->valid != NULL){
+        uint64_t* row_bits = malloc((words ? words : 1)*sizeof(*row_bits));
+        assert(unwanted_null(row_bits));
+        for(i=0; i<rows; i++){
+            memset(row_bits, 0, words*sizeof(*row_bits));
+            for(j=0; j<columns; j++){
+                size_t bit = MATRIX_VALID_BIT(m, i, j);
+                row_bits[j/64] |= ((m->valid[bit >> 6] >> (bit & 63)) & 1)
+                                  << (j % 64);
+            }
+            fwrite(row_bits, sizeof(*row_bits), words, fp);
+        }
+        free(row_bits);
+    }
+
+    static const char zeros[MATRIX_BINARY_PAGE];
+    fwrite(zeros, 1, h.payload_offset - h.labels_offset - h.labels_bytes, fp);
+    for(i=0; i<rows; i++){
+        fwrite(MATRIX_ROW(m, i), sizeof(double), columns, fp);
+        fwrite(zeros, sizeof(double), stride - columns, fp);
+    }
+    int failed = ferror(fp);
+    failed |= fclose(fp);
+    assert(!failed && "Failed writing matrix binary file");
+    (void)failed;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_binary_create
+ *
+ * Arguments: file name to write to
+ *            rows and columns of the matrix
+ *            where to put the byte offset of the payload
+ *
+ * Returns: the file, open for writing, holding the header and labels of an
+ *           unlabelled rows x columns matrix whose entries are all 0. The
+ *           caller writes row i of the entries at payload offset
+ *           + i*matrix_stride(columns) doubles, in any order, and closes it.
+ *           Used to write a result too big to hold in memory.
+ */
+FILE* matrix_binary_create(char* fname, int rows, int columns,
+                           uint64_t* payload_offset)
+{
+    assert(fname != NULL && rows >= 0 && columns >= 0);
+    FILE* fp = fopen(fname, "wb");
+    assert(unwanted_null(fp));
+    matrix_binary_header_t h;
+    /* Row indexes 0, 1, ... and an empty string per label */
+    binary_init_header(&h, rows, columns,
+                       (uint64_t)rows*sizeof(int32_t) + columns + rows, 0);
+    fwrite(&h, sizeof(h), 1, fp);
+    int32_t i;
+    for(i=0; i<rows; i++){
+        fwrite(&i, sizeof(i), 1, fp);
+    }
+    /* The empty labels and the padding, a page of zeros at a time */
+    static const char zeros[MATRIX_BINARY_PAGE];
+    uint64_t gap = h.payload_offset - h.labels_offset
+                   - (uint64_t)rows*sizeof(int32_t);
+    while (gap > 0){
+        size_t n = (gap < sizeof(zeros)) ? (size_t)gap : sizeof(zeros);
+        fwrite(zeros, 1, n, fp);
+        gap -= n;
+    }
+    /* Writing the last byte gives the file its full size; the gap before
+     * it reads as zeros without being written */
+    uint64_t bytes = (uint64_t)rows*h.stride*sizeof(double);
+    if (bytes > 0){
+        fseek(fp, h.payload_offset + bytes - 1, SEEK_SET);
+        fputc(0, fp);
+    }
+    assert(!ferror(fp) && "Failed writing matrix binary file");
+    *payload_offset = h.payload_offset;
+    return fp;
+}
+//-----------------------------------------------------------------------------
+
+/* Rejects anything but a well formed file of file_bytes bytes from a machine
+ * with the same byte order */
+static void binary_check_header(matrix_binary_header_t* h, uint64_t file_bytes)
+{
+    assert(file_bytes >= sizeof(*h) && "File too short for a matrix binary");
+    assert(!memcmp(h->magic, MATRIX_BINARY_MAGIC, sizeof(MATRIX_BINARY_MAGIC))
+           && "Not a matrix binary file");
+    assert(h->version == MATRIX_BINARY_VERSION
+           && "Matrix binary version not supported");
+    assert(h->byte_order == MATRIX_BINARY_BYTE_ORDER
+           && "Matrix binary written with a different byte order");
+    assert(h->num_rows >= 0 && h->num_rows <= INT32_MAX);
+    assert(h->num_columns >= 0 && h->num_columns <= INT32_MAX);
+    assert(h->stride == matrix_stride((int)h->num_columns));
+    assert(h->labels_offset >= sizeof(*h));
+    assert(h->labels_offset + h->labels_bytes <= h->payload_offset);
+    assert(h->payload_offset % MATRIX_BINARY_PAGE == 0);
+    assert(h->payload_offset + (uint64_t)h->num_rows*h->stride*sizeof(double)
+           <= file_bytes && "Matrix binary file truncated");
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: binary_set_labels
+ *
+ * Arguments: matrix with the dimensions in the header and no labels
+ *            header of the file
+ *            labels section of the file
+ *
+ * Returns: void
+ *           sets the row indexes, row labels and column names from the file.
+ *           The label strings are stored back to back in the file, as in the
+ *           matrix's label arena, so they are copied in one piece and only
+ *           the offsets are computed. Nothing is allocated for labels the
+ *           file does not flag as used. Column names are indexed for lookup.
+ *           A flagged validity bitmap is copied into the matrix, so it is
+ *           writable even when the entries are mapped read only.
+ */
+static void binary_set_labels(matrix_t* m, matrix_binary_header_t* h,
+                              const char* labels)
+{
+    const char* end = labels + h->labels_bytes;
+    const char* strings = labels + (size_t)m->num_rows*sizeof(int32_t);
+    int columns_labelled = (h->flags & MATRIX_BINARY_COLUMNS_LABELLED) != 0;
+    int rows_labelled = (h->flags & MATRIX_BINARY_ROWS_LABELLED) != 0;
+    int i;
+    assert(strings <= end && "Matrix binary labels truncated");
+    for(i=0; i<m->num_rows; i++){
+        int32_t index;
+        memcpy(&index, labels + (size_t)i*sizeof(index), sizeof(index));
+        m->index_int[i] = index;
+    }
+    if (h->flags & MATRIX_BINARY_HAS_MISSING){
+        int words = (m->num_columns + 63)/64;
+        size_t bytes = (size_t)m->num_rows*words*sizeof(*m->valid);
+        assert(bytes <= (size_t)(end - strings)
+               && "Matrix binary labels truncated");
+        end -= bytes;
+        m->valid = malloc(bytes ? bytes : 1);
+        assert(unwanted_null(m->valid));
+        memcpy(m->valid, end, bytes);
+        m->valid_stride = words;
+        m->valid_offset = 0;
+    }
+    m->column_index_used = columns_labelled;
+    m->str_index_used = rows_labelled;
+    if (!columns_labelled && !rows_labelled){
+        return;
+    }
+
+    /* Arena offset 0 is the empty string, so file string s is at 1 + s */
+    matrix_labels_t* l = malloc(sizeof(*l));
+    assert(unwanted_null(l));
+    l->used = l->alloc = 1 + (size_t)(end - strings);
+    l->arena = malloc(l->alloc);
+    assert(unwanted_null(l->arena));
+    l->arena[0] = '\0';
+    memcpy(l->arena + 1, strings, end - strings);
+    m->labels = l;
+    if (columns_labelled){
+        m->column_labels = malloc((m->num_columns ? m->num_columns : 1)
+                                  *sizeof(*m->column_labels));
+        assert(unwanted_null(m->column_labels));
+    }
+    if (rows_labelled){
+        m->row_labels = malloc((m->num_rows ? m->num_rows : 1)
+                               *sizeof(*m->row_labels));
+        assert(unwanted_null(m->row_labels));
+    }
+    const char* p = l->arena + 1;
+    const char* arena_end = l->arena + l->used;
+    for(i=0; i<m->num_columns + m->num_rows; i++){
+        const char* label_end = memchr(p, '\0', arena_end - p);
+        assert(label_end != NULL && "Matrix binary labels truncated");
+        size_t offset = (size_t)(p - l->arena);
+        if (i < m->num_columns && columns_labelled){
+            m->column_labels[i] = offset;
+        }
+        else if (i >= m->num_columns && rows_labelled){
+            m->row_labels[i - m->num_columns] = offset;
+        }
+        p = label_end + 1;
+    }
+    if (columns_labelled){
+        matrix_index_columns(m);
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: binary_to_matrix
+ *
+ * Arguments: file name written by matrix_to_binary
+ *
+ * Returns: a matrix holding its own copy of the file's entries and labels.
+ *           The payload is read with a single fread straight into the
+ *           matrix storage.
+ *
+ * Dependency: create_matrix
+ */
+matrix_t* binary_to_matrix(char* fname)
+{
+    assert(fname != NULL);
+    FILE* fp = fopen(fname, "rb");
+    assert(unwanted_null(fp));
+    long file_bytes = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : 0;
+    rewind(fp);
+
+    matrix_binary_header_t h;
+    memset(&h, 0, sizeof(h));
+    size_t read = fread(&h, sizeof(h), 1, fp);
+    binary_check_header(&h, (read == 1 && file_bytes > 0) ? file_bytes : 0);
+
+    char* labels = malloc(h.labels_bytes ? h.labels_bytes : 1);
+    assert(unwanted_null(labels));
+    fseek(fp, h.labels_offset, SEEK_SET);
+    read = fread(labels, 1, h.labels_bytes, fp);
+    assert(read == h.labels_bytes && "Matrix binary labels truncated");
+
+    matrix_t* m = create_matrix((int)h.num_rows, (int)h.num_columns);
+    binary_set_labels(m, &h, labels);
+    free(labels);
+
+    size_t count = (size_t)h.num_rows*h.stride;
+    assert(m->stride == h.stride);
+    fseek(fp, h.payload_offset, SEEK_SET);
+    read = fread(m->data, sizeof(double), count, fp);
+    assert(read == count && "Matrix binary file truncated");
+    fclose(fp);
+    return m;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_map_binary
+ *
+ * Arguments: file name written by matrix_to_binary
+ *            MATRIX_MAP_READ_ONLY or MATRIX_MAP_COPY_ON_WRITE
+ *
+ * Returns: a matrix whose entries are the mapped file, so nothing is read
+ *           until it is touched. The labels and the validity bitmap are
+ *           copied out of the mapping rather than pointing into it. Read
+ *           only matrices assert on writes through set_entry and friends
+ *           and the bulk writers; copy on write matrices may be modified
+ *           freely and the changes are never written back to the file.
+ *           Freeing the matrix unmaps the file. Without mmap (Windows) the
+ *           file is read with binary_to_matrix.
+ *
+ * Dependency: matrix_from_mapping
+ */
+matrix_t* matrix_map_binary(char* fname, int mode)
+{
+    assert(fname != NULL);
+    assert((mode == MATRIX_MAP_READ_ONLY || mode == MATRIX_MAP_COPY_ON_WRITE)
+           && "Mode not recognised");
+#ifdef _WIN32
+    matrix_t* m = binary_to_matrix(fname);
+    m->read_only = (mode == MATRIX_MAP_READ_ONLY);
+    return m;
+#else
+    int fd = open(fname, O_RDONLY);
+    assert(fd >= 0 && "Could not open matrix binary file");
+    struct stat st;
+    size_t bytes = (fstat(fd, &st) == 0) ? (size_t)st.st_size : 0;
+    assert(bytes >= sizeof(matrix_binary_header_t)
+           && "File too short for a matrix binary");
+    int prot = (mode == MATRIX_MAP_READ_ONLY) ? PROT_READ
+                                              : PROT_READ | PROT_WRITE;
+    int flags = (mode == MATRIX_MAP_READ_ONLY) ? MAP_SHARED : MAP_PRIVATE;
+    char* base = mmap(NULL, bytes, prot, flags, fd, 0);
+    assert(base != MAP_FAILED && "Could not map matrix binary file");
+    close(fd);
+
+    matrix_binary_header_t* h = (matrix_binary_header_t*)base;
+    binary_check_header(h, bytes);
+    matrix_t* m = matrix_from_mapping(base, bytes,
+                                      (double*)(base + h->payload_offset),
+                                      (int)h->num_rows, (int)h->num_columns,
+                                      (int)h->stride,
+                                      mode == MATRIX_MAP_READ_ONLY);
+    binary_set_labels(m, h, base + h->labels_offset);
+    return m;
+#endif
+}
+//-----------------------------------------------------------------------------
+
+/* Releases a mapping made by matrix_map_binary, called by the matrix free */
+void matrix_binary_unmap(void* mapping, size_t bytes)
+{
+#ifndef _WIN32
+    munmap(mapping, bytes);
+#else
+    (void)mapping;
+    (void)bytes;
+#endif
+}
@@ -0,0 +1,52 @@
+#ifndef MATRIX_BINARY_H
+#define MATRIX_BINARY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "matrix.h"
+
+/* File layout, all integers in the writer's byte order:
+ *   matrix_binary_header_t
+ *   labels: int32 row indexes, then num_columns NUL terminated column names,
+ *           then num_rows NUL terminated row labels, then, if flagged, the
+ *           validity bitmap: num_rows rows of (num_columns+63)/64 uint64
+ *           words, bit j of a row set if entry j is present
+ *   padding to payload_offset (a multiple of MATRIX_BINARY_PAGE)
+ *   payload: num_rows rows of stride doubles, so rows stay MATRIX_ALIGNMENT
+ *            aligned when the file is mapped */
+#define MATRIX_BINARY_MAGIC "MATRIXB"
+#define MATRIX_BINARY_VERSION 1
+#define MATRIX_BINARY_BYTE_ORDER 0x01020304u
+#define MATRIX_BINARY_PAGE 4096
+
+/* Header flags */
+#define MATRIX_BINARY_COLUMNS_LABELLED 1u
+#define MATRIX_BINARY_ROWS_LABELLED 2u
+#define MATRIX_BINARY_HAS_MISSING 4u
+
+/* Modes for matrix_map_binary */
+#define MATRIX_MAP_READ_ONLY 0
+#define MATRIX_MAP_COPY_ON_WRITE 1
+
+typedef struct matrix_binary_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int64_t num_rows;
+    int64_t num_columns;
+    int64_t stride;
+    uint64_t labels_offset;
+    uint64_t labels_bytes;
+    uint64_t payload_offset;
+    uint32_t flags;
+    uint32_t reserved;
+} matrix_binary_header_t;
+
+void matrix_to_binary(matrix_t* m, char* fname);
+matrix_t* binary_to_matrix(char* fname);
+matrix_t* matrix_map_binary(char* fname, int mode);
+FILE* matrix_binary_create(char* fname, int rows, int columns,
+                           uint64_t* payload_offset);
+void matrix_binary_unmap(void* mapping, size_t bytes);
+
+#endif // MATRIX_BINARY_H
@@ -0,0 +1,635 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_bool.h"
+#include "matrix_gemm.h"
+#include "matrix_missing.h"
+#include "matrix_simd.h"
+#include "matrix_parallel.h"
+#include "../Utilities/utils.h"
+
+/* Four Russians: each byte of a word of A selects one of the 256 ORs of
+ * the 8 rows of B it covers, so a table per byte turns 64 row ORs into 8 */
+#define BOOLMM_TABLES 8
+#define BOOLMM_TABLE_ENTRIES 256
+
+/* Fewest rows of A worth building a set of tables for */
+#define BOOLMM_MIN_ROWS 256
+
+#ifdef __GNUC__
+typedef uint64_t boolmm_lanes_t __attribute__((vector_size(32)));
+#endif
+
+static void matrixb_add_function_pointers(matrixb_t* m);
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixb_stride
+ *
+ * Arguments: number of columns
+ *
+ * Returns: words between the start of consecutive rows, rounded up so each
+ *          row starts on a MATRIX_ALIGNMENT boundary
+ */
+int matrixb_stride(int columns)
+{
+    int per_line = MATRIX_ALIGNMENT/sizeof(uint64_t);
+    int words = (columns + 63)/64;
+    return ((words + per_line - 1)/per_line)*per_line;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_matrixb
+ *
+ * Arguments: number of rows in the matrix
+ *            number of columns in the matrix
+ *
+ * Returns: a pointer to a boolean matrix of zeros
+ *
+ * Dependency: matrix_aligned_alloc
+ */
+matrixb_t* create_matrixb(int rows, int columns)
+{
+    assert(rows >= 0 && columns >= 0);
+    matrixb_t* m = malloc(sizeof(*m));
+    assert(unwanted_null(m));
+    m->num_rows = rows;
+    m->num_columns = columns;
+    m->stride = matrixb_stride(columns);
+    size_t bytes = (size_t)rows*m->stride*sizeof(*m->words);
+    m->words = matrix_aligned_alloc(bytes ? bytes : MATRIX_ALIGNMENT);
+    memset(m->words, 0, bytes);
+    matrixb_add_function_pointers(m);
+    return m;
+}
+//-----------------------------------------------------------------------------
+
+matrixb_t* create_identity_matrixb(int n)
+{
+    matrixb_t* m = create_matrixb(n, n);
+    int i;
+    for(i=0; i<n; i++){
+        MATRIXB_ROW(m, i)[i >> 6] |= (uint64_t)1 << (i & 63);
+    }
+    return m;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_to_matrixb
+ *
+ * Arguments: double precision matrix (or view)
+ *
+ * Returns: a new boolean matrix, 1 where m has a nonzero entry that is not
+ *          missing, eg the adjacency of a weighted graph
+ */
+matrixb_t* matrix_to_matrixb(matrix_t* m)
+{
+    assert(m != NULL);
+    matrixb_t* ret = create_matrixb(m->num_rows, m->num_columns);
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        const double* src = MATRIX_ROW(m, i);
+        uint64_t* dst = MATRIXB_ROW(ret, i);
+        for(j=0; j<m->num_columns; j++){
+            double x = src[j];
+            if (x != 0.0 && !((m->valid != NULL || x != x)
+                              && matrix_is_missing(m, i, j))){
+                dst[j >> 6] |= (uint64_t)1 << (j & 63);
+            }
+        }
+    }
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixb_to_matrix
+ *
+ * Arguments: boolean matrix
+ *
+ * Returns: a new double precision matrix of 0s and 1s
+ */
+matrix_t* matrixb_to_matrix(matrixb_t* m)
+{
+    assert(m != NULL);
+    matrix_t* ret = create_matrix(m->num_rows, m->num_columns);
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        double* dst = MATRIX_ROW(ret, i);
+        for(j=0; j<m->num_columns; j++){
+            dst[j] = MATRIXB_ENTRY(m, i, j);
+        }
+    }
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/* 1 if the matrices have the same shape and entries; padding is always 0,
+ * so whole rows compare */
+int matrixb_equal(matrixb_t* m1, matrixb_t* m2)
+{
+    assert(m1 != NULL && m2 != NULL);
+    return m1->num_rows == m2->num_rows && m1->num_columns == m2->num_columns
+           && memcmp(m1->words, m2->words, (size_t)m1->num_rows*m1->stride
+                                           *sizeof(*m1->words)) == 0;
+}
+
+/* Set bits in n words, with the popcnt instruction where the CPU has it */
+#define BOOL_POPCOUNT(suffix, attribute)                                      \
+    attribute static long popcount_words_##suffix(const uint64_t* w,          \
+                                                  size_t n)                   \
+    {                                                                         \
+        long count = 0;                                                       \
+        size_t i;                                                             \
+        for(i=0; i<n; i++){                                                   \
+            count += __builtin_popcountll(w[i]);                              \
+        }                                                                     \
+        return count;                                                         \
+    }
+
+BOOL_POPCOUNT(baseline, )
+#ifdef MATRIX_HAVE_X86
+BOOL_POPCOUNT(popcnt, __attribute__((target("popcnt"))))
+#endif
+
+static long popcount_words(const uint64_t* w, size_t n)
+{
+#ifdef MATRIX_HAVE_X86
+    if (__builtin_cpu_supports("popcnt")){
+        return popcount_words_popcnt(w, n);
+    }
+#endif
+    return popcount_words_baseline(w, n);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixb_row_counts
+ *
+ * Arguments: boolean matrix
+ *            counts, num_rows ints
+ *
+ * Returns: void
+ *           counts[i] = number of 1s in row i, eg the out degree of node i,
+ *           or the number of nodes it reaches when m is a reachability
+ *           matrix
+ */
+void matrixb_row_counts(matrixb_t* m, int* counts)
+{
+    assert(m != NULL && (counts != NULL || m->num_rows == 0));
+    int i;
+    for(i=0; i<m->num_rows; i++){
+        counts[i] = (int)popcount_words(MATRIXB_ROW(m, i), m->stride);
+    }
+}
+//-----------------------------------------------------------------------------
+
+static long matrixb_count(matrixb_t* m)
+{
+    assert(m != NULL);
+    return popcount_words(m->words, (size_t)m->num_rows*m->stride);
+}
+
+typedef struct boolmm_args{
+    int m;
+    int k;
+    const uint64_t* A;
+    int lda;
+    const uint64_t* B;
+    int ldb;
+    uint64_t* C;
+    int ldc;
+    int column_blocks;      // MATRIXB_BLOCK_WORDS words of C each
+    int row_chunks;
+} boolmm_args_t;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: boolmm_build_tables
+ *
+ * Arguments: boolmm_args_t
+ *            word of A's rows (rows 64*kw to 64*kw + 63 of B)
+ *            first word of the column block
+ *            bytes of A's word that occur, table t built only if bit t set
+ *            tables, BOOLMM_TABLES x 256 entries of MATRIXB_BLOCK_WORDS
+ *
+ * Returns: void
+ *           entry s of table t is the OR of the rows 64*kw + 8*t + b of B
+ *           for each bit b set in s, over the column block. Each bit doubles
+ *           the filled part of the table, so an entry costs one OR.
+ */
+static void boolmm_build_tables(const boolmm_args_t* g, int kw, int word0,
+                                unsigned tables_used, uint64_t* tables)
+{
+    int t, b, s, w;
+    for(t=0; t<BOOLMM_TABLES; t++){
+        if (!(tables_used & (1u << t))){
+            continue;
+        }
+        uint64_t* table = tables
+                          + (size_t)t*BOOLMM_TABLE_ENTRIES*MATRIXB_BLOCK_WORDS;
+        memset(table, 0, MATRIXB_BLOCK_WORDS*sizeof(*table));
+        for(b=0; b<8; b++){
+            int row = 64*kw + 8*t + b;
+            int half = 1 << b;
+            const uint64_t* src = (row < g->k)
+                                  ? g->B + (size_t)row*g->ldb + word0 : NULL;
+            for(s=0; s<half; s++){
+                const uint64_t* low = table + (size_t)s*MATRIXB_BLOCK_WORDS;
+                uint64_t* high = table + (size_t)(half + s)*MATRIXB_BLOCK_WORDS;
+                for(w=0; w<MATRIXB_BLOCK_WORDS; w++){
+                    high[w] = src ? (low[w] | src[w]) : low[w];
+                }
+            }
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: boolmm_blocks
+ *
+ * Arguments: boolmm_args_t
+ *            first task
+ *            one past the last task
+ *
+ * Returns: void
+ *           each task is one column block of C over one chunk of rows. For
+ *           each word of A's rows the tables are built from the 64 rows of
+ *           B it covers, then every row of the chunk ORs in one entry per
+ *           nonzero byte of its word. Words of A that are zero over the whole
+ *           chunk, common in sparse graphs, are skipped with their tables.
+ *           Always inlined into the kernels below.
+ */
+MATRIX_SIMD_INLINE void boolmm_blocks(boolmm_args_t* g, int begin, int end)
+{
+    uint64_t* tables = matrix_aligned_alloc((size_t)BOOLMM_TABLES
+                                            *BOOLMM_TABLE_ENTRIES
+                                            *MATRIXB_BLOCK_WORDS
+                                            *sizeof(*tables));
+    int k_words = (g->k + 63)/64;
+    int task, i, kw, t;
+    for(task=begin; task<end; task++){
+        int chunk = task/g->column_blocks;
+        int word0 = (task % g->column_blocks)*MATRIXB_BLOCK_WORDS;
+        int r0 = (int)((long)g->m*chunk/g->row_chunks);
+        int r1 = (int)((long)g->m*(chunk + 1)/g->row_chunks);
+        for(i=r0; i<r1; i++){
+            memset(g->C + (size_t)i*g->ldc + word0, 0,
+                   MATRIXB_BLOCK_WORDS*sizeof(*g->C));
+        }
+        for(kw=0; kw<k_words; kw++){
+            uint64_t used = 0;
+            for(i=r0; i<r1; i++){
+                used |= g->A[(size_t)i*g->lda + kw];
+            }
+            if (used == 0){
+                continue;
+            }
+            unsigned tables_used = 0;
+            for(t=0; t<BOOLMM_TABLES; t++){
+                tables_used |= ((used >> 8*t) & 0xff) ? 1u << t : 0;
+            }
+            boolmm_build_tables(g, kw, word0, tables_used, tables);
+            for(i=r0; i<r1; i++){
+                uint64_t a = g->A[(size_t)i*g->lda + kw];
+                if (a == 0){
+                    continue;
+                }
+                uint64_t* c = g->C + (size_t)i*g->ldc + word0;
+#ifdef __GNUC__
+                boolmm_lanes_t c0 = MATRIX_SIMD_LOAD(boolmm_lanes_t, c);
+                boolmm_lanes_t c1 = MATRIX_SIMD_LOAD(boolmm_lanes_t, c + 4);
+                for(t=0; t<BOOLMM_TABLES; t++, a >>= 8){
+                    const uint64_t* e = tables
+                        + ((size_t)t*BOOLMM_TABLE_ENTRIES + (a & 0xff))
+                          *MATRIXB_BLOCK_WORDS;
+                    c0 |= MATRIX_SIMD_LOAD(boolmm_lanes_t, e);
+                    c1 |= MATRIX_SIMD_LOAD(boolmm_lanes_t, e + 4);
+                }
+                MATRIX_SIMD_STORE(c, c0);
+                MATRIX_SIMD_STORE(c + 4, c1);
+#else
+                int w;
+                for(t=0; t<BOOLMM_TABLES; t++, a >>= 8){
+                    const uint64_t* e = tables
+                        + ((size_t)t*BOOLMM_TABLE_ENTRIES + (a & 0xff))
+                          *MATRIXB_BLOCK_WORDS;
+                    for(w=0; w<MATRIXB_BLOCK_WORDS; w++){
+                        c[w] |= e[w];
+                    }
+                }
+#endif
+            }
+        }
+    }
+    matrix_aligned_free(tables);
+}
+//-----------------------------------------------------------------------------
+
+#define BOOLMM_KERNELS(suffix, attribute)                                     \
+    attribute static void boolmm_blocks_##suffix(void* arg, int begin,        \
+                                                 int end)                     \
+    {                                                                         \
+        boolmm_blocks(arg, begin, end);                                       \
+    }
+
+BOOLMM_KERNELS(baseline, )
+#ifdef MATRIX_HAVE_X86
+BOOLMM_KERNELS(avx2, __attribute__((target("avx2"))))
+#endif
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixb_product_mt
+ *
+ * Arguments: number of rows of A and C
+ *            number of columns of B and C
+ *            number of columns of A and rows of B
+ *            A, lda words between the starts of its rows, 0 past column k
+ *            B, ldb words between the starts of its rows, 0 past column n
+ *            C, ldc words between the starts of its rows, not overlapping
+ *             A or B; ldb and ldc multiples of MATRIXB_BLOCK_WORDS (as
+ *             matrixb_stride gives)
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           C = A B over the boolean semiring by the Method of Four
+ *           Russians, about m*n*k/512 word ORs for dense A. Threads take
+ *           column blocks of C, and chunks of rows when there are fewer
+ *           blocks than threads. The AVX2 kernel is used whenever the gemm
+ *           SIMD kernels are (matrix_gemm_simd_enabled).
+ */
+void matrixb_product_mt(int m, int n, int k, const uint64_t* A, int lda,
+                        const uint64_t* B, int ldb, uint64_t* C, int ldc,
+                        int num_threads)
+{
+    assert(m >= 0 && n >= 0 && k >= 0);
+    assert(lda*64 >= k && ldb*64 >= n && ldc*64 >= n);
+    assert(ldb % MATRIXB_BLOCK_WORDS == 0 && ldc % MATRIXB_BLOCK_WORDS == 0);
+    int column_blocks = (n + 64*MATRIXB_BLOCK_WORDS - 1)
+                        /(64*MATRIXB_BLOCK_WORDS);
+    if (m == 0 || column_blocks == 0){
+        return;
+    }
+    int threads = matrix_threads_for_work(num_threads,
+                                          (double)m*column_blocks*k/8);
+    int row_chunks = 1;
+    if (threads > column_blocks){
+        row_chunks = (threads + column_blocks - 1)/column_blocks;
+        int most = (m + BOOLMM_MIN_ROWS - 1)/BOOLMM_MIN_ROWS;
+        row_chunks = (row_chunks < most) ? row_chunks : most;
+    }
+    boolmm_args_t g = {m, k, A, lda, B, ldb, C, ldc, column_blocks,
+                       row_chunks};
+    parallel_task_t task = &boolmm_blocks_baseline;
+#ifdef MATRIX_HAVE_X86
+    if (matrix_gemm_simd_enabled()){
+        task = &boolmm_blocks_avx2;
+    }
+#endif
+    matrix_parallel_for(column_blocks*row_chunks, threads, task, &g);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixb_multiply
+ *
+ * Arguments: boolean matrix 1
+ *            boolean matrix 2
+ *
+ * Returns: a new boolean matrix m1 m2, entry (i, j) 1 if some k has both
+ *          m1_ik and m2_kj; NULL if the dimensions are not compatible
+ *
+ * Dependency: matrixb_multiply_mt
+ */
+matrixb_t* matrixb_multiply(matrixb_t* m1, matrixb_t* m2)
+{
+    return matrixb_multiply_mt(m1, m2, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+matrixb_t* matrixb_multiply_mt(matrixb_t* m1, matrixb_t* m2, int num_threads)
+{
+    assert(m1 != NULL && m2 != NULL);
+    if (m1->num_columns != m2->num_rows){
+        return NULL;
+    }
+    matrixb_t* ret = create_matrixb(m1->num_rows, m2->num_columns);
+    matrixb_product_mt(m1->num_rows, m2->num_columns, m1->num_columns,
+                       m1->words, m1->stride, m2->words, m2->stride,
+                       ret->words, ret->stride, num_threads);
+    return ret;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixb_pow_mt
+ *
+ * Arguments: square boolean matrix
+ *            exponent (0 gives the identity)
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: a new boolean matrix m^exponent: for an adjacency matrix, entry
+ *          (i, j) is 1 if there is a walk of exactly exponent edges from i
+ *          to j. Repeated squaring, as matrix_pow_into, with the products
+ *          ping-ponging between three buffers.
+ *
+ * Dependency: matrixb_product_mt
+ */
+matrixb_t* matrixb_pow_mt(matrixb_t* m, int exponent, int num_threads)
+{
+    assert(m != NULL);
+    assert(exponent >= 0 && "Exponent must be non-negative");
+    assert(m->num_rows == m->num_columns
+           && "Can only take powers of square matrices");
+    int n = m->num_rows;
+    if (exponent == 0){
+        return create_identity_matrixb(n);
+    }
+    matrixb_t* base = m->copy(m);
+    matrixb_t* spare = create_matrixb(n, n);
+    matrixb_t* acc = NULL;      // set by the lowest bit of the exponent
+    matrixb_t* temp;
+    while (1){
+        if (exponent & 1){
+            if (acc == NULL){
+                acc = base->copy(base);
+            }
+            else{
+                matrixb_product_mt(n, n, n, acc->words, acc->stride,
+                                   base->words, base->stride, spare->words,
+                                   spare->stride, num_threads);
+                temp = acc;
+                acc = spare;
+                spare = temp;
+            }
+        }
+        exponent >>= 1;
+        if (exponent == 0){
+            break;
+        }
+        matrixb_product_mt(n, n, n, base->words, base->stride, base->words,
+                           base->stride, spare->words, spare->stride,
+                           num_threads);
+        temp = base;
+        base = spare;
+        spare = temp;
+    }
+    base->free(base);
+    spare->free(spare);
+    return acc;
+}
+//-----------------------------------------------------------------------------
+
+matrixb_t* matrixb_pow(matrixb_t* m, int exponent)
+{
+    return matrixb_pow_mt(m, exponent, MATRIX_THREADS_DEFAULT);
+}
+
+/* m with every diagonal entry set: a walk may stay put for a step */
+static matrixb_t* matrixb_with_loops(matrixb_t* m)
+{
+    matrixb_t* ret = m->copy(m);
+    int i;
+    for(i=0; i<m->num_rows; i++){
+        MATRIXB_ROW(ret, i)[i >> 6] |= (uint64_t)1 << (i & 63);
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixb_reachable_within_mt
+ *
+ * Arguments: square boolean (adjacency) matrix
+ *            number of hops
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: a new boolean matrix, entry (i, j) 1 if j can be reached from i
+ *          in at most hops edges (i reaches itself in 0), as (I + m)^hops
+ *
+ * Dependency: matrixb_pow_mt
+ */
+matrixb_t* matrixb_reachable_within_mt(matrixb_t* m, int hops,
+                                       int num_threads)
+{
+    assert(m != NULL && m->num_rows == m->num_columns);
+    matrixb_t* loops = matrixb_with_loops(m);
+    matrixb_t* ret = matrixb_pow_mt(loops, hops, num_threads);
+    loops->free(loops);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+matrixb_t* matrixb_reachable_within(matrixb_t* m, int hops)
+{
+    return matrixb_reachable_within_mt(m, hops, MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixb_transitive_closure_mt
+ *
+ * Arguments: square boolean (adjacency) matrix
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: a new boolean matrix, entry (i, j) 1 if there is a walk of one or
+ *          more edges from i to j. R = I + m is squared until it stops
+ *          changing, which takes about log2 of the graph's diameter
+ *          products and never more than log2(n) + 1; the closure is then
+ *          m R.
+ *
+ * Dependency: matrixb_product_mt
+ */
+matrixb_t* matrixb_transitive_closure_mt(matrixb_t* m, int num_threads)
+{
+    assert(m != NULL && m->num_rows == m->num_columns
+           && "Closure needs a square matrix");
+    int n = m->num_rows;
+    matrixb_t* reach = matrixb_with_loops(m);
+    matrixb_t* spare = create_matrixb(n, n);
+    while (1){
+        matrixb_product_mt(n, n, n, reach->words, reach->stride,
+                           reach->words, reach->stride, spare->words,
+                           spare->stride, num_threads);
+        if (matrixb_equal(spare, reach)){
+            break;
+        }
+        matrixb_t* temp = reach;
+        reach = spare;
+        spare = temp;
+    }
+    matrixb_product_mt(n, n, n, m->words, m->stride, reach->words,
+                       reach->stride, spare->words, spare->stride,
+                       num_threads);
+    reach->free(reach);
+    return spare;
+}
+//-----------------------------------------------------------------------------
+
+matrixb_t* matrixb_transitive_closure(matrixb_t* m)
+{
+    return matrixb_transitive_closure_mt(m, MATRIX_THREADS_DEFAULT);
+}
+
+static int get_matrixb_entry(matrixb_t* m, int i, int j)
+{
+    assert(m != NULL);
+    assert(i >= 0 && i < m->num_rows && j >= 0 && j < m->num_columns);
+    return MATRIXB_ENTRY(m, i, j);
+}
+
+static void set_matrixb_entry(matrixb_t* m, int i, int j, int entry)
+{
+    assert(m != NULL);
+    assert(i >= 0 && i < m->num_rows && j >= 0 && j < m->num_columns);
+    uint64_t bit = (uint64_t)1 << (j & 63);
+    uint64_t* word = &MATRIXB_ROW(m, i)[j >> 6];
+    *word = entry ? (*word | bit) : (*word & ~bit);
+}
+
+static void print_matrixb(matrixb_t* m)
+{
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        for(j=0; j<m->num_columns; j++){
+            printf("%d ", MATRIXB_ENTRY(m, i, j));
+        }
+        printf("\n");
+    }
+}
+
+static matrixb_t* clone_matrixb(matrixb_t* m)
+{
+    assert(m != NULL);
+    matrixb_t* ret = create_matrixb(m->num_rows, m->num_columns);
+    memcpy(ret->words, m->words,
+           (size_t)m->num_rows*m->stride*sizeof(*m->words));
+    return ret;
+}
+
+static void destroy_matrixb(matrixb_t* m)
+{
+    assert(m != NULL);
+    matrix_aligned_free(m->words);
+    free(m);
+}
+
+static void matrixb_add_function_pointers(matrixb_t* m)
+{
+    m->print = &print_matrixb;
+    m->get_entry = &get_matrixb_entry;
+    m->set_entry = &set_matrixb_entry;
+    m->copy = &clone_matrixb;
+    m->count = &matrixb_count;
+    m->free = &destroy_matrixb;
+}
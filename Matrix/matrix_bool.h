@@ -0,0 +1,60 @@
+#ifndef MATRIX_BOOL_H
+#define MATRIX_BOOL_H
+
+#include <stdint.h>
+#include "matrix.h"
+
+/* Columns of the product per task: 8 words, so a row's slice of C is one
+ * cache line and two 256 bit registers */
+#define MATRIXB_BLOCK_WORDS 8
+
+#define MATRIXB_ROW(m, i) ((m)->words + (size_t)(i)*(m)->stride)
+#define MATRIXB_ENTRY(m, i, j)                                                \
+    ((int)((MATRIXB_ROW(m, i)[(j) >> 6] >> ((j) & 63)) & 1))
+
+/* Boolean matrix, one bit per entry: entry (i, j) is bit j%64 of word j/64
+ * of row i. Rows are padded to a whole number of cache lines and the bits
+ * past the last column are always 0, which the product relies on. An
+ * adjacency matrix takes 1/64 of the memory of its matrix_t form. */
+typedef struct matrixb matrixb_t;
+
+struct matrixb{
+    uint64_t* words;        // row-major, one aligned block
+    int stride;             // words between the start of consecutive rows
+    int num_rows;
+    int num_columns;
+
+    void (*print)(matrixb_t* m);
+    int (*get_entry)(matrixb_t* m, int row, int col);
+    void (*set_entry)(matrixb_t* m, int row, int col, int entry);
+    matrixb_t* (*copy)(matrixb_t* m);
+    long (*count)(matrixb_t* m);
+    void (*free)(matrixb_t* m);
+};
+
+matrixb_t* create_matrixb(int rows, int columns);
+matrixb_t* create_identity_matrixb(int n);
+int matrixb_stride(int columns);
+
+/* Nonzero entries become 1; missing entries become 0 */
+matrixb_t* matrix_to_matrixb(matrix_t* m);
+matrix_t* matrixb_to_matrix(matrixb_t* m);
+
+int matrixb_equal(matrixb_t* m1, matrixb_t* m2);
+void matrixb_row_counts(matrixb_t* m, int* counts);
+
+/* Products over the boolean semiring: (m1 m2)_ij = OR_k (m1_ik AND m2_kj) */
+void matrixb_product_mt(int m, int n, int k, const uint64_t* A, int lda,
+                        const uint64_t* B, int ldb, uint64_t* C, int ldc,
+                        int num_threads);
+matrixb_t* matrixb_multiply(matrixb_t* m1, matrixb_t* m2);
+matrixb_t* matrixb_multiply_mt(matrixb_t* m1, matrixb_t* m2, int num_threads);
+matrixb_t* matrixb_pow(matrixb_t* m, int exponent);
+matrixb_t* matrixb_pow_mt(matrixb_t* m, int exponent, int num_threads);
+matrixb_t* matrixb_reachable_within(matrixb_t* m, int hops);
+matrixb_t* matrixb_reachable_within_mt(matrixb_t* m, int hops,
+                                       int num_threads);
+matrixb_t* matrixb_transitive_closure(matrixb_t* m);
+matrixb_t* matrixb_transitive_closure_mt(matrixb_t* m, int num_threads);
+
+#endif // MATRIX_BOOL_H
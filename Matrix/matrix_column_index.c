@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_column_index.h"
+#include "../Utilities/utils.h"
+
+/* The index is an open addressing table of column numbers, at most half
+ * full, probed linearly. The names themselves stay in the label arena, so
+ * the table holds no pointers and survives the arena growing. */
+
+/* FNV-1a */
+static uint32_t column_hash_string(const char* s)
+{
+    uint32_t hash = 2166136261u;
+    for(; *s; s++){
+        hash = (hash ^ (unsigned char)*s)*16777619u;
+    }
+    return hash;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: column_hash_slot
+ *
+ * Arguments: matrix with a built index
+ *            column name
+ *            set to 1 if the name is in the index, otherwise 0
+ *
+ * Returns: the slot holding the name, or the empty slot where it would go
+ */
+static int column_hash_slot(matrix_t* m, const char* name, int* found)
+{
+    int mask = m->column_hash_slots - 1;
+    int slot = (int)(column_hash_string(name) & (uint32_t)mask);
+    while (m->column_hash[slot] != COLUMN_HASH_EMPTY){
+        if (!strcmp(matrix_column_name(m, m->column_hash[slot]), name)){
+            *found = 1;
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    *found = 0;
+    return slot;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_index_columns
+ *
+ * Arguments: matrix (or view)
+ *
+ * Returns: void
+ *           (re)builds the hash from column name to column number. Unnamed
+ *           columns are left out and a repeated name maps to its first
+ *           column, as a linear search would find. csv_to_matrix and the
+ *           binary readers call this once the names are loaded; otherwise
+ *           the first lookup builds it, so call it (or do a lookup) before
+ *           sharing the matrix between threads.
+ */
+void matrix_index_columns(matrix_t* m)
+{
+    assert(m != NULL);
+    int slots = 8;
+    while (slots < 2*m->num_columns){
+        slots *= 2;
+    }
+    free(m->column_hash);
+    m->column_hash = malloc(slots*sizeof(*m->column_hash));
+    assert(unwanted_null(m->column_hash));
+    m->column_hash_slots = slots;
+    int i;
+    for(i=0; i<slots; i++){
+        m->column_hash[i] = COLUMN_HASH_EMPTY;
+    }
+    for(i=0; i<m->num_columns; i++){
+        const char* name = matrix_column_name(m, i);
+        int found;
+        if (name[0] == '\0'){
+            continue;
+        }
+        int slot = column_hash_slot(m, name, &found);
+        if (!found){
+            m->column_hash[slot] = i;
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_column_index
+ *
+ * Arguments: matrix (or view)
+ *            column name
+ *
+ * Returns: the first column with that name, or -1 if there is none
+ *
+ * Dependency: matrix_index_columns
+ */
+int matrix_column_index(matrix_t* m, const char* name)
+{
+    assert(m != NULL && name != NULL);
+    if (m->column_labels == NULL || name[0] == '\0'){
+        return -1;
+    }
+    if (m->column_hash == NULL){
+        matrix_index_columns(m);
+    }
+    int found;
+    int slot = column_hash_slot(m, name, &found);
+    return found ? m->column_hash[slot] : -1;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_column_indices
+ *
+ * Arguments: matrix (or view)
+ *            array of column names
+ *            number of names
+ *            array of n ints for the result
+ *
+ * Returns: the number of names found
+ *           indices[i] is the column of names[i], or -1 if there is none.
+ *           Resolve the names once and then read entries by number, eg
+ *           with MATRIX_ENTRY, rather than looking names up per row.
+ *
+ * Dependency: matrix_column_index
+ */
+int matrix_column_indices(matrix_t* m, char** names, int n, int* indices)
+{
+    assert(m != NULL && n >= 0 && (n == 0 || (names != NULL
+                                              && indices != NULL)));
+    int i, found = 0;
+    for(i=0; i<n; i++){
+        indices[i] = matrix_column_index(m, names[i]);
+        found += (indices[i] >= 0);
+    }
+    return found;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_column_index_renamed
+ *
+ * Arguments: matrix whose column col has just been (re)named
+ *            column number
+ *            1 if the column had no name before
+ *
+ * Returns: void
+ *           keeps a built index in step with matrix_set_column_name. Naming
+ *           an unnamed column is one insertion, which cannot overfill the
+ *           table since each column is inserted at most once. Renaming a
+ *           named column drops the index, to be rebuilt on the next lookup.
+ */
+void matrix_column_index_renamed(matrix_t* m, int col, int was_unnamed)
+{
+    assert(m != NULL && col >= 0 && col < m->num_columns);
+    if (m->column_hash == NULL){
+        return;
+    }
+    const char* name = matrix_column_name(m, col);
+    if (was_unnamed && name[0] == '\0'){
+        return;
+    }
+    int found, slot = 0;
+    if (was_unnamed){
+        slot = column_hash_slot(m, name, &found);
+        if (!found){
+            m->column_hash[slot] = col;
+            return;
+        }
+        if (m->column_hash[slot] < col){
+            /* An earlier column has the name and stays first */
+            return;
+        }
+    }
+    free(m->column_hash);
+    m->column_hash = NULL;
+    m->column_hash_slots = 0;
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,13 @@
+#ifndef MATRIX_COLUMN_INDEX_H
+#define MATRIX_COLUMN_INDEX_H
+
+#include "matrix.h"
+
+#define COLUMN_HASH_EMPTY -1
+
+void matrix_index_columns(matrix_t* m);
+int matrix_column_index(matrix_t* m, const char* name);
+int matrix_column_indices(matrix_t* m, char** names, int n, int* indices);
+void matrix_column_index_renamed(matrix_t* m, int col, int was_unnamed);
+
+#endif // MATRIX_COLUMN_INDEX_H
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_corr.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "../Vector/vector.h"
+#include "../Utilities/utils.h"
+
+#define CORR_COVARIANCE 0
+#define CORR_CORRELATION 1
+
+typedef struct standardise_args{
+    matrix_t* m;
+    double* x;          // centred (and for correlation, scaled) copy of m
+    int stride;
+    double* norms;      // Euclidean norm of each centred row
+    int scale;
+} standardise_args_t;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: standardise_task
+ *
+ * Arguments: standardise_args_t
+ *            first row
+ *            one past the last row
+ *
+ * Returns: void
+ *           writes rows [begin, end) of m into x less their mean, and if
+ *           asked divides each by its norm so that X*X^T is the correlation
+ */
+static void standardise_task(void* arg, int begin, int end)
+{
+    standardise_args_t* s = arg;
+    int d = s->m->num_columns;
+    int i, j;
+    for(i=begin; i<end; i++){
+        double* src = MATRIX_ROW(s->m, i);
+        double* dst = s->x + (size_t)i*s->stride;
+        double mean = 0.0, sum_squares = 0.0;
+        for(j=0; j<d; j++){
+            mean += src[j];
+        }
+        mean /= d;
+        for(j=0; j<d; j++){
+            dst[j] = src[j] - mean;
+            sum_squares += dst[j]*dst[j];
+        }
+        s->norms[i] = sqrt(sum_squares);
+        if (s->scale && s->norms[i] > 0.0){
+            double inverse = 1.0/s->norms[i];
+            for(j=0; j<d; j++){
+                dst[j] *= inverse;
+            }
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/* Result rows and columns are the variables (rows) of m, so both take m's
+ * row labels */
+static matrix_t* corr_create_result(matrix_t* m)
+{
+    int n = m->num_rows;
+    matrix_t* ret = create_matrix(n, n);
+    int i;
+    memcpy(ret->index_int, m->index_int, n*sizeof(*m->index_int));
+    if (m->str_index_used){
+        for(i=0; i<n; i++){
+            matrix_set_row_label(ret, i, matrix_row_label(m, i));
+            matrix_set_column_name(ret, i, matrix_row_label(m, i));
+        }
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: corr_engine
+ *
+ * Arguments: matrix whose rows are the variables and columns the observations
+ *            SAMPLE or POPULATION
+ *            CORR_COVARIANCE or CORR_CORRELATION
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: pointer to the num_rows x num_rows covariance or correlation matrix
+ *           Every row is centred (and for correlation scaled to unit norm)
+ *           once, then the upper triangle of X*X^T is formed by one GEMM per
+ *           CORR_BLOCK rows and mirrored into the lower triangle.
+ *
+ * Dependency: matrix_gemm_mt
+ *             matrix_parallel_for
+ */
+static matrix_t* corr_engine(matrix_t* m, int mode, int kind, int num_threads)
+{
+    assert(m != NULL);
+    assert((mode == SAMPLE || mode == POPULATION) && "Mode not recognised");
+    int n = m->num_rows, d = m->num_columns;
+    matrix_t* ret = corr_create_result(m);
+    int i, j;
+    if (n == 0){
+        return ret;
+    }
+    if (d <= (mode == SAMPLE)){
+        /* Too few observations for a spread, as in vector_covariance */
+        for(i=0; i<n && kind == CORR_CORRELATION; i++){
+            MATRIX_ENTRY(ret, i, i) = 1.0;
+        }
+        return ret;
+    }
+
+    int stride = matrix_stride(d);
+    double* x = matrix_aligned_alloc((size_t)n*stride*sizeof(*x));
+    double* norms = malloc(n*sizeof(*norms));
+    assert(unwanted_null(norms));
+    standardise_args_t s = {m, x, stride, norms, kind == CORR_CORRELATION};
+    matrix_parallel_for(n, matrix_threads_for_work(num_threads,
+                                                   (double)n*d),
+                        &standardise_task, &s);
+
+    double alpha = (kind == CORR_CORRELATION)
+                   ? 1.0 : 1.0/((mode == SAMPLE) ? d-1 : d);
+    int row;
+    for(row=0; row<n; row+=CORR_BLOCK){
+        int rows = (n - row < CORR_BLOCK) ? n - row : CORR_BLOCK;
+        /* Block of rows [row, row+rows) against rows [row, n), B = X^T */
+        matrix_gemm_mt(rows, n-row, d, alpha,
+                       x + (size_t)row*stride, stride, 1,
+                       x + (size_t)row*stride, 1, stride,
+                       0.0, MATRIX_ROW(ret, row) + row, ret->stride,
+                       num_threads);
+    }
+    for(i=0; i<n && kind == CORR_CORRELATION; i++){
+        /* A constant row was left unscaled, so its entries are already 0,
+         * the value vector_correlation gives */
+        MATRIX_ENTRY(ret, i, i) = 1.0;
+    }
+    for(i=0; i<n; i++){
+        for(j=i+1; j<n; j++){
+            MATRIX_ENTRY(ret, j, i) = MATRIX_ENTRY(ret, i, j);
+        }
+    }
+    matrix_aligned_free(x);
+    free(norms);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_covariance
+ *
+ * Arguments: matrix whose rows are variables and columns observations
+ *            mode of calculation: SAMPLE or POPULATION
+ *
+ * Returns: pointer to the symmetric num_rows x num_rows matrix whose ij entry
+ *          is vector_covariance of rows i and j
+ *
+ * Dependency: matrix_covariance_mt
+ */
+matrix_t* matrix_covariance(matrix_t* m, int mode)
+{
+    return matrix_covariance_mt(m, mode, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+matrix_t* matrix_covariance_mt(matrix_t* m, int mode, int num_threads)
+{
+    return corr_engine(m, mode, CORR_COVARIANCE, num_threads);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_correlation
+ *
+ * Arguments: matrix whose rows are variables and columns observations
+ *            mode of calculation: SAMPLE or POPULATION
+ *
+ * Returns: pointer to the symmetric num_rows x num_rows matrix of Pearson
+ *          correlation coefficients between rows, with a unit diagonal.
+ *          Entries involving a constant row are 0.
+ *
+ * Dependency: matrix_correlation_mt
+ */
+matrix_t* matrix_correlation(matrix_t* m, int mode)
+{
+    return matrix_correlation_mt(m, mode, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+matrix_t* matrix_correlation_mt(matrix_t* m, int mode, int num_threads)
+{
+    return corr_engine(m, mode, CORR_CORRELATION, num_threads);
+}
@@ -0,0 +1,14 @@
+#ifndef MATRIX_CORR_H
+#define MATRIX_CORR_H
+
+#include "matrix.h"
+
+/* Rows of the result computed per GEMM call when forming X*X^T */
+#define CORR_BLOCK 256
+
+matrix_t* matrix_covariance(matrix_t* m, int mode);
+matrix_t* matrix_covariance_mt(matrix_t* m, int mode, int num_threads);
+matrix_t* matrix_correlation(matrix_t* m, int mode);
+matrix_t* matrix_correlation_mt(matrix_t* m, int mode, int num_threads);
+
+#endif // MATRIX_CORR_H
@@ -0,0 +1,890 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <assert.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "matrix_csv.h"
+#include "matrix_column_index.h"
+#include "matrix_missing.h"
+#include "../Utilities/utils.h"
+
+/* Parser state for one csv_to_matrix call */
+typedef struct csv_reader{
+    unsigned char is_delim[256];
+    char* miss_val;
+    int columns_labelled;
+    int rows_labelled;
+    int row_hint;
+
+    char* field;            // current field, NUL terminated when emitted
+    int field_len;
+    int field_alloc;
+    int line_fields;        // fields seen on the current line
+    int entry;              // values seen on the current line
+    int in_header;
+
+    long file_size;         // -1 if unknown
+    long position;          // bytes consumed so far
+    long line_start;
+
+    double* data;           // matrix storage once the width is known
+    int stride;
+    int num_rows;
+    int alloc_rows;
+    int num_columns;        // -1 until the first data line ends
+    double* first_row;
+    int first_alloc;
+
+    matrix_labels_t* arena; // row labels and column names, NULL if neither
+    size_t* labels;         // row label offsets, if rows are labelled
+    int labels_alloc;
+    size_t* names;          // column name offsets, if columns are labelled
+    int num_names;
+    int names_alloc;
+
+    int missing_mode;       // matrix_get_missing_mode() when reading began
+    int* missing;           // (row, column) pairs flagged in the bitmap
+    int num_missing;
+    int missing_alloc;
+} csv_reader_t;
+
+/* Powers of ten that are exact doubles */
+static const double csv_exact_powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_parse_double
+ *
+ * Arguments: NUL terminated field
+ *            length of the field
+ *
+ * Returns: the field as a double
+ *           Plain decimals with at most 19 significant digits whose value is
+ *           m*10^e with m < 2^53 and |e| <= 22 are converted with one
+ *           correctly rounded multiply or divide (both operands are exact).
+ *           Everything else, including leading or trailing spaces, is
+ *           handed to strtod, so results always match strtod.
+ */
+static double csv_parse_double(char* s, int len)
+{
+    char* p = s;
+    char* end = s + len;
+    int negative = 0, digits = 0, significant = 0, exponent = 0;
+    uint64_t mantissa = 0;
+
+    if (p < end && (*p == '-' || *p == '+')){
+        negative = (*p++ == '-');
+    }
+    for(; p < end && *p >= '0' && *p <= '9'; p++, digits++){
+        mantissa = mantissa*10 + (*p - '0');
+        significant += (mantissa != 0);
+    }
+    if (p < end && *p == '.'){
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, digits++){
+            mantissa = mantissa*10 + (*p - '0');
+            significant += (mantissa != 0);
+            exponent--;
+        }
+    }
+    if (digits > 0 && p < end && (*p == 'e' || *p == 'E')){
+        char* q = p+1;
+        int exp_negative = 0, exp_value = 0;
+        if (q < end && (*q == '-' || *q == '+')){
+            exp_negative = (*q++ == '-');
+        }
+        if (q < end && *q >= '0' && *q <= '9'){
+            for(; q < end && *q >= '0' && *q <= '9'; q++){
+                exp_value = (exp_value < 10000) ? exp_value*10 + (*q - '0')
+                                                : exp_value;
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+            p = q;
+        }
+    }
+    if (digits == 0 || p != end || significant > 19
+        || mantissa > ((uint64_t)1 << 53)
+        || exponent < -22 || exponent > 22){
+        return strtod(s, NULL);
+    }
+    double value = (double)mantissa;
+    value = (exponent < 0) ? value/csv_exact_powers[-exponent]
+                           : value*csv_exact_powers[exponent];
+    return negative ? -value : value;
+}
+//-----------------------------------------------------------------------------
+
+/* Stores a label in the reader's arena and its offset in a growable array */
+static void csv_push_label(csv_reader_t* r, size_t** array, int* count,
+                           int* alloc, char* s)
+{
+    if (*count == *alloc){
+        *alloc = 2*(*alloc) + 16;
+        *array = realloc(*array, (*alloc)*sizeof(**array));
+        assert(unwanted_null(*array));
+    }
+    (*array)[(*count)++] = matrix_labels_push(&r->arena, s);
+}
+
+/* Notes the field about to be stored as missing, cleared in the bitmap once
+ * the matrix exists */
+static void csv_push_missing(csv_reader_t* r)
+{
+    if (r->num_missing + 2 > r->missing_alloc){
+        r->missing_alloc = 2*r->missing_alloc + 16;
+        r->missing = realloc(r->missing,
+                             r->missing_alloc*sizeof(*r->missing));
+        assert(unwanted_null(r->missing));
+    }
+    r->missing[r->num_missing++] = r->num_rows;
+    r->missing[r->num_missing++] = r->entry;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_grow_rows
+ *
+ * Arguments: reader with the matrix width known
+ *            number of rows wanted
+ *
+ * Returns: void
+ *           moves the rows read so far into storage for alloc_rows rows, at
+ *           least as many as were read
+ */
+static void csv_grow_rows(csv_reader_t* r, int alloc_rows)
+{
+    double* data = matrix_aligned_alloc((size_t)alloc_rows*r->stride
+                                        *sizeof(*data));
+    if (r->data != NULL){
+        memcpy(data, r->data, (size_t)r->num_rows*r->stride*sizeof(*data));
+        matrix_aligned_free(r->data);
+    }
+    r->data = data;
+    r->alloc_rows = alloc_rows;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_emit_field
+ *
+ * Arguments: reader holding a complete, non-empty field
+ *
+ * Returns: void
+ *           stores the field as a column name, a row label or a value.
+ *           Values go straight into the matrix row, except on the first data
+ *           line whose length fixes the number of columns.
+ */
+static void csv_emit_field(csv_reader_t* r)
+{
+    r->field[r->field_len] = '\0';
+    int label = (r->rows_labelled && r->line_fields == 0);
+    r->line_fields++;
+
+    if (r->in_header){
+        if (!label){
+            csv_push_label(r, &r->names, &r->num_names, &r->names_alloc,
+                           r->field);
+        }
+        return;
+    }
+    if (label){
+        int count = r->num_rows;
+        csv_push_label(r, &r->labels, &count, &r->labels_alloc, r->field);
+        return;
+    }
+
+    double value;
+    if (r->miss_val != NULL && !strcmp(r->miss_val, r->field)){
+        value = MATRIX_NA;
+        if (r->missing_mode == MATRIX_MISSING_BITMAP){
+            value = 0.0;
+            csv_push_missing(r);
+        }
+    }
+    else{
+        value = csv_parse_double(r->field, r->field_len);
+    }
+    if (r->num_columns < 0){
+        if (r->entry == r->first_alloc){
+            r->first_alloc = 2*r->first_alloc + 16;
+            r->first_row = realloc(r->first_row,
+                                   r->first_alloc*sizeof(*r->first_row));
+            assert(unwanted_null(r->first_row));
+        }
+        r->first_row[r->entry++] = value;
+        return;
+    }
+    assert(r->entry < r->num_columns && "Row has more entries than header");
+    r->data[(size_t)r->num_rows*r->stride + r->entry++] = value;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_end_line
+ *
+ * Arguments: reader positioned just after a newline (or at end of file)
+ *
+ * Returns: void
+ *           finishes a line. The first data line fixes the width and the
+ *           initial number of rows, estimated from the bytes left in the
+ *           file divided by that line's length. Storage then grows by half
+ *           whenever it fills.
+ */
+static void csv_end_line(csv_reader_t* r)
+{
+    if (r->line_fields == 0){
+        /* Blank line, skipped as strtok would */
+        r->line_start = r->position;
+        return;
+    }
+    if (r->in_header){
+        r->in_header = 0;
+    }
+    else{
+        if (r->num_columns < 0){
+            r->num_columns = r->entry;
+            r->stride = matrix_stride(r->entry);
+            long line_bytes = r->position - r->line_start;
+            long estimate = CSV_MIN_ROWS;
+            if (r->row_hint > 0){
+                estimate = r->row_hint;
+            }
+            else if (r->file_size > 0 && line_bytes > 0){
+                estimate = (r->file_size - r->line_start)/line_bytes;
+                estimate += estimate/8 + 1;
+            }
+            estimate = (estimate > INT32_MAX/2) ? INT32_MAX/2 : estimate;
+            csv_grow_rows(r, (int)estimate);
+            memcpy(r->data, r->first_row, r->entry*sizeof(*r->data));
+        }
+        else{
+            assert(r->entry == r->num_columns
+                   && "Row has fewer entries than the first row");
+        }
+        r->num_rows++;
+        if (r->num_rows == r->alloc_rows){
+            csv_grow_rows(r, r->alloc_rows + r->alloc_rows/2 + 1);
+        }
+    }
+    r->line_fields = 0;
+    r->entry = 0;
+    r->line_start = r->position;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_to_matrix
+ *
+ * Arguments: file name of csv file
+ *            characters delimiting the csv (eg ","); any one of them
+ *             separates fields and empty fields are skipped, as with strtok
+ *            expected number of lines, used only to size the matrix; pass 0
+ *             if unknown and it is estimated from the file size
+ *            missing value sequence for the csv file, (eg "NA"); NULL if none
+ *            whether columns are labelled (LABELLED, NOT_LABELLED) in first row
+ *            whether rows are labelled (LABELLED, NOT_LABELLED) in first column
+ *
+ * Returns: a matrix with entries and indexes corresponding to csv file
+ *           The file is read once through a CSV_READ_BUFFER byte buffer and
+ *           parsed straight into the matrix storage, so the text is never
+ *           held in memory, and the storage is cut to the rows read at the
+ *           end. Missing values are recorded in the current
+ *           missing mode (matrix_set_missing_mode): cleared in the validity
+ *           bitmap, holding 0.0, or stored as MATRIX_NA.
+ *
+ * Dependency: matrix_from_storage
+ *             csv_emit_field
+ *             csv_end_line
+ *             csv_grow_rows
+ *             matrix_set_missing
+ */
+matrix_t* csv_to_matrix(char* fname, char* delim, int num_rows, char* miss_val,
+                        int columns_labelled, int rows_labelled)
+{
+    assert(fname != NULL && delim != NULL);
+    FILE* fp = fopen(fname, "rb");
+    assert(unwanted_null(fp));
+    char* buffer = malloc(CSV_READ_BUFFER);
+    assert(unwanted_null(buffer));
+
+    csv_reader_t r;
+    memset(&r, 0, sizeof(r));
+    for(; *delim != '\0'; delim++){
+        r.is_delim[(unsigned char)*delim] = 1;
+    }
+    r.miss_val = miss_val;
+    r.missing_mode = matrix_get_missing_mode();
+    r.columns_labelled = columns_labelled;
+    r.rows_labelled = rows_labelled;
+    r.row_hint = num_rows - columns_labelled;
+    r.in_header = columns_labelled;
+    r.num_columns = -1;
+    r.field_alloc = 64;
+    r.field = malloc(r.field_alloc);
+    assert(unwanted_null(r.field));
+    r.file_size = -1;
+    if (fseek(fp, 0, SEEK_END) == 0){
+        r.file_size = ftell(fp);
+        rewind(fp);
+    }
+
+    size_t bytes;
+    while ((bytes = fread(buffer, 1, CSV_READ_BUFFER, fp)) > 0){
+        size_t k;
+        for(k=0; k<bytes; k++){
+            unsigned char c = buffer[k];
+            r.position++;
+            if (c == '\n' || r.is_delim[c]){
+                if (r.field_len > 0){
+                    csv_emit_field(&r);
+                    r.field_len = 0;
+                }
+                if (c == '\n'){
+                    csv_end_line(&r);
+                }
+            }
+            else if (c != '\r'){
+                if (r.field_len+1 == r.field_alloc){
+                    r.field_alloc *= 2;
+                    r.field = realloc(r.field, r.field_alloc);
+                    assert(unwanted_null(r.field));
+                }
+                r.field[r.field_len++] = c;
+            }
+        }
+    }
+    if (r.field_len > 0){
+        csv_emit_field(&r);
+    }
+    csv_end_line(&r);
+    fclose(fp);
+    free(buffer);
+    free(r.field);
+    free(r.first_row);
+
+    matrix_t* m;
+    int i;
+    if (r.num_columns < 0){
+        m = create_matrix(0, r.num_names);
+    }
+    else{
+        /* Drop the rows the estimate left over */
+        if (r.alloc_rows > r.num_rows){
+            csv_grow_rows(&r, r.num_rows);
+        }
+        m = matrix_from_storage(r.data, r.num_rows, r.num_columns, r.stride,
+                                r.alloc_rows);
+    }
+    /* The matrix takes over the reader's arena and offset arrays */
+    m->labels = r.arena;
+    if (columns_labelled && r.arena != NULL){
+        m->column_labels = calloc(m->num_columns ? m->num_columns : 1,
+                                  sizeof(*m->column_labels));
+        assert(unwanted_null(m->column_labels));
+        for(i=0; i<r.num_names && i<m->num_columns; i++){
+            m->column_labels[i] = r.names[i];
+        }
+        matrix_index_columns(m);
+    }
+    if (rows_labelled && r.labels != NULL){
+        m->row_labels = r.labels;
+        r.labels = NULL;
+    }
+    m->column_index_used = columns_labelled;
+    m->str_index_used = rows_labelled;
+    for(i=0; i<r.num_missing; i+=2){
+        matrix_set_missing(m, r.missing[i], r.missing[i+1]);
+    }
+    free(r.names);
+    free(r.labels);
+    free(r.missing);
+    return m;
+}
+//-----------------------------------------------------------------------------
+
+/* Shortest round trip formatting of doubles, after Ulf Adams' Ryu (PLDI 2018).
+ * The 125 bit multipliers for 5^i and 2^k/5^i are computed exactly once with
+ * a small bignum instead of being stored as tables. */
+#define CSV_POW5_BITS 125
+#define CSV_POW5_ENTRIES 326
+#define CSV_POW5_INV_ENTRIES 342
+#define CSV_BIG_LIMBS 32
+
+typedef unsigned __int128 csv_u128_t;
+
+static uint64_t csv_pow5_split[CSV_POW5_ENTRIES][2];
+static uint64_t csv_pow5_inv_split[CSV_POW5_INV_ENTRIES][2];
+static pthread_once_t csv_tables_once = PTHREAD_ONCE_INIT;
+
+/* Little endian 32 bit limbs, big enough for 2*5^341 */
+typedef struct csv_big{
+    uint32_t limb[CSV_BIG_LIMBS];
+} csv_big_t;
+
+static int csv_big_bit(csv_big_t* b, int k)
+{
+    return (k < 0) ? 0 : (b->limb[k/32] >> (k%32)) & 1;
+}
+
+static int csv_big_bit_length(csv_big_t* b)
+{
+    int k;
+    for(k=CSV_BIG_LIMBS*32-1; k>=0 && !csv_big_bit(b, k); k--);
+    return k + 1;
+}
+
+static void csv_big_mul_add(csv_big_t* b, uint32_t factor, uint32_t add)
+{
+    uint64_t carry = add;
+    int k;
+    for(k=0; k<CSV_BIG_LIMBS; k++){
+        carry += (uint64_t)b->limb[k]*factor;
+        b->limb[k] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+static int csv_big_compare(csv_big_t* a, csv_big_t* b)
+{
+    int k;
+    for(k=CSV_BIG_LIMBS-1; k>=0; k--){
+        if (a->limb[k] != b->limb[k]){
+            return (a->limb[k] < b->limb[k]) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static void csv_big_subtract(csv_big_t* a, csv_big_t* b)
+{
+    int64_t borrow = 0;
+    int k;
+    for(k=0; k<CSV_BIG_LIMBS; k++){
+        int64_t diff = (int64_t)a->limb[k] - b->limb[k] - borrow;
+        borrow = (diff < 0);
+        a->limb[k] = (uint32_t)(diff + (borrow ? ((int64_t)1 << 32) : 0));
+    }
+}
+
+/* Number of bits in 5^e, valid for 0 <= e <= 3528 */
+static int csv_pow5_bits(int e)
+{
+    return (int)(((uint32_t)e*1217359) >> 19) + 1;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_init_tables
+ *
+ * Arguments: none
+ *
+ * Returns: void
+ *           fills csv_pow5_split[i] with the top CSV_POW5_BITS bits of 5^i and
+ *           csv_pow5_inv_split[i] with floor(2^(bits(5^i)-1+125) / 5^i) + 1,
+ *           the multipliers Ryu's correctness proof is stated for
+ */
+static void csv_init_tables(void)
+{
+    csv_big_t pow5, remainder;
+    int i, k;
+    memset(&pow5, 0, sizeof(pow5));
+    pow5.limb[0] = 1;
+    for(i=0; i<CSV_POW5_INV_ENTRIES; i++){
+        int bits = csv_big_bit_length(&pow5);
+        assert(bits == csv_pow5_bits(i));
+        if (i < CSV_POW5_ENTRIES){
+            csv_u128_t top = 0;
+            for(k=bits-1; k>=bits-CSV_POW5_BITS; k--){
+                top = (top << 1) | csv_big_bit(&pow5, k);
+            }
+            csv_pow5_split[i][0] = (uint64_t)top;
+            csv_pow5_split[i][1] = (uint64_t)(top >> 64);
+        }
+
+        /* Long division of 2^(bits-1+125) by 5^i, one quotient bit a step,
+         * starting from 2^(bits-1) <= 5^i */
+        memset(&remainder, 0, sizeof(remainder));
+        remainder.limb[(bits-1)/32] = (uint32_t)1 << ((bits-1)%32);
+        csv_u128_t quotient = 0;
+        for(k=0; k<=CSV_POW5_BITS; k++){
+            if (k > 0){
+                csv_big_mul_add(&remainder, 2, 0);
+                quotient <<= 1;
+            }
+            if (csv_big_compare(&remainder, &pow5) >= 0){
+                csv_big_subtract(&remainder, &pow5);
+                quotient |= 1;
+            }
+        }
+        quotient += 1;
+        csv_pow5_inv_split[i][0] = (uint64_t)quotient;
+        csv_pow5_inv_split[i][1] = (uint64_t)(quotient >> 64);
+        csv_big_mul_add(&pow5, 5, 0);
+    }
+}
+//-----------------------------------------------------------------------------
+
+static uint64_t csv_mul_shift(uint64_t m, uint64_t* mul, int j)
+{
+    csv_u128_t low = (csv_u128_t)m*mul[0];
+    csv_u128_t high = (csv_u128_t)m*mul[1];
+    return (uint64_t)(((low >> 64) + high) >> (j - 64));
+}
+
+static int csv_pow5_factor(uint64_t value)
+{
+    int count = 0;
+    for(; value % 5 == 0; value /= 5, count++);
+    return count;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_shortest
+ *
+ * Arguments: IEEE mantissa and biased exponent of a finite, non-zero double
+ *            set to the decimal exponent
+ *
+ * Returns: the fewest decimal digits d such that d*10^exponent reads back as
+ *           the same double, choosing the closest when several qualify
+ *           (Ryu's d2d)
+ */
+static uint64_t csv_shortest(uint64_t ieee_mantissa, uint32_t ieee_exponent,
+                             int* exponent)
+{
+    int e2;
+    uint64_t m2;
+    if (ieee_exponent == 0){
+        e2 = 1 - 1023 - 52 - 2;
+        m2 = ieee_mantissa;
+    }
+    else{
+        e2 = (int)ieee_exponent - 1023 - 52 - 2;
+        m2 = ((uint64_t)1 << 52) | ieee_mantissa;
+
+        /* Integers below 2^53 are their own shortest digits */
+        int shift = -(e2 + 2);
+        if (shift >= 0 && shift <= 52
+            && (m2 & (((uint64_t)1 << shift) - 1)) == 0){
+            uint64_t digits = m2 >> shift;
+            *exponent = 0;
+            for(; digits % 10 == 0; digits /= 10, (*exponent)++);
+            return digits;
+        }
+    }
+    int accept_bounds = (m2 & 1) == 0;
+    uint64_t mv = 4*m2;
+    uint32_t mm_shift = (ieee_mantissa != 0 || ieee_exponent <= 1);
+
+    /* Scale the interval [mv-1-mm_shift, mv+2] of values rounding to this
+     * double by a power of ten */
+    uint64_t vr, vp, vm;
+    int e10;
+    int vm_trailing_zeros = 0, vr_trailing_zeros = 0;
+    if (e2 >= 0){
+        int q = (int)(((uint32_t)e2*78913) >> 18) - (e2 > 3);
+        int k = CSV_POW5_BITS + csv_pow5_bits(q) - 1;
+        int i = -e2 + q + k;
+        e10 = q;
+        vr = csv_mul_shift(4*m2, csv_pow5_inv_split[q], i);
+        vp = csv_mul_shift(4*m2 + 2, csv_pow5_inv_split[q], i);
+        vm = csv_mul_shift(4*m2 - 1 - mm_shift, csv_pow5_inv_split[q], i);
+        if (q <= 21){
+            if (mv % 5 == 0){
+                vr_trailing_zeros = csv_pow5_factor(mv) >= q;
+            }
+            else if (accept_bounds){
+                vm_trailing_zeros = csv_pow5_factor(mv - 1 - mm_shift) >= q;
+            }
+            else{
+                vp -= csv_pow5_factor(mv + 2) >= q;
+            }
+        }
+    }
+    else{
+        int q = (int)(((uint32_t)-e2*732923) >> 20) - (-e2 > 1);
+        int i = -e2 - q;
+        int k = csv_pow5_bits(i) - CSV_POW5_BITS;
+        int j = q - k;
+        e10 = q + e2;
+        vr = csv_mul_shift(4*m2, csv_pow5_split[i], j);
+        vp = csv_mul_shift(4*m2 + 2, csv_pow5_split[i], j);
+        vm = csv_mul_shift(4*m2 - 1 - mm_shift, csv_pow5_split[i], j);
+        if (q <= 1){
+            vr_trailing_zeros = 1;
+            if (accept_bounds){
+                vm_trailing_zeros = (mm_shift == 1);
+            }
+            else{
+                vp--;
+            }
+        }
+        else if (q < 63){
+            vr_trailing_zeros = (mv & (((uint64_t)1 << q) - 1)) == 0;
+        }
+    }
+
+    /* Drop digits while the interval still holds a shorter number */
+    int removed = 0;
+    int last_removed = 0;
+    uint64_t output;
+    if (vm_trailing_zeros || vr_trailing_zeros){
+        for(; vp/10 > vm/10; removed++){
+            vm_trailing_zeros &= (vm % 10 == 0);
+            vr_trailing_zeros &= (last_removed == 0);
+            last_removed = (int)(vr % 10);
+            vr /= 10; vp /= 10; vm /= 10;
+        }
+        if (vm_trailing_zeros){
+            for(; vm % 10 == 0; removed++){
+                vr_trailing_zeros &= (last_removed == 0);
+                last_removed = (int)(vr % 10);
+                vr /= 10; vp /= 10; vm /= 10;
+            }
+        }
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0){
+            /* Exactly halfway, round to even */
+            last_removed = 4;
+        }
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros))
+                       || last_removed >= 5);
+    }
+    else{
+        int round_up = 0;
+        if (vp/100 > vm/100){
+            round_up = (vr % 100 >= 50);
+            vr /= 100; vp /= 100; vm /= 100;
+            removed += 2;
+        }
+        for(; vp/10 > vm/10; removed++){
+            round_up = (vr % 10 >= 5);
+            vr /= 10; vp /= 10; vm /= 10;
+        }
+        output = vr + (vr == vm || round_up);
+    }
+    *exponent = e10 + removed;
+    return output;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_format_double
+ *
+ * Arguments: value to format
+ *            buffer of at least CSV_DOUBLE_CHARS characters
+ *
+ * Returns: number of characters written, not counting the terminating NUL
+ *           The text is the shortest that strtod reads back as exactly the
+ *           same value, in plain notation when the decimal point falls
+ *           within 21 digits of the first digit (as %g but with no precision
+ *           limit) and as d.ddde[-]x otherwise. Infinities and NaN are written
+ *           as "inf", "-inf" and "nan".
+ *
+ * Dependency: csv_shortest
+ */
+int csv_format_double(double value, char* buffer)
+{
+    pthread_once(&csv_tables_once, &csv_init_tables);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t ieee_mantissa = bits & (((uint64_t)1 << 52) - 1);
+    uint32_t ieee_exponent = (uint32_t)(bits >> 52) & 0x7ff;
+    char* p = buffer;
+
+    if (ieee_exponent == 0x7ff && ieee_mantissa != 0){
+        strcpy(buffer, "nan");
+        return 3;
+    }
+    if (bits >> 63){
+        *p++ = '-';
+    }
+    if (ieee_exponent == 0x7ff){
+        strcpy(p, "inf");
+        return (int)(p - buffer) + 3;
+    }
+    if (ieee_exponent == 0 && ieee_mantissa == 0){
+        *p++ = '0';
+        *p = '\0';
+        return (int)(p - buffer);
+    }
+
+    int exponent;
+    uint64_t output = csv_shortest(ieee_mantissa, ieee_exponent, &exponent);
+    char digits[20];
+    int length = 0, k;
+    for(; output > 0; output /= 10){
+        digits[19 - length++] = (char)('0' + output % 10);
+    }
+    char* d = digits + 20 - length;
+    int point = length + exponent;     // digits before the decimal point
+
+    if (exponent >= 0 && point <= 21){
+        memcpy(p, d, length);
+        p += length;
+        memset(p, '0', exponent);
+        p += exponent;
+    }
+    else if (point > 0 && point <= 21){
+        memcpy(p, d, point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, d + point, length - point);
+        p += length - point;
+    }
+    else if (point > -6 && point <= 0){
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -point);
+        p += -point;
+        memcpy(p, d, length);
+        p += length;
+    }
+    else{
+        *p++ = d[0];
+        if (length > 1){
+            *p++ = '.';
+            memcpy(p, d + 1, length - 1);
+            p += length - 1;
+        }
+        *p++ = 'e';
+        int e = point - 1;
+        if (e < 0){
+            *p++ = '-';
+            e = -e;
+        }
+        char exp_digits[4];
+        for(k=0; k==0 || e > 0; e /= 10){
+            exp_digits[k++] = (char)('0' + e % 10);
+        }
+        while (k > 0){
+            *p++ = exp_digits[--k];
+        }
+    }
+    *p = '\0';
+    return (int)(p - buffer);
+}
+//-----------------------------------------------------------------------------
+
+typedef struct csv_write_args{
+    matrix_t* m;
+    int first_row;          // first row of the current batch
+    int chunk_rows;
+    char** chunks;          // formatted text of each chunk of the batch
+    size_t* chunk_bytes;
+} csv_write_args_t;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: csv_format_task
+ *
+ * Arguments: csv_write_args_t
+ *            first chunk
+ *            one past the last chunk
+ *
+ * Returns: void
+ *           formats chunks [begin, end) of the batch, chunk_rows rows each,
+ *           into their own buffers
+ */
+static void csv_format_task(void* arg, int begin, int end)
+{
+    csv_write_args_t* w = arg;
+    int c, i, j;
+    for(c=begin; c<end; c++){
+        int row = w->first_row + c*w->chunk_rows;
+        int last = row + w->chunk_rows;
+        last = (last < w->m->num_rows) ? last : w->m->num_rows;
+        char* p = w->chunks[c];
+        for(i=row; i<last; i++){
+            double* entries = MATRIX_ROW(w->m, i);
+            for(j=0; j<w->m->num_columns; j++){
+                if (j > 0){
+                    *p++ = ',';
+                }
+                if ((w->m->valid != NULL || entries[j] != entries[j])
+                    && matrix_is_missing(w->m, i, j)){
+                    memcpy(p, "Nan", 3);
+                    p += 3;
+                }
+                else{
+                    p += csv_format_double(entries[j], p);
+                }
+            }
+            *p++ = '\n';
+        }
+        w->chunk_bytes[c] = p - w->chunks[c];
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_to_csv_mt
+ *
+ * Arguments: matrix
+ *            file name to write to
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           writes the entries, comma separated, one row per line. Missing
+ *           entries are written as "Nan" and every other entry with
+ *           csv_format_double, so csv_to_matrix with "Nan" as the missing
+ *           value reads back exactly the same matrix. Rows are formatted
+ *           in chunks of about CSV_WRITE_CHUNK bytes, one batch of chunks
+ *           per thread at a time, and each batch is written in order with
+ *           one fwrite per chunk.
+ *
+ * Dependency: csv_format_task
+ *             matrix_parallel_for
+ */
+void matrix_to_csv_mt(matrix_t* m, char* fname, int num_threads)
+{
+    assert(m != NULL && fname != NULL);
+    FILE* fp = fopen(fname, "w");
+    assert(unwanted_null(fp));
+    pthread_once(&csv_tables_once, &csv_init_tables);
+
+    /* Each entry followed by a comma or the newline */
+    size_t row_bytes = (size_t)m->num_columns*(CSV_DOUBLE_CHARS + 1) + 1;
+    int chunk_rows = (row_bytes < CSV_WRITE_CHUNK) ? CSV_WRITE_CHUNK/row_bytes
+                                                   : 1;
+    int threads = matrix_threads_for_work(num_threads,
+                                          (double)m->num_rows*m->num_columns);
+    int batch = threads;
+    csv_write_args_t w = {m, 0, chunk_rows, NULL, NULL};
+    w.chunks = malloc(batch*sizeof(*w.chunks));
+    w.chunk_bytes = malloc(batch*sizeof(*w.chunk_bytes));
+    assert(unwanted_null(w.chunks));
+    assert(unwanted_null(w.chunk_bytes));
+    int c;
+    for(c=0; c<batch; c++){
+        w.chunks[c] = malloc(chunk_rows*row_bytes);
+        assert(unwanted_null(w.chunks[c]));
+    }
+
+    for(w.first_row=0; w.first_row<m->num_rows;
+        w.first_row+=batch*chunk_rows){
+        int rows_left = m->num_rows - w.first_row;
+        int chunks = (rows_left + chunk_rows - 1)/chunk_rows;
+        chunks = (chunks < batch) ? chunks : batch;
+        matrix_parallel_for(chunks, threads, &csv_format_task, &w);
+        for(c=0; c<chunks; c++){
+            fwrite(w.chunks[c], 1, w.chunk_bytes[c], fp);
+        }
+    }
+    for(c=0; c<batch; c++){
+        free(w.chunks[c]);
+    }
+    free(w.chunks);
+    free(w.chunk_bytes);
+    fclose(fp);
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,22 @@
+#ifndef MATRIX_CSV_H
+#define MATRIX_CSV_H
+
+#include "matrix.h"
+
+/* Bytes read from the file at a time by csv_to_matrix */
+#define CSV_READ_BUFFER (1 << 16)
+
+/* Rows allocated when the file size gives no estimate (eg a pipe) */
+#define CSV_MIN_ROWS 64
+
+/* Room for the longest csv_format_double output, 25 characters as in
+ * "-0.0000012345678901234567", plus a NUL */
+#define CSV_DOUBLE_CHARS 32
+
+/* Bytes of text each thread formats before the chunks are written in order */
+#define CSV_WRITE_CHUNK (1 << 20)
+
+int csv_format_double(double value, char* buffer);
+void matrix_to_csv_mt(matrix_t* m, char* fname, int num_threads);
+
+#endif // MATRIX_CSV_H
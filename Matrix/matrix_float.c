@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_float.h"
+#include "matrix_simd.h"
+#include "matrix_missing.h"
+#include "matrix_gemm.h"
+#include "matrix_transpose.h"
+#include "matrix_parallel.h"
+#include "../Vector/vector_float.h"
+#include "../Utilities/utils.h"
+
+#ifdef MATRIX_HAVE_X86
+#include <immintrin.h>
+#endif
+
+#define GEMM_REAL float
+#define GEMM_T_MR GEMMF_MR
+#define GEMM_T_NR GEMMF_NR
+#define GEMM_FN(name) matrixf_##name
+#include "matrix_gemm_template.h"
+
+#define TRANSPOSE_REAL float
+#define TRANSPOSE_FN(name) matrixf_##name
+#include "matrix_transpose_template.h"
+
+static void matrixf_add_function_pointers(matrixf_t* m);
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixf_stride
+ *
+ * Arguments: number of columns
+ *
+ * Returns: floats between the start of consecutive rows, rounded up so each
+ *          row starts on a MATRIX_ALIGNMENT boundary
+ */
+int matrixf_stride(int columns)
+{
+    int per_line = MATRIX_ALIGNMENT/sizeof(float);
+    return ((columns + per_line - 1)/per_line)*per_line;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_matrixf
+ *
+ * Arguments: number of rows in the matrix
+ *            number of columns in the matrix
+ *
+ * Returns: a pointer to a zero float matrix
+ *
+ * Dependency: matrix_aligned_alloc
+ */
+matrixf_t* create_matrixf(int rows, int columns)
+{
+    assert(rows >= 0 && columns >= 0);
+    matrixf_t* m = malloc(sizeof(*m));
+    assert(unwanted_null(m));
+    m->num_rows = rows;
+    m->num_columns = columns;
+    m->stride = matrixf_stride(columns);
+    size_t bytes = (size_t)rows*m->stride*sizeof(*m->data);
+    m->data = matrix_aligned_alloc(bytes ? bytes : MATRIX_ALIGNMENT);
+    matrixf_add_function_pointers(m);
+    return m;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_to_matrixf
+ *
+ * Arguments: double precision matrix (or view)
+ *
+ * Returns: a new float matrix with each entry rounded to nearest. Float
+ *          matrices have no validity bitmap, so missing entries become NaN
+ *          rather than their 0.0 placeholder.
+ */
+matrixf_t* matrix_to_matrixf(matrix_t* m)
+{
+    assert(m != NULL);
+    matrixf_t* ret = create_matrixf(m->num_rows, m->num_columns);
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        const double* src = MATRIX_ROW(m, i);
+        float* dst = MATRIXF_ROW(ret, i);
+        for(j=0; j<m->num_columns; j++){
+            dst[j] = (float)src[j];
+        }
+        if (m->valid != NULL){
+            for(j=0; j<m->num_columns; j++){
+                if (matrix_is_missing(m, i, j)){
+                    dst[j] = NAN;
+                }
+            }
+        }
+    }
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixf_to_matrix
+ *
+ * Arguments: float matrix
+ *
+ * Returns: a new double precision matrix with the same (exact) entries
+ */
+matrix_t* matrixf_to_matrix(matrixf_t* m)
+{
+    assert(m != NULL);
+    matrix_t* ret = create_matrix(m->num_rows, m->num_columns);
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        const float* src = MATRIXF_ROW(m, i);
+        double* dst = MATRIX_ROW(ret, i);
+        for(j=0; j<m->num_columns; j++){
+            dst[j] = src[j];
+        }
+    }
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixf_multiply
+ *
+ * Arguments: matrix 1
+ *            matrix 2
+ *
+ * Returns: a new float matrix m1 x m2, or NULL if the dimensions are not
+ *          compatible. Products are accumulated in float.
+ *
+ * Dependency: matrixf_multiply_mt
+ */
+matrixf_t* matrixf_multiply(matrixf_t* m1, matrixf_t* m2)
+{
+    return matrixf_multiply_mt(m1, m2, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+matrixf_t* matrixf_multiply_mt(matrixf_t* m1, matrixf_t* m2, int num_threads)
+{
+    assert(m1 != NULL && m2 != NULL);
+    if (m1->num_columns != m2->num_rows){
+        return NULL;
+    }
+    matrixf_t* ret = create_matrixf(m1->num_rows, m2->num_columns);
+    matrixf_gemm_mt(m1->num_rows, m2->num_columns, m1->num_columns, 1.0f,
+                    m1->data, m1->stride, 1, m2->data, m2->stride, 1,
+                    0.0f, ret->data, ret->stride, num_threads);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixf_transpose_mt
+ *
+ * Arguments: float matrix
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: a new float matrix, the transpose of m
+ *
+ * Dependency: matrixf_transpose_blocked
+ */
+matrixf_t* matrixf_transpose_mt(matrixf_t* m, int num_threads)
+{
+    assert(m != NULL);
+    matrixf_t* ret = create_matrixf(m->num_columns, m->num_rows);
+    matrixf_transpose_blocked(m->num_rows, m->num_columns, m->data, m->stride,
+                              ret->data, ret->stride, num_threads);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+static matrixf_t* matrixf_transpose(matrixf_t* m)
+{
+    return matrixf_transpose_mt(m, MATRIX_THREADS_DEFAULT);
+}
+
+static float get_matrixf_entry(matrixf_t* m, int i, int j)
+{
+    assert(m != NULL);
+    assert(i >= 0 && i < m->num_rows && j >= 0 && j < m->num_columns);
+    return MATRIXF_ENTRY(m, i, j);
+}
+
+static void set_matrixf_entry(matrixf_t* m, int i, int j, float entry)
+{
+    assert(m != NULL);
+    assert(i >= 0 && i < m->num_rows && j >= 0 && j < m->num_columns);
+    MATRIXF_ENTRY(m, i, j) = entry;
+}
+
+static void print_matrixf(matrixf_t* m)
+{
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        for(j=0; j<m->num_columns; j++){
+            float entry = MATRIXF_ENTRY(m, i, j);
+            printf("%10.1f ", (entry == 0.0f) ? 0.0f : entry);
+        }
+        printf("\n");
+    }
+}
+
+static matrixf_t* clone_matrixf(matrixf_t* m)
+{
+    assert(m != NULL);
+    matrixf_t* ret = create_matrixf(m->num_rows, m->num_columns);
+    memcpy(ret->data, m->data,
+           (size_t)m->num_rows*m->stride*sizeof(*m->data));
+    return ret;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrixf_grand_sum
+ *
+ * Arguments: float matrix
+ *
+ * Returns: the sum of all the entries. Each row is summed in float by the
+ *          vector kernels, the row sums are added in double.
+ *
+ * Dependency: "vector_float.h"
+ */
+static double matrixf_grand_sum(matrixf_t* m)
+{
+    assert(m != NULL);
+    double grand_sum = 0.0;
+    vectorf_t row;
+    int i;
+    for(i=0; i<m->num_rows; i++){
+        vectorf_init_view(&row, MATRIXF_ROW(m, i), m->num_columns);
+        grand_sum += row.sum(&row);
+    }
+    return grand_sum;
+}
+//-----------------------------------------------------------------------------
+
+static void destroy_matrixf(matrixf_t* m)
+{
+    assert(m != NULL);
+    matrix_aligned_free(m->data);
+    free(m);
+}
+
+static void matrixf_add_function_pointers(matrixf_t* m)
+{
+    m->print = &print_matrixf;
+    m->get_entry = &get_matrixf_entry;
+    m->set_entry = &set_matrixf_entry;
+    m->copy = &clone_matrixf;
+    m->transpose = &matrixf_transpose;
+    m->grand_sum = &matrixf_grand_sum;
+    m->free = &destroy_matrixf;
+}
+
+#ifdef MATRIX_HAVE_X86
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemmf_kernel_avx2
+ *
+ * Arguments: as matrixf_gemm_kernel_scalar
+ *
+ * Returns: void
+ *           4 x 16 register block held in eight ymm accumulators, the float
+ *           twin of gemm_kernel_avx2 with twice the columns per instruction.
+ *           Only called after matrix_gemm_simd_enabled has been checked.
+ */
+__attribute__((target("avx2,fma")))
+static void gemmf_kernel_avx2(int kc, float alpha, const float* a,
+                              const float* b, float beta, float* c, int ldc)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    int p;
+    for(p=0; p<kc; p++){
+        __m256 b0 = _mm256_load_ps(b);
+        __m256 b1 = _mm256_load_ps(b + 8);
+        __m256 a_i;
+        a_i = _mm256_broadcast_ss(a);
+        c00 = _mm256_fmadd_ps(a_i, b0, c00);
+        c01 = _mm256_fmadd_ps(a_i, b1, c01);
+        a_i = _mm256_broadcast_ss(a + 1);
+        c10 = _mm256_fmadd_ps(a_i, b0, c10);
+        c11 = _mm256_fmadd_ps(a_i, b1, c11);
+        a_i = _mm256_broadcast_ss(a + 2);
+        c20 = _mm256_fmadd_ps(a_i, b0, c20);
+        c21 = _mm256_fmadd_ps(a_i, b1, c21);
+        a_i = _mm256_broadcast_ss(a + 3);
+        c30 = _mm256_fmadd_ps(a_i, b0, c30);
+        c31 = _mm256_fmadd_ps(a_i, b1, c31);
+        a += GEMMF_MR;
+        b += GEMMF_NR;
+    }
+    __m256 acc[GEMMF_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}};
+    __m256 va = _mm256_set1_ps(alpha);
+    __m256 vb = _mm256_set1_ps(beta);
+    int i;
+    for(i=0; i<GEMMF_MR; i++){
+        __m256 r0 = _mm256_mul_ps(va, acc[i][0]);
+        __m256 r1 = _mm256_mul_ps(va, acc[i][1]);
+        if (beta != 0.0f){
+            r0 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(c + i*ldc), r0);
+            r1 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(c + i*ldc + 8), r1);
+        }
+        _mm256_storeu_ps(c + i*ldc, r0);
+        _mm256_storeu_ps(c + i*ldc + 8, r1);
+    }
+}
+//-----------------------------------------------------------------------------
+
+/* 4 x 4 float transpose in xmm registers */
+__attribute__((target("sse")))
+static void transposef_4x4_sse(const float* src, int lds, float* dst, int ldd)
+{
+    __m128 r0 = _mm_loadu_ps(src);
+    __m128 r1 = _mm_loadu_ps(src + lds);
+    __m128 r2 = _mm_loadu_ps(src + 2*(size_t)lds);
+    __m128 r3 = _mm_loadu_ps(src + 3*(size_t)lds);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(dst, r0);
+    _mm_storeu_ps(dst + ldd, r1);
+    _mm_storeu_ps(dst + 2*(size_t)ldd, r2);
+    _mm_storeu_ps(dst + 3*(size_t)ldd, r3);
+}
+#endif
+
+static matrixf_gemm_kernel_t matrixf_gemm_select_kernel(void)
+{
+#ifdef MATRIX_HAVE_X86
+    if (matrix_gemm_simd_enabled()){
+        return &gemmf_kernel_avx2;
+    }
+#endif
+    return &matrixf_gemm_kernel_scalar;
+}
+
+static matrixf_transpose_kernel_t matrixf_transpose_kernel(void)
+{
+#ifdef MATRIX_HAVE_X86
+    if (__builtin_cpu_supports("sse")){
+        return &transposef_4x4_sse;
+    }
+#endif
+    return &matrixf_transpose_4x4_scalar;
+}
@@ -0,0 +1,61 @@
+#ifndef MATRIX_FLOAT_H
+#define MATRIX_FLOAT_H
+
+#include "matrix.h"
+#include "../Vector/vector_float.h"
+
+/* Register block of the float micro-kernel: 4 rows of two 8 float ymm
+ * registers, so one packed B row is a cache line */
+#define GEMMF_MR 4
+#define GEMMF_NR 16
+
+#define MATRIXF_ROW(m, i) ((m)->data + (size_t)(i)*(m)->stride)
+#define MATRIXF_ENTRY(m, i, j) (MATRIXF_ROW(m, i)[j])
+
+/* Single precision dense matrix: the same aligned, padded row-major layout
+ * as matrix_t at half the bytes, so GEMM and transpose move twice the
+ * entries per cache line and per SIMD register. There are no labels and no
+ * views; convert to and from matrix_t at the edges of a float pipeline. */
+typedef struct matrixf matrixf_t;
+
+struct matrixf{
+    float* data;            // row-major, one aligned block
+    int stride;             // floats between the start of consecutive rows
+    int num_rows;
+    int num_columns;
+
+    void (*print)(matrixf_t* m);
+    float (*get_entry)(matrixf_t* m, int row, int col);
+    void (*set_entry)(matrixf_t* m, int row, int col, float entry);
+    matrixf_t* (*copy)(matrixf_t* m);
+    matrixf_t* (*transpose)(matrixf_t* m);
+    double (*grand_sum)(matrixf_t* m);
+    void (*free)(matrixf_t* m);
+};
+
+matrixf_t* create_matrixf(int rows, int columns);
+int matrixf_stride(int columns);
+
+/* Conversions between precisions, rounding to nearest when narrowing.
+ * Labels are not carried over. */
+matrixf_t* matrix_to_matrixf(matrix_t* m);
+matrix_t* matrixf_to_matrix(matrixf_t* m);
+
+matrixf_t* matrixf_multiply(matrixf_t* m1, matrixf_t* m2);
+matrixf_t* matrixf_multiply_mt(matrixf_t* m1, matrixf_t* m2, int num_threads);
+matrixf_t* matrixf_transpose_mt(matrixf_t* m, int num_threads);
+
+/* As matrix_gemm(_mt) and matrix_transpose_blocked, on floats */
+void matrixf_gemm(int m, int n, int k, float alpha,
+                  const float* A, int rsa, int csa,
+                  const float* B, int rsb, int csb,
+                  float beta, float* C, int ldc);
+void matrixf_gemm_mt(int m, int n, int k, float alpha,
+                     const float* A, int rsa, int csa,
+                     const float* B, int rsb, int csb,
+                     float beta, float* C, int ldc, int num_threads);
+void matrixf_transpose_blocked(int rows, int columns,
+                               const float* src, int lds,
+                               float* dst, int ldd, int num_threads);
+
+#endif // MATRIX_FLOAT_H
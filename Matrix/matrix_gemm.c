@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_gemm.h"
+#include "matrix_simd.h"
+#include "matrix_parallel.h"
+#include "../Utilities/utils.h"
+
+#ifdef MATRIX_HAVE_X86
+#include <immintrin.h>
+#endif
+
+#define GEMM_REAL double
+#define GEMM_T_MR GEMM_MR
+#define GEMM_T_NR GEMM_NR
+#define GEMM_FN(name) matrix_##name
+#include "matrix_gemm_template.h"
+
+#ifdef MATRIX_HAVE_X86
+static void gemm_kernel_avx2(int kc, double alpha, const double* a,
+                             const double* b, double beta, double* c,
+                             int ldc);
+#endif
+
+static int gemm_simd_enabled = 1;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_gemm_simd_available
+ *
+ * Arguments: None
+ *
+ * Returns: 1 if the CPU we are running on supports the AVX2/FMA kernel,
+ *          otherwise 0
+ */
+int matrix_gemm_simd_available(void)
+{
+#ifdef MATRIX_HAVE_X86
+    return (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+#else
+    return 0;
+#endif
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_gemm_set_simd
+ *
+ * Arguments: 1 to use the SIMD kernel when the CPU supports it,
+ *            0 to always use the scalar kernel
+ *
+ * Returns: void
+ */
+void matrix_gemm_set_simd(int enabled)
+{
+    gemm_simd_enabled = enabled;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_gemm_simd_enabled
+ *
+ * Arguments: None
+ *
+ * Returns: 1 if the GEMMs (double and float) will use their SIMD kernels,
+ *          ie SIMD is switched on and the CPU supports it, otherwise 0
+ */
+int matrix_gemm_simd_enabled(void)
+{
+    return gemm_simd_enabled && matrix_gemm_simd_available();
+}
+//-----------------------------------------------------------------------------
+
+static matrix_gemm_kernel_t matrix_gemm_select_kernel(void)
+{
+#ifdef MATRIX_HAVE_X86
+    if (matrix_gemm_simd_enabled()){
+        return &gemm_kernel_avx2;
+    }
+#endif
+    return &matrix_gemm_kernel_scalar;
+}
+
+#ifdef MATRIX_HAVE_X86
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemm_kernel_avx2
+ *
+ * Arguments: as gemm_kernel_scalar
+ *
+ * Returns: void
+ *           4 x 8 register block held in eight ymm accumulators. Only called
+ *           after matrix_gemm_simd_available has been checked.
+ */
+__attribute__((target("avx2,fma")))
+static void gemm_kernel_avx2(int kc, double alpha, const double* a,
+                             const double* b, double beta, double* c,
+                             int ldc)
+{
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    int p;
+    for(p=0; p<kc; p++){
+        __m256d b0 = _mm256_load_pd(b);
+        __m256d b1 = _mm256_load_pd(b + 4);
+        __m256d a_i;
+        a_i = _mm256_broadcast_sd(a);
+        c00 = _mm256_fmadd_pd(a_i, b0, c00);
+        c01 = _mm256_fmadd_pd(a_i, b1, c01);
+        a_i = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_fmadd_pd(a_i, b0, c10);
+        c11 = _mm256_fmadd_pd(a_i, b1, c11);
+        a_i = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_fmadd_pd(a_i, b0, c20);
+        c21 = _mm256_fmadd_pd(a_i, b1, c21);
+        a_i = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_fmadd_pd(a_i, b0, c30);
+        c31 = _mm256_fmadd_pd(a_i, b1, c31);
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    __m256d acc[GEMM_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}};
+    __m256d va = _mm256_set1_pd(alpha);
+    __m256d vb = _mm256_set1_pd(beta);
+    int i;
+    for(i=0; i<GEMM_MR; i++){
+        __m256d r0 = _mm256_mul_pd(va, acc[i][0]);
+        __m256d r1 = _mm256_mul_pd(va, acc[i][1]);
+        if (beta != 0.0){
+            r0 = _mm256_fmadd_pd(vb, _mm256_loadu_pd(c + i*ldc), r0);
+            r1 = _mm256_fmadd_pd(vb, _mm256_loadu_pd(c + i*ldc + 4), r1);
+        }
+        _mm256_storeu_pd(c + i*ldc, r0);
+        _mm256_storeu_pd(c + i*ldc + 4, r1);
+    }
+}
+//-----------------------------------------------------------------------------
+#endif
+
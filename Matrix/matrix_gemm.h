@@ -0,0 +1,25 @@
+#ifndef MATRIX_GEMM_H
+#define MATRIX_GEMM_H
+
+/* Register block computed by one call of the micro-kernel */
+#define GEMM_MR 4
+#define GEMM_NR 8
+
+/* Cache blocks: KC x NR panel of B sits in L1, MC x KC block of A in L2 */
+#define GEMM_KC 256
+#define GEMM_MC 96
+#define GEMM_NC 2048
+
+void matrix_gemm(int m, int n, int k, double alpha,
+                 const double* A, int rsa, int csa,
+                 const double* B, int rsb, int csb,
+                 double beta, double* C, int ldc);
+void matrix_gemm_mt(int m, int n, int k, double alpha,
+                    const double* A, int rsa, int csa,
+                    const double* B, int rsb, int csb,
+                    double beta, double* C, int ldc, int num_threads);
+void matrix_gemm_set_simd(int enabled);
+int matrix_gemm_simd_available(void);
+int matrix_gemm_simd_enabled(void);
+
+#endif // MATRIX_GEMM_H
@@ -0,0 +1,302 @@
+/* Packed, cache blocked GEMM shared by the double (matrix_gemm.c) and float
+ * (matrix_float.c) matrices. The including file defines
+ *   GEMM_REAL     the entry type
+ *   GEMM_T_MR     rows of the register block
+ *   GEMM_T_NR     columns of the register block
+ *   GEMM_FN(x)    the name of x for that type (x = gemm gives the public
+ *                 entry point, eg matrix_gemm or matrixf_gemm)
+ * includes this file once, and then defines GEMM_FN(gemm_select_kernel),
+ * which returns the micro-kernel to use. The cache blocks GEMM_KC, GEMM_MC
+ * and GEMM_NC are counted in entries and shared by both types. No include
+ * guard, on purpose. */
+
+typedef void (*GEMM_FN(gemm_kernel_t))(int kc, GEMM_REAL alpha,
+                                       const GEMM_REAL* a, const GEMM_REAL* b,
+                                       GEMM_REAL beta, GEMM_REAL* c, int ldc);
+
+static GEMM_FN(gemm_kernel_t) GEMM_FN(gemm_select_kernel)(void);
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemm_kernel_scalar
+ *
+ * Arguments: depth of the packed panels
+ *            alpha
+ *            packed MR x kc panel of A
+ *            packed kc x NR panel of B
+ *            beta
+ *            MR x NR tile of C and its row stride
+ *
+ * Returns: void
+ *           C = alpha*A*B + beta*C on one register block. C is not read
+ *           when beta is 0.
+ */
+static void GEMM_FN(gemm_kernel_scalar)(int kc, GEMM_REAL alpha,
+                                        const GEMM_REAL* a,
+                                        const GEMM_REAL* b, GEMM_REAL beta,
+                                        GEMM_REAL* c, int ldc)
+{
+    GEMM_REAL ab[GEMM_T_MR*GEMM_T_NR] = {0.0};
+    int p, i, j;
+    for(p=0; p<kc; p++){
+        for(i=0; i<GEMM_T_MR; i++){
+            GEMM_REAL a_ip = a[p*GEMM_T_MR + i];
+            for(j=0; j<GEMM_T_NR; j++){
+                ab[i*GEMM_T_NR + j] += a_ip * b[p*GEMM_T_NR + j];
+            }
+        }
+    }
+    for(i=0; i<GEMM_T_MR; i++){
+        for(j=0; j<GEMM_T_NR; j++){
+            GEMM_REAL v = alpha * ab[i*GEMM_T_NR + j];
+            c[i*ldc + j] = (beta == 0.0) ? v : v + beta*c[i*ldc + j];
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemm_pack_a
+ *
+ * Arguments: mc x kc block of A (general row and column strides)
+ *            destination buffer
+ *
+ * Returns: void
+ *           copies the block into MR-row panels, each stored column by
+ *           column, padding the last panel with zeros
+ */
+static void GEMM_FN(gemm_pack_a)(int mc, int kc, const GEMM_REAL* A, int rsa,
+                                 int csa, GEMM_REAL* buff)
+{
+    int ir, p, i;
+    for(ir=0; ir<mc; ir+=GEMM_T_MR){
+        int rows = (mc-ir < GEMM_T_MR) ? mc-ir : GEMM_T_MR;
+        for(p=0; p<kc; p++){
+            for(i=0; i<rows; i++){
+                buff[i] = A[(size_t)(ir+i)*rsa + (size_t)p*csa];
+            }
+            for(; i<GEMM_T_MR; i++){
+                buff[i] = 0.0;
+            }
+            buff += GEMM_T_MR;
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemm_pack_b
+ *
+ * Arguments: kc x nc block of B (general row and column strides)
+ *            destination buffer
+ *
+ * Returns: void
+ *           copies the block into NR-column panels, each stored row by row,
+ *           padding the last panel with zeros
+ */
+static void GEMM_FN(gemm_pack_b)(int kc, int nc, const GEMM_REAL* B, int rsb,
+                                 int csb, GEMM_REAL* buff)
+{
+    int jr, p, j;
+    for(jr=0; jr<nc; jr+=GEMM_T_NR){
+        int cols = (nc-jr < GEMM_T_NR) ? nc-jr : GEMM_T_NR;
+        for(p=0; p<kc; p++){
+            const GEMM_REAL* b = B + (size_t)p*rsb + (size_t)jr*csb;
+            if (csb == 1){
+                memcpy(buff, b, cols*sizeof(*buff));
+            }
+            else{
+                for(j=0; j<cols; j++){
+                    buff[j] = b[(size_t)j*csb];
+                }
+            }
+            for(j=cols; j<GEMM_T_NR; j++){
+                buff[j] = 0.0;
+            }
+            buff += GEMM_T_NR;
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemm_scale
+ *
+ * Arguments: m x n block of C and its row stride
+ *            beta
+ *
+ * Returns: void
+ *           C = beta*C, used when there is nothing to multiply
+ */
+static void GEMM_FN(gemm_scale)(int m, int n, GEMM_REAL beta, GEMM_REAL* C,
+                                int ldc)
+{
+    int i, j;
+    for(i=0; i<m; i++){
+        GEMM_REAL* c = C + (size_t)i*ldc;
+        for(j=0; j<n; j++){
+            c[j] = (beta == 0.0) ? 0.0 : beta*c[j];
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemm
+ *
+ * Arguments: rows of C (and A), columns of C (and B), inner dimension
+ *            alpha
+ *            A with its row stride and column stride
+ *            B with its row stride and column stride
+ *            beta
+ *            row-major C with its row stride
+ *
+ * Returns: void
+ *           C = alpha*A*B + beta*C using packed, cache blocked panels and a
+ *           register blocked micro-kernel chosen at runtime (AVX2/FMA when
+ *           available, otherwise scalar). Swapping the strides of A or B
+ *           multiplies by its transpose without copying it first.
+ *           C is not read when beta is 0.
+ */
+void GEMM_FN(gemm)(int m, int n, int k, GEMM_REAL alpha,
+                   const GEMM_REAL* A, int rsa, int csa,
+                   const GEMM_REAL* B, int rsb, int csb,
+                   GEMM_REAL beta, GEMM_REAL* C, int ldc)
+{
+    assert(m >= 0 && n >= 0 && k >= 0);
+    if (m == 0 || n == 0){
+        return;
+    }
+    if (k == 0 || alpha == 0.0){
+        GEMM_FN(gemm_scale)(m, n, beta, C, ldc);
+        return;
+    }
+    GEMM_FN(gemm_kernel_t) kernel = GEMM_FN(gemm_select_kernel)();
+    /* Pack buffers only need to be as big as the largest block we will use */
+    size_t kc_max = (k < GEMM_KC) ? k : GEMM_KC;
+    size_t mc_max = (m < GEMM_MC) ? ((m+GEMM_T_MR-1)/GEMM_T_MR)*GEMM_T_MR
+                                  : GEMM_MC;
+    size_t nc_max = (n < GEMM_NC) ? ((n+GEMM_T_NR-1)/GEMM_T_NR)*GEMM_T_NR
+                                  : GEMM_NC;
+    GEMM_REAL* a_pack = matrix_aligned_alloc(mc_max*kc_max*sizeof(*a_pack));
+    GEMM_REAL* b_pack = matrix_aligned_alloc(kc_max*nc_max*sizeof(*b_pack));
+    GEMM_REAL tile[GEMM_T_MR*GEMM_T_NR];
+    int jc, pc, ic, jr, ir, i, j;
+
+    for(jc=0; jc<n; jc+=GEMM_NC){
+        int nc = (n-jc < GEMM_NC) ? n-jc : GEMM_NC;
+        for(pc=0; pc<k; pc+=GEMM_KC){
+            int kc = (k-pc < GEMM_KC) ? k-pc : GEMM_KC;
+            /* Only the first pass over k applies the caller's beta */
+            GEMM_REAL beta_pc = (pc == 0) ? beta : 1.0;
+            GEMM_FN(gemm_pack_b)(kc, nc, B + (size_t)pc*rsb + (size_t)jc*csb,
+                                 rsb, csb, b_pack);
+
+            for(ic=0; ic<m; ic+=GEMM_MC){
+                int mc = (m-ic < GEMM_MC) ? m-ic : GEMM_MC;
+                GEMM_FN(gemm_pack_a)(mc, kc,
+                                     A + (size_t)ic*rsa + (size_t)pc*csa,
+                                     rsa, csa, a_pack);
+
+                for(jr=0; jr<nc; jr+=GEMM_T_NR){
+                    int nr = (nc-jr < GEMM_T_NR) ? nc-jr : GEMM_T_NR;
+                    for(ir=0; ir<mc; ir+=GEMM_T_MR){
+                        int mr = (mc-ir < GEMM_T_MR) ? mc-ir : GEMM_T_MR;
+                        GEMM_REAL* c = C + (size_t)(ic+ir)*ldc + jc + jr;
+                        const GEMM_REAL* a = a_pack + (size_t)ir*kc;
+                        const GEMM_REAL* b = b_pack + (size_t)jr*kc;
+                        if (mr == GEMM_T_MR && nr == GEMM_T_NR){
+                            kernel(kc, alpha, a, b, beta_pc, c, ldc);
+                            continue;
+                        }
+                        /* Fringe block: compute a full tile, copy back part */
+                        kernel(kc, alpha, a, b, 0.0, tile, GEMM_T_NR);
+                        for(i=0; i<mr; i++){
+                            for(j=0; j<nr; j++){
+                                GEMM_REAL v = tile[i*GEMM_T_NR + j];
+                                c[(size_t)i*ldc + j] = (beta_pc == 0.0)
+                                    ? v : v + beta_pc*c[(size_t)i*ldc + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    matrix_aligned_free(a_pack);
+    matrix_aligned_free(b_pack);
+}
+//-----------------------------------------------------------------------------
+
+/* Arguments of a gemm call, shared by the threads of gemm_mt */
+typedef struct GEMM_FN(gemm_args){
+    int m, n, k;
+    GEMM_REAL alpha, beta;
+    const GEMM_REAL* A;
+    int rsa, csa;
+    const GEMM_REAL* B;
+    int rsb, csb;
+    GEMM_REAL* C;
+    int ldc;
+    int block;          // rows (or columns) per parallel iteration
+    int split_rows;     // 1 to split C by rows, 0 by columns
+} GEMM_FN(gemm_args_t);
+
+static void GEMM_FN(gemm_task)(void* arg, int begin, int end)
+{
+    GEMM_FN(gemm_args_t)* g = arg;
+    int extent = g->split_rows ? g->m : g->n;
+    int first = begin*g->block;
+    int last = (end*g->block < extent) ? end*g->block : extent;
+    if (first >= last){
+        return;
+    }
+    if (g->split_rows){
+        GEMM_FN(gemm)(last-first, g->n, g->k, g->alpha,
+                      g->A + (size_t)first*g->rsa, g->rsa, g->csa,
+                      g->B, g->rsb, g->csb,
+                      g->beta, g->C + (size_t)first*g->ldc, g->ldc);
+    }
+    else{
+        GEMM_FN(gemm)(g->m, last-first, g->k, g->alpha,
+                      g->A, g->rsa, g->csa,
+                      g->B + (size_t)first*g->csb, g->rsb, g->csb,
+                      g->beta, g->C + first, g->ldc);
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemm_mt
+ *
+ * Arguments: as gemm
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           C = alpha*A*B + beta*C, with C split into row (or column, when C
+ *           is wide) blocks that are multiplied in parallel. Small products
+ *           stay on the calling thread.
+ */
+void GEMM_FN(gemm_mt)(int m, int n, int k, GEMM_REAL alpha,
+                      const GEMM_REAL* A, int rsa, int csa,
+                      const GEMM_REAL* B, int rsb, int csb,
+                      GEMM_REAL beta, GEMM_REAL* C, int ldc, int num_threads)
+{
+    int threads = matrix_threads_for_work(num_threads, (double)m*n*k);
+    if (threads <= 1){
+        GEMM_FN(gemm)(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc);
+        return;
+    }
+    GEMM_FN(gemm_args_t) g = {m, n, k, alpha, beta, A, rsa, csa, B, rsb, csb,
+                              C, ldc, 0, (m >= n)};
+    /* Keep each thread's share a whole number of register blocks */
+    g.block = g.split_rows ? GEMM_T_MR : GEMM_T_NR;
+    int extent = g.split_rows ? m : n;
+    matrix_parallel_for((extent + g.block - 1)/g.block, threads,
+                        &GEMM_FN(gemm_task), &g);
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_gemv.h"
+#include "matrix_gemm.h"
+#include "matrix_simd.h"
+#include "matrix_parallel.h"
+#include "../Vector/vector.h"
+#include "../Utilities/utils.h"
+
+#ifdef __GNUC__
+typedef double gemv_lanes_t __attribute__((vector_size(32)));
+#define GEMV_LANES 4
+#define GEMV_REDUCE(lanes) ((lanes)[0] + (lanes)[1] + (lanes)[2] + (lanes)[3])
+#endif
+
+/* y = alpha*dot + beta*y, not reading y when beta is 0 (as BLAS) */
+#define GEMV_UPDATE(y, alpha, dot, beta)                                      \
+    ((y) = (alpha)*(dot) + (((beta) == 0.0) ? 0.0 : (beta)*(y)))
+
+typedef struct gemv_args{
+    int m;
+    int n;
+    double alpha;
+    const double* A;
+    int lda;
+    const double* x;
+    double beta;
+    double* y;
+    double* partial;        // transposed, per row chunk: n sums each
+} gemv_args_t;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemv_rows
+ *
+ * Arguments: gemv_args_t
+ *            first row
+ *            one past the last row
+ *
+ * Returns: void
+ *           y[i] = alpha*(row i . x) + beta*y[i] for rows [begin, end). Four
+ *           rows share each load of x, each with its own vector
+ *           accumulator. Always inlined into the kernels below, so the
+ *           vectors are compiled for each instruction set.
+ */
+MATRIX_SIMD_INLINE void gemv_rows(gemv_args_t* g, int begin, int end)
+{
+    int n = g->n;
+    const double* x = g->x;
+    int i = begin, j;
+#ifdef __GNUC__
+    for(; i + 4 <= end; i += 4){
+        const double* a0 = g->A + (size_t)i*g->lda;
+        const double* a1 = a0 + g->lda;
+        const double* a2 = a1 + g->lda;
+        const double* a3 = a2 + g->lda;
+        gemv_lanes_t s0 = {0}, s1 = {0}, s2 = {0}, s3 = {0};
+        for(j=0; j + GEMV_LANES <= n; j += GEMV_LANES){
+            gemv_lanes_t xv = MATRIX_SIMD_LOAD(gemv_lanes_t, x + j);
+            s0 += MATRIX_SIMD_LOAD(gemv_lanes_t, a0 + j)*xv;
+            s1 += MATRIX_SIMD_LOAD(gemv_lanes_t, a1 + j)*xv;
+            s2 += MATRIX_SIMD_LOAD(gemv_lanes_t, a2 + j)*xv;
+            s3 += MATRIX_SIMD_LOAD(gemv_lanes_t, a3 + j)*xv;
+        }
+        double d0 = GEMV_REDUCE(s0), d1 = GEMV_REDUCE(s1);
+        double d2 = GEMV_REDUCE(s2), d3 = GEMV_REDUCE(s3);
+        for(; j<n; j++){
+            d0 += a0[j]*x[j];
+            d1 += a1[j]*x[j];
+            d2 += a2[j]*x[j];
+            d3 += a3[j]*x[j];
+        }
+        GEMV_UPDATE(g->y[i], g->alpha, d0, g->beta);
+        GEMV_UPDATE(g->y[i+1], g->alpha, d1, g->beta);
+        GEMV_UPDATE(g->y[i+2], g->alpha, d2, g->beta);
+        GEMV_UPDATE(g->y[i+3], g->alpha, d3, g->beta);
+    }
+#endif
+    for(; i<end; i++){
+        const double* a = g->A + (size_t)i*g->lda;
+        double dot = 0.0;
+        j = 0;
+#ifdef __GNUC__
+        gemv_lanes_t s = {0};
+        for(; j + GEMV_LANES <= n; j += GEMV_LANES){
+            s += MATRIX_SIMD_LOAD(gemv_lanes_t, a + j)
+                 *MATRIX_SIMD_LOAD(gemv_lanes_t, x + j);
+        }
+        dot = GEMV_REDUCE(s);
+#endif
+        for(; j<n; j++){
+            dot += a[j]*x[j];
+        }
+        GEMV_UPDATE(g->y[i], g->alpha, dot, g->beta);
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: gemv_columns
+ *
+ * Arguments: gemv_args_t
+ *            rows [r0, r1) to add in
+ *            columns [c0, c1) of y to update
+ *            where to accumulate y[c0..c1)
+ *
+ * Returns: void
+ *           y += alpha*x[i]*(row i) for each row in turn, four rows per
+ *           pass over the slice of y, so A is read row-major and never
+ *           transposed
+ */
+MATRIX_SIMD_INLINE void gemv_columns(gemv_args_t* g, int r0, int r1, int c0,
+                                     int c1, double* y)
+{
+    const double* x = g->x;
+    int i = r0, j;
+    y -= c0;
+#ifdef __GNUC__
+    for(; i + 4 <= r1; i += 4){
+        const double* a0 = g->A + (size_t)i*g->lda;
+        const double* a1 = a0 + g->lda;
+        const double* a2 = a1 + g->lda;
+        const double* a3 = a2 + g->lda;
+        double x0 = g->alpha*x[i], x1 = g->alpha*x[i+1];
+        double x2 = g->alpha*x[i+2], x3 = g->alpha*x[i+3];
+        for(j=c0; j + GEMV_LANES <= c1; j += GEMV_LANES){
+            gemv_lanes_t yv = MATRIX_SIMD_LOAD(gemv_lanes_t, y + j);
+            yv += x0*MATRIX_SIMD_LOAD(gemv_lanes_t, a0 + j)
+                  + x1*MATRIX_SIMD_LOAD(gemv_lanes_t, a1 + j)
+                  + x2*MATRIX_SIMD_LOAD(gemv_lanes_t, a2 + j)
+                  + x3*MATRIX_SIMD_LOAD(gemv_lanes_t, a3 + j);
+            MATRIX_SIMD_STORE(y + j, yv);
+        }
+        for(; j<c1; j++){
+            y[j] += x0*a0[j] + x1*a1[j] + x2*a2[j] + x3*a3[j];
+        }
+    }
+#endif
+    for(; i<r1; i++){
+        const double* a = g->A + (size_t)i*g->lda;
+        double xi = g->alpha*x[i];
+        for(j=c0; j<c1; j++){
+            y[j] += xi*a[j];
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/* Column blocks of y, each computed whole by one thread */
+MATRIX_SIMD_INLINE void gemv_column_blocks(gemv_args_t* g, int begin, int end)
+{
+    int b, j;
+    for(b=begin; b<end; b++){
+        int c0 = b*GEMV_COLUMN_BLOCK;
+        int c1 = (c0 + GEMV_COLUMN_BLOCK < g->n) ? c0 + GEMV_COLUMN_BLOCK
+                                                 : g->n;
+        double* y = g->y + c0;
+        for(j=0; j<c1-c0; j++){
+            y[j] = (g->beta == 0.0) ? 0.0 : g->beta*y[j];
+        }
+        gemv_columns(g, 0, g->m, c0, c1, y);
+    }
+}
+
+/* Row chunks, each summed into its own slot of partial */
+MATRIX_SIMD_INLINE void gemv_row_chunks(gemv_args_t* g, int begin, int end)
+{
+    int c;
+    for(c=begin; c<end; c++){
+        int r0 = c*GEMV_ROW_CHUNK;
+        int r1 = (r0 + GEMV_ROW_CHUNK < g->m) ? r0 + GEMV_ROW_CHUNK : g->m;
+        double* y = g->partial + (size_t)c*g->n;
+        memset(y, 0, g->n*sizeof(*y));
+        gemv_columns(g, r0, r1, 0, g->n, y);
+    }
+}
+
+/* One task per shape, compiled for the baseline and for AVX2/FMA. The
+ * AVX2/FMA tasks are used whenever the gemm SIMD kernels are
+ * (matrix_gemm_simd_enabled). */
+#define GEMV_KERNELS(suffix, attribute)                                       \
+    attribute static void gemv_rows_##suffix(void* arg, int begin, int end)   \
+    {                                                                         \
+        gemv_rows(arg, begin, end);                                           \
+    }                                                                         \
+    attribute static void gemv_column_blocks_##suffix(void* arg, int begin,   \
+                                                      int end)                \
+    {                                                                         \
+        gemv_column_blocks(arg, begin, end);                                  \
+    }                                                                         \
+    attribute static void gemv_row_chunks_##suffix(void* arg, int begin,      \
+                                                   int end)                   \
+    {                                                                         \
+        gemv_row_chunks(arg, begin, end);                                     \
+    }
+
+GEMV_KERNELS(baseline, )
+#ifdef MATRIX_HAVE_X86
+GEMV_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+#endif
+
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_gemv_mt
+ *
+ * Arguments: number of rows and columns of A
+ *            alpha
+ *            row-major A, lda doubles between the starts of its rows
+ *            x, n doubles
+ *            beta
+ *            y, m doubles, not overlapping A or x
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           y = alpha*A*x + beta*y, threads taking blocks of rows. Each y[i]
+ *           is summed in the same order whatever the thread count.
+ *
+ * Dependency: gemv_rows
+ */
+void matrix_gemv_mt(int m, int n, double alpha, const double* A, int lda,
+                    const double* x, double beta, double* y, int num_threads)
+{
+    assert(m >= 0 && n >= 0 && lda >= n);
+    assert((A != NULL && x != NULL && y != NULL) || m == 0 || n == 0);
+    gemv_args_t g = {m, n, alpha, A, lda, x, beta, y, NULL};
+    parallel_task_t task = &gemv_rows_baseline;
+#ifdef MATRIX_HAVE_X86
+    if (matrix_gemm_simd_enabled()){
+        task = &gemv_rows_avx2;
+    }
+#endif
+    matrix_parallel_for(m, matrix_threads_for_work(num_threads,
+                                                   (double)m*n),
+                        task, &g);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_gemv(int m, int n, double alpha, const double* A, int lda,
+                 const double* x, double beta, double* y)
+{
+    matrix_gemv_mt(m, n, alpha, A, lda, x, beta, y, MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_gemv_transposed_mt
+ *
+ * Arguments: number of rows and columns of A
+ *            alpha
+ *            row-major A, lda doubles between the starts of its rows
+ *            x, m doubles
+ *            beta
+ *            y, n doubles, not overlapping A or x
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           y = alpha*A'*x + beta*y without forming A'. Rows of A are added
+ *           into y scaled by x, so A is still read row by row. Wide matrices
+ *           are split into GEMV_COLUMN_BLOCK columns of y per task. Narrow
+ *           ones (eg a tall design matrix) are split into GEMV_ROW_CHUNK
+ *           rows per task, each summing into its own copy of y, and the
+ *           copies are added in chunk order; either way the result does not
+ *           depend on the thread count.
+ *
+ * Dependency: gemv_columns
+ */
+void matrix_gemv_transposed_mt(int m, int n, double alpha, const double* A,
+                               int lda, const double* x, double beta,
+                               double* y, int num_threads)
+{
+    assert(m >= 0 && n >= 0 && lda >= n);
+    assert((A != NULL && x != NULL && y != NULL) || m == 0 || n == 0);
+    gemv_args_t g = {m, n, alpha, A, lda, x, beta, y, NULL};
+    parallel_task_t columns_task = &gemv_column_blocks_baseline;
+    parallel_task_t chunks_task = &gemv_row_chunks_baseline;
+#ifdef MATRIX_HAVE_X86
+    if (matrix_gemm_simd_enabled()){
+        columns_task = &gemv_column_blocks_avx2;
+        chunks_task = &gemv_row_chunks_avx2;
+    }
+#endif
+    int threads = matrix_threads_for_work(num_threads, (double)m*n);
+    int j, c;
+    if (n > GEMV_COLUMN_BLOCK || m <= GEMV_ROW_CHUNK){
+        matrix_parallel_for((n + GEMV_COLUMN_BLOCK - 1)/GEMV_COLUMN_BLOCK,
+                            threads, columns_task, &g);
+        return;
+    }
+    int chunks = (m + GEMV_ROW_CHUNK - 1)/GEMV_ROW_CHUNK;
+    g.partial = malloc((size_t)chunks*n*sizeof(*g.partial));
+    assert(unwanted_null(g.partial));
+    matrix_parallel_for(chunks, threads, chunks_task, &g);
+    for(j=0; j<n; j++){
+        double sum = 0.0;
+        for(c=0; c<chunks; c++){
+            sum += g.partial[(size_t)c*n + j];
+        }
+        y[j] = sum + ((beta == 0.0) ? 0.0 : beta*y[j]);
+    }
+    free(g.partial);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_gemv_transposed(int m, int n, double alpha, const double* A,
+                            int lda, const double* x, double beta, double* y)
+{
+    matrix_gemv_transposed_mt(m, n, alpha, A, lda, x, beta, y,
+                              MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_vector_multiply_mt
+ *
+ * Arguments: matrix (or view)
+ *            vector of dimension num_columns
+ *            vector of dimension num_rows for the result, not v
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           out = m*v, straight from the matrix storage with nothing
+ *           allocated
+ *
+ * Dependency: matrix_gemv_mt
+ */
+void matrix_vector_multiply_mt(matrix_t* m, vector_t* v, vector_t* out,
+                               int num_threads)
+{
+    assert(m != NULL && v != NULL && out != NULL);
+    assert(v->dimension == m->num_columns && "Dimensions do not match");
+    assert(out->dimension == m->num_rows && "Result has the wrong dimension");
+    assert(out->vector != v->vector && "Result may not alias the operand");
+    matrix_gemv_mt(m->num_rows, m->num_columns, 1.0, m->data, m->stride,
+                   v->vector, 0.0, out->vector, num_threads);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_vector_multiply(matrix_t* m, vector_t* v, vector_t* out)
+{
+    matrix_vector_multiply_mt(m, v, out, MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_transpose_vector_multiply_mt
+ *
+ * Arguments: matrix (or view)
+ *            vector of dimension num_rows
+ *            vector of dimension num_columns for the result, not v
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           out = m'*v without transposing m
+ *
+ * Dependency: matrix_gemv_transposed_mt
+ */
+void matrix_transpose_vector_multiply_mt(matrix_t* m, vector_t* v,
+                                         vector_t* out, int num_threads)
+{
+    assert(m != NULL && v != NULL && out != NULL);
+    assert(v->dimension == m->num_rows && "Dimensions do not match");
+    assert(out->dimension == m->num_columns
+           && "Result has the wrong dimension");
+    assert(out->vector != v->vector && "Result may not alias the operand");
+    matrix_gemv_transposed_mt(m->num_rows, m->num_columns, 1.0, m->data,
+                              m->stride, v->vector, 0.0, out->vector,
+                              num_threads);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_transpose_vector_multiply(matrix_t* m, vector_t* v,
+                                      vector_t* out)
+{
+    matrix_transpose_vector_multiply_mt(m, v, out, MATRIX_THREADS_DEFAULT);
+}
@@ -0,0 +1,37 @@
+#ifndef MATRIX_GEMV_H
+#define MATRIX_GEMV_H
+
+#include "matrix.h"
+#include "../Vector/vector.h"
+
+/* Rows per chunk of the transposed product's partial sums, used when the
+ * matrix is too narrow to split by columns */
+#define GEMV_ROW_CHUNK 4096
+
+/* Columns of y updated together by the transposed product; 8KB of y
+ * stays in L1 while the rows stream past */
+#define GEMV_COLUMN_BLOCK 1024
+
+/* y = alpha*A*x + beta*y and y = alpha*A'*x + beta*y for a row-major m x n
+ * A with lda doubles between rows. With beta 0, y is not read. */
+void matrix_gemv(int m, int n, double alpha, const double* A, int lda,
+                 const double* x, double beta, double* y);
+void matrix_gemv_mt(int m, int n, double alpha, const double* A, int lda,
+                    const double* x, double beta, double* y,
+                    int num_threads);
+void matrix_gemv_transposed(int m, int n, double alpha, const double* A,
+                            int lda, const double* x, double beta, double* y);
+void matrix_gemv_transposed_mt(int m, int n, double alpha, const double* A,
+                               int lda, const double* x, double beta,
+                               double* y, int num_threads);
+
+/* out = m*v and out = m'*v, out a vector of the right dimension */
+void matrix_vector_multiply(matrix_t* m, vector_t* v, vector_t* out);
+void matrix_vector_multiply_mt(matrix_t* m, vector_t* v, vector_t* out,
+                               int num_threads);
+void matrix_transpose_vector_multiply(matrix_t* m, vector_t* v,
+                                      vector_t* out);
+void matrix_transpose_vector_multiply_mt(matrix_t* m, vector_t* v,
+                                         vector_t* out, int num_threads);
+
+#endif // MATRIX_GEMV_H
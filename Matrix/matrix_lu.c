@@ -0,0 +1,530 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_lu.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "../Vector/vector.h"
+#include "../Utilities/utils.h"
+
+static double lu_determinant(lu_t* f);
+static double lu_log_determinant(lu_t* f, int* sign);
+static int lu_rank(lu_t* f);
+static int lu_is_singular(lu_t* f);
+static vector_t* lu_solve(lu_t* f, vector_t* b);
+static matrix_t* lu_solve_matrix(lu_t* f, matrix_t* B);
+static matrix_t* lu_inverse(lu_t* f);
+static void destroy_lu(lu_t* f);
+static void lu_factorise(lu_t* f);
+static int lu_factorise_blocked(lu_t* f, int num_threads);
+static void lu_reset(lu_t* f, matrix_t* m);
+
+#define LU_ROW(f, i) ((f)->lu + (size_t)(i)*(f)->stride)
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_lu
+ *
+ * Arguments: matrix to factorise (any shape; left unchanged)
+ *
+ * Returns: pointer to the LU factorisation PA = LU of the matrix, computed
+ *          once with partial pivoting. Determinant, rank, solves and the
+ *          inverse are then read off the factors without redoing the
+ *          O(n^3) elimination.
+ *
+ * Dependency: create_lu_mt
+ */
+lu_t* create_lu(matrix_t* m)
+{
+    return create_lu_mt(m, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_lu_mt
+ *
+ * Arguments: matrix to factorise (any shape; left unchanged)
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: as create_lu
+ *           Uses the blocked factorisation, whose trailing updates run on
+ *           num_threads threads. If it meets a column without a usable
+ *           pivot (a rank deficient matrix) the factorisation is redone with
+ *           the unblocked row echelon elimination so that rank is exact.
+ *
+ * Dependency: matrix_aligned_alloc
+ *             lu_factorise_blocked
+ *             lu_factorise
+ */
+lu_t* create_lu_mt(matrix_t* m, int num_threads)
+{
+    assert(m != NULL);
+    lu_t* f = malloc(sizeof(*f));
+    assert(unwanted_null(f));
+    f->num_rows = m->num_rows;
+    f->num_columns = m->num_columns;
+    f->stride = matrix_stride(m->num_columns);
+    f->lu = matrix_aligned_alloc((size_t)f->num_rows*f->stride*sizeof(*f->lu));
+    f->pivot = malloc((f->num_rows ? f->num_rows : 1)*sizeof(*f->pivot));
+    assert(unwanted_null(f->pivot));
+    f->pivot_columns = malloc((f->num_rows ? f->num_rows : 1)
+                              *sizeof(*f->pivot_columns));
+    assert(unwanted_null(f->pivot_columns));
+
+    f->determinant = &lu_determinant;
+    f->log_determinant = &lu_log_determinant;
+    f->get_rank = &lu_rank;
+    f->is_singular = &lu_is_singular;
+    f->solve = &lu_solve;
+    f->solve_matrix = &lu_solve_matrix;
+    f->inverse = &lu_inverse;
+    f->free = &destroy_lu;
+
+    /* Pivots are judged relative to the largest entry, as in rank tests
+     * based on the singular values */
+    double largest_entry = 0.0;
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        for(j=0; j<m->num_columns; j++){
+            double a = fabs(MATRIX_ENTRY(m, i, j));
+            largest_entry = (a > largest_entry) ? a : largest_entry;
+        }
+    }
+    int larger_dim = (f->num_rows > f->num_columns) ? f->num_rows
+                                                    : f->num_columns;
+    f->tolerance = larger_dim * DBL_EPSILON * largest_entry;
+
+    lu_reset(f, m);
+    if (!lu_factorise_blocked(f, num_threads)){
+        lu_reset(f, m);
+        lu_factorise(f);
+    }
+    return f;
+}
+//-----------------------------------------------------------------------------
+
+/* Copies m into the factor storage and clears the pivoting state */
+static void lu_reset(lu_t* f, matrix_t* m)
+{
+    int i;
+    for(i=0; i<f->num_rows; i++){
+        memcpy(LU_ROW(f, i), MATRIX_ROW(m, i), f->num_columns*sizeof(*f->lu));
+        f->pivot[i] = i;
+    }
+    f->num_row_swaps = 0;
+    f->rank = 0;
+}
+
+/* Swaps whole rows a and b of the factors, recording the permutation */
+static void lu_swap_rows(lu_t* f, int a, int b)
+{
+    if (a == b){
+        return;
+    }
+    double* row_a = LU_ROW(f, a);
+    double* row_b = LU_ROW(f, b);
+    int j;
+    for(j=0; j<f->num_columns; j++){
+        double temp = row_a[j];
+        row_a[j] = row_b[j];
+        row_b[j] = temp;
+    }
+    int temp = f->pivot[a];
+    f->pivot[a] = f->pivot[b];
+    f->pivot[b] = temp;
+    f->num_row_swaps++;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_factorise
+ *
+ * Arguments: lu_t holding a copy of the matrix
+ *
+ * Returns: void
+ *           unblocked elimination, used for rank deficient matrices:
+ *           reduces the copy to row echelon form in place, storing the
+ *           multipliers below the pivots. A column whose candidate pivots
+ *           are all within tolerance of zero is skipped, so the number of
+ *           pivots found is the rank (for a non-singular square matrix this
+ *           is the usual LU factorisation).
+ */
+static void lu_factorise(lu_t* f)
+{
+    int rows = f->num_rows, cols = f->num_columns;
+    int r = 0, c, i, j;
+
+    for(c=0; c<cols && r<rows; c++){
+        int p = r;
+        double largest = fabs(LU_ROW(f, r)[c]);
+        for(i=r+1; i<rows; i++){
+            if (fabs(LU_ROW(f, i)[c]) > largest){
+                largest = fabs(LU_ROW(f, i)[c]);
+                p = i;
+            }
+        }
+        if (largest <= f->tolerance){
+            continue;
+        }
+        lu_swap_rows(f, p, r);
+        double* pivot_row = LU_ROW(f, r);
+        for(i=r+1; i<rows; i++){
+            double* row = LU_ROW(f, i);
+            double lambda = row[c]/pivot_row[c];
+            row[c] = lambda;
+            if (lambda == 0.0){
+                continue;
+            }
+            for(j=c+1; j<cols; j++){
+                row[j] -= lambda*pivot_row[j];
+            }
+        }
+        f->pivot_columns[r++] = c;
+    }
+    f->rank = r;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_panel
+ *
+ * Arguments: lu_t part way through the blocked factorisation
+ *            first column of the panel
+ *            number of columns in the panel
+ *
+ * Returns: 1 on success, 0 if a column had no pivot above tolerance
+ *           factorises the tall panel below and including row k with
+ *           partial pivoting. Row swaps are applied to whole rows, so the
+ *           columns either side of the panel are permuted as well.
+ */
+static int lu_panel(lu_t* f, int k, int nb)
+{
+    int j, i, c;
+    for(j=k; j<k+nb; j++){
+        int p = j;
+        double largest = fabs(LU_ROW(f, j)[j]);
+        for(i=j+1; i<f->num_rows; i++){
+            if (fabs(LU_ROW(f, i)[j]) > largest){
+                largest = fabs(LU_ROW(f, i)[j]);
+                p = i;
+            }
+        }
+        if (largest <= f->tolerance){
+            return 0;
+        }
+        lu_swap_rows(f, p, j);
+        double* pivot_row = LU_ROW(f, j);
+        for(i=j+1; i<f->num_rows; i++){
+            double* row = LU_ROW(f, i);
+            double lambda = (row[j] /= pivot_row[j]);
+            for(c=j+1; c<k+nb; c++){
+                row[c] -= lambda*pivot_row[c];
+            }
+        }
+        f->pivot_columns[f->rank++] = j;
+    }
+    return 1;
+}
+//-----------------------------------------------------------------------------
+
+typedef struct lu_trsm_args{
+    lu_t* f;
+    int k;
+    int nb;
+} lu_trsm_args_t;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_trsm_task
+ *
+ * Arguments: lu_trsm_args_t
+ *            range of column blocks to the right of the panel
+ *
+ * Returns: void
+ *           U12 = inverse(L11) * A12 for the given columns, where L11 is the
+ *           unit lower triangle of the panel's diagonal block
+ */
+static void lu_trsm_task(void* arg, int begin, int end)
+{
+    lu_trsm_args_t* t = arg;
+    lu_t* f = t->f;
+    int first = t->k + t->nb + begin*GEMM_NR;
+    int last = t->k + t->nb + end*GEMM_NR;
+    last = (last < f->num_columns) ? last : f->num_columns;
+    int r, i, c;
+    for(r=t->k+1; r<t->k+t->nb; r++){
+        double* row = LU_ROW(f, r);
+        for(i=t->k; i<r; i++){
+            double l = row[i];
+            double* above = LU_ROW(f, i);
+            for(c=first; c<last; c++){
+                row[c] -= l*above[c];
+            }
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_factorise_blocked
+ *
+ * Arguments: lu_t holding a copy of the matrix
+ *            number of threads for the trailing updates
+ *
+ * Returns: 1 on success, 0 if a column had no pivot above tolerance (the
+ *          factors are then incomplete and must be recomputed)
+ *           Right-looking blocked LU: factor a panel of LU_BLOCK columns,
+ *           solve for the block row of U to its right, then update the
+ *           trailing submatrix with one GEMM, A22 -= L21*U12, which is where
+ *           nearly all of the work (and all of the parallelism) is.
+ */
+static int lu_factorise_blocked(lu_t* f, int num_threads)
+{
+    int steps = (f->num_rows < f->num_columns) ? f->num_rows : f->num_columns;
+    int k;
+    for(k=0; k<steps; k+=LU_BLOCK){
+        int nb = (steps-k < LU_BLOCK) ? steps-k : LU_BLOCK;
+        if (!lu_panel(f, k, nb)){
+            return 0;
+        }
+        int right = f->num_columns - (k+nb);
+        int below = f->num_rows - (k+nb);
+        if (right <= 0){
+            continue;
+        }
+        lu_trsm_args_t t = {f, k, nb};
+        int col_blocks = (right + GEMM_NR - 1)/GEMM_NR;
+        matrix_parallel_for(col_blocks,
+                            matrix_threads_for_work(num_threads,
+                                                    (double)nb*nb*right),
+                            &lu_trsm_task, &t);
+        if (below > 0){
+            matrix_gemm_mt(below, right, nb, -1.0,
+                           LU_ROW(f, k+nb) + k, f->stride, 1,
+                           LU_ROW(f, k) + k+nb, f->stride, 1,
+                           1.0, LU_ROW(f, k+nb) + k+nb, f->stride,
+                           num_threads);
+        }
+    }
+    return 1;
+}
+//-----------------------------------------------------------------------------
+
+static int lu_rank(lu_t* f)
+{
+    assert(f != NULL);
+    return f->rank;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_is_singular
+ *
+ * Arguments: LU factorisation
+ *
+ * Returns: 1 if the factorised matrix is square and singular (or is not
+ *          square), 0 if it is invertible
+ */
+static int lu_is_singular(lu_t* f)
+{
+    assert(f != NULL);
+    return (f->num_rows != f->num_columns || f->rank < f->num_rows);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_determinant
+ *
+ * Arguments: LU factorisation of a square matrix
+ *
+ * Returns: the determinant: the product of U's diagonal, negated for an odd
+ *          number of row swaps. May overflow for large matrices, in which
+ *          case use log_determinant.
+ */
+static double lu_determinant(lu_t* f)
+{
+    assert(f != NULL);
+    assert(f->num_rows == f->num_columns
+           && "Determinant only defined for square matrices");
+    if (f->is_singular(f)){
+        return 0.0;
+    }
+    double det = 1.0;
+    int i;
+    for(i=0; i<f->num_rows; i++){
+        det *= LU_ROW(f, i)[i];
+    }
+    return (f->num_row_swaps % 2) ? -det : det;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_log_determinant
+ *
+ * Arguments: LU factorisation of a square matrix
+ *            pointer the sign of the determinant (-1, 0 or 1) is written to
+ *
+ * Returns: log of the absolute value of the determinant, -INFINITY if the
+ *          matrix is singular. det = sign * exp(return value)
+ */
+static double lu_log_determinant(lu_t* f, int* sign)
+{
+    assert(f != NULL && sign != NULL);
+    assert(f->num_rows == f->num_columns
+           && "Determinant only defined for square matrices");
+    if (f->is_singular(f)){
+        *sign = 0;
+        return -INFINITY;
+    }
+    double log_det = 0.0;
+    int s = (f->num_row_swaps % 2) ? -1 : 1;
+    int i;
+    for(i=0; i<f->num_rows; i++){
+        double u = LU_ROW(f, i)[i];
+        s = (u < 0) ? -s : s;
+        log_det += log(fabs(u));
+    }
+    *sign = s;
+    return log_det;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_solve
+ *
+ * Arguments: LU factorisation of a non-singular square matrix A
+ *            right hand side b
+ *
+ * Returns: a new vector x with Ax = b
+ *
+ * Dependency: create_zero_vector
+ */
+static vector_t* lu_solve(lu_t* f, vector_t* b)
+{
+    assert(f != NULL && b != NULL);
+    assert(!f->is_singular(f) && "Cannot solve with a singular matrix");
+    assert(b->dimension == f->num_rows);
+    int n = f->num_rows;
+    vector_t* x = create_zero_vector(n);
+    double* y = x->vector;
+    int i, j;
+
+    /* Ly = Pb */
+    for(i=0; i<n; i++){
+        double* l = LU_ROW(f, i);
+        double sum = b->vector[f->pivot[i]];
+        for(j=0; j<i; j++){
+            sum -= l[j]*y[j];
+        }
+        y[i] = sum;
+    }
+    /* Ux = y */
+    for(i=n-1; i>=0; i--){
+        double* u = LU_ROW(f, i);
+        double sum = y[i];
+        for(j=i+1; j<n; j++){
+            sum -= u[j]*y[j];
+        }
+        y[i] = sum/u[i];
+    }
+    return x;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_solve_matrix
+ *
+ * Arguments: LU factorisation of a non-singular n x n matrix A
+ *            n x k matrix of right hand sides B
+ *
+ * Returns: a new n x k matrix X with AX = B. Works a whole row of X at a
+ *          time, so all k right hand sides share each pass over the factors.
+ *
+ * Dependency: create_matrix
+ */
+static matrix_t* lu_solve_matrix(lu_t* f, matrix_t* B)
+{
+    assert(f != NULL && B != NULL);
+    assert(!f->is_singular(f) && "Cannot solve with a singular matrix");
+    assert(B->num_rows == f->num_rows);
+    int n = f->num_rows, k = B->num_columns;
+    matrix_t* X = create_matrix(n, k);
+    int i, j, c;
+
+    for(i=0; i<n; i++){
+        memcpy(MATRIX_ROW(X, i), MATRIX_ROW(B, f->pivot[i]),
+               k*sizeof(*X->data));
+    }
+    /* LY = PB */
+    for(i=0; i<n; i++){
+        double* l = LU_ROW(f, i);
+        double* x_i = MATRIX_ROW(X, i);
+        for(j=0; j<i; j++){
+            double* x_j = MATRIX_ROW(X, j);
+            for(c=0; c<k; c++){
+                x_i[c] -= l[j]*x_j[c];
+            }
+        }
+    }
+    /* UX = Y */
+    for(i=n-1; i>=0; i--){
+        double* u = LU_ROW(f, i);
+        double* x_i = MATRIX_ROW(X, i);
+        for(j=i+1; j<n; j++){
+            double* x_j = MATRIX_ROW(X, j);
+            for(c=0; c<k; c++){
+                x_i[c] -= u[j]*x_j[c];
+            }
+        }
+        for(c=0; c<k; c++){
+            x_i[c] /= u[i];
+        }
+    }
+    return X;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: lu_inverse
+ *
+ * Arguments: LU factorisation of a non-singular square matrix
+ *
+ * Returns: a new matrix that is the inverse of the factorised matrix
+ *
+ * Dependency: lu_solve_matrix
+ */
+static matrix_t* lu_inverse(lu_t* f)
+{
+    assert(f != NULL);
+    int n = f->num_rows;
+    matrix_t* identity = create_matrix(n, n);
+    int i;
+    for(i=0; i<n; i++){
+        MATRIX_ENTRY(identity, i, i) = 1.0;
+    }
+    matrix_t* inverse = f->solve_matrix(f, identity);
+    identity->free(identity);
+    return inverse;
+}
+//-----------------------------------------------------------------------------
+
+static void destroy_lu(lu_t* f)
+{
+    assert(f != NULL);
+    matrix_aligned_free(f->lu);
+    free(f->pivot);
+    free(f->pivot_columns);
+    free(f);
+}
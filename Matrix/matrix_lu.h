@@ -0,0 +1,38 @@
+#ifndef MATRIX_LU_H
+#define MATRIX_LU_H
+
+#include "matrix.h"
+#include "../Vector/vector.h"
+
+/* Columns factorised per panel of the blocked LU */
+#define LU_BLOCK 64
+
+typedef struct lu lu_t;
+
+/* PA = LU with partial pivoting. L (unit diagonal, not stored) and U share
+ * one row-major block: L's multipliers sit below the diagonal of U. */
+struct lu{
+    double* lu;
+    int stride;
+    int num_rows;
+    int num_columns;
+    int* pivot;             // row i of PA is row pivot[i] of A
+    int* pivot_columns;     // column of row i's pivot in U, for i < rank
+    int num_row_swaps;
+    int rank;
+    double tolerance;       // pivots no larger than this count as zero
+
+    double (*determinant)(lu_t* f);
+    double (*log_determinant)(lu_t* f, int* sign);
+    int (*get_rank)(lu_t* f);
+    int (*is_singular)(lu_t* f);
+    vector_t* (*solve)(lu_t* f, vector_t* b);
+    matrix_t* (*solve_matrix)(lu_t* f, matrix_t* B);
+    matrix_t* (*inverse)(lu_t* f);
+    void (*free)(lu_t* f);
+};
+
+lu_t* create_lu(matrix_t* m);
+lu_t* create_lu_mt(matrix_t* m, int num_threads);
+
+#endif // MATRIX_LU_H
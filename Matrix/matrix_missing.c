@@ -0,0 +1,748 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_missing.h"
+#include "matrix_gemm.h"
+#include "matrix_simd.h"
+#include "matrix_stats.h"
+#include "matrix_prefix.h"
+#include "matrix_parallel.h"
+#include "../Vector/vector.h"
+#include "../Utilities/utils.h"
+
+static int missing_mode = MATRIX_MISSING_BITMAP;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_na
+ *
+ * Arguments: None
+ *
+ * Returns: MATRIX_NA, the NaN that marks a missing value
+ */
+double matrix_na(void)
+{
+    uint64_t bits = MATRIX_NA_BITS;
+    double na;
+    memcpy(&na, &bits, sizeof(na));
+    return na;
+}
+//-----------------------------------------------------------------------------
+
+/* 1 if x is MATRIX_NA, bit for bit (an ordinary NaN is not) */
+int matrix_is_na(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits == MATRIX_NA_BITS;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_set_missing_mode
+ *
+ * Arguments: MATRIX_MISSING_BITMAP (the default) or MATRIX_MISSING_NAN
+ *
+ * Returns: void
+ *           sets how csv_to_matrix and matrix_set_missing record missing
+ *           values from now on, for every thread
+ */
+void matrix_set_missing_mode(int mode)
+{
+    assert((mode == MATRIX_MISSING_BITMAP || mode == MATRIX_MISSING_NAN)
+           && "Mode not recognised");
+    missing_mode = mode;
+}
+//-----------------------------------------------------------------------------
+
+int matrix_get_missing_mode(void)
+{
+    return missing_mode;
+}
+
+/* Gives m a validity bitmap with every entry present. Views copy the
+ * parent's bitmap pointer when they are made, so they would miss one added
+ * later. */
+static void missing_alloc_bitmap(matrix_t* m)
+{
+    assert(!m->is_view
+           && "Cannot add a validity bitmap through a view, set it on the parent");
+    assert(m->num_views == 0
+           && "Cannot add a validity bitmap while the matrix has views");
+    int words = (m->num_columns + 63)/64;
+    words = words ? words : 1;
+    size_t bytes = (size_t)(m->num_rows ? m->num_rows : 1)*words
+                   *sizeof(*m->valid);
+    m->valid = malloc(bytes);
+    assert(unwanted_null(m->valid));
+    memset(m->valid, 0xff, bytes);
+    m->valid_stride = words;
+    m->valid_offset = 0;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_is_missing
+ *
+ * Arguments: matrix (or view)
+ *            row and column of the entry
+ *
+ * Returns: 1 if the entry is missing (bit clear or MATRIX_NA), otherwise 0
+ */
+int matrix_is_missing(matrix_t* m, int row, int col)
+{
+    assert(m != NULL);
+    assert(row >= 0 && row < m->num_rows && col >= 0 && col < m->num_columns);
+    if (m->valid != NULL){
+        size_t bit = MATRIX_VALID_BIT(m, row, col);
+        if (!((m->valid[bit >> 6] >> (bit & 63)) & 1)){
+            return 1;
+        }
+    }
+    return matrix_is_na(MATRIX_ENTRY(m, row, col));
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_set_missing
+ *
+ * Arguments: matrix (a view, or a matrix with views, only if it already
+ *             has a bitmap, or in MATRIX_MISSING_NAN mode)
+ *            row and column of the entry
+ *
+ * Returns: void
+ *           records the entry as missing in the current missing mode. The
+ *           bitmap is allocated, all present, the first time it is needed.
+ */
+void matrix_set_missing(matrix_t* m, int row, int col)
+{
+    assert(m != NULL && !m->read_only && "Matrix is read only");
+    assert(row >= 0 && row < m->num_rows && col >= 0 && col < m->num_columns);
+    if (m->stats != NULL){
+        matrix_stats_remove_entry(m, row, col);
+    }
+    matrix_prefix_mark_dirty(m, row);
+    if (missing_mode == MATRIX_MISSING_NAN){
+        MATRIX_ENTRY(m, row, col) = matrix_na();
+        return;
+    }
+    if (m->valid == NULL){
+        missing_alloc_bitmap(m);
+    }
+    size_t bit = MATRIX_VALID_BIT(m, row, col);
+    m->valid[bit >> 6] &= ~((uint64_t)1 << (bit & 63));
+    MATRIX_ENTRY(m, row, col) = 0.0;
+}
+//-----------------------------------------------------------------------------
+
+/* Sets the entry's validity bit, if the matrix has a bitmap (set_entry) */
+void matrix_mark_present(matrix_t* m, int row, int col)
+{
+    if (m->valid != NULL){
+        size_t bit = MATRIX_VALID_BIT(m, row, col);
+        m->valid[bit >> 6] |= (uint64_t)1 << (bit & 63);
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_copy_missing
+ *
+ * Arguments: matrix without a bitmap
+ *            matrix (or view) of the same size
+ *
+ * Returns: void
+ *           gives dst a copy of src's validity bitmap, if src has one. Rows
+ *           are copied a word at a time unless src is a view whose bits do
+ *           not start on a word.
+ */
+void matrix_copy_missing(matrix_t* dst, matrix_t* src)
+{
+    assert(dst != NULL && src != NULL && dst->valid == NULL);
+    assert(dst->num_rows == src->num_rows
+           && dst->num_columns == src->num_columns);
+    if (src->valid == NULL){
+        return;
+    }
+    missing_alloc_bitmap(dst);
+    int i, j;
+    for(i=0; i<src->num_rows; i++){
+        uint64_t* to = dst->valid + (size_t)i*dst->valid_stride;
+        if (src->valid_offset % 64 == 0){
+            memcpy(to, src->valid + MATRIX_VALID_BIT(src, i, 0)/64,
+                   dst->valid_stride*sizeof(*to));
+            continue;
+        }
+        for(j=0; j<src->num_columns; j++){
+            size_t bit = MATRIX_VALID_BIT(src, i, j);
+            if (!((src->valid[bit >> 6] >> (bit & 63)) & 1)){
+                to[j/64] &= ~((uint64_t)1 << (j % 64));
+            }
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/* Validity bit of entry (i, j) of a matrix with a bitmap */
+static int missing_get_bit(matrix_t* m, int i, int j)
+{
+    size_t bit = MATRIX_VALID_BIT(m, i, j);
+    return (m->valid[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static void missing_put_bit(matrix_t* m, int i, int j, int present)
+{
+    size_t bit = MATRIX_VALID_BIT(m, i, j);
+    if (present){
+        m->valid[bit >> 6] |= (uint64_t)1 << (bit & 63);
+    }
+    else{
+        m->valid[bit >> 6] &= ~((uint64_t)1 << (bit & 63));
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_swap_missing
+ *
+ * Arguments: matrix (or view)
+ *            the two rows swapped
+ *
+ * Returns: void
+ *           swaps the rows' validity bits, if m has a bitmap, so they follow
+ *           a swap of the rows' entries
+ */
+void matrix_swap_missing(matrix_t* m, int row_a, int row_b)
+{
+    assert(m != NULL);
+    assert(row_a >= 0 && row_a < m->num_rows);
+    assert(row_b >= 0 && row_b < m->num_rows);
+    if (m->valid == NULL || row_a == row_b){
+        return;
+    }
+    int j;
+    for(j=0; j<m->num_columns; j++){
+        int a = missing_get_bit(m, row_a, j);
+        missing_put_bit(m, row_a, j, missing_get_bit(m, row_b, j));
+        missing_put_bit(m, row_b, j, a);
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_permute_missing
+ *
+ * Arguments: matrix (or view)
+ *            for each row, the row whose bits it takes
+ *
+ * Returns: void
+ *           reorders the rows' validity bits, if m has a bitmap, to follow
+ *           a permutation of the rows' entries. The bits are copied out
+ *           first, so order[i] may be any row.
+ */
+void matrix_permute_missing(matrix_t* m, const int* order)
+{
+    assert(m != NULL && order != NULL);
+    if (m->valid == NULL || m->num_rows == 0 || m->num_columns == 0){
+        return;
+    }
+    int words = (m->num_columns + 63)/64;
+    uint64_t* bits = calloc((size_t)m->num_rows*words, sizeof(*bits));
+    assert(unwanted_null(bits));
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        for(j=0; j<m->num_columns; j++){
+            bits[(size_t)i*words + j/64] |= (uint64_t)missing_get_bit(m, i, j)
+                                            << (j % 64);
+        }
+    }
+    for(i=0; i<m->num_rows; i++){
+        assert(order[i] >= 0 && order[i] < m->num_rows);
+        const uint64_t* from = bits + (size_t)order[i]*words;
+        for(j=0; j<m->num_columns; j++){
+            missing_put_bit(m, i, j, (from[j/64] >> (j % 64)) & 1);
+        }
+    }
+    free(bits);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_transpose_missing
+ *
+ * Arguments: matrix without a bitmap
+ *            matrix (or view) whose transpose dst holds
+ *
+ * Returns: void
+ *           gives dst the transpose of src's validity bitmap, if src has
+ *           one, so entry (j, i) of dst is missing if (i, j) of src is
+ */
+void matrix_transpose_missing(matrix_t* dst, matrix_t* src)
+{
+    assert(dst != NULL && src != NULL && dst->valid == NULL);
+    assert(dst->num_rows == src->num_columns
+           && dst->num_columns == src->num_rows);
+    if (src->valid == NULL){
+        return;
+    }
+    missing_alloc_bitmap(dst);
+    int i, j;
+    for(i=0; i<src->num_rows; i++){
+        for(j=0; j<src->num_columns; j++){
+            if (!missing_get_bit(src, i, j)){
+                missing_put_bit(dst, j, i, 0);
+            }
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+#ifdef __GNUC__
+/* Four doubles and the matching 64 bit masks */
+typedef double missing_lanes_t __attribute__((vector_size(32)));
+typedef int64_t missing_bits_t __attribute__((vector_size(32)));
+#define MISSING_LANES 4
+
+/* Lane k is all ones if bit k of the index is set */
+static const missing_bits_t missing_expand[16] = {
+    { 0,  0,  0,  0}, {-1,  0,  0,  0}, { 0, -1,  0,  0}, {-1, -1,  0,  0},
+    { 0,  0, -1,  0}, {-1,  0, -1,  0}, { 0, -1, -1,  0}, {-1, -1, -1,  0},
+    { 0,  0,  0, -1}, {-1,  0,  0, -1}, { 0, -1,  0, -1}, {-1, -1,  0, -1},
+    { 0,  0, -1, -1}, {-1,  0, -1, -1}, { 0, -1, -1, -1}, {-1, -1, -1, -1}
+};
+#else
+#define MISSING_LANES 0
+#endif
+
+typedef struct missing_args{
+    matrix_t* m;
+    double* sums;           // present entries summed per column, or NULL
+    int* counts;            // present entries per column, or NULL
+    long* missing;          // missing entries per block, or NULL
+    const double* fill;     // values to fill each column with, or NULL
+    int impute;             // 1 to fill each column with its own mean
+    int first_width;        // columns in block 0, up to the first word edge
+} missing_args_t;
+
+/* Block b covers the columns whose validity bits share one word per row */
+static void missing_block_range(missing_args_t* a, int b, int* c0, int* c1)
+{
+    *c0 = (b == 0) ? 0 : a->first_width + (b - 1)*MISSING_BLOCK;
+    *c1 = (b == 0) ? a->first_width : *c0 + MISSING_BLOCK;
+    *c1 = (*c1 < a->m->num_columns) ? *c1 : a->m->num_columns;
+}
+
+static int missing_num_blocks(missing_args_t* a)
+{
+    int columns = a->m->num_columns;
+    if (columns <= a->first_width){
+        return (columns > 0);
+    }
+    return 1 + (columns - a->first_width + MISSING_BLOCK - 1)/MISSING_BLOCK;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: missing_block_fill
+ *
+ * Arguments: missing_args_t
+ *            columns [c0, c1) of one block
+ *            value for each column of the block
+ *            1 if a MATRIX_NA may be in the block, 0 if only the bitmap
+ *             marks entries missing
+ *
+ * Returns: void
+ *           writes the values over the missing entries and marks them
+ *           present. Without NAs only the bitmap is scanned, so entries that
+ *           are present are neither read nor written.
+ */
+static void missing_block_fill(missing_args_t* a, int c0, int c1,
+                               const double* values, int na_seen)
+{
+    matrix_t* m = a->m;
+    int width = c1 - c0;
+    uint64_t block_mask = (width == 64) ? ~(uint64_t)0
+                                        : (((uint64_t)1 << width) - 1);
+    int shift = (m->valid_offset + c0) & 63;
+    int i, j;
+    for(i=0; i<m->num_rows; i++){
+        double* x = MATRIX_ROW(m, i) + c0;
+        uint64_t* word = (m->valid != NULL)
+            ? m->valid + MATRIX_VALID_BIT(m, i, c0)/64 : NULL;
+        if (!na_seen){
+            uint64_t gaps = ~(*word >> shift) & block_mask;
+            while (gaps){
+                j = __builtin_ctzll(gaps);
+                x[j] = values[j];
+                gaps &= gaps - 1;
+            }
+        }
+        else{
+            uint64_t present = (word != NULL) ? (*word >> shift) : ~(uint64_t)0;
+            for(j=0; j<width; j++){
+                if (!((present >> j) & 1) || matrix_is_na(x[j])){
+                    x[j] = values[j];
+                }
+            }
+        }
+        if (word != NULL){
+            *word |= block_mask << shift;
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: missing_sum_blocks
+ *
+ * Arguments: missing_args_t
+ *            first block of columns
+ *            one past the last block
+ *            sum and count for each column of the blocks, set here
+ *
+ * Returns: 1 if a MATRIX_NA was seen in the blocks, otherwise 0
+ *           one pass down the rows sums and counts the present entries of
+ *           every column, four columns per vector with the validity bits
+ *           expanded to lane masks and MATRIX_NA lanes masked off. The
+ *           accumulators are indexed by column and stay in L1 however many
+ *           rows there are, so each row is read once, in order. Each column
+ *           still adds its entries in row order, as a scalar loop would.
+ *           Always inlined into the kernels below, so the vectors are
+ *           compiled for each instruction set.
+ */
+MATRIX_SIMD_INLINE int missing_sum_blocks(missing_args_t* a, int begin, int end,
+                                          double* sums, long* present)
+{
+    matrix_t* m = a->m;
+    int first, last, c0, c1;
+    missing_block_range(a, begin, &first, &c1);
+    missing_block_range(a, end - 1, &c0, &last);
+    int columns = last - first;
+    int na_seen = 0;
+    int b, i, j;
+    memset(sums, 0, columns*sizeof(*sums));
+    memset(present, 0, columns*sizeof(*present));
+#ifdef __GNUC__
+    /* Vector groups start at each block's first column */
+    int vectors = (end - begin)*(MISSING_BLOCK/MISSING_LANES);
+    missing_lanes_t* lane_sums = matrix_aligned_alloc(vectors
+                                                      *sizeof(*lane_sums));
+    missing_bits_t* lane_present = matrix_aligned_alloc(vectors
+                                                        *sizeof(*lane_present));
+    missing_bits_t na_lanes = {0};
+    missing_bits_t na = {0};
+    na += (int64_t)MATRIX_NA_BITS;
+    memset(lane_sums, 0, vectors*sizeof(*lane_sums));
+    memset(lane_present, 0, vectors*sizeof(*lane_present));
+#endif
+    for(i=0; i<m->num_rows; i++){
+        const double* row = MATRIX_ROW(m, i);
+        const uint64_t* words = (m->valid != NULL)
+            ? m->valid + MATRIX_VALID_BIT(m, i, first)/64 : NULL;
+        for(b=begin; b<end; b++){
+            missing_block_range(a, b, &c0, &c1);
+            const double* x = row + c0;
+            int width = c1 - c0;
+            uint64_t bits = (words != NULL)
+                ? words[b - begin] >> ((m->valid_offset + c0) & 63)
+                : ~(uint64_t)0;
+            int g = 0;
+#ifdef __GNUC__
+            missing_lanes_t* block_sums = lane_sums
+                + (b - begin)*(MISSING_BLOCK/MISSING_LANES);
+            missing_bits_t* block_present = lane_present
+                + (b - begin)*(MISSING_BLOCK/MISSING_LANES);
+            for(; g<width/MISSING_LANES; g++){
+                missing_lanes_t v = MATRIX_SIMD_LOAD(missing_lanes_t,
+                                                     x + g*MISSING_LANES);
+                missing_bits_t is_na = ((missing_bits_t)v == na);
+                missing_bits_t ok = missing_expand[(bits >> (g*MISSING_LANES))
+                                                   & 15] & ~is_na;
+                block_sums[g] += (missing_lanes_t)((missing_bits_t)v & ok);
+                block_present[g] -= ok;
+                na_lanes |= is_na;
+            }
+#endif
+            for(j=g*MISSING_LANES; j<width; j++){
+                int is_na = matrix_is_na(x[j]);
+                if (((bits >> j) & 1) && !is_na){
+                    sums[c0 - first + j] += x[j];
+                    present[c0 - first + j]++;
+                }
+                na_seen |= is_na;
+            }
+        }
+    }
+#ifdef __GNUC__
+    for(b=begin; b<end; b++){
+        missing_block_range(a, b, &c0, &c1);
+        int lanes = (c1 - c0)/MISSING_LANES*MISSING_LANES;
+        for(j=0; j<lanes; j++){
+            int v = (b - begin)*(MISSING_BLOCK/MISSING_LANES) + j/MISSING_LANES;
+            sums[c0 - first + j] = lane_sums[v][j % MISSING_LANES];
+            present[c0 - first + j] = lane_present[v][j % MISSING_LANES];
+        }
+    }
+    for(j=0; j<MISSING_LANES; j++){
+        na_seen |= (na_lanes[j] != 0);
+    }
+    matrix_aligned_free(lane_sums);
+    matrix_aligned_free(lane_present);
+#endif
+    return na_seen;
+}
+//-----------------------------------------------------------------------------
+
+typedef int (*missing_sum_kernel_t)(missing_args_t* a, int begin, int end,
+                                    double* sums, long* present);
+
+static int missing_sum_baseline(missing_args_t* a, int begin, int end,
+                                double* sums, long* present)
+{
+    return missing_sum_blocks(a, begin, end, sums, present);
+}
+
+#ifdef MATRIX_HAVE_X86
+/* The same loop with the 64 bit lane compares done in one instruction;
+ * baseline x86-64 has to emulate them. Used whenever the gemm SIMD kernels
+ * are (matrix_gemm_simd_enabled). */
+__attribute__((target("avx2")))
+static int missing_sum_avx2(missing_args_t* a, int begin, int end,
+                            double* sums, long* present)
+{
+    return missing_sum_blocks(a, begin, end, sums, present);
+}
+#endif
+
+static missing_sum_kernel_t missing_sum_kernel(void)
+{
+#ifdef MATRIX_HAVE_X86
+    if (matrix_gemm_simd_enabled()){
+        return &missing_sum_avx2;
+    }
+#endif
+    return &missing_sum_baseline;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: missing_task
+ *
+ * Arguments: missing_args_t
+ *            first block of columns
+ *            one past the last block
+ *
+ * Returns: void
+ *           sums and counts the present entries of every column of the
+ *           blocks and then, if asked, fills the missing entries of each
+ *           block, with the column means when imputing. Blocks own whole
+ *           bitmap words, so threads never write the same word.
+ *
+ * Dependency: missing_sum_kernel
+ *             missing_block_fill
+ */
+static void missing_task(void* arg, int begin, int end)
+{
+    missing_args_t* a = arg;
+    matrix_t* m = a->m;
+    int first, last, c0, c1, b, j;
+    missing_block_range(a, begin, &first, &c1);
+    missing_block_range(a, end - 1, &c0, &last);
+    double* sums = malloc((last - first)*sizeof(*sums));
+    long* present = malloc((last - first)*sizeof(*present));
+    assert(unwanted_null(sums) && unwanted_null(present));
+    int na_seen = missing_sum_kernel()(a, begin, end, sums, present);
+    for(b=begin; b<end; b++){
+        missing_block_range(a, b, &c0, &c1);
+        int width = c1 - c0;
+        double* block_sums = sums + (c0 - first);
+        long* block_present = present + (c0 - first);
+        long missing = 0;
+        for(j=0; j<width; j++){
+            missing += m->num_rows - block_present[j];
+            if (a->sums != NULL){
+                a->sums[c0 + j] = block_sums[j];
+            }
+            if (a->counts != NULL){
+                a->counts[c0 + j] = (int)block_present[j];
+            }
+        }
+        if (a->missing != NULL){
+            a->missing[b] = missing;
+        }
+        if (missing == 0 || (a->fill == NULL && !a->impute)){
+            continue;
+        }
+        double values[MISSING_BLOCK];
+        for(j=0; j<width; j++){
+            values[j] = a->impute ? (block_present[j]
+                                     ? block_sums[j]/block_present[j] : 0.0)
+                                  : a->fill[c0 + j];
+        }
+        missing_block_fill(a, c0, c1, values, na_seen);
+    }
+    free(sums);
+    free(present);
+}
+//-----------------------------------------------------------------------------
+
+/* Runs missing_task over every block of m's columns */
+static void missing_run(missing_args_t* a, int num_threads)
+{
+    matrix_t* m = a->m;
+    int off = m->valid_offset & 63;
+    a->first_width = MISSING_BLOCK - off;
+    int blocks = missing_num_blocks(a);
+    matrix_parallel_for(blocks,
+                        matrix_threads_for_work(num_threads,
+                                                (double)m->num_rows
+                                                *m->num_columns),
+                        &missing_task, a);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_count_missing
+ *
+ * Arguments: matrix (or view)
+ *
+ * Returns: the number of missing entries
+ *
+ * Dependency: matrix_count_missing_mt
+ */
+long matrix_count_missing(matrix_t* m)
+{
+    return matrix_count_missing_mt(m, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+long matrix_count_missing_mt(matrix_t* m, int num_threads)
+{
+    assert(m != NULL);
+    missing_args_t a = {m, NULL, NULL, NULL, NULL, 0, 0};
+    int blocks = (m->num_columns + MISSING_BLOCK - 1)/MISSING_BLOCK + 1;
+    a.missing = calloc(blocks, sizeof(*a.missing));
+    assert(unwanted_null(a.missing));
+    missing_run(&a, num_threads);
+    long total = 0;
+    int b;
+    for(b=0; b<blocks; b++){
+        total += a.missing[b];
+    }
+    free(a.missing);
+    return total;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_masked_column_sums_mt
+ *
+ * Arguments: matrix (or view)
+ *            array of num_columns doubles for the sums, or NULL
+ *            array of num_columns ints for the counts, or NULL
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           sums[j] is the sum of the present entries of column j and
+ *           counts[j] how many there are, from one pass over the matrix
+ */
+void matrix_masked_column_sums_mt(matrix_t* m, double* sums, int* counts,
+                                  int num_threads)
+{
+    assert(m != NULL);
+    missing_args_t a = {m, sums, counts, NULL, NULL, 0, 0};
+    missing_run(&a, num_threads);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_masked_column_means_mt
+ *
+ * Arguments: matrix (or view)
+ *            array of num_columns doubles for the means
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           means[j] is the mean of the present entries of column j, 0 if
+ *           there are none (as vector_impute_missing_value)
+ *
+ * Dependency: matrix_masked_column_sums_mt
+ */
+void matrix_masked_column_means_mt(matrix_t* m, double* means,
+                                   int num_threads)
+{
+    assert(m != NULL && (means != NULL || m->num_columns == 0));
+    int* counts = malloc((m->num_columns ? m->num_columns : 1)
+                         *sizeof(*counts));
+    assert(unwanted_null(counts));
+    matrix_masked_column_sums_mt(m, means, counts, num_threads);
+    int j;
+    for(j=0; j<m->num_columns; j++){
+        means[j] = counts[j] ? means[j]/counts[j] : 0.0;
+    }
+    free(counts);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_fill_missing_mt
+ *
+ * Arguments: matrix (or view), not read only
+ *            value to fill each column's missing entries with
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           every missing entry of column j becomes values[j] and is marked
+ *           present
+ */
+void matrix_fill_missing_mt(matrix_t* m, const double* values,
+                            int num_threads)
+{
+    assert(m != NULL && (values != NULL || m->num_columns == 0));
+    assert(!m->read_only && "Matrix is read only");
+    missing_args_t a = {m, NULL, NULL, NULL, values, 0, 0};
+    missing_run(&a, num_threads);
+    matrix_invalidate_stats(m);
+    matrix_prefix_mark_dirty(m, 0);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_impute_missing_values_mt
+ *
+ * Arguments: matrix (or view), not read only
+ *            method of imputation (MEAN, anything else is ignored as by
+ *             vector_impute_missing_value)
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           replaces each missing entry with the mean of the present entries
+ *           of its column. Threads take blocks of columns; each block is
+ *           summed in one pass and then only its missing entries are
+ *           written.
+ *
+ * Dependency: missing_task
+ */
+void matrix_impute_missing_values_mt(matrix_t* m, int mode, int num_threads)
+{
+    assert(m != NULL);
+    assert(!m->read_only && "Matrix is read only");
+    if (mode != MEAN){
+        return;
+    }
+    missing_args_t a = {m, NULL, NULL, NULL, NULL, 1, 0};
+    missing_run(&a, num_threads);
+    matrix_invalidate_stats(m);
+    matrix_prefix_mark_dirty(m, 0);
+}
+//-----------------------------------------------------------------------------
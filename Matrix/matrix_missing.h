@@ -0,0 +1,52 @@
+#ifndef MATRIX_MISSING_H
+#define MATRIX_MISSING_H
+
+#include <stdint.h>
+#include "matrix.h"
+
+/* How missing values are recorded (csv_to_matrix, matrix_set_missing):
+ *   MATRIX_MISSING_BITMAP  the entry's bit in the matrix's validity bitmap
+ *                          is cleared and the entry holds 0.0
+ *   MATRIX_MISSING_NAN     the entry holds MATRIX_NA, a quiet NaN with a
+ *                          payload no arithmetic produces, and no bitmap is
+ *                          needed
+ * Either way an entry is missing if its bit is clear or it holds MATRIX_NA,
+ * so matrices recorded both ways mix freely. Other NaNs are values. */
+#define MATRIX_MISSING_BITMAP 0
+#define MATRIX_MISSING_NAN 1
+
+/* R's NA payload (1954) in a quiet NaN */
+#define MATRIX_NA_BITS 0x7ff80000000007a2ULL
+#define MATRIX_NA (matrix_na())
+
+/* Columns handled per task by the column kernels: one bitmap word per row */
+#define MISSING_BLOCK 64
+
+/* Bit of entry (i, j) counted from m->valid */
+#define MATRIX_VALID_BIT(m, i, j) ((size_t)(i)*(m)->valid_stride*64           \
+                                   + (size_t)(m)->valid_offset + (j))
+
+double matrix_na(void);
+int matrix_is_na(double x);
+void matrix_set_missing_mode(int mode);
+int matrix_get_missing_mode(void);
+
+int matrix_is_missing(matrix_t* m, int row, int col);
+void matrix_set_missing(matrix_t* m, int row, int col);
+void matrix_mark_present(matrix_t* m, int row, int col);
+void matrix_copy_missing(matrix_t* dst, matrix_t* src);
+void matrix_swap_missing(matrix_t* m, int row_a, int row_b);
+void matrix_permute_missing(matrix_t* m, const int* order);
+void matrix_transpose_missing(matrix_t* dst, matrix_t* src);
+
+long matrix_count_missing(matrix_t* m);
+long matrix_count_missing_mt(matrix_t* m, int num_threads);
+void matrix_masked_column_sums_mt(matrix_t* m, double* sums, int* counts,
+                                  int num_threads);
+void matrix_masked_column_means_mt(matrix_t* m, double* means,
+                                   int num_threads);
+void matrix_fill_missing_mt(matrix_t* m, const double* values,
+                            int num_threads);
+void matrix_impute_missing_values_mt(matrix_t* m, int mode, int num_threads);
+
+#endif // MATRIX_MISSING_H
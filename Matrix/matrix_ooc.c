@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "matrix.h"
+#include "matrix_ooc.h"
+#include "matrix_gemm.h"
+#include "matrix_binary.h"
+#include "matrix_parallel.h"
+#include "../Utilities/utils.h"
+
+/* Advice for ooc_advise */
+#define OOC_READ_AHEAD 0
+#define OOC_RELEASE 1
+
+/* One tile of an operand held in memory, rows of cache->tile doubles */
+typedef struct ooc_slot{
+    double* data;
+    matrix_t* source;       // operand the tile is from, NULL if empty
+    int tile_row;
+    int tile_col;
+    long last_use;
+} ooc_slot_t;
+
+/* Least recently used tiles are replaced first, except the first pin_count
+ * tiles of row pin_row of pin_source: the row panel of A the current product
+ * tiles reuse. There is always an unpinned slot besides the newest. */
+typedef struct ooc_cache{
+    ooc_slot_t* slots;
+    int num_slots;
+    int tile;
+    long clock;
+    long loads;
+    long hits;
+    matrix_t* pin_source;
+    int pin_row;
+    int pin_count;
+} ooc_cache_t;
+
+/* Rows and columns of tile (tile_row, tile_col) of m, short at the edges */
+static void ooc_tile_shape(matrix_t* m, int tile, int tile_row, int tile_col,
+                           int* rows, int* columns)
+{
+    int r = tile_row*tile, c = tile_col*tile;
+    *rows = (m->num_rows - r < tile) ? m->num_rows - r : tile;
+    *columns = (m->num_columns - c < tile) ? m->num_columns - c : tile;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: ooc_advise
+ *
+ * Arguments: mapped operand
+ *            tile side, tile row and tile column
+ *            OOC_READ_AHEAD or OOC_RELEASE
+ *
+ * Returns: void
+ *           advises the kernel on the pages under each row of the tile: read
+ *           ahead starts reading them in the background, release drops them
+ *           from the process once copied (they stay in the page cache and
+ *           fault back in if a neighbouring tile needs them). Nothing for
+ *           matrices that are not mapped.
+ */
+static void ooc_advise(matrix_t* m, int tile, int tile_row, int tile_col,
+                       int advice)
+{
+#if !defined(_WIN32) && defined(MADV_WILLNEED) && defined(MADV_DONTNEED)
+    if (m->mapping == NULL){
+        return;
+    }
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    int rows, columns, i;
+    ooc_tile_shape(m, tile, tile_row, tile_col, &rows, &columns);
+    for(i=0; i<rows; i++){
+        const double* x = MATRIX_ROW(m, tile_row*tile + i) + tile_col*tile;
+        uintptr_t first = (uintptr_t)x & ~(page - 1);
+        uintptr_t last = (uintptr_t)(x + columns);
+        madvise((void*)first, last - first,
+                (advice == OOC_READ_AHEAD) ? MADV_WILLNEED : MADV_DONTNEED);
+    }
+#else
+    (void)m; (void)tile; (void)tile_row; (void)tile_col; (void)advice;
+#endif
+}
+//-----------------------------------------------------------------------------
+
+static ooc_slot_t* ooc_find(ooc_cache_t* cache, matrix_t* m, int tile_row,
+                            int tile_col)
+{
+    int s;
+    for(s=0; s<cache->num_slots; s++){
+        ooc_slot_t* slot = &cache->slots[s];
+        if (slot->source == m && slot->tile_row == tile_row
+            && slot->tile_col == tile_col){
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: ooc_get
+ *
+ * Arguments: tile cache
+ *            operand, tile row and tile column
+ *
+ * Returns: the tile, from the cache or copied from the operand into the
+ *           least recently used unpinned slot
+ *
+ * Dependency: ooc_find, ooc_advise
+ */
+static const double* ooc_get(ooc_cache_t* cache, matrix_t* m, int tile_row,
+                             int tile_col)
+{
+    ooc_slot_t* slot = ooc_find(cache, m, tile_row, tile_col);
+    cache->clock++;
+    if (slot != NULL){
+        cache->hits++;
+        slot->last_use = cache->clock;
+        return slot->data;
+    }
+    int s;
+    for(s=0; s<cache->num_slots; s++){
+        ooc_slot_t* candidate = &cache->slots[s];
+        int pinned = candidate->source == cache->pin_source
+                     && candidate->tile_row == cache->pin_row
+                     && candidate->tile_col < cache->pin_count;
+        if (!pinned && (slot == NULL
+                        || candidate->last_use < slot->last_use)){
+            slot = candidate;
+        }
+    }
+    int rows, columns, i;
+    ooc_tile_shape(m, cache->tile, tile_row, tile_col, &rows, &columns);
+    for(i=0; i<rows; i++){
+        memcpy(slot->data + (size_t)i*cache->tile,
+               MATRIX_ROW(m, tile_row*cache->tile + i)
+               + (size_t)tile_col*cache->tile,
+               columns*sizeof(*slot->data));
+    }
+    ooc_advise(m, cache->tile, tile_row, tile_col, OOC_RELEASE);
+    slot->source = m;
+    slot->tile_row = tile_row;
+    slot->tile_col = tile_col;
+    slot->last_use = cache->clock;
+    cache->loads++;
+    return slot->data;
+}
+//-----------------------------------------------------------------------------
+
+/* Starts reading a tile the next step needs, unless it is cached */
+static void ooc_read_ahead(ooc_cache_t* cache, matrix_t* m, int tile_row,
+                           int tile_col)
+{
+    if (ooc_find(cache, m, tile_row, tile_col) == NULL){
+        ooc_advise(m, cache->tile, tile_row, tile_col, OOC_READ_AHEAD);
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: ooc_tile_side
+ *
+ * Arguments: memory budget in bytes, at least MATRIX_OOC_MIN_MEMORY
+ *            largest dimension of the operands
+ *
+ * Returns: the tile side: MATRIX_OOC_TILE, or less so that the product
+ *          tile and three operand tiles fit the budget, and no more than
+ *          the largest dimension needs; always a multiple of GEMM_KC
+ */
+static int ooc_tile_side(size_t memory_bytes, int largest)
+{
+    int tile = MATRIX_OOC_TILE;
+    int needed = (largest + GEMM_KC - 1)/GEMM_KC*GEMM_KC;
+    tile = (needed < tile) ? needed : tile;
+    tile = (tile < GEMM_KC) ? GEMM_KC : tile;
+    while (tile > GEMM_KC
+           && 4*(size_t)tile*tile*sizeof(double) > memory_bytes){
+        tile -= GEMM_KC;
+    }
+    return tile;
+}
+//-----------------------------------------------------------------------------
+
+void matrix_multiply_binary(char* a_fname, char* b_fname, char* dest_fname,
+                            size_t memory_bytes)
+{
+    matrix_multiply_binary_mt(a_fname, b_fname, dest_fname, memory_bytes,
+                              NULL, MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_multiply_binary_mt
+ *
+ * Arguments: file names of A and B, written by matrix_to_binary
+ *            file name to write A*B to, in the same format and unlabelled
+ *            bytes of memory for tiles (0 for MATRIX_OOC_DEFAULT_MEMORY)
+ *            where to put what was done, or NULL
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           maps A and B and computes the product one tile of it at a time,
+ *           going along the tiles of the inner dimension in order, each
+ *           step a gemm of an A tile and a B tile into the product tile.
+ *           The product tile is then written to its rows of the file. Tiles
+ *           of A and B are copied from the mappings into a cache filling the
+ *           budget less the product tile; the tiles of the next step are
+ *           read ahead by the kernel while the current one is multiplied.
+ *           The first tiles of the current row panel of A stay cached for
+ *           the whole row of product tiles. Besides the budget, each gemm
+ *           uses its usual packing buffers per thread. The result is
+ *           bit-identical to matrix_multiply in the classical multiply mode
+ *           (the default), since tile sides are multiples of GEMM_KC and
+ *           each product tile accumulates its kc blocks in the same order.
+ *           Without mmap (Windows) the operands are read whole.
+ *
+ * Dependency: matrix_map_binary, matrix_binary_create, matrix_gemm_mt
+ */
+void matrix_multiply_binary_mt(char* a_fname, char* b_fname,
+                               char* dest_fname, size_t memory_bytes,
+                               matrix_ooc_stats_t* stats, int num_threads)
+{
+    assert(a_fname != NULL && b_fname != NULL && dest_fname != NULL);
+    memory_bytes = memory_bytes ? memory_bytes : MATRIX_OOC_DEFAULT_MEMORY;
+    memory_bytes = (memory_bytes < MATRIX_OOC_MIN_MEMORY)
+                   ? MATRIX_OOC_MIN_MEMORY : memory_bytes;
+    matrix_t* a = matrix_map_binary(a_fname, MATRIX_MAP_READ_ONLY);
+    matrix_t* b = matrix_map_binary(b_fname, MATRIX_MAP_READ_ONLY);
+    assert(a->num_columns == b->num_rows && "Dimensions do not match");
+    int m = a->num_rows, n = b->num_columns, k = a->num_columns;
+    int largest = (m > n) ? m : n;
+    largest = (k > largest) ? k : largest;
+    int tile = ooc_tile_side(memory_bytes, largest);
+    size_t tile_bytes = (size_t)tile*tile*sizeof(double);
+    int tiles_m = (m + tile - 1)/tile, tiles_n = (n + tile - 1)/tile;
+    int tiles_k = (k + tile - 1)/tile;
+
+    /* No more slots than there are operand tiles */
+    ooc_cache_t cache;
+    long operand_tiles = (long)tiles_k*(tiles_m + tiles_n);
+    cache.num_slots = (int)(memory_bytes/tile_bytes - 1);
+    cache.num_slots = (operand_tiles < cache.num_slots)
+                      ? (int)operand_tiles : cache.num_slots;
+    cache.num_slots = (cache.num_slots < 2) ? 2 : cache.num_slots;
+    cache.slots = calloc(cache.num_slots, sizeof(*cache.slots));
+    assert(unwanted_null(cache.slots));
+    int s;
+    for(s=0; s<cache.num_slots; s++){
+        cache.slots[s].data = matrix_aligned_alloc(tile_bytes);
+        assert(unwanted_null(cache.slots[s].data));
+    }
+    cache.tile = tile;
+    cache.clock = cache.loads = cache.hits = 0;
+    cache.pin_source = a;
+    cache.pin_row = 0;
+    cache.pin_count = cache.num_slots - 2;
+    double* product = matrix_aligned_alloc(tile_bytes);
+    assert(unwanted_null(product));
+
+    uint64_t payload;
+    FILE* fp = matrix_binary_create(dest_fname, m, n, &payload);
+    int stride = matrix_stride(n);
+    int ti, tj, tk, i;
+    for(ti=0; ti<tiles_m; ti++){
+        cache.pin_row = ti;
+        for(tj=0; tj<tiles_n; tj++){
+            int rows = (m - ti*tile < tile) ? m - ti*tile : tile;
+            int columns = (n - tj*tile < tile) ? n - tj*tile : tile;
+            if (tiles_k == 0){
+                for(i=0; i<rows; i++){
+                    memset(product + (size_t)i*tile, 0,
+                           columns*sizeof(*product));
+                }
+            }
+            for(tk=0; tk<tiles_k; tk++){
+                int inner = (k - tk*tile < tile) ? k - tk*tile : tile;
+                const double* a_tile = ooc_get(&cache, a, ti, tk);
+                const double* b_tile = ooc_get(&cache, b, tk, tj);
+                if (tk + 1 < tiles_k){
+                    ooc_read_ahead(&cache, a, ti, tk + 1);
+                    ooc_read_ahead(&cache, b, tk + 1, tj);
+                }
+                else if (tj + 1 < tiles_n){
+                    ooc_read_ahead(&cache, a, ti, 0);
+                    ooc_read_ahead(&cache, b, 0, tj + 1);
+                }
+                else if (ti + 1 < tiles_m){
+                    ooc_read_ahead(&cache, a, ti + 1, 0);
+                    ooc_read_ahead(&cache, b, 0, 0);
+                }
+                matrix_gemm_mt(rows, columns, inner, 1.0, a_tile, tile, 1,
+                               b_tile, tile, 1, (tk == 0) ? 0.0 : 1.0,
+                               product, tile, num_threads);
+            }
+            for(i=0; i<rows; i++){
+                uint64_t row = (uint64_t)ti*tile + i;
+                fseek(fp, payload + (row*stride + (uint64_t)tj*tile)
+                          *sizeof(double), SEEK_SET);
+                fwrite(product + (size_t)i*tile, sizeof(*product), columns,
+                       fp);
+            }
+        }
+    }
+    int failed = ferror(fp);
+    failed |= fclose(fp);
+    assert(!failed && "Failed writing matrix binary file");
+    (void)failed;
+
+    if (stats != NULL){
+        stats->tile = tile;
+        stats->cache_tiles = cache.num_slots;
+        stats->loads = cache.loads;
+        stats->hits = cache.hits;
+        stats->peak_bytes = (cache.num_slots + 1)*tile_bytes;
+    }
+    for(s=0; s<cache.num_slots; s++){
+        matrix_aligned_free(cache.slots[s].data);
+    }
+    free(cache.slots);
+    matrix_aligned_free(product);
+    a->free(a);
+    b->free(b);
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,34 @@
+#ifndef MATRIX_OOC_H
+#define MATRIX_OOC_H
+
+#include <stddef.h>
+#include "matrix.h"
+#include "matrix_gemm.h"
+
+/* Out-of-core (ooc) multiply: the operands and the product are matrix binary
+ * files, and only a bounded number of square tiles of them are in memory at
+ * once. Tile sides are multiples of GEMM_KC, so each tile of the inner
+ * dimension starts on a kc block of the in-memory gemm and the product is
+ * bit-identical to matrix_multiply. */
+#define MATRIX_OOC_TILE 1024    // largest tile side
+#define MATRIX_OOC_DEFAULT_MEMORY ((size_t)256 << 20)
+
+/* Budgets below four GEMM_KC tiles are raised to it */
+#define MATRIX_OOC_MIN_MEMORY ((size_t)4*GEMM_KC*GEMM_KC*sizeof(double))
+
+/* What a multiply did, for tuning the budget */
+typedef struct matrix_ooc_stats{
+    int tile;               // tile side used
+    int cache_tiles;        // operand tiles the cache holds
+    long loads;             // tiles copied from the operand files
+    long hits;              // tiles found in the cache
+    size_t peak_bytes;      // tile cache and product tile together
+} matrix_ooc_stats_t;
+
+void matrix_multiply_binary(char* a_fname, char* b_fname, char* dest_fname,
+                            size_t memory_bytes);
+void matrix_multiply_binary_mt(char* a_fname, char* b_fname,
+                               char* dest_fname, size_t memory_bytes,
+                               matrix_ooc_stats_t* stats, int num_threads);
+
+#endif // MATRIX_OOC_H
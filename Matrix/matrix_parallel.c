@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "matrix_parallel.h"
+#include "../Utilities/utils.h"
+
+/* A single process wide pool of worker threads. Workers are created lazily
+ * the first time a job needs them and then sleep on work_ready between
+ * jobs. One job runs at a time; the submitting thread works on it too. */
+typedef struct worker_pool{
+    pthread_mutex_t lock;
+    pthread_mutex_t submit_lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    pthread_t* workers;
+    int num_workers;
+    unsigned long generation;
+
+    parallel_task_t task;
+    void* arg;
+    int n;
+    int num_chunks;
+    int next_chunk;
+    int chunks_done;
+} worker_pool_t;
+
+static worker_pool_t pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    NULL, 0, 0, NULL, NULL, 0, 0, 0, 0
+};
+
+static int global_num_threads = 0;     // 0 until first asked for
+static long parallel_threshold = DEFAULT_PARALLEL_THRESHOLD;
+
+/* Set while a thread is running part of a job, so nested parallel calls
+ * (eg a GEMM inside a parallel loop) run inline rather than deadlock */
+static __thread int inside_parallel_region = 0;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_set_num_threads
+ *
+ * Arguments: number of threads matrix operations may use (>= 1)
+ *
+ * Returns: void
+ */
+void matrix_set_num_threads(int num_threads)
+{
+    assert(num_threads >= 1);
+    global_num_threads = num_threads;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_get_num_threads
+ *
+ * Arguments: None
+ *
+ * Returns: the global thread count. Defaults to the number of online CPUs.
+ */
+int matrix_get_num_threads(void)
+{
+    if (global_num_threads == 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        global_num_threads = (cpus > 0) ? (int)cpus : 1;
+    }
+    return global_num_threads;
+}
+//-----------------------------------------------------------------------------
+
+void matrix_set_parallel_threshold(long threshold)
+{
+    assert(threshold >= 0);
+    parallel_threshold = threshold;
+}
+
+long matrix_get_parallel_threshold(void)
+{
+    return parallel_threshold;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_threads_for_work
+ *
+ * Arguments: threads requested by the caller (MATRIX_THREADS_DEFAULT for
+ *             the global setting)
+ *            amount of work (entries touched or multiply-adds)
+ *
+ * Returns: number of threads the operation should actually use
+ */
+int matrix_threads_for_work(int num_threads, double work)
+{
+    assert(num_threads >= 0);
+    if (work < parallel_threshold || inside_parallel_region){
+        return 1;
+    }
+    return (num_threads == MATRIX_THREADS_DEFAULT)
+           ? matrix_get_num_threads() : num_threads;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: pool_run_chunks
+ *
+ * Arguments: None (pool lock must be held)
+ *
+ * Returns: void
+ *           claims and runs chunks of the current job until none are left.
+ *           Returns with the lock held.
+ */
+static void pool_run_chunks(void)
+{
+    while (pool.next_chunk < pool.num_chunks){
+        int chunk = pool.next_chunk++;
+        parallel_task_t task = pool.task;
+        void* arg = pool.arg;
+        int begin = (int)((long)pool.n*chunk/pool.num_chunks);
+        int end = (int)((long)pool.n*(chunk+1)/pool.num_chunks);
+        pthread_mutex_unlock(&pool.lock);
+
+        inside_parallel_region = 1;
+        task(arg, begin, end);
+        inside_parallel_region = 0;
+
+        pthread_mutex_lock(&pool.lock);
+        if (++pool.chunks_done == pool.num_chunks){
+            pthread_cond_signal(&pool.work_done);
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+static void* pool_worker(void* unused)
+{
+    unsigned long seen;
+    pthread_mutex_lock(&pool.lock);
+    seen = pool.generation;
+    while (1){
+        while (pool.generation == seen){
+            pthread_cond_wait(&pool.work_ready, &pool.lock);
+        }
+        seen = pool.generation;
+        pool_run_chunks();
+    }
+    return NULL;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: pool_grow
+ *
+ * Arguments: number of workers wanted (pool lock must be held)
+ *
+ * Returns: void
+ */
+static void pool_grow(int num_workers)
+{
+    if (num_workers <= pool.num_workers){
+        return;
+    }
+    pool.workers = realloc(pool.workers, num_workers*sizeof(*pool.workers));
+    assert(unwanted_null(pool.workers));
+    while (pool.num_workers < num_workers){
+        int err = pthread_create(&pool.workers[pool.num_workers], NULL,
+                                 &pool_worker, NULL);
+        assert(err == 0 && "Could not create worker thread");
+        pthread_detach(pool.workers[pool.num_workers++]);
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_parallel_for
+ *
+ * Arguments: number of iterations
+ *            number of threads to use (1 runs inline on the calling thread)
+ *            task called as task(arg, begin, end) on a range of iterations
+ *            argument passed to the task
+ *
+ * Returns: void, once every iteration in [0, n) has been run
+ *           The range is split into num_threads contiguous chunks which are
+ *           shared between the worker pool and the calling thread.
+ */
+void matrix_parallel_for(int n, int num_threads, parallel_task_t task,
+                         void* arg)
+{
+    assert(task != NULL && n >= 0 && num_threads >= 1);
+    if (num_threads > n){
+        num_threads = n;
+    }
+    if (num_threads <= 1 || inside_parallel_region){
+        if (n > 0){
+            task(arg, 0, n);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool.submit_lock);
+    pthread_mutex_lock(&pool.lock);
+    pool_grow(num_threads-1);
+    pool.task = task;
+    pool.arg = arg;
+    pool.n = n;
+    pool.num_chunks = num_threads;
+    pool.next_chunk = 0;
+    pool.chunks_done = 0;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.work_ready);
+
+    pool_run_chunks();
+    while (pool.chunks_done < pool.num_chunks){
+        pthread_cond_wait(&pool.work_done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.submit_lock);
+}
+//-----------------------------------------------------------------------------
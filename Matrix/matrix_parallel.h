@@ -0,0 +1,21 @@
+#ifndef MATRIX_PARALLEL_H
+#define MATRIX_PARALLEL_H
+
+/* Operations touching fewer entries (or multiply-adds) than this run on the
+ * calling thread, since waking the pool costs more than it saves */
+#define DEFAULT_PARALLEL_THRESHOLD (1L << 17)
+
+/* Pass as num_threads to use the global setting */
+#define MATRIX_THREADS_DEFAULT 0
+
+typedef void (*parallel_task_t)(void* arg, int begin, int end);
+
+void matrix_set_num_threads(int num_threads);
+int matrix_get_num_threads(void);
+void matrix_set_parallel_threshold(long threshold);
+long matrix_get_parallel_threshold(void);
+int matrix_threads_for_work(int num_threads, double work);
+void matrix_parallel_for(int n, int num_threads, parallel_task_t task,
+                         void* arg);
+
+#endif // MATRIX_PARALLEL_H
@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_prefix.h"
+#include "matrix_missing.h"
+#include "matrix_parallel.h"
+#include "../Utilities/utils.h"
+
+#define PREFIX_SUMS(p, i) ((p)->sums + (size_t)(i)*(p)->stride)
+#define PREFIX_COUNTS(p, i) ((p)->counts + (size_t)(i)*(p)->stride)
+
+typedef struct prefix_args{
+    matrix_t* m;
+    matrix_prefix_t* p;
+    int first;              // first row of m to rebuild
+    int cumulative;         // 1 to add the row above in the same pass
+} prefix_args_t;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: prefix_rows_task
+ *
+ * Arguments: prefix_args_t
+ *            rows first + begin to first + end of m
+ *
+ * Returns: void
+ *           writes row i + 1 of the table as the running sum along row i of
+ *           m, plus the table's row i when cumulative, which needs the rows
+ *           above done first. Missing entries add 0 and are counted per row.
+ */
+static void prefix_rows_task(void* arg, int begin, int end)
+{
+    prefix_args_t* a = arg;
+    matrix_t* m = a->m;
+    matrix_prefix_t* p = a->p;
+    int i, j;
+    for(i=a->first+begin; i<a->first+end; i++){
+        const double* x = MATRIX_ROW(m, i);
+        double* s = PREFIX_SUMS(p, i + 1);
+        const double* above = PREFIX_SUMS(p, i);
+        int* c = (p->counts != NULL) ? PREFIX_COUNTS(p, i + 1) : NULL;
+        const int* c_above = (p->counts != NULL) ? PREFIX_COUNTS(p, i) : NULL;
+        double run = 0.0;
+        int present = 0, missing = 0;
+        s[0] = 0.0;
+        if (c != NULL){
+            c[0] = 0;
+        }
+        for(j=0; j<m->num_columns; j++){
+            double v = x[j];
+            if ((m->valid != NULL || v != v) && matrix_is_missing(m, i, j)){
+                v = 0.0;
+                missing++;
+            }
+            else{
+                present++;
+            }
+            run += v;
+            s[j + 1] = a->cumulative ? above[j + 1] + run : run;
+            if (c != NULL){
+                c[j + 1] = a->cumulative ? c_above[j + 1] + present : present;
+            }
+        }
+        p->row_missing[i] = missing;
+    }
+}
+//-----------------------------------------------------------------------------
+
+/* Adds each table row to the one below, down from the first rebuilt row,
+ * over blocks [begin, end) of MATRIX_PREFIX_BLOCK columns */
+static void prefix_columns_task(void* arg, int begin, int end)
+{
+    prefix_args_t* a = arg;
+    matrix_prefix_t* p = a->p;
+    int j0 = begin*MATRIX_PREFIX_BLOCK;
+    int j1 = end*MATRIX_PREFIX_BLOCK;
+    int i, j;
+    j1 = (j1 < p->num_columns + 1) ? j1 : p->num_columns + 1;
+    for(i=a->first+2; i<=p->num_rows; i++){
+        double* s = PREFIX_SUMS(p, i);
+        const double* above = PREFIX_SUMS(p, i - 1);
+        for(j=j0; j<j1; j++){
+            s[j] += above[j];
+        }
+        if (p->counts != NULL){
+            int* c = PREFIX_COUNTS(p, i);
+            const int* c_above = PREFIX_COUNTS(p, i - 1);
+            for(j=j0; j<j1; j++){
+                c[j] += c_above[j];
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: prefix_build
+ *
+ * Arguments: matrix with prefix sums enabled
+ *            first row of m to rebuild; the table rows up to it are current
+ *            number of threads, resolved
+ *
+ * Returns: void
+ *           one thread makes one cumulative pass. Several first write the
+ *           running sum of each row, split by rows, then add the rows
+ *           together down the table, split by blocks of columns; the first
+ *           rebuilt row already has the right sums once the row above is
+ *           added, so the downward pass starts with the one after it.
+ *
+ * Dependency: prefix_rows_task, prefix_columns_task
+ */
+static void prefix_build(matrix_t* m, int first, int num_threads)
+{
+    matrix_prefix_t* p = m->prefix;
+    int rows = p->num_rows - first;
+    prefix_args_t a = {m, p, first, (num_threads == 1)};
+    if (a.cumulative){
+        prefix_rows_task(&a, 0, rows);
+        return;
+    }
+    matrix_parallel_for(rows, num_threads, &prefix_rows_task, &a);
+    /* Only the first rebuilt row needs the table row above it here */
+    double* s = PREFIX_SUMS(p, first + 1);
+    const double* above = PREFIX_SUMS(p, first);
+    int j;
+    for(j=1; j<=p->num_columns; j++){
+        s[j] += above[j];
+    }
+    if (p->counts != NULL){
+        int* c = PREFIX_COUNTS(p, first + 1);
+        const int* c_above = PREFIX_COUNTS(p, first);
+        for(j=1; j<=p->num_columns; j++){
+            c[j] += c_above[j];
+        }
+    }
+    int blocks = (p->num_columns + MATRIX_PREFIX_BLOCK)/MATRIX_PREFIX_BLOCK;
+    matrix_parallel_for(blocks, num_threads, &prefix_columns_task, &a);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_enable_prefix_sums
+ *
+ * Arguments: matrix, not a view
+ *
+ * Returns: void
+ *           gives m a summed-area table, built on the first query, after
+ *           which matrix_range_sum, matrix_range_count and
+ *           matrix_range_mean answer any rectangle in O(1). Writes through
+ *           set_entry, set_matrix_row and matrix_set_missing mark their row
+ *           dirty, and the next query rebuilds the table from the first
+ *           dirty row down only; library operations that write m in bulk
+ *           mark it all. After writing through MATRIX_ENTRY, the data
+ *           pointer or a view, call matrix_prefix_mark_dirty. A rectangle is
+ *           the difference of sums over everything above and left of it, so
+ *           its rounding error grows with those sums rather than with the
+ *           rectangle's. Queries may rebuild the table, so do not query a
+ *           dirty matrix from several threads at once.
+ */
+void matrix_enable_prefix_sums(matrix_t* m)
+{
+    assert(m != NULL);
+    assert(!m->is_view && "Enable prefix sums on the parent, views share "
+                          "its data");
+    if (m->prefix != NULL){
+        return;
+    }
+    matrix_prefix_t* p = malloc(sizeof(*p));
+    assert(unwanted_null(p));
+    p->stride = matrix_stride(m->num_columns + 1);
+    p->num_rows = m->num_rows;
+    p->num_columns = m->num_columns;
+    p->sums = matrix_aligned_alloc((size_t)(p->num_rows + 1)*p->stride
+                                   *sizeof(*p->sums));
+    assert(unwanted_null(p->sums));
+    memset(p->sums, 0, p->stride*sizeof(*p->sums));
+    p->counts = NULL;
+    p->row_missing = malloc((p->num_rows ? p->num_rows : 1)
+                            *sizeof(*p->row_missing));
+    assert(unwanted_null(p->row_missing));
+    p->dirty_from = 0;
+    m->prefix = p;
+}
+//-----------------------------------------------------------------------------
+
+void matrix_disable_prefix_sums(matrix_t* m)
+{
+    assert(m != NULL);
+    if (m->prefix == NULL){
+        return;
+    }
+    matrix_aligned_free(m->prefix->sums);
+    matrix_aligned_free(m->prefix->counts);
+    free(m->prefix->row_missing);
+    free(m->prefix);
+    m->prefix = NULL;
+}
+
+/* Gives dst, with the same entries as src, a table of its own if src has
+ * one; it is built on dst's first query */
+void matrix_copy_prefix_sums(matrix_t* dst, matrix_t* src)
+{
+    assert(dst != NULL && src != NULL && dst->prefix == NULL);
+    if (src->prefix != NULL){
+        matrix_enable_prefix_sums(dst);
+    }
+}
+
+/* Marks the table, if any, to be rebuilt from row on; O(1) */
+void matrix_prefix_mark_dirty(matrix_t* m, int row)
+{
+    if (m->prefix != NULL && row < m->prefix->dirty_from){
+        assert(row >= 0 && "Row out of range");
+        m->prefix->dirty_from = row;
+    }
+}
+
+void matrix_refresh_prefix_sums(matrix_t* m)
+{
+    matrix_refresh_prefix_sums_mt(m, MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_refresh_prefix_sums_mt
+ *
+ * Arguments: matrix with prefix sums enabled
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           rebuilds the table from its first dirty row down, so after
+ *           set_matrix_row on the last rows of a matrix only those rows are
+ *           summed again. The first missing entry found makes the counts
+ *           table, built over the whole matrix.
+ *
+ * Dependency: prefix_build
+ */
+void matrix_refresh_prefix_sums_mt(matrix_t* m, int num_threads)
+{
+    assert(m != NULL && m->prefix != NULL && "Prefix sums not enabled");
+    matrix_prefix_t* p = m->prefix;
+    assert(p->num_rows == m->num_rows && p->num_columns == m->num_columns);
+    int first = p->dirty_from;
+    if (first >= p->num_rows){
+        return;
+    }
+    prefix_build(m, first,
+                 matrix_threads_for_work(num_threads,
+                                         (double)(p->num_rows - first)
+                                         *p->num_columns));
+    if (p->counts == NULL){
+        int i = first;
+        while (i < p->num_rows && p->row_missing[i] == 0){
+            i++;
+        }
+        if (i < p->num_rows){
+            p->counts = matrix_aligned_alloc((size_t)(p->num_rows + 1)
+                                             *p->stride*sizeof(*p->counts));
+            assert(unwanted_null(p->counts));
+            memset(p->counts, 0, p->stride*sizeof(*p->counts));
+            prefix_build(m, 0,
+                         matrix_threads_for_work(num_threads,
+                                                 (double)p->num_rows
+                                                 *p->num_columns));
+        }
+    }
+    p->dirty_from = p->num_rows;
+}
+//-----------------------------------------------------------------------------
+
+/* Refreshes a dirty table before a query */
+static matrix_prefix_t* prefix_current(matrix_t* m, int row_begin,
+                                       int col_begin, int row_end,
+                                       int col_end)
+{
+    assert(m != NULL && m->prefix != NULL && "Prefix sums not enabled");
+    assert(0 <= row_begin && row_begin <= row_end && row_end <= m->num_rows);
+    assert(0 <= col_begin && col_begin <= col_end
+           && col_end <= m->num_columns);
+    if (m->prefix->dirty_from < m->prefix->num_rows){
+        matrix_refresh_prefix_sums(m);
+    }
+    return m->prefix;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_range_sum
+ *
+ * Arguments: matrix with prefix sums enabled
+ *            first row and first column of the rectangle
+ *            row and column one past its last
+ *
+ * Returns: the sum of the present entries of the rectangle, 0 if it is
+ *          empty; four lookups once the table is current
+ *
+ * Dependency: prefix_current
+ */
+double matrix_range_sum(matrix_t* m, int row_begin, int col_begin,
+                        int row_end, int col_end)
+{
+    matrix_prefix_t* p = prefix_current(m, row_begin, col_begin, row_end,
+                                        col_end);
+    const double* top = PREFIX_SUMS(p, row_begin);
+    const double* bottom = PREFIX_SUMS(p, row_end);
+    return (bottom[col_end] - bottom[col_begin])
+           - (top[col_end] - top[col_begin]);
+}
+//-----------------------------------------------------------------------------
+
+/* Number of present entries of the rectangle, as for matrix_range_sum */
+long matrix_range_count(matrix_t* m, int row_begin, int col_begin,
+                        int row_end, int col_end)
+{
+    matrix_prefix_t* p = prefix_current(m, row_begin, col_begin, row_end,
+                                        col_end);
+    if (p->counts == NULL){
+        return (long)(row_end - row_begin)*(col_end - col_begin);
+    }
+    const int* top = PREFIX_COUNTS(p, row_begin);
+    const int* bottom = PREFIX_COUNTS(p, row_end);
+    return (long)(bottom[col_end] - bottom[col_begin])
+           - (top[col_end] - top[col_begin]);
+}
+
+/* Mean of the present entries of the rectangle, NaN if there are none */
+double matrix_range_mean(matrix_t* m, int row_begin, int col_begin,
+                         int row_end, int col_end)
+{
+    double sum = matrix_range_sum(m, row_begin, col_begin, row_end, col_end);
+    long count = matrix_range_count(m, row_begin, col_begin, row_end,
+                                    col_end);
+    return sum/count;
+}
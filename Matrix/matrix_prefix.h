@@ -0,0 +1,42 @@
+#ifndef MATRIX_PREFIX_H
+#define MATRIX_PREFIX_H
+
+#include "matrix.h"
+
+/* Columns of the table per task of the downward pass: whole cache lines, so
+ * no two threads write the same line */
+#define MATRIX_PREFIX_BLOCK 64
+
+/* The summed-area table behind m->prefix. Entry (i, j) of sums is the sum of
+ * the present entries of m above row i and left of column j, so row 0 and
+ * column 0 are zero and any rectangle takes four lookups. counts holds the
+ * number of present entries the same way; it stays NULL, and every entry
+ * counts, until a build finds a missing entry. Rows from dirty_from on are
+ * rebuilt before the next query. */
+struct matrix_prefix{
+    double* sums;           // (num_rows + 1) rows of stride doubles
+    int* counts;            // same layout as sums, or NULL
+    int* row_missing;       // missing entries per row, found by the build
+    int stride;
+    int num_rows;
+    int num_columns;
+    int dirty_from;         // first row of m to rebuild, num_rows if none
+};
+typedef struct matrix_prefix matrix_prefix_t;
+
+void matrix_enable_prefix_sums(matrix_t* m);
+void matrix_disable_prefix_sums(matrix_t* m);
+void matrix_copy_prefix_sums(matrix_t* dst, matrix_t* src);
+void matrix_prefix_mark_dirty(matrix_t* m, int row);
+void matrix_refresh_prefix_sums(matrix_t* m);
+void matrix_refresh_prefix_sums_mt(matrix_t* m, int num_threads);
+
+/* Over rows [row_begin, row_end) and columns [col_begin, col_end) */
+double matrix_range_sum(matrix_t* m, int row_begin, int col_begin,
+                        int row_end, int col_end);
+long matrix_range_count(matrix_t* m, int row_begin, int col_begin,
+                        int row_end, int col_end);
+double matrix_range_mean(matrix_t* m, int row_begin, int col_begin,
+                         int row_end, int col_end);
+
+#endif // MATRIX_PREFIX_H
@@ -0,0 +1,35 @@
+#ifndef MATRIX_SIMD_H
+#define MATRIX_SIMD_H
+
+#include <string.h>
+
+/* Kernels are compiled once for the baseline and again for AVX2 with
+ * __attribute__((target)), and picked at run time
+ * (matrix_gemm_simd_enabled). MATRIX_HAVE_X86 is set where the second copy
+ * can be built. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_HAVE_X86 1
+#endif
+
+#ifdef __GNUC__
+/* Forced inline into each copy, so the body is compiled for its target */
+#define MATRIX_SIMD_INLINE static inline __attribute__((always_inline))
+
+/* Unaligned load and store of a GCC vector (or any other type). Macros
+ * rather than functions, so vectors never cross a call. */
+#define MATRIX_SIMD_LOAD(type, p) ({                                          \
+    type x_;                                                                  \
+    memcpy(&x_, (p), sizeof(x_));                                             \
+    x_;                                                                       \
+})
+#define MATRIX_SIMD_STORE(p, x) do{                                           \
+    __typeof__(x) x_ = (x);                                                   \
+    memcpy((p), &x_, sizeof(x_));                                             \
+} while(0)
+#else
+#define MATRIX_SIMD_INLINE static inline
+#define MATRIX_SIMD_LOAD(type, p) (*(p))
+#define MATRIX_SIMD_STORE(p, x) (*(p) = (x))
+#endif
+
+#endif // MATRIX_SIMD_H
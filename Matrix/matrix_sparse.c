@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_sparse.h"
+#include "matrix_parallel.h"
+#include "../Vector/vector.h"
+#include "../Utilities/utils.h"
+
+static double sparse_get_entry(sparse_matrix_t* s, int row, int col);
+static vector_t* sparse_multiply_vector(sparse_matrix_t* s, vector_t* x);
+static sparse_matrix_t* sparse_transpose(sparse_matrix_t* s);
+static sparse_matrix_t* sparse_to_format(sparse_matrix_t* s, int format);
+static matrix_t* sparse_to_dense(sparse_matrix_t* s);
+static sparse_matrix_t* clone_sparse(sparse_matrix_t* s);
+static void print_sparse(sparse_matrix_t* s);
+static void destroy_sparse(sparse_matrix_t* s);
+
+/* Number of compressed rows (CSR) or columns (CSC), and the other dimension */
+#define SPARSE_OUTER(s) ((s)->format == SPARSE_CSR ? (s)->num_rows \
+                                                   : (s)->num_columns)
+#define SPARSE_INNER(s) ((s)->format == SPARSE_CSR ? (s)->num_columns \
+                                                   : (s)->num_rows)
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: sparse_alloc
+ *
+ * Arguments: storage format (SPARSE_CSR or SPARSE_CSC)
+ *            number of rows and columns
+ *            number of entries to make room for
+ *
+ * Returns: pointer to a sparse matrix with its arrays allocated but unset
+ */
+static sparse_matrix_t* sparse_alloc(int format, int rows, int columns,
+                                     int nnz)
+{
+    assert(format == SPARSE_CSR || format == SPARSE_CSC);
+    assert(rows >= 0 && columns >= 0 && nnz >= 0);
+    sparse_matrix_t* s = malloc(sizeof(*s));
+    assert(unwanted_null(s));
+    s->format = format;
+    s->num_rows = rows;
+    s->num_columns = columns;
+    s->nnz = nnz;
+    s->ptr = malloc((SPARSE_OUTER(s)+1)*sizeof(*s->ptr));
+    s->index = malloc((nnz ? nnz : 1)*sizeof(*s->index));
+    s->values = malloc((nnz ? nnz : 1)*sizeof(*s->values));
+    assert(unwanted_null(s->ptr));
+    assert(unwanted_null(s->index));
+    assert(unwanted_null(s->values));
+
+    s->get_entry = &sparse_get_entry;
+    s->multiply_vector = &sparse_multiply_vector;
+    s->transpose = &sparse_transpose;
+    s->to_format = &sparse_to_format;
+    s->to_dense = &sparse_to_dense;
+    s->copy = &clone_sparse;
+    s->print = &print_sparse;
+    s->free = &destroy_sparse;
+    return s;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: compress_transpose
+ *
+ * Arguments: compressed arrays (ptr, index, values) with num_outer
+ *            compressed rows whose indices run over [0, num_inner)
+ *            output arrays, ptr of size num_inner+1
+ *
+ * Returns: void
+ *           writes the same entries compressed the other way round, ie
+ *           converts CSR to CSC of the same matrix (or CSR of A to CSR of
+ *           A transposed). A counting sort, O(nnz + num_outer + num_inner).
+ *           Walking the input in order leaves the output indices sorted.
+ */
+static void compress_transpose(int num_outer, int num_inner, int* ptr,
+                               int* index, double* values, int* t_ptr,
+                               int* t_index, double* t_values)
+{
+    int i, p;
+    memset(t_ptr, 0, (num_inner+1)*sizeof(*t_ptr));
+    for(p=0; p<ptr[num_outer]; p++){
+        t_ptr[index[p]+1]++;
+    }
+    for(i=0; i<num_inner; i++){
+        t_ptr[i+1] += t_ptr[i];
+    }
+    int* next = malloc((num_inner ? num_inner : 1)*sizeof(*next));
+    assert(unwanted_null(next));
+    memcpy(next, t_ptr, num_inner*sizeof(*next));
+    for(i=0; i<num_outer; i++){
+        for(p=ptr[i]; p<ptr[i+1]; p++){
+            int q = next[index[p]]++;
+            t_index[q] = i;
+            t_values[q] = values[p];
+        }
+    }
+    free(next);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_sparse_from_triplets
+ *
+ * Arguments: number of rows and columns
+ *            number of triplets
+ *            row index, column index and value of each triplet (COO format,
+ *            in any order)
+ *            storage format of the result (SPARSE_CSR or SPARSE_CSC)
+ *
+ * Returns: pointer to the sparse matrix holding the triplets. Triplets with
+ *          the same row and column are summed. The arrays are not kept.
+ *
+ * Dependency: compress_transpose
+ */
+sparse_matrix_t* create_sparse_from_triplets(int rows, int columns, int nnz,
+                                             int* row_index, int* col_index,
+                                             double* values, int format)
+{
+    assert(nnz == 0 || (row_index && col_index && values));
+    sparse_matrix_t* s = sparse_alloc(format, rows, columns, nnz);
+    int* outer = (format == SPARSE_CSR) ? row_index : col_index;
+    int* inner = (format == SPARSE_CSR) ? col_index : row_index;
+    int num_outer = SPARSE_OUTER(s), num_inner = SPARSE_INNER(s);
+    int i, p;
+
+    /* Bucket the triplets by inner index, then transpose those buckets so
+     * that entries end up grouped by outer index with sorted inner indices */
+    int* t_ptr = calloc(num_inner+1, sizeof(*t_ptr));
+    int* t_index = malloc((nnz ? nnz : 1)*sizeof(*t_index));
+    double* t_values = malloc((nnz ? nnz : 1)*sizeof(*t_values));
+    assert(unwanted_null(t_ptr));
+    assert(unwanted_null(t_index));
+    assert(unwanted_null(t_values));
+    for(p=0; p<nnz; p++){
+        assert(outer[p] >= 0 && outer[p] < num_outer);
+        assert(inner[p] >= 0 && inner[p] < num_inner);
+        t_ptr[inner[p]+1]++;
+    }
+    for(i=0; i<num_inner; i++){
+        t_ptr[i+1] += t_ptr[i];
+    }
+    int* next = malloc((num_inner ? num_inner : 1)*sizeof(*next));
+    assert(unwanted_null(next));
+    memcpy(next, t_ptr, num_inner*sizeof(*next));
+    for(p=0; p<nnz; p++){
+        int q = next[inner[p]]++;
+        t_index[q] = outer[p];
+        t_values[q] = values[p];
+    }
+    free(next);
+    compress_transpose(num_inner, num_outer, t_ptr, t_index, t_values,
+                       s->ptr, s->index, s->values);
+    free(t_ptr);
+    free(t_index);
+    free(t_values);
+
+    /* Duplicates are now adjacent, fold them together */
+    int count = 0, start = 0;
+    for(i=0; i<num_outer; i++){
+        int end = s->ptr[i+1];
+        for(p=start; p<end; p++){
+            if (count > s->ptr[i] && s->index[count-1] == s->index[p]){
+                s->values[count-1] += s->values[p];
+            }
+            else{
+                s->index[count] = s->index[p];
+                s->values[count++] = s->values[p];
+            }
+        }
+        start = end;
+        s->ptr[i+1] = count;
+    }
+    s->nnz = count;
+    return s;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_sparse_from_dense
+ *
+ * Arguments: dense matrix
+ *            storage format of the result (SPARSE_CSR or SPARSE_CSC)
+ *
+ * Returns: pointer to a sparse matrix holding the non-zero entries of m
+ */
+sparse_matrix_t* create_sparse_from_dense(matrix_t* m, int format)
+{
+    assert(m != NULL);
+    int i, j, nnz = 0;
+    for(i=0; i<m->num_rows; i++){
+        for(j=0; j<m->num_columns; j++){
+            nnz += (MATRIX_ENTRY(m, i, j) != 0.0);
+        }
+    }
+    sparse_matrix_t* s = sparse_alloc(SPARSE_CSR, m->num_rows,
+                                      m->num_columns, nnz);
+    nnz = 0;
+    s->ptr[0] = 0;
+    for(i=0; i<m->num_rows; i++){
+        double* row = MATRIX_ROW(m, i);
+        for(j=0; j<m->num_columns; j++){
+            if (row[j] != 0.0){
+                s->index[nnz] = j;
+                s->values[nnz++] = row[j];
+            }
+        }
+        s->ptr[i+1] = nnz;
+    }
+    if (format == SPARSE_CSR){
+        return s;
+    }
+    sparse_matrix_t* ret = s->to_format(s, format);
+    s->free(s);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: sparse_to_format
+ *
+ * Arguments: sparse matrix
+ *            storage format wanted (SPARSE_CSR or SPARSE_CSC)
+ *
+ * Returns: pointer to a new sparse matrix with the same entries stored in
+ *          the given format
+ *
+ * Dependency: compress_transpose
+ */
+static sparse_matrix_t* sparse_to_format(sparse_matrix_t* s, int format)
+{
+    if (format == s->format){
+        return s->copy(s);
+    }
+    sparse_matrix_t* ret = sparse_alloc(format, s->num_rows, s->num_columns,
+                                        s->nnz);
+    compress_transpose(SPARSE_OUTER(s), SPARSE_INNER(s), s->ptr, s->index,
+                       s->values, ret->ptr, ret->index, ret->values);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: sparse_transpose
+ *
+ * Arguments: sparse matrix
+ *
+ * Returns: pointer to the transpose, stored in the same format as s
+ *
+ * Dependency: compress_transpose
+ */
+static sparse_matrix_t* sparse_transpose(sparse_matrix_t* s)
+{
+    sparse_matrix_t* ret = sparse_alloc(s->format, s->num_columns,
+                                        s->num_rows, s->nnz);
+    compress_transpose(SPARSE_OUTER(s), SPARSE_INNER(s), s->ptr, s->index,
+                       s->values, ret->ptr, ret->index, ret->values);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+static sparse_matrix_t* clone_sparse(sparse_matrix_t* s)
+{
+    sparse_matrix_t* ret = sparse_alloc(s->format, s->num_rows,
+                                        s->num_columns, s->nnz);
+    memcpy(ret->ptr, s->ptr, (SPARSE_OUTER(s)+1)*sizeof(*s->ptr));
+    memcpy(ret->index, s->index, s->nnz*sizeof(*s->index));
+    memcpy(ret->values, s->values, s->nnz*sizeof(*s->values));
+    return ret;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: sparse_to_dense
+ *
+ * Arguments: sparse matrix
+ *
+ * Returns: pointer to a dense matrix with the same entries
+ */
+static matrix_t* sparse_to_dense(sparse_matrix_t* s)
+{
+    matrix_t* m = create_matrix(s->num_rows, s->num_columns);
+    int i, p;
+    for(i=0; i<SPARSE_OUTER(s); i++){
+        for(p=s->ptr[i]; p<s->ptr[i+1]; p++){
+            if (s->format == SPARSE_CSR){
+                MATRIX_ENTRY(m, i, s->index[p]) = s->values[p];
+            }
+            else{
+                MATRIX_ENTRY(m, s->index[p], i) = s->values[p];
+            }
+        }
+    }
+    return m;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: sparse_get_entry
+ *
+ * Arguments: sparse matrix
+ *            row and column of the entry
+ *
+ * Returns: the entry, found by binary search of its row (CSR) or column (CSC)
+ */
+static double sparse_get_entry(sparse_matrix_t* s, int row, int col)
+{
+    assert(row >= 0 && row < s->num_rows);
+    assert(col >= 0 && col < s->num_columns);
+    int outer = (s->format == SPARSE_CSR) ? row : col;
+    int inner = (s->format == SPARSE_CSR) ? col : row;
+    int lo = s->ptr[outer], hi = s->ptr[outer+1]-1;
+    while (lo <= hi){
+        int mid = lo + (hi-lo)/2;
+        if (s->index[mid] == inner){
+            return s->values[mid];
+        }
+        else if (s->index[mid] < inner){
+            lo = mid+1;
+        }
+        else{
+            hi = mid-1;
+        }
+    }
+    return 0.0;
+}
+//-----------------------------------------------------------------------------
+
+typedef struct spmv_args{
+    sparse_matrix_t* s;
+    double* x;
+    double* y;
+} spmv_args_t;
+
+/* y[begin..end) = rows begin..end of the CSR matrix times x */
+static void spmv_csr_task(void* arg, int begin, int end)
+{
+    spmv_args_t* a = arg;
+    int* ptr = a->s->ptr;
+    int* index = a->s->index;
+    double* values = a->s->values;
+    int i, p;
+    for(i=begin; i<end; i++){
+        double sum = 0.0;
+        for(p=ptr[i]; p<ptr[i+1]; p++){
+            sum += values[p]*a->x[index[p]];
+        }
+        a->y[i] = sum;
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: sparse_multiply_vector_into
+ *
+ * Arguments: sparse matrix
+ *            array of num_columns doubles
+ *            array of num_rows doubles to receive the product (not x)
+ *
+ * Returns: void
+ *           y = s*x. CSR rows are shared out between threads once there is
+ *           enough work; CSC scatters each column into y.
+ */
+void sparse_multiply_vector_into(sparse_matrix_t* s, double* x, double* y)
+{
+    assert(s != NULL && x != NULL && y != NULL && x != y);
+    if (s->format == SPARSE_CSR){
+        spmv_args_t a = {s, x, y};
+        matrix_parallel_for(s->num_rows,
+                            matrix_threads_for_work(MATRIX_THREADS_DEFAULT,
+                                                    s->nnz),
+                            &spmv_csr_task, &a);
+        return;
+    }
+    int j, p;
+    memset(y, 0, s->num_rows*sizeof(*y));
+    for(j=0; j<s->num_columns; j++){
+        double xj = x[j];
+        if (xj == 0.0){
+            continue;
+        }
+        for(p=s->ptr[j]; p<s->ptr[j+1]; p++){
+            y[s->index[p]] += s->values[p]*xj;
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: sparse_multiply_vector
+ *
+ * Arguments: sparse matrix
+ *            vector of dimension num_columns
+ *
+ * Returns: pointer to the vector s*x
+ *
+ * Dependency: sparse_multiply_vector_into
+ */
+static vector_t* sparse_multiply_vector(sparse_matrix_t* s, vector_t* x)
+{
+    assert(x != NULL && x->dimension == s->num_columns);
+    vector_t* y = create_zero_vector(s->num_rows);
+    sparse_multiply_vector_into(s, x->vector, y->vector);
+    return y;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: sparse_multiply
+ *
+ * Arguments: two sparse matrices, a->num_columns == b->num_rows, in either
+ *            format
+ *
+ * Returns: pointer to the CSR matrix a*b
+ *           Gustavson's row-by-row algorithm: row i of the product is the
+ *           sum of the rows of b picked out by row i of a, accumulated in a
+ *           dense scratch row. Work and memory are proportional to the
+ *           number of multiplications and entries, never rows*columns.
+ */
+sparse_matrix_t* sparse_multiply(sparse_matrix_t* a, sparse_matrix_t* b)
+{
+    assert(a != NULL && b != NULL);
+    assert(a->num_columns == b->num_rows);
+    sparse_matrix_t* a_csr = (a->format == SPARSE_CSR)
+                             ? a : a->to_format(a, SPARSE_CSR);
+    sparse_matrix_t* b_csr = (b->format == SPARSE_CSR)
+                             ? b : b->to_format(b, SPARSE_CSR);
+    int rows = a->num_rows, columns = b->num_columns;
+    int i, j, p, q;
+
+    double* accumulator = malloc((columns ? columns : 1)*sizeof(*accumulator));
+    int* marker = malloc((columns ? columns : 1)*sizeof(*marker));
+    int* row_columns = malloc((columns ? columns : 1)*sizeof(*row_columns));
+    assert(unwanted_null(accumulator));
+    assert(unwanted_null(marker));
+    assert(unwanted_null(row_columns));
+    for(j=0; j<columns; j++){
+        marker[j] = -1;
+    }
+
+    int capacity = a_csr->nnz + b_csr->nnz;
+    sparse_matrix_t* c = sparse_alloc(SPARSE_CSR, rows, columns, capacity);
+    int nnz = 0;
+    c->ptr[0] = 0;
+    for(i=0; i<rows; i++){
+        int count = 0;
+        for(p=a_csr->ptr[i]; p<a_csr->ptr[i+1]; p++){
+            int k = a_csr->index[p];
+            double a_ik = a_csr->values[p];
+            for(q=b_csr->ptr[k]; q<b_csr->ptr[k+1]; q++){
+                j = b_csr->index[q];
+                if (marker[j] != i){
+                    marker[j] = i;
+                    row_columns[count++] = j;
+                    accumulator[j] = a_ik*b_csr->values[q];
+                }
+                else{
+                    accumulator[j] += a_ik*b_csr->values[q];
+                }
+            }
+        }
+        if (nnz + count > capacity){
+            while (nnz + count > capacity){
+                capacity = 2*capacity + 1;
+            }
+            c->index = realloc(c->index, capacity*sizeof(*c->index));
+            c->values = realloc(c->values, capacity*sizeof(*c->values));
+            assert(unwanted_null(c->index));
+            assert(unwanted_null(c->values));
+        }
+        qsort(row_columns, count, sizeof(*row_columns), &int_cmp);
+        for(p=0; p<count; p++){
+            c->index[nnz] = row_columns[p];
+            c->values[nnz++] = accumulator[row_columns[p]];
+        }
+        c->ptr[i+1] = nnz;
+    }
+    c->nnz = nnz;
+
+    free(accumulator);
+    free(marker);
+    free(row_columns);
+    if (a_csr != a){
+        a_csr->free(a_csr);
+    }
+    if (b_csr != b){
+        b_csr->free(b_csr);
+    }
+    return c;
+}
+//-----------------------------------------------------------------------------
+
+static void print_sparse(sparse_matrix_t* s)
+{
+    int i, p;
+    printf("%d x %d %s matrix, %d stored entries\n", s->num_rows,
+           s->num_columns, (s->format == SPARSE_CSR) ? "CSR" : "CSC", s->nnz);
+    for(i=0; i<SPARSE_OUTER(s); i++){
+        for(p=s->ptr[i]; p<s->ptr[i+1]; p++){
+            if (s->format == SPARSE_CSR){
+                printf("(%d, %d) %lf\n", i, s->index[p], s->values[p]);
+            }
+            else{
+                printf("(%d, %d) %lf\n", s->index[p], i, s->values[p]);
+            }
+        }
+    }
+}
+
+static void destroy_sparse(sparse_matrix_t* s)
+{
+    free(s->ptr);
+    free(s->index);
+    free(s->values);
+    free(s);
+}
@@ -0,0 +1,43 @@
+#ifndef MATRIX_SPARSE_H
+#define MATRIX_SPARSE_H
+
+#include "matrix.h"
+#include "../Vector/vector.h"
+
+/* Storage formats of a sparse matrix */
+#define SPARSE_CSR 0        // compressed rows
+#define SPARSE_CSC 1        // compressed columns
+
+typedef struct sparse_matrix sparse_matrix_t;
+
+/* Compressed sparse row/column storage. For CSR the entries of row i are
+ * values[ptr[i]] .. values[ptr[i+1]-1] with their columns in index[]; CSC is
+ * the same with the roles of rows and columns exchanged. Indices within a
+ * row (column) are kept in increasing order without duplicates. */
+struct sparse_matrix{
+    int format;
+    int num_rows;
+    int num_columns;
+    int nnz;                // number of stored entries
+    int* ptr;               // num_rows+1 (CSR) or num_columns+1 (CSC) offsets
+    int* index;             // column (CSR) or row (CSC) of each entry
+    double* values;
+
+    double (*get_entry)(sparse_matrix_t* s, int row, int col);
+    vector_t* (*multiply_vector)(sparse_matrix_t* s, vector_t* x);
+    sparse_matrix_t* (*transpose)(sparse_matrix_t* s);
+    sparse_matrix_t* (*to_format)(sparse_matrix_t* s, int format);
+    matrix_t* (*to_dense)(sparse_matrix_t* s);
+    sparse_matrix_t* (*copy)(sparse_matrix_t* s);
+    void (*print)(sparse_matrix_t* s);
+    void (*free)(sparse_matrix_t* s);
+};
+
+sparse_matrix_t* create_sparse_from_triplets(int rows, int columns, int nnz,
+                                             int* row_index, int* col_index,
+                                             double* values, int format);
+sparse_matrix_t* create_sparse_from_dense(matrix_t* m, int format);
+sparse_matrix_t* sparse_multiply(sparse_matrix_t* a, sparse_matrix_t* b);
+void sparse_multiply_vector_into(sparse_matrix_t* s, double* x, double* y);
+
+#endif // MATRIX_SPARSE_H
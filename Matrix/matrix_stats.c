@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_stats.h"
+#include "matrix_missing.h"
+#include "../Utilities/utils.h"
+
+/* Only NaNs and matrices with a bitmap need the full test */
+static int stats_is_missing(matrix_t* m, int row, int col, double x)
+{
+    return (m->valid != NULL || x != x) && matrix_is_missing(m, row, col);
+}
+
+static void stats_reset_column(matrix_column_stats_t* c)
+{
+    c->count = 0;
+    c->sum = 0.0;
+    c->sum_squares = 0.0;
+    c->min = INFINITY;
+    c->max = -INFINITY;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: stats_rebuild
+ *
+ * Arguments: matrix with stats enabled
+ *
+ * Returns: void
+ *           recomputes every statistic in one pass over the rows, each row
+ *           updating the accumulators of all its columns
+ */
+static void stats_rebuild(matrix_t* m)
+{
+    matrix_stats_t* s = m->stats;
+    int i, j;
+    for(j=0; j<m->num_columns; j++){
+        stats_reset_column(&s->columns[j]);
+    }
+    memset(s->extremes_stale, 0, m->num_columns);
+    for(i=0; i<m->num_rows; i++){
+        const double* row = MATRIX_ROW(m, i);
+        for(j=0; j<m->num_columns; j++){
+            double x = row[j];
+            matrix_column_stats_t* c = &s->columns[j];
+            if (stats_is_missing(m, i, j, x)){
+                continue;
+            }
+            c->count++;
+            c->sum += x;
+            c->sum_squares += x*x;
+            c->min = (x < c->min) ? x : c->min;
+            c->max = (x > c->max) ? x : c->max;
+        }
+    }
+    s->grand_sum = 0.0;
+    for(j=0; j<m->num_columns; j++){
+        s->grand_sum += s->columns[j].sum;
+    }
+    s->trace = 0.0;
+    if (m->num_rows == m->num_columns){
+        for(i=0; i<m->num_rows; i++){
+            double x = MATRIX_ENTRY(m, i, i);
+            s->trace += stats_is_missing(m, i, i, x) ? 0.0 : x;
+        }
+    }
+    s->stale = 0;
+}
+//-----------------------------------------------------------------------------
+
+/* Rescans one column for its min and max */
+static void stats_rescan_extremes(matrix_t* m, int col)
+{
+    matrix_column_stats_t* c = &m->stats->columns[col];
+    c->min = INFINITY;
+    c->max = -INFINITY;
+    int i;
+    for(i=0; i<m->num_rows; i++){
+        double x = MATRIX_ENTRY(m, i, col);
+        if (stats_is_missing(m, i, col, x)){
+            continue;
+        }
+        c->min = (x < c->min) ? x : c->min;
+        c->max = (x > c->max) ? x : c->max;
+    }
+    m->stats->extremes_stale[col] = 0;
+}
+
+/* Rebuilds a stale cache before a query */
+static matrix_stats_t* stats_current(matrix_t* m)
+{
+    assert(m != NULL && m->stats != NULL && "Stats not enabled");
+    if (m->stats->stale){
+        stats_rebuild(m);
+    }
+    return m->stats;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_enable_stats
+ *
+ * Arguments: matrix, not a view
+ *
+ * Returns: void
+ *           gives m a statistics cache, built on the first query. From then
+ *           on grand_sum, trace and matrix_column_mean answer from the cache,
+ *           and writes through set_entry, set_matrix_row and
+ *           matrix_set_missing keep it up to date in O(1) each. Library
+ *           operations that write m in bulk mark it stale; after writing
+ *           through MATRIX_ENTRY, the data pointer or a view, call
+ *           matrix_invalidate_stats. Sums updated incrementally can drift
+ *           from a fresh sum in the last bits; invalidating resets them.
+ *           Queries update the cache, so do not query one matrix from
+ *           several threads at once.
+ */
+void matrix_enable_stats(matrix_t* m)
+{
+    assert(m != NULL);
+    assert(!m->is_view && "Enable stats on the parent, views share its data");
+    if (m->stats != NULL){
+        return;
+    }
+    matrix_stats_t* s = malloc(sizeof(*s));
+    assert(unwanted_null(s));
+    s->columns = malloc((m->num_columns ? m->num_columns : 1)
+                        *sizeof(*s->columns));
+    assert(unwanted_null(s->columns));
+    s->extremes_stale = malloc(m->num_columns ? m->num_columns : 1);
+    assert(unwanted_null(s->extremes_stale));
+    s->stale = 1;
+    s->grand_sum = 0.0;
+    s->trace = 0.0;
+    m->stats = s;
+}
+//-----------------------------------------------------------------------------
+
+void matrix_disable_stats(matrix_t* m)
+{
+    assert(m != NULL);
+    if (m->stats == NULL){
+        return;
+    }
+    free(m->stats->columns);
+    free(m->stats->extremes_stale);
+    free(m->stats);
+    m->stats = NULL;
+}
+
+/* Marks the cache, if any, to be rebuilt on the next query; O(1) */
+void matrix_invalidate_stats(matrix_t* m)
+{
+    if (m->stats != NULL){
+        m->stats->stale = 1;
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_copy_stats
+ *
+ * Arguments: matrix without stats
+ *            matrix with the same entries (eg the one dst was cloned from)
+ *
+ * Returns: void
+ *           gives dst a copy of src's cache, if src has one
+ */
+void matrix_copy_stats(matrix_t* dst, matrix_t* src)
+{
+    assert(dst != NULL && src != NULL && dst->stats == NULL);
+    assert(dst->num_columns == src->num_columns);
+    if (src->stats == NULL){
+        return;
+    }
+    matrix_enable_stats(dst);
+    matrix_stats_t* s = dst->stats;
+    memcpy(s->columns, src->stats->columns,
+           src->num_columns*sizeof(*s->columns));
+    memcpy(s->extremes_stale, src->stats->extremes_stale, src->num_columns);
+    s->grand_sum = src->stats->grand_sum;
+    s->trace = src->stats->trace;
+    s->stale = src->stats->stale;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_column_stats
+ *
+ * Arguments: matrix with stats enabled
+ *            column number
+ *
+ * Returns: the count, sum, sum of squares, min and max of the entries of
+ *          the column that are not missing, valid until m is next written
+ */
+const matrix_column_stats_t* matrix_column_stats(matrix_t* m, int col)
+{
+    matrix_stats_t* s = stats_current(m);
+    assert(col >= 0 && col < m->num_columns);
+    if (s->extremes_stale[col]){
+        stats_rescan_extremes(m, col);
+    }
+    return &s->columns[col];
+}
+//-----------------------------------------------------------------------------
+
+/* The sum of the entries that are not missing */
+double matrix_stats_grand_sum(matrix_t* m)
+{
+    return stats_current(m)->grand_sum;
+}
+
+/* The sum of the diagonal entries that are not missing */
+double matrix_stats_trace(matrix_t* m)
+{
+    assert(m->num_rows == m->num_columns);
+    return stats_current(m)->trace;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_stats_remove_entry
+ *
+ * Arguments: matrix with stats enabled
+ *            row and column of an entry about to be overwritten
+ *
+ * Returns: void
+ *           takes the entry out of the statistics. If it was its column's
+ *           min or max, the column's extremes are left to rescan.
+ *           matrix_stats_add_entry puts the new value in once it is written.
+ */
+void matrix_stats_remove_entry(matrix_t* m, int row, int col)
+{
+    matrix_stats_t* s = m->stats;
+    if (s == NULL || s->stale){
+        return;
+    }
+    double x = MATRIX_ENTRY(m, row, col);
+    if (stats_is_missing(m, row, col, x)){
+        return;
+    }
+    matrix_column_stats_t* c = &s->columns[col];
+    c->count--;
+    c->sum -= x;
+    c->sum_squares -= x*x;
+    s->grand_sum -= x;
+    if (row == col && m->num_rows == m->num_columns){
+        s->trace -= x;
+    }
+    if (x <= c->min || x >= c->max){
+        s->extremes_stale[col] = 1;
+    }
+}
+//-----------------------------------------------------------------------------
+
+void matrix_stats_add_entry(matrix_t* m, int row, int col)
+{
+    matrix_stats_t* s = m->stats;
+    if (s == NULL || s->stale){
+        return;
+    }
+    double x = MATRIX_ENTRY(m, row, col);
+    if (stats_is_missing(m, row, col, x)){
+        return;
+    }
+    matrix_column_stats_t* c = &s->columns[col];
+    c->count++;
+    c->sum += x;
+    c->sum_squares += x*x;
+    s->grand_sum += x;
+    if (row == col && m->num_rows == m->num_columns){
+        s->trace += x;
+    }
+    if (!s->extremes_stale[col]){
+        c->min = (x < c->min) ? x : c->min;
+        c->max = (x > c->max) ? x : c->max;
+    }
+}
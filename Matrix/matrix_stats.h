@@ -0,0 +1,40 @@
+#ifndef MATRIX_STATS_H
+#define MATRIX_STATS_H
+
+#include "matrix.h"
+
+/* Statistics of the entries of one column that are not missing */
+typedef struct matrix_column_stats{
+    long count;
+    double sum;
+    double sum_squares;
+    double min;             // INFINITY if count is 0
+    double max;             // -INFINITY if count is 0
+} matrix_column_stats_t;
+
+/* The cache behind m->stats. Writes through set_entry, set_matrix_row and
+ * matrix_set_missing adjust it in O(1); every other write marks it stale and
+ * the next query rebuilds it in one pass. Overwriting a column's min or max
+ * leaves only that column's extremes to rescan, on its next query. */
+struct matrix_stats{
+    matrix_column_stats_t* columns;
+    unsigned char* extremes_stale;  // per column, min and max to rescan
+    double grand_sum;
+    double trace;           // over the diagonal of a square matrix
+    int stale;              // 1 to rebuild everything on the next query
+};
+typedef struct matrix_stats matrix_stats_t;
+
+void matrix_enable_stats(matrix_t* m);
+void matrix_disable_stats(matrix_t* m);
+void matrix_invalidate_stats(matrix_t* m);
+void matrix_copy_stats(matrix_t* dst, matrix_t* src);
+
+const matrix_column_stats_t* matrix_column_stats(matrix_t* m, int col);
+double matrix_stats_grand_sum(matrix_t* m);
+double matrix_stats_trace(matrix_t* m);
+
+void matrix_stats_remove_entry(matrix_t* m, int row, int col);
+void matrix_stats_add_entry(matrix_t* m, int row, int col);
+
+#endif // MATRIX_STATS_H
@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_strassen.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "../Utilities/utils.h"
+
+/* Seven products run concurrently at the top level; with more threads than
+ * that the recursion stays sequential and the leaf GEMMs use them all */
+#define STRASSEN_PRODUCTS 7
+
+static int multiply_mode = MATRIX_MULTIPLY_CLASSICAL;
+static int strassen_cutoff = STRASSEN_DEFAULT_CUTOFF;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_set_multiply_mode
+ *
+ * Arguments: MATRIX_MULTIPLY_CLASSICAL or MATRIX_MULTIPLY_STRASSEN
+ *
+ * Returns: void
+ *           chooses how matrix_multiply, matrix_multiply_into and
+ *           matrix_pow_into form their products. Strassen mode trades a
+ *           weaker error bound (see matrix_strassen_mt) for fewer flops on
+ *           products whose dimensions all exceed the cutoff; smaller ones
+ *           are unaffected. Classical is the default.
+ */
+void matrix_set_multiply_mode(int mode)
+{
+    assert((mode == MATRIX_MULTIPLY_CLASSICAL
+            || mode == MATRIX_MULTIPLY_STRASSEN) && "Unknown multiply mode");
+    multiply_mode = mode;
+}
+//-----------------------------------------------------------------------------
+
+int matrix_get_multiply_mode(void)
+{
+    return multiply_mode;
+}
+
+/* Products with m, n or k at most cutoff are done by matrix_gemm */
+void matrix_set_strassen_cutoff(int cutoff)
+{
+    assert(cutoff >= 1);
+    strassen_cutoff = cutoff;
+}
+
+int matrix_get_strassen_cutoff(void)
+{
+    return strassen_cutoff;
+}
+
+static int strassen_is_leaf(int m, int n, int k, int cutoff)
+{
+    return m <= cutoff || n <= cutoff || k <= cutoff;
+}
+
+/* Doubles the sequential recursion needs below an m x k by k x n product */
+static size_t strassen_sequential_workspace(int m, int n, int k, int cutoff)
+{
+    if (strassen_is_leaf(m, n, k, cutoff)){
+        return 0;
+    }
+    size_t m2 = m/2, n2 = n/2, k2 = k/2;
+    return m2*((k2 > n2) ? k2 : n2) + k2*n2
+           + strassen_sequential_workspace(m2, n2, k2, cutoff);
+}
+
+/* Doubles the concurrent top level needs: its operand sums, the seven
+ * products and a sequential workspace for each */
+static size_t strassen_parallel_workspace(int m, int n, int k, int cutoff)
+{
+    size_t m2 = m/2, n2 = n/2, k2 = k/2;
+    return 4*m2*k2 + 4*k2*n2 + STRASSEN_PRODUCTS*m2*n2
+           + STRASSEN_PRODUCTS*strassen_sequential_workspace(m2, n2, k2,
+                                                             cutoff);
+}
+
+/* Threads for the product, 1 when its top level should run sequentially */
+static int strassen_parallel_threads(int m, int n, int k, int num_threads)
+{
+    int threads = matrix_threads_for_work(num_threads, (double)m*n*k);
+    return (threads > STRASSEN_PRODUCTS) ? 1 : threads;
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_strassen_workspace
+ *
+ * Arguments: number of rows of A and C
+ *            number of columns of B and C
+ *            number of columns of A and rows of B
+ *            number of threads the product will be called with
+ *
+ * Returns: number of doubles of workspace matrix_strassen_mt needs, with the
+ *          current cutoff. For an n x n product this is about 2n^2/3 when
+ *          run sequentially and about 5n^2 when the top level runs its
+ *          seven products concurrently; 0 if the product is left to GEMM.
+ */
+size_t matrix_strassen_workspace(int m, int n, int k, int num_threads)
+{
+    assert(m >= 0 && n >= 0 && k >= 0);
+    int cutoff = strassen_cutoff;
+    if (strassen_is_leaf(m, n, k, cutoff)){
+        return 0;
+    }
+    if (strassen_parallel_threads(m, n, k, num_threads) > 1){
+        return strassen_parallel_workspace(m, n, k, cutoff);
+    }
+    return strassen_sequential_workspace(m, n, k, cutoff);
+}
+//-----------------------------------------------------------------------------
+
+/* c = a + sign*b over a rows x cols block; c may be a or b */
+static void strassen_add(int rows, int cols, const double* a, int lda,
+                         const double* b, int ldb, double sign,
+                         double* c, int ldc)
+{
+    int i, j;
+    for(i=0; i<rows; i++){
+        const double* a_row = a + (size_t)i*lda;
+        const double* b_row = b + (size_t)i*ldb;
+        double* c_row = c + (size_t)i*ldc;
+        if (sign > 0.0){
+            for(j=0; j<cols; j++){
+                c_row[j] = a_row[j] + b_row[j];
+            }
+        }
+        else{
+            for(j=0; j<cols; j++){
+                c_row[j] = a_row[j] - b_row[j];
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: strassen_peel
+ *
+ * Arguments: as strassen_sequential, with C's leading even block already
+ *             holding the product of A's and B's leading even blocks
+ *            number of threads for the GEMMs
+ *
+ * Returns: void
+ *           finishes C for odd dimensions: the last column of A times the
+ *           last row of B is added to the even block, then the last column
+ *           and last row of C are formed directly
+ */
+static void strassen_peel(int m, int n, int k, const double* A, int lda,
+                          const double* B, int ldb, double* C, int ldc,
+                          int threads)
+{
+    int m_even = m & ~1, n_even = n & ~1, k_even = k & ~1;
+    if (k_even < k){
+        matrix_gemm_mt(m_even, n_even, 1, 1.0, A + k_even, lda, 1,
+                       B + (size_t)k_even*ldb, ldb, 1, 1.0, C, ldc, threads);
+    }
+    if (n_even < n){
+        matrix_gemm_mt(m, 1, k, 1.0, A, lda, 1, B + n_even, ldb, 1,
+                       0.0, C + n_even, ldc, threads);
+    }
+    if (m_even < m){
+        matrix_gemm_mt(1, n_even, k, 1.0, A + (size_t)m_even*lda, lda, 1,
+                       B, ldb, 1, 0.0, C + (size_t)m_even*ldc, ldc, threads);
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: strassen_sequential
+ *
+ * Arguments: m, n, k, A, lda, B, ldb, C, ldc as matrix_strassen_mt
+ *            workspace of strassen_sequential_workspace(m, n, k, cutoff)
+ *            cutoff
+ *            number of threads for the leaf GEMMs
+ *
+ * Returns: void
+ *           C = A*B by Winograd's variant of Strassen: seven half size
+ *           products and fifteen additions per level. The schedule keeps
+ *           the operand sums in two buffers, X (m/2 x max(k/2, n/2)) and
+ *           Y (k/2 x n/2), and builds the products in C's own quadrants.
+ */
+static void strassen_sequential(int m, int n, int k, const double* A, int lda,
+                                const double* B, int ldb, double* C, int ldc,
+                                double* workspace, int cutoff, int threads)
+{
+    if (strassen_is_leaf(m, n, k, cutoff)){
+        matrix_gemm_mt(m, n, k, 1.0, A, lda, 1, B, ldb, 1, 0.0, C, ldc,
+                       threads);
+        return;
+    }
+    int m2 = m/2, n2 = n/2, k2 = k/2;
+    const double* A11 = A;
+    const double* A12 = A + k2;
+    const double* A21 = A + (size_t)m2*lda;
+    const double* A22 = A21 + k2;
+    const double* B11 = B;
+    const double* B12 = B + n2;
+    const double* B21 = B + (size_t)k2*ldb;
+    const double* B22 = B21 + n2;
+    double* C11 = C;
+    double* C12 = C + n2;
+    double* C21 = C + (size_t)m2*ldc;
+    double* C22 = C21 + n2;
+    int ldx = (k2 > n2) ? k2 : n2;
+    double* X = workspace;
+    double* Y = X + (size_t)m2*ldx;
+    double* rest = Y + (size_t)k2*n2;
+
+    /* P7 = (A11 - A21)(B22 - B12) */
+    strassen_add(m2, k2, A11, lda, A21, lda, -1.0, X, ldx);
+    strassen_add(k2, n2, B22, ldb, B12, ldb, -1.0, Y, n2);
+    strassen_sequential(m2, n2, k2, X, ldx, Y, n2, C21, ldc, rest,
+                        cutoff, threads);
+    /* P5 = S1 T1 with S1 = A21 + A22, T1 = B12 - B11 */
+    strassen_add(m2, k2, A21, lda, A22, lda, 1.0, X, ldx);
+    strassen_add(k2, n2, B12, ldb, B11, ldb, -1.0, Y, n2);
+    strassen_sequential(m2, n2, k2, X, ldx, Y, n2, C22, ldc, rest,
+                        cutoff, threads);
+    /* P6 = S2 T2 with S2 = S1 - A11, T2 = B22 - T1 */
+    strassen_add(m2, k2, X, ldx, A11, lda, -1.0, X, ldx);
+    strassen_add(k2, n2, B22, ldb, Y, n2, -1.0, Y, n2);
+    strassen_sequential(m2, n2, k2, X, ldx, Y, n2, C12, ldc, rest,
+                        cutoff, threads);
+    /* P3 = (A12 - S2) B22 */
+    strassen_add(m2, k2, A12, lda, X, ldx, -1.0, X, ldx);
+    strassen_sequential(m2, n2, k2, X, ldx, B22, ldb, C11, ldc, rest,
+                        cutoff, threads);
+    /* P1 = A11 B11, then U2 = P1 + P6, U3 = U2 + P7, U4 = U2 + P5,
+     * C22 = U3 + P5, C12 = U4 + P3 */
+    strassen_sequential(m2, n2, k2, A11, lda, B11, ldb, X, ldx, rest,
+                        cutoff, threads);
+    strassen_add(m2, n2, X, ldx, C12, ldc, 1.0, C12, ldc);
+    strassen_add(m2, n2, C12, ldc, C21, ldc, 1.0, C21, ldc);
+    strassen_add(m2, n2, C12, ldc, C22, ldc, 1.0, C12, ldc);
+    strassen_add(m2, n2, C21, ldc, C22, ldc, 1.0, C22, ldc);
+    strassen_add(m2, n2, C12, ldc, C11, ldc, 1.0, C12, ldc);
+    /* P4 = A22 (T2 - B21), C21 = U3 - P4 */
+    strassen_add(k2, n2, Y, n2, B21, ldb, -1.0, Y, n2);
+    strassen_sequential(m2, n2, k2, A22, lda, Y, n2, C11, ldc, rest,
+                        cutoff, threads);
+    strassen_add(m2, n2, C21, ldc, C11, ldc, -1.0, C21, ldc);
+    /* P2 = A12 B21, C11 = P1 + P2 */
+    strassen_sequential(m2, n2, k2, A12, lda, B21, ldb, C11, ldc, rest,
+                        cutoff, threads);
+    strassen_add(m2, n2, X, ldx, C11, ldc, 1.0, C11, ldc);
+
+    strassen_peel(m, n, k, A, lda, B, ldb, C, ldc, threads);
+}
+//-----------------------------------------------------------------------------
+
+typedef struct strassen_product{
+    const double* A;
+    int lda;
+    const double* B;
+    int ldb;
+    double* P;
+} strassen_product_t;
+
+typedef struct strassen_args{
+    int m2;
+    int n2;
+    int k2;
+    int cutoff;
+    strassen_product_t products[STRASSEN_PRODUCTS];
+    double* workspace;      // product_workspace doubles per product
+    size_t product_workspace;
+} strassen_args_t;
+
+static void strassen_products(void* arg, int begin, int end)
+{
+    strassen_args_t* s = arg;
+    int p;
+    for(p=begin; p<end; p++){
+        strassen_product_t* q = &s->products[p];
+        strassen_sequential(s->m2, s->n2, s->k2, q->A, q->lda, q->B, q->ldb,
+                            q->P, s->n2,
+                            s->workspace + (size_t)p*s->product_workspace,
+                            s->cutoff, 1);
+    }
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: strassen_parallel
+ *
+ * Arguments: as strassen_sequential, the workspace being of
+ *             strassen_parallel_workspace(m, n, k, cutoff)
+ *            number of threads, 2 to 7
+ *
+ * Returns: void
+ *           the top level of strassen_sequential with its seven products
+ *           in separate buffers so they can run concurrently, each product
+ *           recursing sequentially on one thread. The operand sums and the
+ *           combination are the same operations in the same order, so the
+ *           result matches the sequential one bit for bit.
+ */
+static void strassen_parallel(int m, int n, int k, const double* A, int lda,
+                              const double* B, int ldb, double* C, int ldc,
+                              double* workspace, int cutoff, int threads)
+{
+    int m2 = m/2, n2 = n/2, k2 = k/2;
+    const double* A11 = A;
+    const double* A12 = A + k2;
+    const double* A21 = A + (size_t)m2*lda;
+    const double* A22 = A21 + k2;
+    const double* B11 = B;
+    const double* B12 = B + n2;
+    const double* B21 = B + (size_t)k2*ldb;
+    const double* B22 = B21 + n2;
+    size_t a_size = (size_t)m2*k2, b_size = (size_t)k2*n2;
+    size_t c_size = (size_t)m2*n2;
+    double* S1 = workspace;
+    double* S2 = S1 + a_size;
+    double* S3 = S2 + a_size;
+    double* S4 = S3 + a_size;
+    double* T1 = S4 + a_size;
+    double* T2 = T1 + b_size;
+    double* T3 = T2 + b_size;
+    double* T4 = T3 + b_size;
+    double* P = T4 + b_size;
+    int i, j;
+
+    strassen_add(m2, k2, A21, lda, A22, lda, 1.0, S1, k2);
+    strassen_add(m2, k2, S1, k2, A11, lda, -1.0, S2, k2);
+    strassen_add(m2, k2, A11, lda, A21, lda, -1.0, S3, k2);
+    strassen_add(m2, k2, A12, lda, S2, k2, -1.0, S4, k2);
+    strassen_add(k2, n2, B12, ldb, B11, ldb, -1.0, T1, n2);
+    strassen_add(k2, n2, B22, ldb, T1, n2, -1.0, T2, n2);
+    strassen_add(k2, n2, B22, ldb, B12, ldb, -1.0, T3, n2);
+    strassen_add(k2, n2, T2, n2, B21, ldb, -1.0, T4, n2);
+
+    strassen_args_t s = {m2, n2, k2, cutoff, {
+        {A11, lda, B11, ldb, P},
+        {A12, lda, B21, ldb, P + c_size},
+        {S4, k2, B22, ldb, P + 2*c_size},
+        {A22, lda, T4, n2, P + 3*c_size},
+        {S1, k2, T1, n2, P + 4*c_size},
+        {S2, k2, T2, n2, P + 5*c_size},
+        {S3, k2, T3, n2, P + 6*c_size}},
+        P + STRASSEN_PRODUCTS*c_size,
+        strassen_sequential_workspace(m2, n2, k2, cutoff)};
+    matrix_parallel_for(STRASSEN_PRODUCTS, threads, &strassen_products, &s);
+
+    for(i=0; i<m2; i++){
+        double* C11 = C + (size_t)i*ldc;
+        double* C12 = C11 + n2;
+        double* C21 = C + (size_t)(m2 + i)*ldc;
+        double* C22 = C21 + n2;
+        const double* P1 = P + (size_t)i*n2;
+        const double* P2 = P1 + c_size;
+        const double* P3 = P2 + c_size;
+        const double* P4 = P3 + c_size;
+        const double* P5 = P4 + c_size;
+        const double* P6 = P5 + c_size;
+        const double* P7 = P6 + c_size;
+        for(j=0; j<n2; j++){
+            double u2 = P1[j] + P6[j];
+            double u3 = u2 + P7[j];
+            C11[j] = P1[j] + P2[j];
+            C12[j] = (u2 + P5[j]) + P3[j];
+            C21[j] = u3 - P4[j];
+            C22[j] = u3 + P5[j];
+        }
+    }
+
+    strassen_peel(m, n, k, A, lda, B, ldb, C, ldc, threads);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_strassen_mt
+ *
+ * Arguments: number of rows of A and C
+ *            number of columns of B and C
+ *            number of columns of A and rows of B
+ *            row-major A, lda doubles between the starts of its rows
+ *            row-major B, ldb doubles between the starts of its rows
+ *            row-major C, ldc doubles between the starts of its rows, not
+ *             overlapping A or B
+ *            workspace of matrix_strassen_workspace(m, n, k, num_threads)
+ *             doubles, or NULL to allocate it for this call
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           C = A*B, recursing by Strassen-Winograd while m, n and k all
+ *           exceed the cutoff and handing the blocks below it to
+ *           matrix_gemm. Odd dimensions are split evenly and the spare row
+ *           and column are done by GEMM. With 2 to 7 threads the seven top
+ *           level products run concurrently (the thread count only changes
+ *           the speed, not the result); with more, the leaf GEMMs share
+ *           them instead.
+ *
+ *           Error: each entry of C carries an error bounded by about
+ *           (n/n0)^log2(18) * n0^2 * u * max|A| * max|B| for n x n operands,
+ *           recursion stopping at n0 and u = 2^-53 (Higham, Accuracy and
+ *           Stability of Numerical Algorithms, ch. 23). Classical GEMM's
+ *           bound is n*u*(|A||B|)_ij entry by entry, so rows or columns of
+ *           small entries keep their accuracy there but not here, and the
+ *           bound grows by about 4.2 bits per level rather than 1; one
+ *           level (n at most twice the cutoff) loses little.
+ */
+void matrix_strassen_mt(int m, int n, int k, const double* A, int lda,
+                        const double* B, int ldb, double* C, int ldc,
+                        double* workspace, int num_threads)
+{
+    assert(m >= 0 && n >= 0 && k >= 0);
+    assert(lda >= k && ldb >= n && ldc >= n);
+    int cutoff = strassen_cutoff;
+    if (strassen_is_leaf(m, n, k, cutoff)){
+        matrix_gemm_mt(m, n, k, 1.0, A, lda, 1, B, ldb, 1, 0.0, C, ldc,
+                       num_threads);
+        return;
+    }
+    int threads = strassen_parallel_threads(m, n, k, num_threads);
+    double* allocated = NULL;
+    if (workspace == NULL){
+        allocated = matrix_aligned_alloc(
+            matrix_strassen_workspace(m, n, k, num_threads)*sizeof(double));
+        workspace = allocated;
+    }
+    if (threads > 1){
+        strassen_parallel(m, n, k, A, lda, B, ldb, C, ldc, workspace,
+                          cutoff, threads);
+    }
+    else{
+        strassen_sequential(m, n, k, A, lda, B, ldb, C, ldc, workspace,
+                            cutoff, num_threads);
+    }
+    matrix_aligned_free(allocated);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_strassen(int m, int n, int k, const double* A, int lda,
+                     const double* B, int ldb, double* C, int ldc)
+{
+    matrix_strassen_mt(m, n, k, A, lda, B, ldb, C, ldc, NULL,
+                       MATRIX_THREADS_DEFAULT);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_multiply_dispatch
+ *
+ * Arguments: as matrix_strassen_mt, without the workspace
+ *
+ * Returns: void
+ *           C = A*B by the method matrix_set_multiply_mode chose
+ */
+void matrix_multiply_dispatch(int m, int n, int k, const double* A, int lda,
+                              const double* B, int ldb, double* C, int ldc,
+                              int num_threads)
+{
+    if (multiply_mode == MATRIX_MULTIPLY_STRASSEN){
+        matrix_strassen_mt(m, n, k, A, lda, B, ldb, C, ldc, NULL,
+                           num_threads);
+        return;
+    }
+    matrix_gemm_mt(m, n, k, 1.0, A, lda, 1, B, ldb, 1, 0.0, C, ldc,
+                   num_threads);
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,28 @@
+#ifndef MATRIX_STRASSEN_H
+#define MATRIX_STRASSEN_H
+
+#include <stddef.h>
+
+/* Modes for matrix_set_multiply_mode */
+#define MATRIX_MULTIPLY_CLASSICAL 0
+#define MATRIX_MULTIPLY_STRASSEN 1
+
+/* Products with a dimension at most this are left to matrix_gemm */
+#define STRASSEN_DEFAULT_CUTOFF 1024
+
+void matrix_set_multiply_mode(int mode);
+int matrix_get_multiply_mode(void);
+void matrix_set_strassen_cutoff(int cutoff);
+int matrix_get_strassen_cutoff(void);
+
+size_t matrix_strassen_workspace(int m, int n, int k, int num_threads);
+void matrix_strassen(int m, int n, int k, const double* A, int lda,
+                     const double* B, int ldb, double* C, int ldc);
+void matrix_strassen_mt(int m, int n, int k, const double* A, int lda,
+                        const double* B, int ldb, double* C, int ldc,
+                        double* workspace, int num_threads);
+void matrix_multiply_dispatch(int m, int n, int k, const double* A, int lda,
+                              const double* B, int ldb, double* C, int ldc,
+                              int num_threads);
+
+#endif // MATRIX_STRASSEN_H
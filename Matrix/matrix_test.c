@@ -1,11 +1,67 @@
+#include <errno.h>
+#include <math.h>
+#include <float.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 #include "matrix.h"
-#include "..\Files\files.h"
-#include "..\Utilities\utils.h"
-#include "..\Hashtable\hashtable.h"
-#include "..\Math_Extended\math_extended.h"
+#include "matrix_gemm.h"
+#include "matrix_lu.h"
+#include "matrix_sparse.h"
+#include "matrix_corr.h"
+#include "matrix_binary.h"
+#include "matrix_csv.h"
+#include "matrix_transpose.h"
+#include "matrix_float.h"
+#include "matrix_column_index.h"
+#include "matrix_missing.h"
+#include "matrix_stats.h"
+#include "matrix_gemv.h"
+#include "matrix_strassen.h"
+#include "matrix_bool.h"
+#include "matrix_batch.h"
+#include "matrix_prefix.h"
+#include "matrix_ooc.h"
+#include "../Files/files.h"
+#include "../Utilities/utils.h"
+#include "../Hashtable/hashtable.h"
+#include "../Math_Extended/math_extended.h"
 
 #define IRIS_DATASET "..\\Test_Data\\Iris.csv"
 #define SUCCESS_FAIL (printf("Success\n")) : (printf("Failure\n"))
+#define TOLERANCE 1e-9
+
+static matrix_t* random_matrix(int rows, int columns)
+{
+    matrix_t* m = create_matrix(rows, columns);
+    int i, j;
+    for(i=0; i<rows; i++){
+        for(j=0; j<columns; j++){
+            m->set_entry(m, i, j, (double)rand()/RAND_MAX - 0.5);
+        }
+    }
+    return m;
+}
+
+/* Textbook triple loop, used to check the optimised kernels */
+static int multiply_matches_reference(matrix_t* a, matrix_t* b, matrix_t* c)
+{
+    int i, j, k;
+    for(i=0; i<a->num_rows; i++){
+        for(j=0; j<b->num_columns; j++){
+            double sum = 0.0;
+            for(k=0; k<a->num_columns; k++){
+                sum += a->get_entry(a, i, k) * b->get_entry(b, k, j);
+            }
+            if (fabs(sum - c->get_entry(c, i, j)) > TOLERANCE){
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
 
 int main(void){
     double A[] = {3, 4, 5};
@@ -20,7 +76,7 @@ int main(void){
      && m->str_index_used == 0) ? SUCCESS_FAIL;
 
     printf("Testing matrix_set_row: ");
-    int success;
+    int success = 0;
     int i;
     m->set_matrix_row(m, A, init_col, 0);
     for(i=0; i<m->num_columns; i++){
@@ -64,6 +120,1337 @@ int main(void){
         (0) ? SUCCESS_FAIL;
     }
 
+    printf("Testing contiguous storage: ");
+    success = ((size_t)m->data % MATRIX_ALIGNMENT == 0
+               && m->stride >= m->num_columns
+               && m->matrix[1]->vector == MATRIX_ROW(m, 1));
+    m->set_entry(m, 1, 2, 42.0);
+    success = success && m->matrix[1]->vector[2] == 42.0;
+    (success) ? SUCCESS_FAIL;
+
+    printf("Testing matrix_row_swap: ");
+    m->row_swap(m, 0, 1);
+    (m->get_entry(m, 0, 2) == 42.0 && m->get_entry(m, 1, 2) == A[2])
+        ? SUCCESS_FAIL;
+    m->free(m);
+
+    printf("Testing matrix_multiply: ");
+    double B[] = {1, 2, 3, 4, 5, 6};
+    double C[] = {22, 28, 49, 64};
+    matrix_t* b1 = create_matrix(2, 3);
+    matrix_t* b2 = create_matrix(3, 2);
+    b1->set_matrix_row(b1, B, 3, 0);
+    b1->set_matrix_row(b1, B+3, 3, 1);
+    for(i=0; i<3; i++){
+        b2->set_matrix_row(b2, B+2*i, 2, i);
+    }
+    matrix_t* prod = matrix_multiply(b1, b2);
+    (prod->num_rows == 2 && prod->num_columns == 2
+     && prod->get_entry(prod, 0, 0) == C[0] && prod->get_entry(prod, 0, 1) == C[1]
+     && prod->get_entry(prod, 1, 0) == C[2] && prod->get_entry(prod, 1, 1) == C[3])
+        ? SUCCESS_FAIL;
+    b1->free(b1); b2->free(b2); prod->free(prod);
+
+    printf("Testing matrix_multiply (blocked, rectangular): ");
+    b1 = random_matrix(101, 263);
+    b2 = random_matrix(263, 77);
+    prod = matrix_multiply(b1, b2);
+    success = multiply_matches_reference(b1, b2, prod);
+    prod->free(prod);
+    matrix_gemm_set_simd(0);
+    prod = matrix_multiply(b1, b2);
+    matrix_gemm_set_simd(1);
+    (success && multiply_matches_reference(b1, b2, prod)) ? SUCCESS_FAIL;
+    b1->free(b1); b2->free(b2); prod->free(prod);
+
+    printf("Testing multithreaded operations: ");
+    b1 = random_matrix(67, 45);
+    b2 = random_matrix(45, 67);
+    matrix_t* serial = matrix_multiply_mt(b1, b2, 1);
+    matrix_set_parallel_threshold(0);
+    prod = matrix_multiply_mt(b1, b2, 4);
+    success = matrix_equality(serial, prod);
+    serial->free(serial); prod->free(prod);
+    matrix_t* b2t = matrix_transpose_mt(b2, 3);
+    prod = b2t->transpose(b2t);
+    success = success && matrix_equality(prod, b2);
+    prod->free(prod);
+    prod = b1->transpose(b1);
+    success = success
+              && prod->get_entry(prod, 44, 66) == b1->get_entry(b1, 66, 44);
+    serial = matrix_addition_mt(b1, b2t, 1);
+    matrix_t* sum_mt = matrix_addition_mt(b1, b2t, 5);
+    success = success && matrix_equality(serial, sum_mt);
+    serial->free(serial); sum_mt->free(sum_mt);
+    serial = matrix_scalar_multiplication_mt(b1, 3.0, 1);
+    sum_mt = matrix_scalar_multiplication(b1, 3.0);
+    success = success && matrix_equality(serial, sum_mt);
+    matrix_set_parallel_threshold(DEFAULT_PARALLEL_THRESHOLD);
+    (success) ? SUCCESS_FAIL;
+    serial->free(serial); sum_mt->free(sum_mt); prod->free(prod);
+    b1->free(b1); b2->free(b2); b2t->free(b2t);
+
+    printf("Testing matrix_pow: ");
+    b1 = random_matrix(23, 23);
+    serial = b1->copy(b1);
+    for(i=1; i<13; i++){
+        prod = matrix_multiply(serial, b1);
+        serial->free(serial);
+        serial = prod;
+    }
+    prod = b1->pow(b1, 13);
+    success = 1;
+    for(i=0; i<23*23; i++){
+        if (fabs(prod->get_entry(prod, i/23, i%23)
+                 - serial->get_entry(serial, i/23, i%23)) > TOLERANCE){
+            success = 0;
+        }
+    }
+    matrix_pow_into(prod, b1, 0);
+    success = success && prod->trace(prod) == 23 && prod->grand_sum(prod) == 23;
+    matrix_pow_into(b1, b1, 1);
+    matrix_pow_into(prod, b1, 1);
+    (success && matrix_equality(prod, b1)) ? SUCCESS_FAIL;
+    serial->free(serial); prod->free(prod); b1->free(b1);
+
+    printf("Testing lu determinant and log_determinant: ");
+    double D[] = {2, -1, 0, -1, 2, -1, 0, -1, 2};
+    b1 = create_matrix(3, 3);
+    for(i=0; i<3; i++){
+        b1->set_matrix_row(b1, D+3*i, 3, i);
+    }
+    lu_t* lu = create_lu(b1);
+    int sign;
+    double log_det = lu->log_determinant(lu, &sign);
+    (fabs(lu->determinant(lu) - 4.0) < TOLERANCE
+     && fabs(b1->determinant(b1) - 4.0) < TOLERANCE
+     && sign == 1 && fabs(log_det - log(4.0)) < TOLERANCE
+     && lu->get_rank(lu) == 3) ? SUCCESS_FAIL;
+
+    printf("Testing lu solve: ");
+    double rhs[] = {1, 0, 1};
+    vector_t* b = create_vector_from_array(rhs, 3);
+    vector_t* x = lu->solve(lu, b);
+    (fabs(x->vector[0] - 1) < TOLERANCE && fabs(x->vector[1] - 1) < TOLERANCE
+     && fabs(x->vector[2] - 1) < TOLERANCE) ? SUCCESS_FAIL;
+    b->free(b); x->free(x); lu->free(lu); b1->free(b1);
+
+    printf("Testing lu inverse and solve_matrix: ");
+    b1 = random_matrix(40, 40);
+    lu = create_lu(b1);
+    matrix_t* inv = lu->inverse(lu);
+    prod = matrix_multiply(b1, inv);
+    success = 1;
+    for(i=0; i<40*40; i++){
+        double expected = (i/40 == i%40) ? 1.0 : 0.0;
+        if (fabs(prod->get_entry(prod, i/40, i%40) - expected) > 1e-8){
+            success = 0;
+        }
+    }
+    b2 = random_matrix(40, 7);
+    serial = lu->solve_matrix(lu, b2);
+    sum_mt = matrix_multiply(b1, serial);
+    for(i=0; i<40*7; i++){
+        if (fabs(sum_mt->get_entry(sum_mt, i/7, i%7)
+                 - b2->get_entry(b2, i/7, i%7)) > 1e-8){
+            success = 0;
+        }
+    }
+    (success) ? SUCCESS_FAIL;
+    inv->free(inv); prod->free(prod); b2->free(b2); serial->free(serial);
+    sum_mt->free(sum_mt); lu->free(lu); b1->free(b1);
+
+    printf("Testing blocked lu (solve, rank of rectangular and singular): ");
+    b1 = random_matrix(150, 150);
+    lu = create_lu_mt(b1, 3);
+    b2 = random_matrix(150, 3);
+    serial = lu->solve_matrix(lu, b2);
+    sum_mt = matrix_multiply(b1, serial);
+    success = (lu->get_rank(lu) == 150);
+    for(i=0; i<150*3; i++){
+        if (fabs(sum_mt->get_entry(sum_mt, i/3, i%3)
+                 - b2->get_entry(b2, i/3, i%3)) > 1e-8){
+            success = 0;
+        }
+    }
+    serial->free(serial); sum_mt->free(sum_mt); b2->free(b2); lu->free(lu);
+    /* Duplicate a row so the blocked path has to fall back */
+    b1->set_matrix_row(b1, MATRIX_ROW(b1, 3), 150, 120);
+    success = success && b1->rank(b1) == 149 && b1->determinant(b1) == 0.0;
+    b1->free(b1);
+    b1 = random_matrix(200, 90);
+    b2 = b1->transpose(b1);
+    success = success && b1->rank(b1) == 90 && b2->rank(b2) == 90;
+    (success) ? SUCCESS_FAIL;
+    b1->free(b1); b2->free(b2);
+
+    printf("Testing gaussian_elimination: ");
+    double E[] = {0, 2, 1, 4, 4, 3, 2, 0, 2};
+    b1 = create_matrix(3, 3);
+    for(i=0; i<3; i++){
+        b1->set_matrix_row(b1, E+3*i, 3, i);
+    }
+    int det = b1->gaussian_elimination(b1);
+    (det == -12 && b1->get_entry(b1, 1, 0) == 0.0 && b1->get_entry(b1, 2, 1) == 0.0
+     && b1->get_entry(b1, 0, 0) == 4 && b1->index_int[0] == 1) ? SUCCESS_FAIL;
+    b1->free(b1);
+
+    printf("Testing gaussian_elimination with a zero leading column: ");
+    /* The pivots sit right of the diagonal, so the multipliers left of them
+     * must not survive into the echelon form */
+    double E_skip[] = {0, 1, 2, 0, 2, 5, 0, 3, 7};
+    b1 = create_matrix(3, 3);
+    for(i=0; i<3; i++){
+        b1->set_matrix_row(b1, E_skip+3*i, 3, i);
+    }
+    det = b1->gaussian_elimination(b1);
+    success = (det == 0 && b1->get_entry(b1, 0, 1) == 3
+               && b1->get_entry(b1, 0, 2) == 7
+               && b1->get_entry(b1, 1, 2) != 0.0);
+    for(i=0; i<3; i++){
+        /* Column 0 everywhere, column 1 below row 0 and all of row 2 */
+        success = success && b1->get_entry(b1, i, 0) == 0.0
+                  && (i == 0 || b1->get_entry(b1, i, 1) == 0.0)
+                  && b1->get_entry(b1, 2, i) == 0.0;
+    }
+    success ? SUCCESS_FAIL;
+    b1->free(b1);
+
+    printf("Testing lu singular matrix: ");
+    b1 = create_matrix(3, 3);
+    for(i=0; i<3; i++){
+        b1->set_matrix_row(b1, A, 3, i);
+    }
+    lu = create_lu(b1);
+    lu->log_determinant(lu, &sign);
+    (lu->is_singular(lu) && lu->determinant(lu) == 0.0 && sign == 0
+     && lu->get_rank(lu) == 1) ? SUCCESS_FAIL;
+    lu->free(lu); b1->free(b1);
+
+    printf("Testing sparse from triplets (duplicates summed): ");
+    int tr_rows[] = {2, 0, 1, 2, 0, 2};
+    int tr_cols[] = {1, 2, 0, 1, 0, 3};
+    double tr_vals[] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+    sparse_matrix_t* sp = create_sparse_from_triplets(3, 4, 6, tr_rows,
+                                                      tr_cols, tr_vals,
+                                                      SPARSE_CSR);
+    sparse_matrix_t* sp_csc = sp->to_format(sp, SPARSE_CSC);
+    (sp->nnz == 5 && sp->get_entry(sp, 2, 1) == 5.0
+     && sp->get_entry(sp, 0, 0) == 5.0 && sp->get_entry(sp, 1, 1) == 0.0
+     && sp->index[0] == 0 && sp->index[1] == 2
+     && sp_csc->get_entry(sp_csc, 2, 3) == 6.0
+     && sp_csc->get_entry(sp_csc, 2, 1) == 5.0) ? SUCCESS_FAIL;
+    sp_csc->free(sp_csc); sp->free(sp);
+
+    printf("Testing sparse multiply_vector, multiply and transpose: ");
+    int j, k;
+    matrix_t* dense_a = random_matrix(60, 50);
+    matrix_t* dense_b = random_matrix(50, 40);
+    for(i=0; i<60; i++){
+        for(k=0; k<50; k++){
+            if (rand() % 10){
+                dense_a->set_entry(dense_a, i, k, 0.0);
+            }
+        }
+    }
+    for(i=0; i<50; i++){
+        for(k=0; k<40; k++){
+            if (rand() % 10){
+                dense_b->set_entry(dense_b, i, k, 0.0);
+            }
+        }
+    }
+    sparse_matrix_t* sa = create_sparse_from_dense(dense_a, SPARSE_CSR);
+    sparse_matrix_t* sb = create_sparse_from_dense(dense_b, SPARSE_CSC);
+    vector_t* sx = create_zero_vector(50);
+    for(k=0; k<50; k++){
+        sx->vector[k] = k - 25.0;
+    }
+    vector_t* sy = sa->multiply_vector(sa, sx);
+    sparse_matrix_t* sa_csc = sa->to_format(sa, SPARSE_CSC);
+    vector_t* sy_csc = sa_csc->multiply_vector(sa_csc, sx);
+    success = 1;
+    for(i=0; i<60; i++){
+        double sum = 0.0;
+        for(k=0; k<50; k++){
+            sum += dense_a->get_entry(dense_a, i, k)*sx->vector[k];
+        }
+        success = success && fabs(sum - sy->vector[i]) < TOLERANCE
+                  && fabs(sum - sy_csc->vector[i]) < TOLERANCE;
+    }
+    sparse_matrix_t* sc = sparse_multiply(sa, sb);
+    matrix_t* dense_c = sc->to_dense(sc);
+    success = success && multiply_matches_reference(dense_a, dense_b, dense_c);
+    sparse_matrix_t* sat = sa->transpose(sa);
+    matrix_t* dense_t = sat->to_dense(sat);
+    matrix_t* at = dense_a->transpose(dense_a);
+    matrix_t* round_trip = sb->to_dense(sb);
+    (success && matrix_equality(dense_t, at)
+     && matrix_equality(round_trip, dense_b)) ? SUCCESS_FAIL;
+    sx->free(sx); sy->free(sy); sy_csc->free(sy_csc);
+    sa->free(sa); sb->free(sb); sa_csc->free(sa_csc); sc->free(sc);
+    sat->free(sat); dense_t->free(dense_t); at->free(at);
+    round_trip->free(round_trip);
+    dense_a->free(dense_a); dense_b->free(dense_b); dense_c->free(dense_c);
+
+    printf("Testing matrix views (split, strided, column, write through): ");
+    matrix_t* data_set = random_matrix(100, 6);
+    matrix_t* train = create_matrix_view(data_set, 0, 80, 0, 6);
+    matrix_t* validate = create_matrix_view(data_set, 80, 20, 1, 5);
+    matrix_t* every_other = create_matrix_view_strided(data_set, 1, 50, 2,
+                                                       0, 6);
+    matrix_t* column = matrix_column_view(validate, 2);
+    matrix_t* block = create_matrix_view(train, 10, 6, 0, 6);
+    matrix_t* validate_copy = validate->copy(validate);
+    matrix_t* block_copy = block->copy(block);
+    matrix_t* weights = random_matrix(5, 3);
+    matrix_t* from_view = matrix_multiply(validate, weights);
+    matrix_t* from_copy = matrix_multiply(validate_copy, weights);
+    double column_sum = 0.0;
+    for(i=0; i<20; i++){
+        column_sum += data_set->get_entry(data_set, 80+i, 3);
+    }
+    success = matrix_equality(from_view, from_copy)
+              && !validate_copy->is_view
+              && validate_copy->stride == matrix_stride(5)
+              && fabs(column->grand_sum(column) - column_sum) < TOLERANCE
+              && fabs(validate->matrix_column_mean(validate, 2)
+                      - column_sum/20) < TOLERANCE
+              && fabs(block->trace(block) - block_copy->trace(block_copy))
+                 < TOLERANCE
+              && fabs(block->determinant(block)
+                      - block_copy->determinant(block_copy)) < TOLERANCE
+              && every_other->get_entry(every_other, 7, 4)
+                 == data_set->get_entry(data_set, 15, 4);
+    double row_one = data_set->get_entry(data_set, 1, 5);
+    validate->set_entry(validate, 3, 0, 42.0);
+    train->row_swap(train, 0, 1);
+    matrix_t* validate_t = validate->transpose(validate);
+    (success && data_set->get_entry(data_set, 83, 1) == 42.0
+     && validate_t->get_entry(validate_t, 0, 3) == 42.0
+     && data_set->get_entry(data_set, 0, 5) == row_one) ? SUCCESS_FAIL;
+    validate_t->free(validate_t);
+    from_view->free(from_view); from_copy->free(from_copy);
+    weights->free(weights); block_copy->free(block_copy);
+    validate_copy->free(validate_copy);
+    block->free(block); column->free(column); every_other->free(every_other);
+    validate->free(validate); train->free(train);
+
+    printf("Testing matrix_pow_into a view: ");
+    matrix_t* before = data_set->copy(data_set);
+    matrix_t* square = create_matrix_view(data_set, 20, 5, 1, 5);
+    matrix_t* cubed = square->pow(square, 3);
+    matrix_pow_into(square, square, 3);
+    success = matrix_equality(square, cubed);
+    for(i=0; i<100; i++){
+        for(j=0; j<6; j++){
+            if (i >= 20 && i < 25 && j >= 1){
+                continue;
+            }
+            success = success && data_set->get_entry(data_set, i, j)
+                                 == before->get_entry(before, i, j);
+        }
+    }
+    success ? SUCCESS_FAIL;
+    square->free(square); cubed->free(cubed); before->free(before);
+    data_set->free(data_set);
+
+    printf("Testing _into and in place operations: ");
+    matrix_t* p1 = random_matrix(40, 30);
+    matrix_t* p2 = random_matrix(40, 30);
+    matrix_t* p3 = random_matrix(30, 20);
+    matrix_t* expected = matrix_addition(p1, p2);
+    matrix_t* out = create_matrix(40, 30);
+    matrix_t* product = create_matrix(40, 20);
+    matrix_addition_into(out, p1, p2);
+    success = matrix_equality(out, expected);
+    matrix_multiply_into(product, p1, p3);
+    success = success && multiply_matches_reference(p1, p3, product);
+    matrix_axpy(out, -1.0, p2);                         // p1
+    matrix_add_in_place(out, p1);                       // 2 p1
+    matrix_scale_in_place(out, 0.25);                   // p1/2
+    matrix_scalar_multiplication_into(out, out, 2.0);   // p1
+    matrix_hadamard_product_into(out, out, p1);         // p1 o p1
+    for(i=0; i<40; i++){
+        for(j=0; j<30; j++){
+            double e = p1->get_entry(p1, i, j);
+            success = success
+                      && fabs(out->get_entry(out, i, j) - e*e) < TOLERANCE;
+        }
+    }
+    success ? SUCCESS_FAIL;
+    p1->free(p1); p2->free(p2); p3->free(p3); expected->free(expected);
+    out->free(out); product->free(product);
+
+    printf("Testing matrix_correlation and matrix_covariance: ");
+    matrix_t* obs = random_matrix(300, 45);
+    for(j=0; j<45; j++){
+        obs->set_entry(obs, 7, j, 2.0*obs->get_entry(obs, 3, j) + 1.0);
+        obs->set_entry(obs, 9, j, 5.0);
+    }
+    matrix_t* corr = matrix_correlation(obs, SAMPLE);
+    matrix_t* cov_sample = matrix_covariance_mt(obs, SAMPLE, 3);
+    matrix_t* cov_population = matrix_covariance(obs, POPULATION);
+    success = (corr->num_rows == 300 && corr->num_columns == 300);
+    for(i=0; i<300 && success; i++){
+        for(j=0; j<300; j++){
+            double c = corr->get_entry(corr, i, j);
+            if (i == 9 || j == 9){
+                success = success && c == ((i == j) ? 1.0 : 0.0);
+                continue;
+            }
+            success = success
+                && fabs(c - ((i == j) ? 1.0 : vector_correlation(
+                        obs->matrix[i], obs->matrix[j], SAMPLE))) < TOLERANCE
+                && c == corr->get_entry(corr, j, i)
+                && fabs(cov_sample->get_entry(cov_sample, i, j)
+                        - vector_covariance(obs->matrix[i], obs->matrix[j],
+                                            SAMPLE)) < TOLERANCE
+                && fabs(cov_population->get_entry(cov_population, i, j)
+                        - vector_covariance(obs->matrix[i], obs->matrix[j],
+                                            POPULATION)) < TOLERANCE;
+        }
+    }
+    (success && fabs(corr->get_entry(corr, 3, 7) - 1.0) < TOLERANCE)
+        ? SUCCESS_FAIL;
+    corr->free(corr); cov_sample->free(cov_sample);
+    cov_population->free(cov_population); obs->free(obs);
+
+    printf("Testing streaming csv_to_matrix: ");
+    FILE* csv = fopen("csv_stream_test.csv", "w");
+    matrix_t* written = random_matrix(500, 7);
+    fprintf(csv, "id,a,b,c,d,e,f,g\r\n");
+    for(i=0; i<500; i++){
+        fprintf(csv, "row%d", i);
+        for(j=0; j<7; j++){
+            if (i == 4 && j == 2){
+                fprintf(csv, ",NA");
+            }
+            else if (j == 3){
+                /* Short decimals take the fast path, the rest go to strtod */
+                written->set_entry(written, i, j, (i - 250)/8.0);
+                fprintf(csv, ",%g", (i - 250)/8.0);
+            }
+            else{
+                fprintf(csv, ",%.17g", written->get_entry(written, i, j));
+            }
+        }
+        fprintf(csv, (i == 100) ? "\r\n\r\n" : "\r\n");
+    }
+    fclose(csv);
+    matrix_t* streamed = csv_to_matrix("csv_stream_test.csv", ",", 0, "NA",
+                                       LABELLED, LABELLED);
+    matrix_t* regrown = csv_to_matrix("csv_stream_test.csv", ",", 3, "NA",
+                                      LABELLED, LABELLED);
+    matrix_set_missing(written, 4, 2);
+    remove("csv_stream_test.csv");
+    (matrix_equality(streamed, written) && matrix_equality(regrown, written)
+     && !strcmp(matrix_column_name(streamed, 6), "g")
+     && !strcmp(matrix_row_label(regrown, 499), "row499")
+     && streamed->column_hash != NULL
+     && get_matrix_entry_by_colname(streamed, 7, "c")
+        == written->get_entry(written, 7, 2)
+     && streamed->str_index_used && streamed->column_index_used
+     && streamed->alloc_rows == 500 && regrown->alloc_rows == 500)
+        ? SUCCESS_FAIL;
+    written->free(written); streamed->free(streamed); regrown->free(regrown);
+
+    printf("Testing csv_format_double shortest round trip: ");
+    char text[CSV_DOUBLE_CHARS], shorter[40];
+    int saved_errno = errno;
+    success = !strcmp((csv_format_double(0.1, text), text), "0.1")
+              && !strcmp((csv_format_double(-1234.5, text), text), "-1234.5")
+              && !strcmp((csv_format_double(1e23, text), text), "1e23")
+              && !strcmp((csv_format_double(5e-324, text), text), "5e-324")
+              && !strcmp((csv_format_double(1e20, text), text),
+                         "100000000000000000000")
+              && !strcmp((csv_format_double(0.000123, text), text),
+                         "0.000123")
+              && !strcmp((csv_format_double(-0.0, text), text), "-0")
+              && !strcmp((csv_format_double(-1.2345678901234567e-6, text),
+                          text), "-0.0000012345678901234567");
+    for(i=0; i<200000 && success; i++){
+        uint64_t bits = ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31)
+                        ^ (uint64_t)rand();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if (isnan(value) || isinf(value)){
+            continue;
+        }
+        int length = csv_format_double(value, text);
+        /* Significant digits, between the first and last non-zero digit */
+        int first = -1, last = -1, digits = 0;
+        for(j=0; j<length && text[j] != 'e'; j++){
+            if (text[j] >= '1' && text[j] <= '9'){
+                first = (first < 0) ? j : first;
+                last = j;
+            }
+        }
+        for(j=first; j>=0 && j<=last; j++){
+            digits += (text[j] != '.');
+        }
+        success = (strtod(text, NULL) == value);
+        if (digits > 1){
+            snprintf(shorter, sizeof(shorter), "%.*e", digits - 2, value);
+            success = success && (strtod(shorter, NULL) != value);
+        }
+    }
+    success ? SUCCESS_FAIL;
+    errno = saved_errno;    // strtod reports ERANGE for subnormals
+
+    printf("Testing parallel matrix_to_csv round trip: ");
+    matrix_t* exported = random_matrix(20000, 9);
+    matrix_set_missing(exported, 17, 4);
+    exported->set_entry(exported, 19999, 8, 1e300);
+    exported->set_entry(exported, 3, 0, 42.0);
+    matrix_to_csv_mt(exported, "csv_write_test.csv", 3);
+    matrix_t* imported = csv_to_matrix("csv_write_test.csv", ",", 0, "Nan",
+                                       NOT_LABELLED, NOT_LABELLED);
+    exported->to_csv(exported, "csv_write_test.csv");
+    matrix_t* reimported = csv_to_matrix("csv_write_test.csv", ",", 0, "Nan",
+                                         NOT_LABELLED, NOT_LABELLED);
+    remove("csv_write_test.csv");
+    success = matrix_equality(imported, exported)
+              && matrix_equality(reimported, exported);
+    exported->free(exported); imported->free(imported);
+    reimported->free(reimported);
+    /* Every entry of the longest text, on one thread */
+    exported = create_matrix(6000, 8);
+    for(i=0; i<6000; i++){
+        for(j=0; j<8; j++){
+            MATRIX_ENTRY(exported, i, j) = -1.2345678901234567e-6;
+        }
+    }
+    matrix_to_csv_mt(exported, "csv_write_test.csv", 1);
+    imported = csv_to_matrix("csv_write_test.csv", ",", 0, "Nan",
+                             NOT_LABELLED, NOT_LABELLED);
+    remove("csv_write_test.csv");
+    (success && matrix_equality(imported, exported)) ? SUCCESS_FAIL;
+    exported->free(exported); imported->free(imported);
+
+    printf("Testing blocked and in place transpose: ");
+    matrix_t* ragged = random_matrix(71, 38);
+    matrix_t* ragged_t = ragged->transpose(ragged);
+    success = (ragged_t->num_rows == 38 && ragged_t->num_columns == 71);
+    for(i=0; i<71 && success; i++){
+        for(j=0; j<38; j++){
+            success = success && MATRIX_ENTRY(ragged_t, j, i)
+                                 == MATRIX_ENTRY(ragged, i, j);
+        }
+    }
+    /* A 33 x 33 view, transposed out of place and then in place */
+    matrix_t* window = create_matrix_view(ragged, 5, 33, 3, 33);
+    matrix_t* window_t = matrix_transpose_mt(window, 2);
+    matrix_transpose_in_place(window);
+    success = success && matrix_equality(window, window_t)
+              && MATRIX_ENTRY(window_t, 0, 32) == MATRIX_ENTRY(ragged_t, 3, 37);
+    matrix_t* swapped = random_matrix(67, 67);
+    matrix_t* swapped_copy = swapped->copy(swapped);
+    matrix_transpose_in_place_mt(swapped, 3);
+    for(i=0; i<67 && success; i++){
+        for(j=0; j<67; j++){
+            success = success && MATRIX_ENTRY(swapped, i, j)
+                                 == MATRIX_ENTRY(swapped_copy, j, i);
+        }
+    }
+    success ? SUCCESS_FAIL;
+    window->free(window); ragged->free(ragged); ragged_t->free(ragged_t);
+    window_t->free(window_t); swapped->free(swapped);
+    swapped_copy->free(swapped_copy);
+
+    printf("Testing float matrices: ");
+    matrix_t* da = random_matrix(77, 301);
+    matrix_t* db = random_matrix(301, 45);
+    matrix_t* dprod = matrix_multiply(da, db);
+    matrixf_t* fa = matrix_to_matrixf(da);
+    matrixf_t* fb = matrix_to_matrixf(db);
+    matrixf_t* fprod = matrixf_multiply_mt(fa, fb, 3);
+    matrix_gemm_set_simd(0);
+    matrixf_t* fprod_scalar = matrixf_multiply(fa, fb);
+    matrix_gemm_set_simd(1);
+    matrix_t* fprod_d = matrixf_to_matrix(fprod);
+    matrixf_t* fa_t = fa->transpose(fa);
+    success = (fa->stride % 16 == 0 && fprod_d->num_rows == 77
+               && fprod_d->num_columns == 45 && fa_t->num_rows == 301
+               && matrixf_multiply(fa, fa) == NULL);
+    for(i=0; i<77 && success; i++){
+        for(j=0; j<45; j++){
+            success = success
+                && fabs(MATRIX_ENTRY(fprod_d, i, j) - MATRIX_ENTRY(dprod, i, j))
+                   < 1e-4
+                && fabs(MATRIXF_ENTRY(fprod_scalar, i, j)
+                        - MATRIXF_ENTRY(fprod, i, j)) < 1e-4;
+        }
+    }
+    for(i=0; i<77 && success; i++){
+        for(j=0; j<301; j++){
+            success = success && MATRIXF_ENTRY(fa_t, j, i)
+                                 == (float)MATRIX_ENTRY(da, i, j);
+        }
+    }
+    success = success && fabs(fa->grand_sum(fa) - da->grand_sum(da)) < 1e-3;
+    success ? SUCCESS_FAIL;
+    da->free(da); db->free(db); dprod->free(dprod); fa->free(fa);
+    fb->free(fb); fprod->free(fprod); fprod_scalar->free(fprod_scalar);
+    fprod_d->free(fprod_d); fa_t->free(fa_t);
+
+    printf("Testing label arena: ");
+    matrix_t* tall = create_matrix(100000, 3);
+    matrix_t* tall_copy = tall->copy(tall);
+    success = (tall->labels == NULL && tall->row_labels == NULL
+               && tall_copy->labels == NULL && tall_copy->column_labels == NULL
+               && !strcmp(matrix_row_label(tall, 99999), ""));
+    for(i=0; i<100000; i += 7){
+        char label[16];
+        sprintf(label, "r%d", i);
+        matrix_set_row_label(tall, i, label);
+    }
+    matrix_set_column_name(tall, 2, "z");
+    /* A label copied from the same arena, which may move while growing */
+    matrix_set_row_label(tall, 1, matrix_row_label(tall, 99995));
+    matrix_t* relabelled = tall->copy(tall);
+    matrix_t* tall_view = create_matrix_view_strided(tall, 98000, 20, 7, 1, 2);
+    success = success && tall->str_index_used && tall->column_index_used
+              && !strcmp(matrix_row_label(tall, 99995), "r99995")
+              && !strcmp(matrix_row_label(tall, 1), "r99995")
+              && !strcmp(matrix_row_label(tall, 2), "")
+              && !strcmp(matrix_row_label(relabelled, 700), "r700")
+              && !strcmp(matrix_column_name(relabelled, 2), "z")
+              && !strcmp(matrix_column_name(relabelled, 0), "")
+              && !strcmp(matrix_row_label(tall_view, 1), "r98007")
+              && !strcmp(matrix_column_name(tall_view, 1), "z");
+    success ? SUCCESS_FAIL;
+    tall_view->free(tall_view); tall->free(tall); tall_copy->free(tall_copy);
+    relabelled->free(relabelled);
+
+    printf("Testing column name index: ");
+    matrix_t* named = random_matrix(4, 300);
+    char* lookup[] = {"c0", "c299", "dup", "missing", "c150", ""};
+    int found_at[6];
+    success = (matrix_column_index(named, "c0") == -1);
+    for(j=0; j<300; j++){
+        char name[16];
+        sprintf(name, "c%d", j);
+        matrix_set_column_name(named, j, (j == 40 || j == 90) ? "dup" : name);
+    }
+    matrix_index_columns(named);
+    success = success
+              && matrix_column_indices(named, lookup, 6, found_at) == 4
+              && found_at[0] == 0 && found_at[1] == 299 && found_at[2] == 40
+              && found_at[3] == -1 && found_at[4] == 150 && found_at[5] == -1;
+    /* Naming an unnamed column is an insertion, renaming drops the index */
+    matrix_t* widened = create_matrix(2, 3);
+    matrix_set_column_name(widened, 0, "x");
+    success = success && matrix_column_index(widened, "x") == 0
+              && matrix_column_index(widened, "y") == -1;
+    matrix_set_column_name(widened, 2, "y");
+    matrix_set_column_name(widened, 1, "y");
+    success = success && matrix_column_index(widened, "y") == 1;
+    matrix_set_column_name(widened, 0, "z");
+    success = success && widened->column_hash == NULL
+              && matrix_column_index(widened, "x") == -1
+              && matrix_column_index(widened, "z") == 0;
+    matrix_set_column_name(named, 40, "renamed");
+    matrix_t* named_copy = named->copy(named);
+    matrix_t* named_view = create_matrix_view(named, 1, 2, 100, 100);
+    success = success && matrix_column_index(named, "dup") == 90
+              && matrix_column_index(named_copy, "renamed") == 40
+              && matrix_column_index(named_view, "c150") == 50
+              && matrix_column_index(named_view, "c0") == -1
+              && get_matrix_entry_by_colname(named_view, 1, "c199")
+                 == named->get_entry(named, 2, 199);
+    success ? SUCCESS_FAIL;
+    named_view->free(named_view); named->free(named);
+    named_copy->free(named_copy); widened->free(widened);
+
+    printf("Testing binary format and mapping: ");
+    matrix_t* saved = random_matrix(300, 13);
+    for(j=0; j<13; j++){
+        matrix_set_column_name(saved, j, (j % 2) ? "odd" : "even");
+    }
+    matrix_set_row_label(saved, 299, "last");
+    saved->index_int[0] = 42;
+    matrix_to_binary(saved, "binary_test.mtx");
+    matrix_t* loaded = binary_to_matrix("binary_test.mtx");
+    matrix_t* mapped = matrix_map_binary("binary_test.mtx",
+                                         MATRIX_MAP_READ_ONLY);
+    matrix_t* private = matrix_map_binary("binary_test.mtx",
+                                          MATRIX_MAP_COPY_ON_WRITE);
+    private->set_entry(private, 7, 5, -1.0);
+    matrix_t* remapped = matrix_map_binary("binary_test.mtx",
+                                           MATRIX_MAP_READ_ONLY);
+    matrix_t* band = create_matrix_view(saved, 10, 20, 3, 9);
+    matrix_to_binary(band, "binary_view_test.mtx");
+    matrix_t* band_loaded = binary_to_matrix("binary_view_test.mtx");
+    remove("binary_view_test.mtx");
+    (matrix_equality(loaded, saved) && matrix_equality(mapped, saved)
+     && matrix_equality(remapped, saved) && matrix_equality(band_loaded, band)
+     && private->get_entry(private, 7, 5) == -1.0
+     && mapped->read_only && !private->read_only && !loaded->read_only
+     && ((uintptr_t)mapped->data % MATRIX_ALIGNMENT) == 0
+     && !strcmp(matrix_column_name(mapped, 3), "odd")
+     && !strcmp(matrix_row_label(loaded, 299), "last")
+     && !strcmp(matrix_column_name(band_loaded, 0), "odd")
+     && mapped->index_int[0] == 42 && mapped->str_index_used)
+        ? SUCCESS_FAIL;
+#ifndef _WIN32
+    printf("Testing bulk writes to a read only mapping: ");
+    /* The write must stop at the read only assertion, so it runs in a
+     * child process and the child is expected to abort */
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0){
+        freopen("/dev/null", "w", stderr);
+        matrix_scale_in_place(mapped, 2.0);
+        _exit(0);
+    }
+    int child_status = 0;
+    waitpid(child, &child_status, 0);
+    (child > 0 && WIFSIGNALED(child_status)
+     && WTERMSIG(child_status) == SIGABRT && matrix_equality(mapped, saved))
+        ? SUCCESS_FAIL;
+#endif
+    band->free(band); saved->free(saved); loaded->free(loaded);
+    mapped->free(mapped); private->free(private); remapped->free(remapped);
+    band_loaded->free(band_loaded);
+    remove("binary_test.mtx");
+
+    printf("Testing missing values: ");
+    matrix_t* gappy = random_matrix(300, 150);
+    long gaps = 0;
+    for(i=0; i<300; i++){
+        for(j=0; j<150; j++){
+            if ((i*7 + j*3) % 11 == 0 || j == 149){
+                /* Both encodings in one matrix */
+                matrix_set_missing_mode((i + j) % 2 ? MATRIX_MISSING_NAN
+                                                    : MATRIX_MISSING_BITMAP);
+                matrix_set_missing(gappy, i, j);
+                gaps++;
+            }
+        }
+    }
+    matrix_set_missing_mode(MATRIX_MISSING_BITMAP);
+    double gappy_means[150], expected_means[150], scalar_means[150];
+    matrix_masked_column_means_mt(gappy, gappy_means, 3);
+    matrix_gemm_set_simd(0);
+    matrix_masked_column_means_mt(gappy, scalar_means, 3);
+    matrix_gemm_set_simd(1);
+    success = (matrix_count_missing(gappy) == gaps)
+              && matrix_is_missing(gappy, 0, 0)
+              && !matrix_is_missing(gappy, 0, 1)
+              && matrix_is_na(MATRIX_NA) && !matrix_is_na(NAN);
+    for(j=0; j<150; j++){
+        double sum = 0;
+        int present = 0;
+        for(i=0; i<300; i++){
+            if (!matrix_is_missing(gappy, i, j)){
+                sum += gappy->get_entry(gappy, i, j);
+                present++;
+            }
+        }
+        expected_means[j] = present ? sum/present : 0.0;
+        success = success && (gappy_means[j] == expected_means[j])
+                  && (scalar_means[j] == expected_means[j]);
+    }
+    /* A view whose columns start mid word, with a row step */
+    matrix_t* gappy_view = create_matrix_view_strided(gappy, 3, 90, 3, 37,
+                                                      100);
+    long view_gaps = 0;
+    for(i=0; i<90; i++){
+        for(j=0; j<100; j++){
+            view_gaps += matrix_is_missing(gappy_view, i, j);
+        }
+    }
+    success = success && matrix_count_missing_mt(gappy_view, 2) == view_gaps;
+    matrix_t* imputed = gappy->copy(gappy);
+    imputed->impute_missing_values(imputed, MEAN);
+    for(i=0; i<300 && success; i++){
+        for(j=0; j<150; j++){
+            double expected = matrix_is_missing(gappy, i, j)
+                              ? expected_means[j]
+                              : gappy->get_entry(gappy, i, j);
+            success = success && imputed->get_entry(imputed, i, j) == expected;
+        }
+    }
+    matrix_t* filled = gappy->copy(gappy);
+    matrix_t* filled_view = create_matrix_view_strided(filled, 3, 90, 3, 37,
+                                                       100);
+    matrix_fill_missing_mt(filled_view, expected_means, 2);
+    matrix_to_binary(gappy_view, "binary_missing_test.mtx");
+    matrix_t* gappy_loaded = binary_to_matrix("binary_missing_test.mtx");
+    remove("binary_missing_test.mtx");
+    success = success && matrix_count_missing(imputed) == 0
+              && matrix_count_missing(filled_view) == 0
+              && matrix_count_missing(filled) == gaps - view_gaps
+              && filled_view->get_entry(filled_view, 0, 0)
+                 == expected_means[0]
+              && matrix_equality(gappy_loaded, gappy_view)
+              && matrix_count_missing(gappy_loaded) == view_gaps
+              && !matrix_equality(gappy, filled);
+    gappy->set_entry(gappy, 0, 0, 1.0);
+    success = success && !matrix_is_missing(gappy, 0, 0);
+    success ? SUCCESS_FAIL;
+    gappy_view->free(gappy_view); filled_view->free(filled_view);
+    gappy->free(gappy); imputed->free(imputed); filled->free(filled);
+    gappy_loaded->free(gappy_loaded);
+
+    printf("Testing row swaps with a validity bitmap: ");
+    double swap_entries[] = {1, 2, 3, 4, 5, 6, 7, 8, 10};
+    matrix_t* row_swapped = create_matrix(3, 3);
+    for(i=0; i<3; i++){
+        row_swapped->set_matrix_row(row_swapped, swap_entries + 3*i, 3, i);
+    }
+    matrix_t* eliminated = row_swapped->copy(row_swapped);
+    matrix_set_missing(row_swapped, 0, 1);
+    row_swapped->row_swap(row_swapped, 0, 2);
+    success = !matrix_is_missing(row_swapped, 0, 1)
+              && row_swapped->get_entry(row_swapped, 0, 1) == 8
+              && matrix_is_missing(row_swapped, 2, 1)
+              && matrix_count_missing(row_swapped) == 1;
+    /* Pivoting moves the missing entry's row along with its bit */
+    matrix_set_missing(eliminated, 1, 2);
+    eliminated->gaussian_elimination(eliminated);
+    for(i=0; i<3; i++){
+        success = success && matrix_is_missing(eliminated, i, 2)
+                             == (eliminated->index_int[i] == 1);
+    }
+    success = success && eliminated->index_int[1] != 1;
+    success ? SUCCESS_FAIL;
+    row_swapped->free(row_swapped); eliminated->free(eliminated);
+
+    printf("Testing missing values set on the parent of a view: ");
+    matrix_t* viewed = random_matrix(4, 4);
+    matrix_t* viewed_block = create_matrix_view(viewed, 1, 3, 1, 3);
+    matrix_t* viewed_row = matrix_row_view(viewed_block, 2);
+    /* Without a bitmap only the NaN encoding reaches the views */
+    matrix_set_missing_mode(MATRIX_MISSING_NAN);
+    matrix_set_missing(viewed, 3, 2);
+    matrix_set_missing_mode(MATRIX_MISSING_BITMAP);
+    success = matrix_is_missing(viewed_block, 2, 1)
+              && matrix_count_missing(viewed_row) == 1
+              && viewed->num_views == 2;
+#ifndef _WIN32
+    /* A bitmap added now would not reach the views, so the child aborts */
+    fflush(stdout);
+    pid_t bitmap_child = fork();
+    if (bitmap_child == 0){
+        freopen("/dev/null", "w", stderr);
+        matrix_set_missing(viewed, 1, 1);
+        _exit(0);
+    }
+    int bitmap_status = 0;
+    waitpid(bitmap_child, &bitmap_status, 0);
+    success = success && bitmap_child > 0 && WIFSIGNALED(bitmap_status)
+              && WTERMSIG(bitmap_status) == SIGABRT;
+#endif
+    viewed_row->free(viewed_row); viewed_block->free(viewed_block);
+    matrix_set_missing(viewed, 1, 1);
+    viewed_block = create_matrix_view(viewed, 1, 3, 1, 3);
+    matrix_set_missing(viewed, 2, 2);
+    success = success && viewed->num_views == 1
+              && matrix_is_missing(viewed_block, 0, 0)
+              && matrix_is_missing(viewed_block, 1, 1)
+              && matrix_count_missing(viewed_block) == 3;
+    success ? SUCCESS_FAIL;
+    viewed_block->free(viewed_block); viewed->free(viewed);
+
+    printf("Testing transposing and converting missing values: ");
+    matrix_t* sparse_gaps = random_matrix(70, 130);
+    for(i=0; i<70; i++){
+        matrix_set_missing(sparse_gaps, i, (i*13) % 130);
+    }
+    matrix_t* gaps_view = create_matrix_view(sparse_gaps, 5, 60, 3, 100);
+    matrix_t* gaps_t = matrix_transpose_mt(gaps_view, 2);
+    matrixf_t* gaps_f = matrix_to_matrixf(gaps_view);
+    success = matrix_count_missing(gaps_t) == matrix_count_missing(gaps_view);
+    for(i=0; i<60 && success; i++){
+        for(j=0; j<100; j++){
+            int gap = matrix_is_missing(gaps_view, i, j);
+            success = success && matrix_is_missing(gaps_t, j, i) == gap
+                      && (isnan(MATRIXF_ENTRY(gaps_f, i, j)) != 0) == gap;
+        }
+    }
+    success ? SUCCESS_FAIL;
+    gaps_t->free(gaps_t); gaps_f->free(gaps_f);
+    gaps_view->free(gaps_view); sparse_gaps->free(sparse_gaps);
+
+    printf("Testing cached column statistics: ");
+    matrix_t* tracked = random_matrix(150, 150);
+    matrix_t* untracked = tracked->copy(tracked);
+    matrix_enable_stats(tracked);
+    double first_expected = untracked->matrix_column_mean(untracked, 3);
+    double first_mean = tracked->matrix_column_mean(tracked, 3);
+    double updates[150];
+    for(i=0; i<150; i++){
+        updates[i] = i - 75.0;
+    }
+    for(i=0; i<500; i++){
+        int row = rand() % 150, col = rand() % 150;
+        double value = (double)rand()/RAND_MAX;
+        tracked->set_entry(tracked, row, col, value);
+        untracked->set_entry(untracked, row, col, value);
+    }
+    tracked->set_matrix_row(tracked, updates, 150, 9);
+    untracked->set_matrix_row(untracked, updates, 150, 9);
+    matrix_set_missing(tracked, 20, 9);
+    matrix_set_missing(untracked, 20, 9);
+    /* Overwrite the max of the last column */
+    tracked->set_entry(tracked, 9, 149, 0.0);
+    untracked->set_entry(untracked, 9, 149, 0.0);
+    const matrix_column_stats_t* last_column;
+    last_column = matrix_column_stats(tracked, 149);
+    double last_max = -INFINITY;
+    for(i=0; i<150; i++){
+        if (!matrix_is_missing(untracked, i, 149)){
+            last_max = fmax(last_max, untracked->get_entry(untracked, i, 149));
+        }
+    }
+    success = (first_mean == first_expected && last_column->count == 150
+               && last_column->max == last_max
+               && matrix_column_stats(tracked, 9)->count == 149)
+              && fabs(tracked->grand_sum(tracked)
+                      - untracked->grand_sum(untracked)) < 1e-9
+              && fabs(tracked->trace(tracked) - untracked->trace(untracked))
+                 < 1e-9;
+    for(j=0; j<150 && success; j++){
+        success = fabs(tracked->matrix_column_mean(tracked, j)
+                       - untracked->matrix_column_mean(untracked, j)) < 1e-12;
+    }
+    /* Raw writes need an explicit invalidation */
+    MATRIX_ENTRY(tracked, 0, 0) += 1000.0;
+    MATRIX_ENTRY(untracked, 0, 0) += 1000.0;
+    matrix_invalidate_stats(tracked);
+    matrix_scale_in_place(tracked, 2.0);
+    matrix_scale_in_place(untracked, 2.0);
+    matrix_t* tracked_copy = tracked->copy(tracked);
+    success = success && matrix_column_stats(tracked, 0)->max
+                         == untracked->get_entry(untracked, 0, 0)
+              && fabs(tracked_copy->grand_sum(tracked_copy)
+                      - untracked->grand_sum(untracked)) < 1e-9
+              && tracked_copy->trace(tracked_copy) == untracked->trace(untracked);
+    /* The cache only changes the speed, also with an NA on the diagonal */
+    matrix_t* na_ones = create_matrix(3, 3);
+    for(i=0; i<9; i++){
+        na_ones->set_entry(na_ones, i/3, i%3, 1.0);
+    }
+    matrix_set_missing_mode(MATRIX_MISSING_NAN);
+    matrix_set_missing(na_ones, 1, 1);
+    matrix_set_missing_mode(MATRIX_MISSING_BITMAP);
+    matrix_t* na_tracked = na_ones->copy(na_ones);
+    matrix_enable_stats(na_tracked);
+    success = success && na_ones->grand_sum(na_ones) == 8.0
+              && na_ones->trace(na_ones) == 2.0
+              && na_tracked->grand_sum(na_tracked) == 8.0
+              && na_tracked->trace(na_tracked) == 2.0;
+    success ? SUCCESS_FAIL;
+    tracked->free(tracked); untracked->free(untracked);
+    tracked_copy->free(tracked_copy);
+    na_ones->free(na_ones); na_tracked->free(na_tracked);
+
+    printf("Testing matrix vector multiply and its transpose: ");
+    /* Square with ragged edges, tall and narrow (row chunks), wide (column
+     * blocks) and a strided view */
+    int gemv_rows[] = {67, 3*GEMV_ROW_CHUNK + 5, 9, 0};
+    int gemv_columns[] = {67, 6, GEMV_COLUMN_BLOCK + 3, 0};
+    success = 1;
+    for(k=0; k<4 && success; k++){
+        matrix_t* base = random_matrix(k == 3 ? 90 : gemv_rows[k],
+                                       k == 3 ? 41 : gemv_columns[k]);
+        matrix_t* a = (k == 3) ? create_matrix_view_strided(base, 1, 29, 3,
+                                                            2, 37)
+                               : base;
+        vector_t* x = create_zero_vector(a->num_columns);
+        vector_t* xt = create_zero_vector(a->num_rows);
+        vector_t* y = create_zero_vector(a->num_rows);
+        vector_t* yt = create_zero_vector(a->num_columns);
+        for(j=0; j<a->num_columns; j++){
+            x->vector[j] = (double)rand()/RAND_MAX - 0.5;
+        }
+        for(i=0; i<a->num_rows; i++){
+            xt->vector[i] = (double)rand()/RAND_MAX - 0.5;
+        }
+        matrix_vector_multiply_mt(a, x, y, 3);
+        matrix_transpose_vector_multiply_mt(a, xt, yt, 2);
+        for(i=0; i<a->num_rows && success; i++){
+            double dot = 0.0;
+            for(j=0; j<a->num_columns; j++){
+                dot += MATRIX_ENTRY(a, i, j)*x->vector[j];
+            }
+            success = fabs(y->vector[i] - dot) < 1e-12;
+        }
+        for(j=0; j<a->num_columns && success; j++){
+            double dot = 0.0;
+            for(i=0; i<a->num_rows; i++){
+                dot += MATRIX_ENTRY(a, i, j)*xt->vector[i];
+            }
+            success = fabs(yt->vector[j] - dot) < 1e-10;
+        }
+        /* y = 2Ax + y, and the same with the scalar kernels */
+        vector_t* y2 = y->copy(y);
+        matrix_gemv(a->num_rows, a->num_columns, 2.0, a->data, a->stride,
+                    x->vector, 1.0, y2->vector);
+        matrix_gemm_set_simd(0);
+        vector_t* yt2 = create_zero_vector(a->num_columns);
+        matrix_transpose_vector_multiply(a, xt, yt2);
+        matrix_gemm_set_simd(1);
+        for(i=0; i<a->num_rows && success; i++){
+            success = fabs(y2->vector[i] - 3*y->vector[i]) < 1e-12;
+        }
+        for(j=0; j<a->num_columns && success; j++){
+            success = fabs(yt2->vector[j] - yt->vector[j]) < 1e-10;
+        }
+        x->free(x); xt->free(xt); y->free(y); yt->free(yt);
+        y2->free(y2); yt2->free(yt2);
+        if (a != base){
+            a->free(a);
+        }
+        base->free(base);
+    }
+    success ? SUCCESS_FAIL;
+
+    printf("Testing Strassen-Winograd multiply: ");
+    /* Odd sizes and a small cutoff, so three levels recurse and each peels
+     * a spare row, column or inner index */
+    matrix_set_strassen_cutoff(16);
+    b1 = random_matrix(75, 83);
+    b2 = random_matrix(83, 69);
+    matrix_t* classical = matrix_multiply(b1, b2);
+    matrix_t* fast = create_matrix(75, 69);
+    size_t words = matrix_strassen_workspace(75, 69, 83, 1);
+    double* workspace = matrix_aligned_alloc(words*sizeof(*workspace));
+    matrix_strassen_mt(75, 69, 83, b1->data, b1->stride, b2->data,
+                       b2->stride, fast->data, fast->stride, workspace, 1);
+    matrix_aligned_free(workspace);
+    /* Entries are in [-0.5, 0.5]; the bound with n = 83 and n0 = 9 */
+    double strassen_bound = pow(83.0/9, log2(18.0))*81*DBL_EPSILON*0.25;
+    success = words > 0;
+    for(i=0; i<75 && success; i++){
+        for(j=0; j<69 && success; j++){
+            success = fabs(MATRIX_ENTRY(fast, i, j)
+                           - MATRIX_ENTRY(classical, i, j)) < strassen_bound;
+        }
+    }
+    /* Concurrent products give the same bits; the mode routes
+     * matrix_multiply and matrix_pow_into through it */
+    matrix_set_parallel_threshold(0);
+    matrix_t* fast_mt = create_matrix(75, 69);
+    matrix_strassen_mt(75, 69, 83, b1->data, b1->stride, b2->data,
+                       b2->stride, fast_mt->data, fast_mt->stride, NULL, 3);
+    matrix_set_multiply_mode(MATRIX_MULTIPLY_STRASSEN);
+    prod = matrix_multiply_mt(b1, b2, 1);
+    for(i=0; i<75 && success; i++){
+        for(j=0; j<69 && success; j++){
+            success = MATRIX_ENTRY(fast_mt, i, j) == MATRIX_ENTRY(fast, i, j)
+                      && MATRIX_ENTRY(prod, i, j) == MATRIX_ENTRY(fast, i, j);
+        }
+    }
+    prod->free(prod);
+    matrix_t* power_base = random_matrix(41, 41);
+    matrix_t* cube = create_matrix(41, 41);
+    matrix_pow_into(cube, power_base, 3);
+    matrix_set_multiply_mode(MATRIX_MULTIPLY_CLASSICAL);
+    matrix_set_parallel_threshold(DEFAULT_PARALLEL_THRESHOLD);
+    matrix_set_strassen_cutoff(STRASSEN_DEFAULT_CUTOFF);
+    matrix_t* squared = matrix_multiply(power_base, power_base);
+    prod = matrix_multiply(squared, power_base);
+    for(i=0; i<41 && success; i++){
+        for(j=0; j<41 && success; j++){
+            success = fabs(MATRIX_ENTRY(cube, i, j)
+                           - MATRIX_ENTRY(prod, i, j)) < 1e-10;
+        }
+    }
+    success ? SUCCESS_FAIL;
+    b1->free(b1); b2->free(b2); classical->free(classical);
+    fast->free(fast); fast_mt->free(fast_mt); prod->free(prod);
+    power_base->free(power_base); cube->free(cube); squared->free(squared);
+
+    printf("Testing boolean matrices: ");
+    /* Sparse 0/1 operands with two column blocks and a ragged last word,
+     * checked against the double precision product */
+    b1 = create_matrix(300, 700);
+    b2 = create_matrix(700, 530);
+    for(i=0; i<700; i++){
+        for(j=0; j<700; j++){
+            if (i < 300 && rand() % 50 == 0){
+                MATRIX_ENTRY(b1, i, j) = 2.0;
+            }
+            if (j < 530 && rand() % 50 == 0){
+                MATRIX_ENTRY(b2, i, j) = 1.0;
+            }
+        }
+    }
+    matrixb_t* bool1 = matrix_to_matrixb(b1);
+    matrixb_t* bool2 = matrix_to_matrixb(b2);
+    matrixb_t* bool_prod = matrixb_multiply(bool1, bool2);
+    prod = matrix_multiply(b1, b2);
+    long ones = 0;
+    success = bool1->get_entry(bool1, 0, 0) == (b1->get_entry(b1, 0, 0) != 0);
+    for(i=0; i<300 && success; i++){
+        for(j=0; j<530 && success; j++){
+            success = bool_prod->get_entry(bool_prod, i, j)
+                      == (MATRIX_ENTRY(prod, i, j) != 0.0);
+            ones += MATRIX_ENTRY(prod, i, j) != 0.0;
+        }
+    }
+    success = success && bool_prod->count(bool_prod) == ones;
+    matrix_set_parallel_threshold(0);
+    matrixb_t* bool_mt = matrixb_multiply_mt(bool1, bool2, 5);
+    matrix_set_parallel_threshold(DEFAULT_PARALLEL_THRESHOLD);
+    matrix_gemm_set_simd(0);
+    matrixb_t* bool_scalar = matrixb_multiply(bool1, bool2);
+    matrix_gemm_set_simd(1);
+    success = success && matrixb_equal(bool_mt, bool_prod)
+              && matrixb_equal(bool_scalar, bool_prod);
+    bool1->free(bool1); bool2->free(bool2); bool_prod->free(bool_prod);
+    bool_mt->free(bool_mt); bool_scalar->free(bool_scalar);
+    b1->free(b1); b2->free(b2); prod->free(prod);
+
+    /* Walks of exactly 3 edges, within 2 hops and of any length on a
+     * sparse directed graph */
+    b1 = create_matrix(131, 131);
+    for(k=0; k<180; k++){
+        MATRIX_ENTRY(b1, rand() % 131, rand() % 131) = 1.0;
+    }
+    bool1 = matrix_to_matrixb(b1);
+    b2 = create_matrix(131, 131);
+    matrix_pow_into(b2, b1, 3);
+    bool_prod = matrixb_pow(bool1, 3);
+    for(i=0; i<131 && success; i++){
+        for(j=0; j<131 && success; j++){
+            success = bool_prod->get_entry(bool_prod, i, j)
+                      == (MATRIX_ENTRY(b2, i, j) != 0.0);
+        }
+    }
+    bool_prod->free(bool_prod);
+    bool_prod = matrixb_reachable_within(bool1, 2);
+    prod = matrix_multiply(b1, b1);
+    for(i=0; i<131 && success; i++){
+        for(j=0; j<131 && success; j++){
+            success = bool_prod->get_entry(bool_prod, i, j)
+                      == (i == j || MATRIX_ENTRY(b1, i, j) != 0.0
+                          || MATRIX_ENTRY(prod, i, j) != 0.0);
+        }
+    }
+    bool_prod->free(bool_prod);
+    /* Warshall on bytes for the closure */
+    unsigned char* warshall = malloc(131*131);
+    for(i=0; i<131*131; i++){
+        warshall[i] = MATRIX_ENTRY(b1, i/131, i % 131) != 0.0;
+    }
+    for(k=0; k<131; k++){
+        for(i=0; i<131; i++){
+            for(j=0; j<131; j++){
+                warshall[i*131 + j] |= warshall[i*131 + k]
+                                       & warshall[k*131 + j];
+            }
+        }
+    }
+    bool_prod = matrixb_transitive_closure(bool1);
+    int* reached = malloc(131*sizeof(*reached));
+    matrixb_row_counts(bool_prod, reached);
+    for(i=0; i<131 && success; i++){
+        int reach_count = 0;
+        for(j=0; j<131 && success; j++){
+            success = bool_prod->get_entry(bool_prod, i, j)
+                      == warshall[i*131 + j];
+            reach_count += warshall[i*131 + j];
+        }
+        success = success && reached[i] == reach_count;
+    }
+    success ? SUCCESS_FAIL;
+    free(warshall); free(reached);
+    bool1->free(bool1); bool_prod->free(bool_prod);
+    b1->free(b1); b2->free(b2); prod->free(prod);
+
+    printf("Testing batched small matrices: ");
+    /* Counts that leave a partial vector, checked one matrix at a time
+     * against the general routines */
+    success = 1;
+    for(k=1; k<=MATRIX_BATCH_MAX_DIM && success; k++){
+        int count = 1003, q = (k % 2) ? 1 : 2, m_idx;
+        matrix_batch_t* batch_a = create_matrix_batch(count, k, k);
+        matrix_batch_t* batch_b = create_matrix_batch(count, k, q);
+        matrix_batch_t* batch_inv = create_matrix_batch(count, k, k);
+        matrix_batch_t* batch_x = create_matrix_batch(count, k, q);
+        matrix_batch_t* batch_ab = create_matrix_batch(count, k, q);
+        double* dets = malloc(count*sizeof(*dets));
+        double* solve_dets = malloc(count*sizeof(*solve_dets));
+        for(m_idx=0; m_idx<count; m_idx++){
+            /* Diagonally dominant, so well conditioned */
+            b1 = random_matrix(k, k);
+            for(i=0; i<k; i++){
+                MATRIX_ENTRY(b1, i, i) += k;
+            }
+            b2 = random_matrix(k, q);
+            batch_a->set_matrix(batch_a, m_idx, b1);
+            batch_b->set_matrix(batch_b, m_idx, b2);
+            b1->free(b1); b2->free(b2);
+        }
+        matrix_set_parallel_threshold(0);
+        matrix_batch_determinant_mt(batch_a, dets, 3);
+        matrix_set_parallel_threshold(DEFAULT_PARALLEL_THRESHOLD);
+        matrix_batch_inverse(batch_a, batch_inv, NULL);
+        matrix_batch_multiply(batch_a, batch_b, batch_ab);
+        matrix_batch_solve(batch_a, batch_ab, batch_x, solve_dets);
+        for(m_idx=0; m_idx<count && success; m_idx++){
+            b1 = batch_a->get_matrix(batch_a, m_idx);
+            b2 = batch_b->get_matrix(batch_b, m_idx);
+            matrix_t* inv = batch_inv->get_matrix(batch_inv, m_idx);
+            matrix_t* ab = batch_ab->get_matrix(batch_ab, m_idx);
+            matrix_t* x = batch_x->get_matrix(batch_x, m_idx);
+            matrix_t* identity = matrix_multiply(b1, inv);
+            prod = matrix_multiply(b1, b2);
+            double det = b1->determinant(b1);
+            success = fabs(dets[m_idx] - det) < 1e-12*fabs(det)
+                      && solve_dets[m_idx] == dets[m_idx];
+            for(i=0; i<k && success; i++){
+                for(j=0; j<k && success; j++){
+                    success = fabs(MATRIX_ENTRY(identity, i, j)
+                                   - (i == j)) < 1e-12;
+                }
+                /* Solving A X = A B gives back B */
+                for(j=0; j<q && success; j++){
+                    success = fabs(MATRIX_ENTRY(ab, i, j)
+                                   - MATRIX_ENTRY(prod, i, j)) < 1e-12
+                              && fabs(MATRIX_ENTRY(x, i, j)
+                                      - MATRIX_ENTRY(b2, i, j)) < 1e-12;
+                }
+            }
+            b1->free(b1); b2->free(b2); inv->free(inv); ab->free(ab);
+            x->free(x); identity->free(identity); prod->free(prod);
+        }
+        /* In place inverse, with the scalar kernels */
+        matrix_gemm_set_simd(0);
+        matrix_batch_inverse(batch_a, batch_a, NULL);
+        matrix_gemm_set_simd(1);
+        for(m_idx=0; m_idx<count && success; m_idx++){
+            for(i=0; i<k && success; i++){
+                for(j=0; j<k && success; j++){
+                    success = fabs(MATRIX_BATCH_ENTRY(batch_a, m_idx, i, j)
+                                   - MATRIX_BATCH_ENTRY(batch_inv, m_idx,
+                                                        i, j)) < 1e-12;
+                }
+            }
+        }
+        batch_a->free(batch_a); batch_b->free(batch_b);
+        batch_inv->free(batch_inv); batch_x->free(batch_x);
+        batch_ab->free(batch_ab);
+        free(dets); free(solve_dets);
+    }
+    success ? SUCCESS_FAIL;
+
+    printf("Testing prefix sums: ");
+    /* Random rectangles against a rescan, after row writes, missing entries,
+     * a threaded rebuild and a clone */
+    success = 1;
+    b1 = random_matrix(37, 53);
+    matrix_enable_prefix_sums(b1);
+    for(k=0; k<5 && success; k++){
+        int trial;
+        if (k == 1){
+            double new_row[53];
+            for(j=0; j<53; j++){
+                new_row[j] = j - 26.5;
+            }
+            b1->set_matrix_row(b1, new_row, 53, 30);
+            b1->set_entry(b1, 36, 52, 100.0);
+            success = b1->prefix->dirty_from == 30;
+        }
+        else if (k == 2){
+            matrix_set_missing(b1, 3, 4);
+            matrix_set_missing(b1, 20, 0);
+        }
+        else if (k == 3){
+            matrix_prefix_mark_dirty(b1, 0);
+            matrix_set_parallel_threshold(0);
+            matrix_refresh_prefix_sums_mt(b1, 3);
+            matrix_set_parallel_threshold(DEFAULT_PARALLEL_THRESHOLD);
+        }
+        else if (k == 4){
+            b2 = b1->copy(b1);
+            b1->free(b1);
+            b1 = b2;
+        }
+        for(trial=0; trial<300 && success; trial++){
+            int r0 = rand() % 38, r1 = rand() % 38;
+            int c0 = rand() % 54, c1 = rand() % 54;
+            int t, row, col;
+            long count = 0;
+            double sum = 0.0;
+            t = (r0 < r1) ? r0 : r1; r1 = r0 + r1 - t; r0 = t;
+            t = (c0 < c1) ? c0 : c1; c1 = c0 + c1 - t; c0 = t;
+            for(row=r0; row<r1; row++){
+                for(col=c0; col<c1; col++){
+                    if (!matrix_is_missing(b1, row, col)){
+                        sum += MATRIX_ENTRY(b1, row, col);
+                        count++;
+                    }
+                }
+            }
+            success = fabs(matrix_range_sum(b1, r0, c0, r1, c1) - sum) < 1e-9
+                      && matrix_range_count(b1, r0, c0, r1, c1) == count
+                      && (count == 0
+                          || fabs(matrix_range_mean(b1, r0, c0, r1, c1)
+                                  - sum/count) < 1e-9);
+        }
+    }
+    b1->free(b1);
+    success ? SUCCESS_FAIL;
+
+    printf("Testing out-of-core multiply: ");
+    /* Inner dimension over several GEMM_KC tiles, with ragged edges, at the
+     * smallest budget and one that caches all twelve operand tiles; the
+     * product file must match matrix_multiply bit for bit */
+    success = 1;
+    size_t ooc_budget = (size_t)13*GEMM_KC*GEMM_KC*sizeof(double);
+    b1 = random_matrix(300, 2*GEMM_KC + 77);
+    b2 = random_matrix(2*GEMM_KC + 77, GEMM_KC + 9);
+    prod = matrix_multiply(b1, b2);
+    matrix_to_binary(b1, "ooc_a_test.mtx");
+    matrix_to_binary(b2, "ooc_b_test.mtx");
+    for(k=0; k<2 && success; k++){
+        matrix_ooc_stats_t ooc;
+        matrix_set_parallel_threshold(0);
+        matrix_multiply_binary_mt("ooc_a_test.mtx", "ooc_b_test.mtx",
+                                  "ooc_c_test.mtx",
+                                  k ? ooc_budget : 1, &ooc, 3);
+        matrix_set_parallel_threshold(DEFAULT_PARALLEL_THRESHOLD);
+        matrix_t* ooc_prod = matrix_map_binary("ooc_c_test.mtx",
+                                               MATRIX_MAP_READ_ONLY);
+        success = ooc_prod->num_rows == prod->num_rows
+                  && ooc_prod->num_columns == prod->num_columns
+                  && ooc.tile == GEMM_KC
+                  && ooc.peak_bytes <= (k ? ooc_budget
+                                          : MATRIX_OOC_MIN_MEMORY)
+                  && ooc.loads + ooc.hits == 2*2*3*2
+                  && (!k || ooc.loads == 12);
+        for(i=0; i<prod->num_rows && success; i++){
+            success = !memcmp(MATRIX_ROW(ooc_prod, i), MATRIX_ROW(prod, i),
+                              prod->num_columns*sizeof(double));
+        }
+        ooc_prod->free(ooc_prod);
+    }
+    b1->free(b1); b2->free(b2); prod->free(prod);
+    /* A tall product whose empty labels span several pages */
+    b1 = random_matrix(3000, 5);
+    b2 = random_matrix(5, 3);
+    prod = matrix_multiply(b1, b2);
+    matrix_to_binary(b1, "ooc_a_test.mtx");
+    matrix_to_binary(b2, "ooc_b_test.mtx");
+    matrix_multiply_binary("ooc_a_test.mtx", "ooc_b_test.mtx",
+                           "ooc_c_test.mtx", 0);
+    matrix_t* ooc_tall = binary_to_matrix("ooc_c_test.mtx");
+    success = success && matrix_equality(ooc_tall, prod)
+              && ooc_tall->index_int[2999] == 2999
+              && !strcmp(matrix_row_label(ooc_tall, 2999), "")
+              && !strcmp(matrix_column_name(ooc_tall, 2), "");
+    ooc_tall->free(ooc_tall);
+    remove("ooc_a_test.mtx");
+    remove("ooc_b_test.mtx");
+    remove("ooc_c_test.mtx");
+    b1->free(b1); b2->free(b2); prod->free(prod);
+    success ? SUCCESS_FAIL;
+
     if (errno == 0){
         printf("All tests successful\n");
     }
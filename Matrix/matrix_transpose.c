@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "matrix_transpose.h"
+#include "matrix_simd.h"
+#include "matrix_stats.h"
+#include "matrix_prefix.h"
+#include "matrix_parallel.h"
+
+#ifdef MATRIX_HAVE_X86
+#include <immintrin.h>
+#endif
+
+#define TRANSPOSE_REAL double
+#define TRANSPOSE_FN(name) matrix_##name
+#include "matrix_transpose_template.h"
+
+/* Swaps the 4 x 4 blocks at a and b, each transposed; a == b transposes the
+ * block in place */
+typedef void (*swap_kernel_t)(double* a, double* b, int ld);
+
+static void swap_4x4_scalar(double* a, double* b, int ld)
+{
+    double block_a[16], block_b[16];
+    int i, j;
+    for(i=0; i<4; i++){
+        for(j=0; j<4; j++){
+            block_a[4*i + j] = a[(size_t)i*ld + j];
+            block_b[4*i + j] = b[(size_t)i*ld + j];
+        }
+    }
+    for(i=0; i<4; i++){
+        for(j=0; j<4; j++){
+            a[(size_t)i*ld + j] = block_b[4*j + i];
+            b[(size_t)i*ld + j] = block_a[4*j + i];
+        }
+    }
+}
+
+#ifdef MATRIX_HAVE_X86
+/* Transposes four rows held in ymm registers: two unpacks swap within
+ * 128 bit lanes, two lane permutes swap across them */
+#define TRANSPOSE_4X4_PD(r0, r1, r2, r3)                                     \
+    do{                                                                      \
+        __m256d t0 = _mm256_unpacklo_pd(r0, r1);                             \
+        __m256d t1 = _mm256_unpackhi_pd(r0, r1);                             \
+        __m256d t2 = _mm256_unpacklo_pd(r2, r3);                             \
+        __m256d t3 = _mm256_unpackhi_pd(r2, r3);                             \
+        r0 = _mm256_permute2f128_pd(t0, t2, 0x20);                           \
+        r1 = _mm256_permute2f128_pd(t1, t3, 0x20);                           \
+        r2 = _mm256_permute2f128_pd(t0, t2, 0x31);                           \
+        r3 = _mm256_permute2f128_pd(t1, t3, 0x31);                           \
+    } while(0)
+
+__attribute__((target("avx")))
+static void transpose_4x4_avx(const double* src, int lds, double* dst,
+                              int ldd)
+{
+    __m256d r0 = _mm256_loadu_pd(src);
+    __m256d r1 = _mm256_loadu_pd(src + lds);
+    __m256d r2 = _mm256_loadu_pd(src + 2*(size_t)lds);
+    __m256d r3 = _mm256_loadu_pd(src + 3*(size_t)lds);
+    TRANSPOSE_4X4_PD(r0, r1, r2, r3);
+    _mm256_storeu_pd(dst, r0);
+    _mm256_storeu_pd(dst + ldd, r1);
+    _mm256_storeu_pd(dst + 2*(size_t)ldd, r2);
+    _mm256_storeu_pd(dst + 3*(size_t)ldd, r3);
+}
+
+__attribute__((target("avx")))
+static void swap_4x4_avx(double* a, double* b, int ld)
+{
+    __m256d a0 = _mm256_loadu_pd(a);
+    __m256d a1 = _mm256_loadu_pd(a + ld);
+    __m256d a2 = _mm256_loadu_pd(a + 2*(size_t)ld);
+    __m256d a3 = _mm256_loadu_pd(a + 3*(size_t)ld);
+    __m256d b0 = _mm256_loadu_pd(b);
+    __m256d b1 = _mm256_loadu_pd(b + ld);
+    __m256d b2 = _mm256_loadu_pd(b + 2*(size_t)ld);
+    __m256d b3 = _mm256_loadu_pd(b + 3*(size_t)ld);
+    TRANSPOSE_4X4_PD(a0, a1, a2, a3);
+    TRANSPOSE_4X4_PD(b0, b1, b2, b3);
+    _mm256_storeu_pd(a, b0);
+    _mm256_storeu_pd(a + ld, b1);
+    _mm256_storeu_pd(a + 2*(size_t)ld, b2);
+    _mm256_storeu_pd(a + 3*(size_t)ld, b3);
+    _mm256_storeu_pd(b, a0);
+    _mm256_storeu_pd(b + ld, a1);
+    _mm256_storeu_pd(b + 2*(size_t)ld, a2);
+    _mm256_storeu_pd(b + 3*(size_t)ld, a3);
+}
+#endif
+
+static matrix_transpose_kernel_t matrix_transpose_kernel(void)
+{
+#ifdef MATRIX_HAVE_X86
+    if (__builtin_cpu_supports("avx")){
+        return &transpose_4x4_avx;
+    }
+#endif
+    return &matrix_transpose_4x4_scalar;
+}
+
+static swap_kernel_t swap_kernel(void)
+{
+#ifdef MATRIX_HAVE_X86
+    if (__builtin_cpu_supports("avx")){
+        return &swap_4x4_avx;
+    }
+#endif
+    return &swap_4x4_scalar;
+}
+
+typedef struct in_place_args{
+    matrix_t* m;
+    swap_kernel_t kernel;
+} in_place_args_t;
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: in_place_task
+ *
+ * Arguments: in_place_args_t
+ *            first tile row
+ *            one past the last tile row
+ *
+ * Returns: void
+ *           for each tile row I in [begin, end), swaps tile (I, J) with tile
+ *           (J, I) transposed for every J >= I. Different tile rows touch
+ *           disjoint pairs of tiles.
+ */
+static void in_place_task(void* arg, int begin, int end)
+{
+    in_place_args_t* t = arg;
+    matrix_t* m = t->m;
+    int n = m->num_rows, n4 = n & ~3;
+    int tile_i, tile_j, i, j;
+    for(tile_i=begin*TRANSPOSE_TILE; tile_i<end*TRANSPOSE_TILE && tile_i<n;
+        tile_i+=TRANSPOSE_TILE){
+        int i_end = tile_i + TRANSPOSE_TILE;
+        i_end = (i_end < n4) ? i_end : n4;
+        for(tile_j=tile_i; tile_j<n4; tile_j+=TRANSPOSE_TILE){
+            int j_end = tile_j + TRANSPOSE_TILE;
+            j_end = (j_end < n4) ? j_end : n4;
+            for(i=tile_i; i<i_end; i+=4){
+                for(j=(tile_j == tile_i) ? i : tile_j; j<j_end; j+=4){
+                    t->kernel(MATRIX_ROW(m, i) + j, MATRIX_ROW(m, j) + i,
+                              m->stride);
+                }
+            }
+        }
+        /* Columns past the last full block of 4 */
+        int tile_end = tile_i + TRANSPOSE_TILE;
+        for(i=tile_i; i<tile_end && i<n; i++){
+            for(j=(i+1 > n4) ? i+1 : n4; j<n; j++){
+                double entry = MATRIX_ENTRY(m, i, j);
+                MATRIX_ENTRY(m, i, j) = MATRIX_ENTRY(m, j, i);
+                MATRIX_ENTRY(m, j, i) = entry;
+            }
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: matrix_transpose_in_place
+ *
+ * Arguments: square matrix (or view), not read only
+ *
+ * Returns: void
+ *           replaces m with its transpose without allocating. Labels are left
+ *           as they are, as matrix_transpose leaves them empty.
+ *
+ * Dependency: matrix_transpose_in_place_mt
+ */
+void matrix_transpose_in_place(matrix_t* m)
+{
+    matrix_transpose_in_place_mt(m, MATRIX_THREADS_DEFAULT);
+}
+//-----------------------------------------------------------------------------
+
+void matrix_transpose_in_place_mt(matrix_t* m, int num_threads)
+{
+    assert(m != NULL);
+    assert(m->num_rows == m->num_columns && "Matrix is not square");
+    assert(!m->read_only && "Matrix is read only");
+    matrix_invalidate_stats(m);
+    matrix_prefix_mark_dirty(m, 0);
+    in_place_args_t t = {m, swap_kernel()};
+    int tiles = (m->num_rows + TRANSPOSE_TILE - 1)/TRANSPOSE_TILE;
+    matrix_parallel_for(tiles,
+                        matrix_threads_for_work(num_threads,
+                                                (double)m->num_rows
+                                                *m->num_rows),
+                        &in_place_task, &t);
+}
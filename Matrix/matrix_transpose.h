@@ -0,0 +1,16 @@
+#ifndef MATRIX_TRANSPOSE_H
+#define MATRIX_TRANSPOSE_H
+
+#include "matrix.h"
+
+/* Square tile transposed at a time: a TRANSPOSE_TILE x TRANSPOSE_TILE block
+ * of the source and of the destination fit in L1 together */
+#define TRANSPOSE_TILE 32
+
+void matrix_transpose_blocked(int rows, int columns,
+                              const double* src, int lds,
+                              double* dst, int ldd, int num_threads);
+void matrix_transpose_in_place(matrix_t* m);
+void matrix_transpose_in_place_mt(matrix_t* m, int num_threads);
+
+#endif // MATRIX_TRANSPOSE_H
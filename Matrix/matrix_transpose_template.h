@@ -0,0 +1,119 @@
+/* Tiled out of place transpose shared by the double (matrix_transpose.c)
+ * and float (matrix_float.c) matrices. The including file defines
+ *   TRANSPOSE_REAL    the entry type
+ *   TRANSPOSE_FN(x)   the name of x for that type (x = transpose_blocked
+ *                     gives the public entry point)
+ * includes this file once, and then defines TRANSPOSE_FN(transpose_kernel),
+ * which returns the 4 x 4 block kernel to use. No include guard, on purpose.
+ */
+
+/* dst (4 x 4, leading dimension ldd) = src^T */
+typedef void (*TRANSPOSE_FN(transpose_kernel_t))(const TRANSPOSE_REAL* src,
+                                                 int lds, TRANSPOSE_REAL* dst,
+                                                 int ldd);
+
+static TRANSPOSE_FN(transpose_kernel_t) TRANSPOSE_FN(transpose_kernel)(void);
+
+static void TRANSPOSE_FN(transpose_4x4_scalar)(const TRANSPOSE_REAL* src,
+                                               int lds, TRANSPOSE_REAL* dst,
+                                               int ldd)
+{
+    int i, j;
+    for(i=0; i<4; i++){
+        for(j=0; j<4; j++){
+            dst[(size_t)j*ldd + i] = src[(size_t)i*lds + j];
+        }
+    }
+}
+
+typedef struct TRANSPOSE_FN(blocked_args){
+    int rows;
+    int columns;
+    const TRANSPOSE_REAL* src;
+    int lds;
+    TRANSPOSE_REAL* dst;
+    int ldd;
+    TRANSPOSE_FN(transpose_kernel_t) kernel;
+} TRANSPOSE_FN(blocked_args_t);
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: transpose_blocked_task
+ *
+ * Arguments: blocked_args_t
+ *            first tile column of the source
+ *            one past the last tile column
+ *
+ * Returns: void
+ *           transposes source columns [begin*TRANSPOSE_TILE,
+ *           end*TRANSPOSE_TILE) tile by tile, so each tile is read and
+ *           written while it is in L1. Full 4 x 4 blocks go through the
+ *           kernel, the ragged edges of the matrix element by element.
+ */
+static void TRANSPOSE_FN(transpose_blocked_task)(void* arg, int begin, int end)
+{
+    TRANSPOSE_FN(blocked_args_t)* t = arg;
+    int rows4 = t->rows & ~3, columns4 = t->columns & ~3;
+    int tile_i, tile_j, i, j;
+    for(tile_j=begin*TRANSPOSE_TILE; tile_j<end*TRANSPOSE_TILE
+        && tile_j<t->columns; tile_j+=TRANSPOSE_TILE){
+        int j_end = tile_j + TRANSPOSE_TILE;
+        j_end = (j_end < t->columns) ? j_end : t->columns;
+        for(tile_i=0; tile_i<t->rows; tile_i+=TRANSPOSE_TILE){
+            int i_end = tile_i + TRANSPOSE_TILE;
+            i_end = (i_end < t->rows) ? i_end : t->rows;
+            for(i=tile_i; i<i_end; i+=4){
+                for(j=tile_j; j<j_end; j+=4){
+                    if (i < rows4 && j < columns4){
+                        t->kernel(t->src + (size_t)i*t->lds + j, t->lds,
+                                  t->dst + (size_t)j*t->ldd + i, t->ldd);
+                        continue;
+                    }
+                    int ii, jj;
+                    for(ii=i; ii<i+4 && ii<t->rows; ii++){
+                        for(jj=j; jj<j+4 && jj<t->columns; jj++){
+                            t->dst[(size_t)jj*t->ldd + ii]
+                                = t->src[(size_t)ii*t->lds + jj];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: transpose_blocked
+ *
+ * Arguments: rows and columns of the source
+ *            source and the doubles between its rows
+ *            destination (columns x rows) and the doubles between its rows
+ *            number of threads (MATRIX_THREADS_DEFAULT for the global setting)
+ *
+ * Returns: void
+ *           dst = src^T, in TRANSPOSE_TILE square tiles with 4 x 4 register
+ *           transposes (SIMD when the CPU has it). Threads take disjoint tile
+ *           columns of the source, ie tile rows of the destination.
+ *
+ * Dependency: transpose_blocked_task
+ *             matrix_parallel_for
+ */
+void TRANSPOSE_FN(transpose_blocked)(int rows, int columns,
+                                     const TRANSPOSE_REAL* src, int lds,
+                                     TRANSPOSE_REAL* dst, int ldd,
+                                     int num_threads)
+{
+    assert(rows >= 0 && columns >= 0);
+    assert(lds >= columns && ldd >= rows);
+    TRANSPOSE_FN(blocked_args_t) t = {rows, columns, src, lds, dst, ldd,
+                                      TRANSPOSE_FN(transpose_kernel)()};
+    int tiles = (columns + TRANSPOSE_TILE - 1)/TRANSPOSE_TILE;
+    matrix_parallel_for(tiles,
+                        matrix_threads_for_work(num_threads,
+                                                (double)rows*columns),
+                        &TRANSPOSE_FN(transpose_blocked_task), &t);
+}
+//-----------------------------------------------------------------------------
+
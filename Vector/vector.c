@@ -3,10 +3,15 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
 #include "vector.h"
 #include "../Math_Extended/math_extended.h"
 #include "../Utilities/utils.h"
 
+#define VECTOR_REAL double
+#define VECTOR_BITS uint64_t
+#define VECTOR_FN(name) vector_##name
+#include "vector_template.h"
 
 
 /*****************************************************************************/
@@ -27,6 +32,7 @@ static void vector_normalise(vector_t* v);
 static double vector_arithmetic_mean(vector_t* v);
 static double vector_geometric_mean(vector_t* v);
 static void destroy_vector(vector_t* v);
+static void destroy_vector_view(vector_t* v);
 static int vector_is_zero(vector_t* v);
 static void vector_impute_missing_value(vector_t* v, double miss_val, int mode);
 static double vector_standard_deviation(vector_t* v1, int mode);
@@ -38,6 +44,7 @@ vector_t* create_zero_vector(int dim)
     assert(dim >= 0);
     v->dimension = dim;
     v->alloc = dim;
+    v->is_view = 0;
     v->vector = calloc(sizeof(*v->vector) * v->alloc, sizeof(double));
     assert(unwanted_null(v->vector));
 
@@ -90,6 +97,7 @@ vector_t* create_vector_from_array(double* src, int n)
     assert(unwanted_null(v));
     v->dimension = n;
     v->alloc = n;
+    v->is_view = 0;
     v->vector = malloc(sizeof(*v->vector) * v->alloc);
     assert(unwanted_null(v->vector));
     int i;
@@ -101,6 +109,31 @@ vector_t* create_vector_from_array(double* src, int n)
 }
 //-----------------------------------------------------------------------------
 
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: vector_init_view
+ *
+ * Arguments: uninitialized vector struct (owned by the caller)
+ *            array of doubles the vector will alias
+ *            number of elements in array
+ *
+ * Returns: void
+ *           Note: The vector does not own src, so it cannot grow, and freeing
+ *                 it is a no-op. Used by matrix_t for its row views.
+ */
+void vector_init_view(vector_t* v, double* src, int n)
+{
+    assert(v != NULL);
+    assert(n >= 0);
+    v->dimension = n;
+    v->alloc = n;
+    v->is_view = 1;
+    v->vector = src;
+    vector_add_function_pointers(v);
+    v->free = &destroy_vector_view;
+}
+//-----------------------------------------------------------------------------
+
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
  * Function: clone_vector
@@ -116,6 +149,7 @@ static vector_t* clone_vector(vector_t* src)
     dest = malloc(sizeof(*dest));
     assert(unwanted_null(dest));
     dest->alloc = dest->dimension = src->dimension;
+    dest->is_view = 0;
     dest->vector = malloc(sizeof(*dest->vector) * dest->alloc);
     assert(unwanted_null(dest->vector));
     int i;
@@ -145,6 +179,7 @@ static void vector_set(vector_t* v, int index, double val)
         assert(0 && "Vector dimension too small");
     }
     else if (index >= v->alloc){
+        assert(!v->is_view && "Cannot grow a vector view");
         v->alloc *= 2;
         v->vector = realloc(v->vector, v->alloc*sizeof(*v->vector));
         assert(unwanted_null(v->vector));
@@ -169,6 +204,7 @@ static void vector_set(vector_t* v, int index, double val)
  *                 is less than old size
  */
 static void vector_resize(vector_t* v, int new_alloc_size){
+    assert(!v->is_view && "Cannot resize a vector view");
     if (new_alloc_size < v->alloc){
         v->dimension = new_alloc_size;
     }
@@ -208,17 +244,12 @@ static void vector_add_function_pointers(vector_t* v)
  *
  * Returns: dot product between the two vectors
  *
- * Dependency: vector_hadamard_product
- *             vector_sum
- *             destroy_vector
+ * Dependency: vector_kernel_dot
  */
 double vector_dot_product(vector_t* v1, vector_t* v2)
 {
-    assert(v1 != NULL && v2 != NULL);
-    vector_t* temp = vector_hadamard_product(v1, v2);
-    double dot_product = temp->sum(temp);
-    temp->free(temp);
-    return dot_product;
+    assert(vectors_same_dimension(v1, v2));
+    return vector_kernel_dot(v1->vector, v2->vector, v1->dimension);
 }
 //-----------------------------------------------------------------------------
 
@@ -233,19 +264,13 @@ double vector_dot_product(vector_t* v1, vector_t* v2)
  * Returns: A third vector whose components are the sum of the components
  *          of the first two vectors
  *
- * Dependency: clone_vector
+ * Dependency: vector_addition_into
  */
 vector_t* vector_addition(vector_t* v1, vector_t* v2)
 {
     assert(v1 != NULL && v2 != NULL);
-    if (v1->dimension != v2->dimension){
-        assert(0 && "Can only add vectors of same dimension");
-    }
-    vector_t* v3 = v1->copy(v1);
-    int i;
-    for(i=0; i<v2->dimension; i++){
-        v3->vector[i] += v2->vector[i];
-    }
+    vector_t* v3 = create_zero_vector(v1->dimension);
+    vector_addition_into(v3, v1, v2);
     return v3;
 }
 //-----------------------------------------------------------------------------
@@ -259,16 +284,13 @@ vector_t* vector_addition(vector_t* v1, vector_t* v2)
  *
  * Returns: A second vector whose components are a scalar multiple of the input
  *
- * Dependency: clone_vector
+ * Dependency: vector_scalar_multiplication_into
  */
 vector_t* vector_scalar_multiplication(vector_t* v1, double scalar)
 {
     assert(v1 != NULL);
-    vector_t* v2 = v1->copy(v1);
-    int i;
-    for(i=0; i<v2->dimension; i++){
-        v2->vector[i] *= scalar;
-    }
+    vector_t* v2 = create_zero_vector(v1->dimension);
+    vector_scalar_multiplication_into(v2, v1, scalar);
     return v2;
 }
 //-----------------------------------------------------------------------------
@@ -284,20 +306,118 @@ vector_t* vector_scalar_multiplication(vector_t* v1, double scalar)
  *          of the first two vectors.
  *           Note that a vector is equivalent to a 1 x Dim(v) matrix.
  *
- * Dependency: clone_vector
+ * Dependency: vector_hadamard_product_into
  */
 vector_t* vector_hadamard_product(vector_t* v1, vector_t* v2)
 {
     assert(v1 != NULL && v2 != NULL);
-    if (v1->dimension != v2->dimension){
-        assert(0 && "Vectors not same dimension");
+    vector_t* v3 = create_zero_vector(v1->dimension);
+    vector_hadamard_product_into(v3, v1, v2);
+    return v3;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: vector_addition_into
+ *
+ * Arguments: result vector (same dimension, may be v1 or v2)
+ *            vector 1
+ *            vector 2
+ *
+ * Returns: void
+ *           dst = v1 + v2 without allocating
+ */
+void vector_addition_into(vector_t* dst, vector_t* v1, vector_t* v2)
+{
+    assert(dst != NULL && v1 != NULL && v2 != NULL);
+    assert(v1->dimension == v2->dimension
+           && "Can only add vectors of same dimension");
+    assert(dst->dimension == v1->dimension);
+    int i;
+    for(i=0; i<dst->dimension; i++){
+        dst->vector[i] = v1->vector[i] + v2->vector[i];
     }
-    vector_t* v3 = v1->copy(v1);
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: vector_scalar_multiplication_into
+ *
+ * Arguments: result vector (same dimension, may be v1)
+ *            vector 1
+ *            a scalar to multiply each vector component by
+ *
+ * Returns: void
+ *           dst = scalar*v1 without allocating
+ */
+void vector_scalar_multiplication_into(vector_t* dst, vector_t* v1,
+                                       double scalar)
+{
+    assert(dst != NULL && v1 != NULL);
+    assert(dst->dimension == v1->dimension);
     int i;
-    for(i=0; i<v2->dimension; i++){
-        v3->vector[i] *= v2->vector[i];
+    for(i=0; i<dst->dimension; i++){
+        dst->vector[i] = v1->vector[i]*scalar;
+    }
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: vector_hadamard_product_into
+ *
+ * Arguments: result vector (same dimension, may be v1 or v2)
+ *            vector 1
+ *            vector 2
+ *
+ * Returns: void
+ *           dst = v1 o v2 (component-wise product) without allocating
+ */
+void vector_hadamard_product_into(vector_t* dst, vector_t* v1, vector_t* v2)
+{
+    assert(dst != NULL && v1 != NULL && v2 != NULL);
+    assert(v1->dimension == v2->dimension && "Vectors not same dimension");
+    assert(dst->dimension == v1->dimension);
+    int i;
+    for(i=0; i<dst->dimension; i++){
+        dst->vector[i] = v1->vector[i]*v2->vector[i];
+    }
+}
+//-----------------------------------------------------------------------------
+
+/* v += other */
+void vector_add_in_place(vector_t* v, vector_t* other)
+{
+    vector_addition_into(v, v, other);
+}
+
+/* v *= scalar */
+void vector_scale_in_place(vector_t* v, double scalar)
+{
+    vector_scalar_multiplication_into(v, v, scalar);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: vector_axpy
+ *
+ * Arguments: vector y, updated in place
+ *            scalar alpha
+ *            vector x (same dimension as y)
+ *
+ * Returns: void
+ *           y += alpha*x in one pass, without a temporary for alpha*x
+ */
+void vector_axpy(vector_t* y, double alpha, vector_t* x)
+{
+    assert(y != NULL && x != NULL);
+    assert(y->dimension == x->dimension && "Vectors not same dimension");
+    int i;
+    for(i=0; i<y->dimension; i++){
+        y->vector[i] += alpha*x->vector[i];
     }
-    return v3;
 }
 //-----------------------------------------------------------------------------
 
@@ -308,15 +428,12 @@ vector_t* vector_hadamard_product(vector_t* v1, vector_t* v2)
  * Arguments: a vector
  *
  * Returns: The sum of all the components in the vector
+ *
+ * Dependency: vector_kernel_sum
  */
 static double vector_sum(vector_t* v)
 {
-    double ret = 0.0;
-    int i;
-    for(i=0; i<v->dimension; i++){
-        ret += v->vector[i];
-    }
-    return ret;
+    return vector_kernel_sum(v->vector, v->dimension);
 }
 //-----------------------------------------------------------------------------
 
@@ -338,6 +455,22 @@ static void destroy_vector(vector_t* v)
 }
 //-----------------------------------------------------------------------------
 
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: destroy_vector_view
+ *
+ * Arguments: a vector view
+ *
+ * Returns: void
+ *           Note: The view and its storage belong to someone else (eg the
+ *                 matrix it is a row of), so there is nothing to free
+ */
+static void destroy_vector_view(vector_t* v)
+{
+    assert(v != NULL && v->is_view);
+}
+//-----------------------------------------------------------------------------
+
 /*****************************************************************************/
 /**----------------------------------------------------------------------------
  * Function: vector_norm
@@ -346,16 +479,11 @@ static void destroy_vector(vector_t* v)
  *
  * Returns: The norm of the vector
  *
- * Dependency: vector_hadamard_product
- *             vector_sum
- *             destroy_vector
+ * Dependency: vector_kernel_dot
  */
 static double vector_norm(vector_t* v)
 {
-    vector_t* temp = vector_hadamard_product(v, v);
-    double norm = sqrt(temp->sum(temp));
-    temp->free(temp);
-    return (norm);
+    return sqrt(vector_kernel_dot(v->vector, v->vector, v->dimension));
 }
 //-----------------------------------------------------------------------------
 
@@ -426,23 +554,13 @@ int vectors_same_dimension(vector_t* v1, vector_t* v2)
  * Returns: the euclidean distance between the two vectors
  *
  * Dependency: vectors_same_dimension
- *             vector_scalar_multiplication
- *             vector_addition
- *             vector_hadamard_product
- *             vector_sum
- *             vector_destroy
+ *             vector_kernel_squared_distance
  */
 double vector_euclidean_distance(vector_t* v1, vector_t* v2)
 {
     assert(vectors_same_dimension(v1, v2));
-    vector_t* temp = vector_scalar_multiplication(v1, -1);
-    vector_t* temp2 = vector_addition(temp, v2);
-    temp->free(temp);
-    temp = vector_hadamard_product(temp2, temp2);
-    temp2->free(temp2);
-    double dist = sqrt(temp->sum(temp));
-    temp->free(temp);
-    return dist;
+    return sqrt(vector_kernel_squared_distance(v1->vector, v2->vector,
+                                               v1->dimension));
 }
 //-----------------------------------------------------------------------------
 
@@ -457,17 +575,13 @@ double vector_euclidean_distance(vector_t* v1, vector_t* v2)
  *           sum of absolute value of distance between components
  *
  * Dependency: vectors_same_dimension
+ *             vector_kernel_manhattan_distance
  */
 double vector_manhattan_distance(vector_t* v1, vector_t* v2)
 {
     assert(vectors_same_dimension(v1, v2));
-    double dist = 0.0;
-    int i;
-    for(i=0; i<v1->dimension; i++){
-        dist += fabs(v1->vector[i] - v2->vector[i]);
-    }
-    return dist;
-
+    return vector_kernel_manhattan_distance(v1->vector, v2->vector,
+                                            v1->dimension);
 }
 //-----------------------------------------------------------------------------
 
@@ -720,10 +834,10 @@ double vector_correlation(vector_t* v1, vector_t* v2, int mode)
     else{
         vector_t* v3 = vector_scalar_multiplication(v1, -1);
         if (vector_equality(v3, v2)){
-            free(v3);
+            v3->free(v3);
             return -1.0;
         }
-        free(v3);
+        v3->free(v3);
     }
     double cov = vector_covariance(v1, v2, mode);
     double std1 = v1->standard_deviation(v1, mode);
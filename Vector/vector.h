@@ -20,6 +20,7 @@ struct vector{
     double* vector;
     int dimension;
     int alloc;
+    int is_view;    // 1 if vector aliases memory it does not own
 
     void (*set)(vector_t* v, int index, double val);
     void (*resize)(vector_t* v, int new_alloc_size);
@@ -39,6 +40,7 @@ struct vector{
 
 vector_t* create_zero_vector(int dim);
 vector_t* create_vector_from_array(double* src, int n);
+void vector_init_view(vector_t* v, double* src, int n);
 
 double vector_euclidean_distance(vector_t* v1, vector_t* v2);
 double vector_manhattan_distance(vector_t* v1, vector_t* v2);
@@ -54,4 +56,15 @@ int vectors_same_dimension(vector_t* v1, vector_t* v2);
 int vector_equality(vector_t* v1, vector_t* v2);
 vector_t* vector_hadamard_product(vector_t* v1, vector_t* v2);
 
+/* Write the result into a caller supplied vector of the right dimension */
+void vector_addition_into(vector_t* dst, vector_t* v1, vector_t* v2);
+void vector_scalar_multiplication_into(vector_t* dst, vector_t* v1,
+                                       double scalar);
+void vector_hadamard_product_into(vector_t* dst, vector_t* v1, vector_t* v2);
+
+/* In place: v += other, v *= scalar, y += alpha*x */
+void vector_add_in_place(vector_t* v, vector_t* other);
+void vector_scale_in_place(vector_t* v, double scalar);
+void vector_axpy(vector_t* y, double alpha, vector_t* x);
+
 #endif // VECTOR_H
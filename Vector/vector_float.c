@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include "vector.h"
+#include "vector_float.h"
+#include "../Utilities/utils.h"
+
+#define VECTOR_REAL float
+#define VECTOR_BITS uint32_t
+#define VECTOR_FN(name) vectorf_##name
+#include "vector_template.h"
+
+static void vectorf_add_function_pointers(vectorf_t* v);
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_zero_vectorf
+ *
+ * Arguments: dimension of the vector (number of components)
+ *
+ * Returns: pointer to a zero vector that stores floats
+ */
+vectorf_t* create_zero_vectorf(int dim)
+{
+    assert(dim >= 0);
+    vectorf_t* v = malloc(sizeof(*v));
+    assert(unwanted_null(v));
+    v->dimension = dim;
+    v->alloc = dim;
+    v->is_view = 0;
+    v->vector = calloc(dim ? dim : 1, sizeof(*v->vector));
+    assert(unwanted_null(v->vector));
+    vectorf_add_function_pointers(v);
+    return v;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: create_vectorf_from_array
+ *
+ * Arguments: array of floats
+ *            number of elements in array
+ *
+ * Returns: pointer to a vector with components equal to the array
+ */
+vectorf_t* create_vectorf_from_array(float* src, int n)
+{
+    vectorf_t* v = create_zero_vectorf(n);
+    memcpy(v->vector, src, n*sizeof(*src));
+    return v;
+}
+//-----------------------------------------------------------------------------
+
+static void destroy_vectorf_view(vectorf_t* v)
+{
+    assert(v != NULL && v->is_view);
+}
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: vectorf_init_view
+ *
+ * Arguments: uninitialized vector struct (owned by the caller)
+ *            array of floats the vector will alias
+ *            number of elements in array
+ *
+ * Returns: void
+ *           Note: as vector_init_view, the view cannot grow and freeing it
+ *                 is a no-op
+ */
+void vectorf_init_view(vectorf_t* v, float* src, int n)
+{
+    assert(v != NULL && n >= 0);
+    v->dimension = n;
+    v->alloc = n;
+    v->is_view = 1;
+    v->vector = src;
+    vectorf_add_function_pointers(v);
+    v->free = &destroy_vectorf_view;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: vector_to_vectorf
+ *
+ * Arguments: double precision vector
+ *
+ * Returns: a new float vector with each component rounded to nearest
+ */
+vectorf_t* vector_to_vectorf(vector_t* v)
+{
+    assert(v != NULL);
+    vectorf_t* ret = create_zero_vectorf(v->dimension);
+    int i;
+    for(i=0; i<v->dimension; i++){
+        ret->vector[i] = (float)v->vector[i];
+    }
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/*****************************************************************************/
+/**----------------------------------------------------------------------------
+ * Function: vectorf_to_vector
+ *
+ * Arguments: float vector
+ *
+ * Returns: a new double precision vector with the same (exact) components
+ */
+vector_t* vectorf_to_vector(vectorf_t* v)
+{
+    assert(v != NULL);
+    vector_t* ret = create_zero_vector(v->dimension);
+    int i;
+    for(i=0; i<v->dimension; i++){
+        ret->vector[i] = v->vector[i];
+    }
+    return ret;
+}
+//-----------------------------------------------------------------------------
+
+/* As vector_set: index == dimension appends, growing the storage */
+static void vectorf_set(vectorf_t* v, int index, float val)
+{
+    assert(v != NULL);
+    assert(index >= 0 && index <= v->dimension && "Vector dimension too small");
+    if (index >= v->alloc){
+        assert(!v->is_view && "Cannot grow a vector view");
+        v->alloc = 2*v->alloc + 1;
+        v->vector = realloc(v->vector, v->alloc*sizeof(*v->vector));
+        assert(unwanted_null(v->vector));
+    }
+    v->vector[index] = val;
+    if (index == v->dimension){
+        v->dimension++;
+    }
+}
+
+static void print_vectorf(vectorf_t* v)
+{
+    int i;
+    for(i=0; i<v->dimension; i++){
+        printf("%10.1f ", (v->vector[i] == 0.0f) ? 0.0f : v->vector[i]);
+    }
+    printf("\n");
+}
+
+static float vectorf_sum(vectorf_t* v)
+{
+    return vectorf_kernel_sum(v->vector, v->dimension);
+}
+
+static float vectorf_norm(vectorf_t* v)
+{
+    return sqrtf(vectorf_kernel_dot(v->vector, v->vector, v->dimension));
+}
+
+/* Scales v to unit length; the zero vector is left alone */
+static void vectorf_normalise(vectorf_t* v)
+{
+    float norm = vectorf_norm(v);
+    int i;
+    if (norm == 0.0f){
+        return;
+    }
+    for(i=0; i<v->dimension; i++){
+        v->vector[i] /= norm;
+    }
+}
+
+static vectorf_t* clone_vectorf(vectorf_t* v)
+{
+    assert(v != NULL);
+    return create_vectorf_from_array(v->vector, v->dimension);
+}
+
+static void destroy_vectorf(vectorf_t* v)
+{
+    assert(v != NULL);
+    free(v->vector);
+    free(v);
+}
+
+static void vectorf_add_function_pointers(vectorf_t* v)
+{
+    v->set = &vectorf_set;
+    v->print = &print_vectorf;
+    v->sum = &vectorf_sum;
+    v->norm = &vectorf_norm;
+    v->normalise = &vectorf_normalise;
+    v->copy = &clone_vectorf;
+    v->free = &destroy_vectorf;
+}
+
+float vectorf_dot_product(vectorf_t* v1, vectorf_t* v2)
+{
+    assert(v1 != NULL && v2 != NULL && v1->dimension == v2->dimension);
+    return vectorf_kernel_dot(v1->vector, v2->vector, v1->dimension);
+}
+
+float vectorf_euclidean_distance(vectorf_t* v1, vectorf_t* v2)
+{
+    assert(v1 != NULL && v2 != NULL && v1->dimension == v2->dimension);
+    return sqrtf(vectorf_kernel_squared_distance(v1->vector, v2->vector,
+                                                 v1->dimension));
+}
+
+float vectorf_manhattan_distance(vectorf_t* v1, vectorf_t* v2)
+{
+    assert(v1 != NULL && v2 != NULL && v1->dimension == v2->dimension);
+    return vectorf_kernel_manhattan_distance(v1->vector, v2->vector,
+                                             v1->dimension);
+}
+
+float cosine_similarityf(vectorf_t* v1, vectorf_t* v2)
+{
+    return vectorf_dot_product(v1, v2)/(v1->norm(v1)*v2->norm(v2));
+}
@@ -0,0 +1,39 @@
+#ifndef VECTOR_FLOAT_H
+#define VECTOR_FLOAT_H
+
+#include "vector.h"
+
+/* Single precision counterpart of vector_t: half the memory and twice the
+ * SIMD lanes, for workloads (eg similarity search) where float is accurate
+ * enough. The kernels come from vector_template.h, as for vector_t. */
+typedef struct vectorf vectorf_t;
+
+struct vectorf{
+    float* vector;
+    int dimension;
+    int alloc;
+    int is_view;    // 1 if vector aliases memory it does not own
+
+    void (*set)(vectorf_t* v, int index, float val);
+    void (*print)(vectorf_t* v);
+    float (*sum)(vectorf_t* v);
+    float (*norm)(vectorf_t* v);
+    void (*normalise)(vectorf_t* v);
+    vectorf_t* (*copy)(vectorf_t* v);
+    void (*free)(vectorf_t* v);
+};
+
+vectorf_t* create_zero_vectorf(int dim);
+vectorf_t* create_vectorf_from_array(float* src, int n);
+void vectorf_init_view(vectorf_t* v, float* src, int n);
+
+/* Conversions between precisions, rounding to nearest when narrowing */
+vectorf_t* vector_to_vectorf(vector_t* v);
+vector_t* vectorf_to_vector(vectorf_t* v);
+
+float vectorf_dot_product(vectorf_t* v1, vectorf_t* v2);
+float vectorf_euclidean_distance(vectorf_t* v1, vectorf_t* v2);
+float vectorf_manhattan_distance(vectorf_t* v1, vectorf_t* v2);
+float cosine_similarityf(vectorf_t* v1, vectorf_t* v2);
+
+#endif // VECTOR_FLOAT_H
@@ -0,0 +1,129 @@
+/* Kernels shared by the double (vector.c) and float (vector_float.c) vectors.
+ * The including file defines
+ *   VECTOR_REAL   the component type
+ *   VECTOR_BITS   an unsigned integer type of the same size
+ *   VECTOR_FN(x)  the name of kernel x for that type
+ * and includes this file once. With GCC the loops run on 32 byte vectors
+ * (4 doubles or 8 floats) with two accumulators, so float gets twice the
+ * lanes from the same source. No include guard, on purpose. */
+
+#define VECTOR_LANES ((int)(32/sizeof(VECTOR_REAL)))
+#define VECTOR_SIGN ((VECTOR_BITS)1 << (8*sizeof(VECTOR_BITS) - 1))
+
+#ifdef __GNUC__
+typedef VECTOR_REAL VECTOR_FN(lanes_t) __attribute__((vector_size(32)));
+typedef VECTOR_BITS VECTOR_FN(lane_bits_t) __attribute__((vector_size(32)));
+
+/* Macros rather than functions, so the vectors never cross a call (which
+ * would depend on the AVX calling convention) */
+#define VECTOR_LOAD(p) ({                                                     \
+    VECTOR_FN(lanes_t) lanes_;                                                \
+    memcpy(&lanes_, (p), sizeof(lanes_));                                     \
+    lanes_;                                                                   \
+})
+#define VECTOR_REDUCE(total, lanes) do{                                       \
+    int k_;                                                                   \
+    for(k_=0; k_<VECTOR_LANES; k_++){                                         \
+        (total) += (lanes)[k_];                                               \
+    }                                                                         \
+} while(0)
+#endif
+
+/* Sum of x[0..n) */
+static VECTOR_REAL VECTOR_FN(kernel_sum)(const VECTOR_REAL* x, int n)
+{
+    VECTOR_REAL total = 0;
+    int i = 0;
+#ifdef __GNUC__
+    VECTOR_FN(lanes_t) acc0 = {0}, acc1 = {0};
+    for(; i + 2*VECTOR_LANES <= n; i += 2*VECTOR_LANES){
+        acc0 += VECTOR_LOAD(x + i);
+        acc1 += VECTOR_LOAD(x + i + VECTOR_LANES);
+    }
+    VECTOR_REDUCE(total, acc0 + acc1);
+#endif
+    for(; i<n; i++){
+        total += x[i];
+    }
+    return total;
+}
+
+/* Sum of x[i]*y[i] */
+static VECTOR_REAL VECTOR_FN(kernel_dot)(const VECTOR_REAL* x,
+                                         const VECTOR_REAL* y, int n)
+{
+    VECTOR_REAL total = 0;
+    int i = 0;
+#ifdef __GNUC__
+    VECTOR_FN(lanes_t) acc0 = {0}, acc1 = {0};
+    for(; i + 2*VECTOR_LANES <= n; i += 2*VECTOR_LANES){
+        acc0 += VECTOR_LOAD(x + i)*VECTOR_LOAD(y + i);
+        acc1 += VECTOR_LOAD(x + i + VECTOR_LANES)
+                *VECTOR_LOAD(y + i + VECTOR_LANES);
+    }
+    VECTOR_REDUCE(total, acc0 + acc1);
+#endif
+    for(; i<n; i++){
+        total += x[i]*y[i];
+    }
+    return total;
+}
+
+/* Sum of (x[i] - y[i])^2 */
+static VECTOR_REAL VECTOR_FN(kernel_squared_distance)(const VECTOR_REAL* x,
+                                                      const VECTOR_REAL* y,
+                                                      int n)
+{
+    VECTOR_REAL total = 0;
+    int i = 0;
+#ifdef __GNUC__
+    VECTOR_FN(lanes_t) acc0 = {0}, acc1 = {0};
+    for(; i + 2*VECTOR_LANES <= n; i += 2*VECTOR_LANES){
+        VECTOR_FN(lanes_t) d0 = VECTOR_LOAD(x + i)
+                                - VECTOR_LOAD(y + i);
+        VECTOR_FN(lanes_t) d1 = VECTOR_LOAD(x + i + VECTOR_LANES)
+                                - VECTOR_LOAD(y + i + VECTOR_LANES);
+        acc0 += d0*d0;
+        acc1 += d1*d1;
+    }
+    VECTOR_REDUCE(total, acc0 + acc1);
+#endif
+    for(; i<n; i++){
+        VECTOR_REAL d = x[i] - y[i];
+        total += d*d;
+    }
+    return total;
+}
+
+/* Sum of |x[i] - y[i]|, the absolute value taken by clearing the sign bit */
+static VECTOR_REAL VECTOR_FN(kernel_manhattan_distance)(const VECTOR_REAL* x,
+                                                        const VECTOR_REAL* y,
+                                                        int n)
+{
+    VECTOR_REAL total = 0;
+    int i = 0;
+#ifdef __GNUC__
+    VECTOR_FN(lanes_t) acc0 = {0}, acc1 = {0};
+    VECTOR_FN(lane_bits_t) magnitude = ~((VECTOR_FN(lane_bits_t)){0}
+                                         + VECTOR_SIGN);
+    for(; i + 2*VECTOR_LANES <= n; i += 2*VECTOR_LANES){
+        VECTOR_FN(lanes_t) d0 = VECTOR_LOAD(x + i)
+                                - VECTOR_LOAD(y + i);
+        VECTOR_FN(lanes_t) d1 = VECTOR_LOAD(x + i + VECTOR_LANES)
+                                - VECTOR_LOAD(y + i + VECTOR_LANES);
+        acc0 += (VECTOR_FN(lanes_t))((VECTOR_FN(lane_bits_t))d0 & magnitude);
+        acc1 += (VECTOR_FN(lanes_t))((VECTOR_FN(lane_bits_t))d1 & magnitude);
+    }
+    VECTOR_REDUCE(total, acc0 + acc1);
+#endif
+    for(; i<n; i++){
+        VECTOR_REAL d = x[i] - y[i];
+        total += (d < 0) ? -d : d;
+    }
+    return total;
+}
+
+#undef VECTOR_LANES
+#undef VECTOR_SIGN
+#undef VECTOR_LOAD
+#undef VECTOR_REDUCE
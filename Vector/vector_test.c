@@ -7,6 +7,7 @@
 #include <unistd.h> // for getpid
 #include <errno.h>
 #include "vector.h"
+#include "vector_float.h"
 #include "../Math_Extended/math_extended.h"
 
 #define MAX_DIMENSION 1000
@@ -49,6 +50,19 @@ int main(void)
     }
     printf("vector_addition Success\n");
 
+    /* Test the in place and destination passing forms */
+    vector_addition_into(v3, v3, v1);
+    vector_axpy(v3, -2.0, v1);
+    vector_scale_in_place(v3, 4.0);
+    vector_hadamard_product_into(v3, v3, v1);
+    vector_add_in_place(v3, v1);
+    vector_scalar_multiplication_into(v3, v3, 0.5);
+    if (v3->vector[0] != 2.5 || v3->vector[1] != 2.5){
+        printf("vector_into and in place operations Failure\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("vector_into and in place operations Success\n");
+
     /* Test normalising a vector in place */
     v2->normalise(v2);
     if (v2->vector[0] != 1/sqrt(2) || v2->vector[1] != 1/sqrt(2)){
@@ -103,6 +117,47 @@ int main(void)
     (vector_equality(v4, v4) == 1) ? printf("vector_equality Success\n"):
                                      printf("vector_equality Failure\n");
 
+    /* Test the double kernels and their float instances against plain loops,
+     * with a length that leaves a remainder after the SIMD lanes */
+    int n = 37;
+    vector_t* x = create_zero_vector(n);
+    vector_t* y = create_zero_vector(n);
+    double dot = 0.0, squares = 0.0, manhattan = 0.0;
+    for(i=0; i<n; i++){
+        x->vector[i] = (double)rand()/RAND_MAX - 0.5;
+        y->vector[i] = (double)rand()/RAND_MAX - 0.5;
+        dot += x->vector[i]*y->vector[i];
+        squares += (x->vector[i] - y->vector[i])*(x->vector[i] - y->vector[i]);
+        manhattan += fabs(x->vector[i] - y->vector[i]);
+    }
+    if (fabs(vector_dot_product(x, y) - dot) > 1e-12
+        || fabs(vector_euclidean_distance(x, y) - sqrt(squares)) > 1e-12
+        || fabs(vector_manhattan_distance(x, y) - manhattan) > 1e-12){
+        printf("vector kernels Failure\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("vector kernels Success\n");
+
+    vectorf_t* xf = vector_to_vectorf(x);
+    vectorf_t* yf = vector_to_vectorf(y);
+    vector_t* back = vectorf_to_vector(xf);
+    for(i=0; i<n; i++){
+        if (back->vector[i] != (float)x->vector[i]){
+            printf("vector float conversion Failure\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (fabs(vectorf_dot_product(xf, yf) - dot) > 1e-5
+        || fabs(vectorf_euclidean_distance(xf, yf) - sqrt(squares)) > 1e-5
+        || fabs(vectorf_manhattan_distance(xf, yf) - manhattan) > 1e-5
+        || fabs(cosine_similarityf(xf, yf) - cosine_similarity(x, y)) > 1e-5
+        || fabs(xf->sum(xf) - x->sum(x)) > 1e-5){
+        printf("vector float kernels Failure\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("vector float kernels Success\n");
+    x->free(x); y->free(y); back->free(back); xf->free(xf); yf->free(yf);
+
 
     if (errno == 0){
         printf("All tests successful\n");